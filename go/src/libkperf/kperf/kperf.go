@@ -113,6 +113,27 @@ void SetPerThread(struct PmuAttr* attr, unsigned perThread) {
 	attr->perThread = perThread;
 }
 
+void SetPerCpuSample(struct PmuAttr* attr, unsigned perCpuSample) {
+	attr->perCpuSample = perCpuSample;
+}
+
+void SetOverheadBudget(struct PmuAttr* attr, unsigned overheadBudget) {
+	attr->overheadBudget = overheadBudget;
+}
+
+void SetIncludeChildCgroup(struct PmuAttr* attr, unsigned includeChildCgroup) {
+	attr->includeChildCgroup = includeChildCgroup;
+}
+
+void SetAuxSize(struct PmuAttr* attr, unsigned auxPages, unsigned auxWatermark) {
+	attr->auxPages = auxPages;
+	attr->auxWatermark = auxWatermark;
+}
+
+void SetUserStackSize(struct PmuAttr* attr, unsigned userStackSize) {
+	attr->userStackSize = userStackSize;
+}
+
 struct PmuData* IPmuRead(int fd, int* len) {
 	struct PmuData* pmuData = NULL;
 	*len = PmuRead(fd, &pmuData);
@@ -242,6 +263,7 @@ var (
 	ELF_DWARF C.enum_SymbolMode = C.RESOLVE_ELF_DWARF
 	DELAY_ELF C.enum_SymbolMode = C.RESOLVE_DELAY_ELF
 	DELAY_DWARF C.enum_SymbolMode = C.RESOLVE_DELAY_DWARF
+	OFFLINE C.enum_SymbolMode = C.RESOLVE_OFFLINE
 )
 
 // spe filter, for pmuAttr.DataFilter
@@ -433,10 +455,16 @@ type PmuAttr struct {
 	BlockedSample bool                 // This indicates whether the blocked sample mode is enabled. In this mode, both on Cpu and off Cpu data is collected
 	CgroupNameList []string            // cgroup name list, if not user cgroup function, this field will be nullptr.if use cgroup function,use the cgroup name in the cgroupList to apply all event in the Event list
 	EnableUserAccess bool              // enable user access counting for current process
-	EnableBpf bool                     // enable bpf mode for counting
+	EnableBpf bool                     // enable bpf mode for counting and sampling, samples are aggregated by call stack in kernel
 	EnableHwMetric bool                // enable hw metric 
 	EnableOnExec bool                  // enable enable_on_exec, after PmuOpen is called, if the load is started, enabling enable_on_exec will automatically enable the performance event after the load starts,withoud the need to call PmuEnable
 	PerThread bool                     // --per-thread This mode supports only the pidList and does not support the CPU specification. This mode can't be used togerther with enableOnExec, and can't support inherit which instructed the kernel to automatically make that event available to newly created child processes.
+	PerCpuSample bool                  // --per-cpu sampling for PidList, open one event per cpu instead of one per (cpu, thread) and keep only samples of PidList and their children. Just supports SAMPLING mode and can't be used together with PerThread, EnableOnExec or CgroupNameList.
+	OverheadBudget uint32              // cpu overhead budget of sampling in units of 0.01% of one cpu, e.g. 100 means 1%. Sample period is enlarged when it is exceeded and effective period is stored in PmuData.Period. 0 means disabled.
+	IncludeChildCgroup bool            // in bpf counting of CgroupNameList, also return each descendant cgroup, whose count includes its subtree and CgroupName is the path relative to cgroup root.
+	AuxPages uint32                    // pages of spe aux buffer for each cpu, must be a power of 2. 0 means 1MB. Records are lost if it is full before reading.
+	AuxWatermark uint32                // bytes of spe aux data to hand over to user space. 0 means half of aux buffer.
+	UserStackSize uint32               // bytes of user stack dumped per sample to unwind with dwarf cfi, a multiple of 8 and no more than 65528. Just supports SAMPLING mode with CallStack and symbol resolving. 0 means frame pointer callchain.
 }
 
 type CpuTopology struct {
@@ -751,6 +779,26 @@ func ToCPmuAttr(attr PmuAttr) (*C.struct_PmuAttr, int) {
 		C.SetPerThread(cAttr, C.uint(1))
 	}
 
+	if attr.PerCpuSample {
+		C.SetPerCpuSample(cAttr, C.uint(1))
+	}
+
+	if attr.OverheadBudget > 0 {
+		C.SetOverheadBudget(cAttr, C.uint(attr.OverheadBudget))
+	}
+
+	if attr.IncludeChildCgroup {
+		C.SetIncludeChildCgroup(cAttr, C.uint(1))
+	}
+
+	if attr.AuxPages > 0 || attr.AuxWatermark > 0 {
+		C.SetAuxSize(cAttr, C.uint(attr.AuxPages), C.uint(attr.AuxWatermark))
+	}
+
+	if attr.UserStackSize > 0 {
+		C.SetUserStackSize(cAttr, C.uint(attr.UserStackSize))
+	}
+
 	return cAttr, 0
 }
 
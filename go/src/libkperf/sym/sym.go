@@ -47,6 +47,7 @@ type AsmCode struct {
 	Code string       // code of asm
 	FileName string   // this source file name of this asm code
 	LineNum uint32    // the real line of this addr
+	Count uint64      // number of samples of this addr, only set by PmuAnnotate
 }
 
 type Asm struct {
@@ -93,6 +94,37 @@ func RecordModuleNoDwarf(pid int) error {
 	return nil
 }
 
+// Set directory to cache symbol indexes of elf files by build-id, which should be called before recording modules
+func SetCacheDir(dir string) error {
+	res := C.SymResolverSetCacheDir(C.CString(dir))
+	if int(res) != 0 {
+		return errors.New(C.GoString(C.Perror()))
+	}
+	return nil
+}
+
+// Save module layouts recorded in RESOLVE_OFFLINE mode and kernel symbols, to resolve addresses later
+func SaveLayout(path string) error {
+	res := C.SymResolverSaveLayout(C.CString(path))
+	if int(res) != 0 {
+		return errors.New(C.GoString(C.Perror()))
+	}
+	return nil
+}
+
+// Load saved module layouts and kernel symbols, after which StackToHash and MapAddr resolve saved addresses
+func LoadLayout(path string, rootDir string) error {
+	var cRootDir *C.char
+	if rootDir != "" {
+		cRootDir = C.CString(rootDir)
+	}
+	res := C.SymResolverLoadLayout(C.CString(path), cRootDir)
+	if int(res) != 0 {
+		return errors.New(C.GoString(C.Perror()))
+	}
+	return nil
+}
+
 //  Incremental update modules of pid, i.e. record newly loaded dynamic libraries by pid.
 func IncrUpdateModule(pid int) error {
 	res := C.SymResolverIncrUpdateModule(C.int(pid))
@@ -129,6 +161,24 @@ func UpdateModuleNoDwarf(pid int, moduleName string, startAddr  uint64) error {
 	return nil
 }
 
+// update module info from a mmap record, which doesn't re-read /proc/<pid>/maps
+func UpdateModuleMmap(pid int, moduleName string, startAddr uint64, length uint64, pgoff uint64) error {
+	res := C.SymResolverUpdateModuleMmap(C.int(pid), C.CString(moduleName), C.ulong(startAddr), C.ulong(length), C.ulong(pgoff))
+	if int(res) != 0 {
+		return errors.New(C.GoString(C.Perror()))
+	}
+	return nil
+}
+
+// update module info from a mmap record but dose not collect dwarf info
+func UpdateModuleMmapNoDwarf(pid int, moduleName string, startAddr uint64, length uint64, pgoff uint64) error {
+	res := C.SymResolverUpdateModuleMmapNoDwarf(C.int(pid), C.CString(moduleName), C.ulong(startAddr), C.ulong(length), C.ulong(pgoff))
+	if int(res) != 0 {
+		return errors.New(C.GoString(C.Perror()))
+	}
+	return nil
+}
+
 // Clean up resolver in the end after usage
 func Destory() {
 	C.SymResolverDestroy()
@@ -190,7 +240,7 @@ func GetAsmCode(moduleName string, startAddr uint64, endAddr uint64) (AsmStack,
 		oneAsm := Asm{FuncName: C.GoString(curStack.funcName), FuncFileOffset: uint64(curStack.functFileOffset), FuncStartAddr: uint64(curStack.funcStartAddr)}
 		cAsmCode := curStack.asmCode
 		if cAsmCode != nil {
-			oneAsm.CodeData = AsmCode{Addr: uint64(cAsmCode.addr), Code: C.GoString(cAsmCode.code), FileName: C.GoString(cAsmCode.fileName), LineNum: uint32(cAsmCode.lineNum)}
+			oneAsm.CodeData = AsmCode{Addr: uint64(cAsmCode.addr), Code: C.GoString(cAsmCode.code), FileName: C.GoString(cAsmCode.fileName), LineNum: uint32(cAsmCode.lineNum), Count: uint64(cAsmCode.count)}
 		}
 		asmList = append(asmList, oneAsm)
 		curStack = curStack.next
@@ -44,6 +44,8 @@ extern "C" {
 #define LIBSYM_ERR_READ_BUILDID 117
 #define LIBSYM_ERR_BUILDID_TOO_LONG 118
 #define LIBSYM_ERR_ASM_RESOLVE_FAILED 119
+#define LIBSYM_ERR_CACHE_DIR_INVALID 120
+#define LIBSYM_ERR_LAYOUT_INVALID 121
 // libperf 1000-3000
 #define LIBPERF_ERR_NO_AVAIL_PD 1000
 #define LIBPERF_ERR_CHIP_TYPE_INVALID 1001
@@ -146,6 +148,17 @@ extern "C" {
 #define LIBPERF_ERR_PROC_SOURCE_INVALID 1098
 #define LIBPERF_ERR_KERNEL_TRACE_FAILED 1099
 #define LIBPERF_ERR_INVALID_TRACE_CONF 1100
+#define LIBPERF_ERR_NOT_SUPPORT_PER_CPU_SAMPLE 1101
+#define LIBPERF_ERR_INVALID_OVERHEAD_BUDGET 1102
+#define LIBPERF_ERR_FAILED_PMU_SET_PERIOD 1103
+#define LIBPERF_ERR_INVALID_AUX_SIZE 1104
+#define LIBPERF_ERR_INVALID_HEATMAP_ATTR 1105
+#define LIBPERF_ERR_INVALID_HEATMAP 1106
+#define LIBPERF_ERR_INVALID_CONTENTION_ATTR 1107
+#define LIBPERF_ERR_INVALID_CONTENTION 1108
+#define LIBPERF_ERR_INVALID_BRANCH_PROFILE 1109
+#define LIBPERF_ERR_BRANCH_PROFILE_NO_MODULE 1110
+#define LIBPERF_ERR_INVALID_USER_STACK_SIZE 1111
 
 #define UNKNOWN_ERROR 9999
 
@@ -162,6 +175,8 @@ extern "C" {
 #define LIBPERF_WARN_LBR_DRIVER_START_FAILED 1006
 #define LIBPERF_WARN_UTRACE_KERNEL_FAILED 1007
 #define LIBPERF_WARN_UTRACE_NATIVE_READ_FAILED 1008
+#define LIBPERF_WARN_BPF_CGROUP_DROPPED 1009
+#define LIBPERF_WARN_SPE_AUX_TRUNCATED 1010
 
 /**
 * @brief Obtaining error codes
@@ -66,7 +66,10 @@ enum SymbolMode {
     // Load elf. The ResolvePmuDataSymbol can be called to obtain elf information.
     RESOLVE_DELAY_ELF = 3,
     // Load elf and dwarf. The ResolvePmuDataSymbol can be called to obtain elf information and dwarf information.
-    RESOLVE_DELAY_DWARF = 4
+    RESOLVE_DELAY_DWARF = 4,
+    // Don't load the elf and dwarf, and only addr of Symbol in <stack> is valid. Module layouts of processes are
+    // recorded, which can be saved by SymResolverSaveLayout to resolve addresses later, possibly on another host.
+    RESOLVE_OFFLINE = 5
 };
 
 enum BranchSampleFilter {
@@ -184,7 +187,9 @@ struct PmuAttr {
 
     // enable user access counting for current process
     unsigned enableUserAccess : 1;
-    // enable bpf mode for counting
+    // enable bpf mode for counting and sampling.
+    // For sampling, samples are aggregated by (pid, kernel stack, user stack) in kernel,
+    // and each PmuData is one aggregated row: count is number of samples and period is sum of sample period.
     unsigned enableBpf : 1;
     // enable hw metric
     unsigned enableHwMetric : 1;
@@ -195,6 +200,29 @@ struct PmuAttr {
     // This mode supports only the pidList and does not support the CPU specification. 
     // This mode can't be used togerther with enableOnExec, and can't support inherit which instructed the kernel to automatically make that event available to newly created child processes.
     unsigned perThread : 1;
+    // --per-cpu sampling for pidList
+    // Open one sampling event per cpu instead of one per (cpu, thread), and keep only the samples of processes in pidList and their children.
+    // This mode only supports SAMPLING, needs the permission of system-wide collection, and can't be used together with perThread, enableOnExec or cgroup.
+    unsigned perCpuSample : 1;
+    // CPU overhead budget of sampling, in units of 0.01% of one cpu, e.g. 100 means 1% of one cpu.
+    // If it is not zero, the sample period of running events is enlarged when the cost of reading ring buffers
+    // exceeds the budget or ring buffers are close to full, and is restored to <period>/<freq> when load drops.
+    // The effective period of each sample is stored in PmuData.period. It just supports SAMPLING mode.
+    unsigned overheadBudget;
+    // In bpf cgroup counting, also report each descendant cgroup of cgroupNameList, which is discovered when its task is scheduled.
+    // Counts of a descendant include its own subtree, and PmuData.cgroupName is the path relative to cgroup root, e.g. "kubepods/pod1".
+    // It just supports COUNTING mode with enableBpf and cgroupNameList.
+    unsigned includeChildCgroup : 1;
+    // Size of SPE aux buffer of each cpu in pages, which must be a power of 2. 0 means 1MB.
+    // Records are lost and LIBPERF_WARN_SPE_AUX_TRUNCATED is set if aux buffer is full before it is read.
+    unsigned auxPages;
+    // Bytes of SPE aux data to hand over to user space, which should be less than aux buffer. 0 means half of aux buffer.
+    unsigned auxWatermark;
+    // Bytes of user stack dumped with registers per sample, to unwind user callchain with .eh_frame/.debug_frame
+    // instead of frame pointers, which recovers callchains of binaries built with -fomit-frame-pointer.
+    // It should be a multiple of 8 and no more than 65528. 0 means user callchain is collected by frame pointers.
+    // It just supports SAMPLING mode with callStack and symbol resolving, and can't be used together with enableBpf.
+    unsigned userStackSize;
 };
 
 enum PmuTraceType {
@@ -316,7 +344,7 @@ struct PmuData {
     struct CpuTopology *cpuTopo;    // cpu topology
     const char *comm;               // process command
     uint64_t period;                // sample period
-    uint64_t count;                 // event count. Only available for Counting.
+    uint64_t count;                 // event count. Only available for Counting, or number of samples for bpf Sampling.
     double countPercent;            // event count Percent. when count = 0, countPercent = -1; Only available for Counting.
     struct PmuDataExt *ext;         // extension. Only available for Spe.
     struct SampleRawData *rawData;  // trace pointer collect data.
@@ -782,6 +810,264 @@ int PmuWriteData(PmuFile file, struct PmuData *data, int len);
  */
 void PmuEndWrite(PmuFile file);
 
+struct PmuMemHeatmapAttr {
+    // Granularity of hot pages in bytes, which should be power of 2. 0 means page size of system.
+    unsigned pageSize;
+    // Granularity of hot cache lines in bytes, which should be power of 2. 0 means 64 bytes.
+    unsigned cacheLineSize;
+    // Only keep the hottest <topN> pages and cache lines in each window. 0 means all of them.
+    unsigned topN;
+};
+
+// Samples in a page or cache line.
+struct PmuMemHotSpot {
+    int pid;                // process id, virtual addresses of different processes are not merged.
+    unsigned long va;       // start virtual address of page or cache line.
+    unsigned long pa;       // physical address of the last sample, 0 if not available.
+    int nodeId;             // numa node of memory derived from pa, -1 if unknown.
+    uint64_t samples;       // number of samples.
+    uint64_t stores;        // number of store samples.
+    uint64_t remote;        // number of samples from cpus of other numa nodes.
+    uint64_t latSum;        // sum of total latency in cycles.
+    unsigned short maxLat;  // max total latency in cycles.
+};
+
+// Number of buckets of latency histogram. Bucket 0 is latency 0, bucket i (i > 0) is [2^(i-1), 2^i),
+// and the last bucket includes all larger latencies.
+#define PMU_MEM_LAT_BUCKETS 16
+
+// Latency distribution of a data source.
+struct PmuMemSourceStat {
+    unsigned short source;  // data source, defined in HIP_DATA_SOURCE.
+    uint64_t samples;
+    uint64_t latSum;
+    unsigned short maxLat;
+    uint64_t latHist[PMU_MEM_LAT_BUCKETS];
+};
+
+// Locality of memory accesses from cpus of a numa node.
+struct PmuMemNodeStat {
+    int nodeId;             // numa node of accessing cpus.
+    uint64_t local;         // samples on memory of the same node.
+    uint64_t remote;        // samples on memory of other nodes.
+    uint64_t unknown;       // samples whose memory node is unknown.
+};
+
+struct PmuMemHeatmapData {
+    uint64_t samples;                   // samples with data address in this window.
+    int64_t beginTs;                    // timestamp of the first sample.
+    int64_t endTs;                      // timestamp of the last sample.
+    struct PmuMemHotSpot *pages;        // hot pages, sorted by samples in descending order.
+    unsigned numPages;
+    struct PmuMemHotSpot *lines;        // hot cache lines, sorted by samples in descending order.
+    unsigned numLines;
+    struct PmuMemNodeStat *nodes;       // sorted by node id.
+    unsigned numNodes;
+    struct PmuMemSourceStat *sources;   // sorted by data source.
+    unsigned numSources;
+};
+
+typedef void* PmuMemHeatmap;
+
+/**
+ * @brief Create a memory access heatmap, which folds SPE samples by page, cache line, numa node and data source.
+ * @param attr attribute of heatmap
+ * @return a handle of heatmap. If error, return NULL and check Perrorno.
+ */
+PmuMemHeatmap PmuMemHeatmapOpen(struct PmuMemHeatmapAttr *attr);
+
+/**
+ * @brief Fold SPE samples into the current window of heatmap. Samples without data address are ignored.
+ * It can be called many times with data from PmuRead, and is thread safe for the same heatmap.
+ * @param heatmap handle of heatmap
+ * @param data PmuData list from SPE_SAMPLING
+ * @param len length of data
+ * @return On success, return SUCCESS. on error, return error code.
+ */
+int PmuMemHeatmapAdd(PmuMemHeatmap heatmap, struct PmuData *data, unsigned len);
+
+/**
+ * @brief Get heatmap of the current window, and start a new window.
+ * Call it periodically to get heatmap of incremental windows, such as for page migration decisions.
+ * @param heatmap handle of heatmap
+ * @param heatmapData output heatmap data, which should be freed by PmuMemHeatmapDataFree.
+ * @return On success, return SUCCESS. on error, return error code.
+ */
+int PmuMemHeatmapRead(PmuMemHeatmap heatmap, struct PmuMemHeatmapData **heatmapData);
+
+/**
+ * @brief Free heatmap data from PmuMemHeatmapRead.
+ */
+void PmuMemHeatmapDataFree(struct PmuMemHeatmapData *heatmapData);
+
+/**
+ * @brief Destroy heatmap.
+ */
+void PmuMemHeatmapClose(PmuMemHeatmap heatmap);
+
+struct PmuContentionAttr {
+    // Accesses in the same window are regarded as concurrent. 0 means 5 ms.
+    unsigned windowMs;
+    // Size of cache line in bytes, which should be power of 2. 0 means 64 bytes.
+    unsigned cacheLineSize;
+    // Lines conflicting in less windows are not reported. 0 means 2.
+    unsigned minConflictWindows;
+    // Number of shards aggregated by parallel threads, cache lines are hashed into shards. 0 means 8.
+    unsigned shards;
+    // Only output the most contended <topN> lines. 0 means all of them.
+    unsigned topN;
+    // Only output the most active <topParticipants> participants of each line. 0 means all of them.
+    unsigned topParticipants;
+    // If it is 1, read instructions from process memory to get access width in bytes,
+    // otherwise, 8 bytes for atomic operations and 4 bytes for the others.
+    unsigned decodeAccessWidth : 1;
+};
+
+enum PmuContentionKind {
+    PMU_FALSE_SHARING,  // threads access different bytes of the same cache line.
+    PMU_TRUE_SHARING,   // threads access the same bytes of the cache line.
+};
+
+// Accesses of an instruction from a thread on a contended cache line.
+struct PmuContentionParticipant {
+    int tid;
+    unsigned long pc;           // instruction address.
+    char *symbolName;           // function of instruction, NULL if symbol is not resolved.
+    char *module;               // binary of instruction, NULL if symbol is not resolved.
+    unsigned long offset;       // offset of instruction from the start of function.
+    unsigned long va;           // address accessed by the first sample.
+    uint64_t byteMask;          // bit i is set if byte i of cache line is accessed.
+    uint64_t reads;             // load samples in conflicting windows.
+    uint64_t writes;            // store samples in conflicting windows.
+    uint64_t hitmReads;         // load samples hitting modified line in other caches.
+};
+
+struct PmuContendedLine {
+    int pid;                    // process id, virtual addresses of different processes are not merged.
+    unsigned long va;           // start virtual address of cache line.
+    enum PmuContentionKind kind;
+    uint64_t score;             // sum of conflicting accesses between threads of each window.
+    uint64_t evidence;          // conflicting loads with hitm or hazard, which confirms the contention.
+    unsigned conflictWindows;   // number of windows in which threads conflict.
+    struct PmuContentionParticipant *participants;  // sorted by reads and writes in descending order.
+    unsigned numParticipants;
+};
+
+struct PmuContentionData {
+    uint64_t samples;                   // load and store samples since last read.
+    int64_t beginTs;                    // timestamp of the first sample.
+    int64_t endTs;                      // timestamp of the last sample.
+    struct PmuContendedLine *lines;     // sorted by score in descending order.
+    unsigned numLines;
+};
+
+typedef void* PmuContention;
+
+/**
+ * @brief Create a cache line contention detector, which finds false sharing and true sharing
+ * from load and store samples with data address, such as SPE samples.
+ * @param attr attribute of detector
+ * @return a handle of detector. If error, return NULL and check Perrorno.
+ */
+PmuContention PmuContentionOpen(struct PmuContentionAttr *attr);
+
+/**
+ * @brief Aggregate samples by cache line and window. Samples without data address or symbol are ignored.
+ * It can be called many times with data from PmuRead, and is thread safe for the same detector.
+ * @param contention handle of detector
+ * @param data PmuData list, such as from SPE_SAMPLING
+ * @param len length of data
+ * @return On success, return SUCCESS. on error, return error code.
+ */
+int PmuContentionAdd(PmuContention contention, struct PmuData *data, unsigned len);
+
+/**
+ * @brief Get contended lines since last read, and start a new period.
+ * Call it periodically to detect contention continuously.
+ * @param contention handle of detector
+ * @param contentionData output data, which should be freed by PmuContentionDataFree.
+ * @return On success, return SUCCESS. on error, return error code.
+ */
+int PmuContentionRead(PmuContention contention, struct PmuContentionData **contentionData);
+
+/**
+ * @brief Free data from PmuContentionRead.
+ */
+void PmuContentionDataFree(struct PmuContentionData *contentionData);
+
+/**
+ * @brief Destroy detector.
+ */
+void PmuContentionClose(PmuContention contention);
+
+enum PmuBranchProfileFormat {
+    PMU_PROFILE_AUTOFDO,    // text profile of AutoFDO, with fall-through ranges and branches of elf addresses.
+    PMU_PROFILE_BOLT,       // fdata of BOLT, with branches from function offset to function offset.
+};
+
+struct PmuBranchProfileAttr {
+    // Max number of branches and fall-through ranges kept in memory.
+    // Counts are halved and cold entries are dropped when it is exceeded. 0 means 262144.
+    unsigned maxEntries;
+};
+
+typedef void* PmuBranchProfile;
+
+/**
+ * @brief Create a branch profile, which aggregates branch records of samples into branches and
+ * fall-through ranges of each binary, for feedback-directed optimization, such as AutoFDO and BOLT.
+ * @param attr attribute of profile
+ * @return a handle of profile. If error, return NULL and check Perrorno.
+ */
+PmuBranchProfile PmuBranchProfileOpen(struct PmuBranchProfileAttr *attr);
+
+/**
+ * @brief Aggregate branch records of samples. Addresses are converted to addresses in elf files
+ * by modules of processes, so symbol resolving should be enabled when collecting, and addresses of
+ * kernel, anonymous memory and unknown modules are ignored.
+ * It can be called many times with data from PmuRead, and is thread safe for the same profile.
+ * @param profile handle of profile
+ * @param data PmuData list collected with branchSampleFilter
+ * @param len length of data
+ * @return On success, return SUCCESS. on error, return error code.
+ */
+int PmuBranchProfileAdd(PmuBranchProfile profile, struct PmuData *data, unsigned len);
+
+/**
+ * @brief Write profile of a binary to file. Counts are kept after writing, so it can be called periodically.
+ * @param profile handle of profile
+ * @param module path of binary, which is the same as module of Symbol, such as /usr/bin/mysqld.
+ * Binaries are profiled by build-id, so builds in different containers are not merged. If binaries at several paths
+ * have the same name, the binary is written by its path including mntPoint of Symbol.
+ * @param format format of profile
+ * @param path path of output file
+ * @return On success, return SUCCESS. on error, return error code.
+ */
+int PmuBranchProfileWrite(PmuBranchProfile profile, const char *module,
+                          enum PmuBranchProfileFormat format, const char *path);
+
+/**
+ * @brief Destroy profile.
+ */
+void PmuBranchProfileClose(PmuBranchProfile profile);
+
+/**
+ * @brief Disassemble code of a binary and count samples of each instruction, like perf annotate.
+ * Sampled addresses are converted to addresses in elf files by modules of processes, so symbol resolving
+ * should be enabled when collecting.
+ * @param data PmuData list from PmuRead, and the first frame of stack is the sampled instruction
+ * @param len length of data
+ * @param module path of binary, which is the same as module of Symbol, such as /usr/bin/mysqld.
+ * For processes in containers, it is mntPoint + "/" + module of Symbol, so that the binary can be opened on host.
+ * Samples are counted only if they are in the binary recorded at this path.
+ * @param startAddr start of code to disassemble in elf file, such as codeMapAddr - offset of a Symbol.
+ * @param endAddr end of code to disassemble in elf file, which is excluded.
+ * @return the same list as SymResolverAsmCode, and count of AsmCode is the number of samples of the instruction.
+ * It should be freed by FreeAsmStack. If error, return NULL and check Perrorno.
+ */
+struct StackAsm *PmuAnnotate(struct PmuData *data, unsigned len, const char *module,
+                             unsigned long startAddr, unsigned long endAddr);
+
 enum PmuHwMetric {
     PMU_HWM_CPI = 1 << 0,
     PMU_HWM_CACHE_MISS = 1 << 1,
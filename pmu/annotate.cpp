@@ -0,0 +1,73 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: annotate disassembled code of binaries with numbers of samples of instructions.
+ ******************************************************************************/
+#include <cstring>
+#include <unordered_map>
+#include "symbol.h"
+#include "symbol_resolve.h"
+#include "pcerr.h"
+#include "pmu.h"
+
+using namespace std;
+using namespace pcerr;
+
+static bool IsSampleOfModule(const KUNPENG_SYM::ModuleMap &module, const char *path)
+{
+    if (module.moduleName == path) {
+        return true;
+    }
+    string mntPoint = KUNPENG_SYM::SymbolResolve::GetInstance()->ModuleMntPoint(module);
+    return !mntPoint.empty() && mntPoint + "/" + module.moduleName == path;
+}
+
+struct StackAsm *PmuAnnotate(struct PmuData *data, unsigned len, const char *module,
+                             unsigned long startAddr, unsigned long endAddr)
+{
+    if (module == nullptr || (data == nullptr && len > 0)) {
+        New(LIBPERF_ERR_NULL_POINTER, "PmuData and module cannot be null");
+        return nullptr;
+    }
+    try {
+        auto symResolve = KUNPENG_SYM::SymbolResolve::GetInstance();
+        unordered_map<unsigned long, unsigned long> counts;
+        for (unsigned i = 0; i < len; ++i) {
+            if (data[i].stack == nullptr || data[i].stack->symbol == nullptr) {
+                continue;
+            }
+            unsigned long elfAddr = 0;
+            auto sampleModule = symResolve->MapModuleAddr(data[i].pid, data[i].stack->symbol->addr, elfAddr,
+                                                          data[i].ts);
+            if (!sampleModule || !IsSampleOfModule(*sampleModule, module)) {
+                continue;
+            }
+            if (elfAddr >= startAddr && elfAddr < endAddr) {
+                ++counts[elfAddr];
+            }
+        }
+        struct StackAsm *head = SymResolverAsmCode(module, startAddr, endAddr);
+        if (head == nullptr) {
+            return nullptr;
+        }
+        for (struct StackAsm *node = head; node != nullptr; node = node->next) {
+            if (node->asmCode == nullptr) {
+                continue;
+            }
+            auto findCount = counts.find(node->asmCode->addr);
+            node->asmCode->count = findCount == counts.end() ? 0 : findCount->second;
+        }
+        New(SUCCESS);
+        return head;
+    } catch (bad_alloc &) {
+        New(COMMON_ERR_NOMEM);
+        return nullptr;
+    }
+}
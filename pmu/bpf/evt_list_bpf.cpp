@@ -25,6 +25,35 @@
 
 using namespace std;
 
+int KUNPENG_PMU::EvtListBpf::InitSample(const bool groupEnable)
+{
+    // Open one sampling event per cpu, and samples of all processes are aggregated by bpf prog.
+    for (unsigned int cpu = 0; cpu < numCpu; cpu++) {
+        PerfEvtPtr perfEvt =
+                std::make_shared<KUNPENG_PMU::PerfSamplerBpf>(this->cpuList[cpu]->coreId, -1, this->pmuEvt.get(), procMap);
+        int err = perfEvt->Init(groupEnable, -1, -1);
+        if (err != SUCCESS) {
+            return err;
+        }
+        this->cpuCounterArray.emplace_back(perfEvt);
+    }
+
+    for (auto& proc: pidList) {
+        if (proc->tid > 0) {
+            this->allPids.emplace_back(proc->tid);
+        }
+    }
+
+    // Reader of aggregated samples, which is not bound to any cpu.
+    PerfEvtPtr perfEvt = std::make_shared<KUNPENG_PMU::PerfSamplerBpf>(-1, -1, this->pmuEvt.get(), procMap);
+    int err = std::dynamic_pointer_cast<KUNPENG_PMU::PerfSamplerBpf>(perfEvt)->InitPidForEvent(allPids);
+    if (err != SUCCESS) {
+        return err;
+    }
+    this->pidCounterArray.emplace_back(perfEvt);
+    return SUCCESS;
+}
+
 int KUNPENG_PMU::EvtListBpf::Init(const bool groupEnable, const std::shared_ptr<EvtList> evtLeader)
 {
     // Init process map.
@@ -34,6 +63,10 @@ int KUNPENG_PMU::EvtListBpf::Init(const bool groupEnable, const std::shared_ptr<
         }
     }
 
+    if (pmuEvt->collectType == SAMPLING) {
+        return InitSample(groupEnable);
+    }
+
     for (unsigned int cpu = 0; cpu < numCpu; cpu++) {
         PerfEvtPtr perfEvt =
                 std::make_shared<KUNPENG_PMU::PerfCounterBpf>(this->cpuList[cpu]->coreId, -1, this->pmuEvt.get(), procMap);
@@ -113,9 +146,31 @@ int KUNPENG_PMU::EvtListBpf::Close()
     return SUCCESS;
 }
 
+int KUNPENG_PMU::EvtListBpf::ReadSample(EventData &eventData)
+{
+    size_t oldSize = eventData.data.size();
+    int err = std::dynamic_pointer_cast<KUNPENG_PMU::PerfSamplerBpf>(
+            this->pidCounterArray[0])->ReadBpfSample(eventData);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    const char* evtName = pmuEvt->name.c_str();
+    for (size_t i = oldSize; i < eventData.data.size(); i++) {
+        auto& d = eventData.data[i];
+        d.evt = evtName;
+        d.ts = this->ts;
+        d.groupId = this->groupId;
+    }
+    return SUCCESS;
+}
+
 int KUNPENG_PMU::EvtListBpf::Read(EventData &eventData)
 {
     std::unique_lock<std::mutex> lg(mutex);
+    if (pmuEvt->collectType == SAMPLING) {
+        return ReadSample(eventData);
+    }
     auto perfEvt = this->pidCounterArray[0];
     int err = perfEvt->BeginRead();
     if (err != SUCCESS) {
@@ -129,7 +184,7 @@ int KUNPENG_PMU::EvtListBpf::Read(EventData &eventData)
                 this->pidCounterArray[0])->ReadBpfProcess(this->allPids, eventData.data);
     } else {
         err = std::dynamic_pointer_cast<KUNPENG_PMU::PerfCounterBpf>(
-                this->pidCounterArray[0])->ReadBpfCgroup(eventData.data);
+                this->pidCounterArray[0])->ReadBpfCgroup(eventData);
     }
     if (err != SUCCESS) {
         return err;
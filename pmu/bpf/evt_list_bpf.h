@@ -23,6 +23,7 @@
 #include <mutex>
 #include "cpu_map.h"
 #include "perf_counter_bpf.h"
+#include "perf_sampler_bpf.h"
 #include "perf_counter_default.h"
 #include "pmu.h"
 #include "process_map.h"
@@ -57,6 +58,8 @@ private:
     std::vector<std::shared_ptr<PerfEvt>> cpuCounterArray;
     std::vector<std::shared_ptr<PerfEvt>> pidCounterArray;
     int CollectorTaskArrayDoTask(std::vector<PerfEvtPtr>& taskArray, int task);
+    int InitSample(const bool groupEnable);
+    int ReadSample(EventData &eventData);
     void FillFields(size_t start, size_t end, CpuTopology* cpuTopo, ProcTopology* procTopo, std::vector<PmuData>& pmuData);
 };
 
@@ -13,7 +13,9 @@
  * Description: implementations for reading performance counters and initializing counting logic
  * of PerfCounterBpf in the KUNPENG_PMU namespace.
  ******************************************************************************/
+#include <algorithm>
 #include <climits>
+#include <dirent.h>
 #include <poll.h>
 #include <unistd.h>
 #include <sys/syscall.h>
@@ -50,13 +52,57 @@ static unordered_set<string> readCgroups;
 static unordered_set<string> triggerdEvt;
 static int evtIdx = 0;
 static int cgrpProgFd = 0;
+static std::unordered_map<std::string, int> cgroupIdxMap;           // key: cgroup name, value: sequential number
+// cgrp_readings of all cgroups and events, read by one batch in each read.
+static std::vector<bpf_perf_event_value> cgrpValues;
+static bool cgrpValuesValid = false;
+
+// key of cgrp_id_readings, same as struct cgrp_evt_key in sched_cgroup.bpf.c
+struct CgrpEvtKey {
+    __u64 cgrpId;
+    __u32 evtIdx;
+    __u32 reserved;
+};
+
+// value of switch_stats, same as struct switch_stat in sched_cgroup.bpf.c
+struct SwitchStat {
+    __u64 count;
+    __u64 ns;
+    __u64 dropped;
+};
+
+struct ChildCgroupValue {
+    __u64 cgrpId;
+    __u32 evtIdx;
+    std::vector<bpf_perf_event_value> values;
+};
+
+#define CHILD_BATCH_SIZE 1024
+#define MAX_CGROUP_LEVELS 10                                          // same as MAX_LEVELS in sched_cgroup.bpf.c
+// Names of child cgroups without counts in so many reads are dropped, which are mostly removed cgroups.
+#define CHILD_CGROUP_IDLE_READS 64
+
+struct ChildCgroupName {
+    std::string name;                                                 // path relative to cgroup root
+    unsigned long lastRead;                                           // the last read with counts of the cgroup
+};
+
+static bool includeChildCgroup = false;
+// cgrp_id_readings of descendant cgroups, read and deleted in each read.
+static std::vector<ChildCgroupValue> childCgrpValues;
+static std::unordered_map<__u64, ChildCgroupName> cgroupIdName;      // key: cgroup id
+static unsigned long childCgroupReads = 0;
+static unordered_set<string> scannedCgroups;                          // registered cgroups scanned in this read
+static SwitchStat lastSwitchStat = {0};
 
 static inline int TriggeredRead(int prog_fd, int cpu)
 {
+    // arguments of sched_switch(preempt, prev, next), all zero for a triggered read.
+    __u64 args[3] = {0};
     // enforce the bpf trace function
     DECLARE_LIBBPF_OPTS(bpf_test_run_opts, opts,
-                .ctx_in = NULL,                     // no input context
-                .ctx_size_in = 0,
+                .ctx_in = args,
+                .ctx_size_in = sizeof(args),
                 .retval = 0,                        // return code of the BPF program
                 .flags = BPF_F_TEST_RUN_ON_CPU,
                 .cpu = cpu,
@@ -73,6 +119,8 @@ int KUNPENG_PMU::PerfCounterBpf::EndRead()
 {
     triggerdEvt.clear();
     readCgroups.clear();
+    cgrpValuesValid = false;
+    scannedCgroups.clear();
     return SUCCESS;
 }
 
@@ -85,6 +133,162 @@ inline int CachedCpuCount()
     return cached > MAX_CPU_LIMIT ? MAX_CPU_LIMIT : cached;
 }
 
+// Read all entries of <mapFd> into <keys> and <values>, with as few syscalls as possible.
+// Return number of entries, or -1 if batch operation is not supported.
+static int LookupBatch(int mapFd, void *keys, size_t keySize, void *values, size_t valueSize, __u32 capacity)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts);
+    __u32 total = 0;
+    __u32 outBatch = 0;
+    void *inBatch = nullptr;
+    while (total < capacity) {
+        __u32 cnt = capacity - total;
+        int err = bpf_map_lookup_batch(mapFd, inBatch, &outBatch,
+                                       static_cast<char*>(keys) + total * keySize,
+                                       static_cast<char*>(values) + total * valueSize, &cnt, &opts);
+        total += cnt;
+        if (err) {
+            // ENOENT means all entries have been read.
+            if (errno == ENOENT) {
+                break;
+            }
+            return total == 0 ? -1 : static_cast<int>(total);
+        }
+        inBatch = &outBatch;
+    }
+    return static_cast<int>(total);
+}
+
+static uint64_t ReadCgroupIdByPath(const string &fullCgroupPath)
+{
+    struct {
+        struct file_handle fh;
+        uint64_t cgroup_id;
+    } handle;
+    int mount_id;
+    handle.fh.handle_bytes = sizeof(handle.cgroup_id);
+    if (name_to_handle_at(AT_FDCWD, fullCgroupPath.c_str(), &handle.fh, &mount_id, 0) < 0) {
+        return -1;
+    }
+
+    return handle.cgroup_id;
+}
+
+static uint64_t ReadCgroupId(const string &cgroupName)
+{
+    return ReadCgroupIdByPath(GetCgroupPath(cgroupName));
+}
+
+// Record ids of all descendant directories of <dirPath>, whose name relative to cgroup root is <name>.
+static void ScanCgroupDir(const string &dirPath, const string &name, int depth)
+{
+    DIR *dir = opendir(dirPath.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_type != DT_DIR || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        string childPath = dirPath + "/" + entry->d_name;
+        string childName = name + "/" + entry->d_name;
+        uint64_t cgrpId = ReadCgroupIdByPath(childPath);
+        if (cgrpId != UINT64_MAX) {
+            cgroupIdName.emplace(cgrpId, ChildCgroupName{childName, childCgroupReads});
+        }
+        if (depth + 1 < MAX_CGROUP_LEVELS) {
+            ScanCgroupDir(childPath, childName, depth + 1);
+        }
+    }
+    closedir(dir);
+}
+
+// Get name of a descendant cgroup by id. New cgroups are found by scanning registered cgroups at most once per read.
+static const string *FindChildCgroupName(__u64 cgrpId)
+{
+    auto findName = cgroupIdName.find(cgrpId);
+    if (findName == cgroupIdName.end()) {
+        for (auto &cgrp : cgroupIdxMap) {
+            if (scannedCgroups.insert(cgrp.first).second) {
+                ScanCgroupDir(GetCgroupPath(cgrp.first), cgrp.first, 0);
+            }
+        }
+        findName = cgroupIdName.find(cgrpId);
+        if (findName == cgroupIdName.end()) {
+            return nullptr;
+        }
+    }
+    findName->second.lastRead = childCgroupReads;
+    return &findName->second.name;
+}
+
+// Drop names of cgroups which have no counts for a while. A cgroup which runs again is found by the next scan.
+static void PruneChildCgroupNames()
+{
+    for (auto iter = cgroupIdName.begin(); iter != cgroupIdName.end();) {
+        if (childCgroupReads - iter->second.lastRead > CHILD_CGROUP_IDLE_READS) {
+            iter = cgroupIdName.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+// Get the deepest registered cgroup which contains <childName>, rows of the child are reported by that cgroup.
+static const string *FindOwnerCgroup(const string &childName)
+{
+    const string *owner = nullptr;
+    for (auto &cgrp : cgroupIdxMap) {
+        const string &root = cgrp.first;
+        if (childName.size() > root.size() && childName[root.size()] == '/' &&
+            childName.compare(0, root.size(), root) == 0 && (owner == nullptr || root.size() > owner->size())) {
+            owner = &root;
+        }
+    }
+    return owner;
+}
+
+static void TriggerRunningCpus(struct sched_counter_bpf *obj, int progFd, unsigned cpuNums)
+{
+    // Only cpus running a tracked task have pmu count not flushed to accum_readings.
+    std::vector<__u64> running(cpuNums, 1);
+    __u32 zero = 0;
+    if (bpf_map_lookup_elem(bpf_map__fd(obj->maps.oncpu), &zero, running.data()) != 0) {
+        std::fill(running.begin(), running.end(), 1);
+    }
+    for (unsigned cpu = 0; cpu < cpuNums; cpu++) {
+        if (running[cpu] == 0) {
+            continue;
+        }
+        int triggerErr = TriggeredRead(progFd, cpu);
+        if (triggerErr) {
+            DBG_PRINT("trigger error: %s\n", strerror(-triggerErr));
+        }
+    }
+}
+
+void KUNPENG_PMU::PerfCounterBpf::AppendProcessData(int tid, const bpf_perf_event_value *values, std::vector<PmuData>& data)
+{
+    const unsigned cpuNums = CachedCpuCount();
+    int processId = 0;
+    auto it = procMap.find(tid);
+    if (it != procMap.end()) {
+        processId = it->second->pid;
+    }
+    for (int cpu = 0; cpu < cpuNums; ++cpu) {
+        if (values[cpu].counter == 0) continue;
+        data.emplace_back(PmuData{
+            .pid          = processId,
+            .tid          = tid,
+            .cpu          = cpu,
+            .count        = values[cpu].counter,
+            .countPercent = values[cpu].enabled ? 
+                            (double)values[cpu].running / values[cpu].enabled : 0.0,
+        });
+    }
+}
+
 int KUNPENG_PMU::PerfCounterBpf::ReadBpfProcess(const std::vector<int>& pids, std::vector<PmuData>& data)
 {
     const unsigned cpuNums = CachedCpuCount();
@@ -93,71 +297,229 @@ int KUNPENG_PMU::PerfCounterBpf::ReadBpfProcess(const std::vector<int>& pids, st
     // must execute sched_switch when each read operation.
     // the pid may not have been scheduled for a long time and the pmu count will not be recoreded.
     if (triggerdEvt.find(this->evt->name) == triggerdEvt.end()) {
-        for (int i = 0; i < cpuNums; i++) {
-            int triggerErr = TriggeredRead(evtDataMap[this->evt->name].bpfFd, i);
-            if (triggerErr) {
-                DBG_PRINT("trigger error: %s\n", strerror(-triggerErr));
+        TriggerRunningCpus(obj, evtDataMap[this->evt->name].bpfFd, cpuNums);
+        triggerdEvt.insert(this->evt->name);
+    }
+
+    int mapFd = bpf_map__fd(obj->maps.accum_readings);
+    int cnt = LookupBatch(mapFd, batchKeys.data(), sizeof(__u32), batchValues.data(),
+                          sizeof(bpf_perf_event_value) * cpuNums, batchKeys.size());
+    if (cnt >= 0) {
+        // accum_readings is shared by all tasks of this event, only report and clear pids of this task.
+        std::vector<__u32> readKeys;
+        readKeys.reserve(cnt);
+        for (int i = 0; i < cnt; ++i) {
+            int tid = static_cast<int>(batchKeys[i]);
+            if (pidSet.find(tid) == pidSet.end()) {
+                continue;
             }
+            AppendProcessData(tid, &batchValues[i * cpuNums], data);
+            readKeys.emplace_back(batchKeys[i]);
         }
-        triggerdEvt.insert(this->evt->name);
+        __u32 updateCnt = readKeys.size();
+        if (updateCnt == 0) {
+            return SUCCESS;
+        }
+        DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts, .elem_flags = BPF_EXIST);
+        if (batchZeros.size() < updateCnt * cpuNums) {
+            batchZeros.resize(updateCnt * cpuNums, bpf_perf_event_value{});
+        }
+        if (bpf_map_update_batch(mapFd, readKeys.data(), batchZeros.data(), &updateCnt, &opts) == 0) {
+            return SUCCESS;
+        }
+        // Fall through to clear remaining pids one by one.
+        for (size_t i = updateCnt; i < readKeys.size(); ++i) {
+            bpf_map_update_elem(mapFd, &readKeys[i], batchZeros.data(), BPF_EXIST);
+        }
+        return SUCCESS;
     }
 
+    // Batch operation is not supported by kernel, read pids one by one.
     static const std::vector<bpf_perf_event_value> zeros(cpuNums, bpf_perf_event_value{});
+    std::vector<bpf_perf_event_value> values(cpuNums, bpf_perf_event_value{});
     for (int tid : pids) {
-        std::vector<bpf_perf_event_value> values(cpuNums, bpf_perf_event_value{});
-        if (bpf_map_lookup_elem(bpf_map__fd(obj->maps.accum_readings), &tid, values.data())) {
+        if (bpf_map_lookup_elem(mapFd, &tid, values.data())) {
             continue;
         }
+        AppendProcessData(tid, values.data(), data);
+        bpf_map_update_elem(mapFd, &tid, zeros.data(), BPF_EXIST);
+    }
+
+    return SUCCESS;
+}
+
+static void AppendChildCgroupValue(const CgrpEvtKey &key, const bpf_perf_event_value *values, unsigned cpuNums)
+{
+    childCgrpValues.emplace_back(ChildCgroupValue{key.cgrpId, key.evtIdx,
+                                                  std::vector<bpf_perf_event_value>(values, values + cpuNums)});
+}
+
+// Read and delete all entries of cgrp_id_readings, so cgroups removed from system don't occupy the map.
+static void ReadChildCgroupValues()
+{
+    const unsigned cpuNums = MAX_CPU_NUM;
+    int mapFd = bpf_map__fd(cgrpCounter->maps.cgrp_id_readings);
+    static std::vector<CgrpEvtKey> keys(CHILD_BATCH_SIZE);
+    static std::vector<bpf_perf_event_value> values(CHILD_BATCH_SIZE * cpuNums);
+    childCgrpValues.clear();
+
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts);
+    __u32 outBatch = 0;
+    void *inBatch = nullptr;
+    bool batchSupported = true;
+    while (true) {
+        __u32 cnt = CHILD_BATCH_SIZE;
+        int err = bpf_map_lookup_and_delete_batch(mapFd, inBatch, &outBatch, keys.data(), values.data(), &cnt, &opts);
+        for (__u32 i = 0; i < cnt; ++i) {
+            AppendChildCgroupValue(keys[i], &values[i * cpuNums], cpuNums);
+        }
+        if (err) {
+            // ENOENT means all entries have been read.
+            batchSupported = errno == ENOENT || inBatch != nullptr || cnt > 0;
+            break;
+        }
+        inBatch = &outBatch;
+    }
+    if (batchSupported) {
+        return;
+    }
 
-        int processId = 0;
-        auto it = procMap.find(tid);
-        if (it != procMap.end()) {
-            processId = it->second->pid;
+    // Batch operation is not supported by kernel, read and delete keys one by one.
+    CgrpEvtKey key;
+    CgrpEvtKey nextKey;
+    CgrpEvtKey *prevKey = nullptr;
+    std::vector<CgrpEvtKey> readKeys;
+    while (bpf_map_get_next_key(mapFd, prevKey, &nextKey) == 0) {
+        if (bpf_map_lookup_elem(mapFd, &nextKey, values.data()) == 0) {
+            AppendChildCgroupValue(nextKey, values.data(), cpuNums);
+            readKeys.emplace_back(nextKey);
         }
-        for (int cpu = 0; cpu < cpuNums; ++cpu) {
-            if (values[cpu].counter == 0) continue;
-            data.emplace_back(PmuData{
-                .pid          = processId,
-                .tid          = tid,
-                .cpu          = cpu,
-                .count        = values[cpu].counter,
-                .countPercent = values[cpu].enabled ? 
-                                (double)values[cpu].running / values[cpu].enabled : 0.0,
-            });
+        key = nextKey;
+        prevKey = &key;
+    }
+    for (auto &readKey : readKeys) {
+        bpf_map_delete_elem(mapFd, &readKey);
+    }
+}
+
+// Check the cost of sched_switch since last read.
+static void CheckSwitchStat()
+{
+    const unsigned cpuNums = MAX_CPU_NUM;
+    std::vector<SwitchStat> stats(cpuNums, SwitchStat{0});
+    __u32 zero = 0;
+    if (bpf_map_lookup_elem(bpf_map__fd(cgrpCounter->maps.switch_stats), &zero, stats.data()) != 0) {
+        return;
+    }
+    SwitchStat total = {0};
+    for (auto &stat : stats) {
+        total.count += stat.count;
+        total.ns += stat.ns;
+        total.dropped += stat.dropped;
+    }
+    __u64 count = total.count - lastSwitchStat.count;
+    if (count > 0) {
+        DBG_PRINT("cgroup sched_switch: %llu times, %llu ns per switch\n",
+                  count, (total.ns - lastSwitchStat.ns) / count);
+    }
+    if (total.dropped > lastSwitchStat.dropped) {
+        SetWarn(LIBPERF_WARN_BPF_CGROUP_DROPPED, "bpf map of child cgroups is full, " +
+                to_string(total.dropped - lastSwitchStat.dropped) + " counts are dropped");
+    }
+    lastSwitchStat = total;
+}
+
+static int ReadAllCgroupValues()
+{
+    const unsigned cpuNums = MAX_CPU_NUM;
+    for (int i = 0; i < cpuNums; ++i) {
+        int triggerErr = TriggeredRead(cgrpProgFd, i);
+        if (triggerErr) {
+            DBG_PRINT("trigger error: %s\n", strerror(-triggerErr));
         }
+    }
 
-        bpf_map_update_elem(bpf_map__fd(obj->maps.accum_readings), &tid, zeros.data(), BPF_EXIST);
+    __u32 keyNum = cgroupIdxMap.size() * evtDataMap.size();
+    int mapFd = bpf_map__fd(cgrpCounter->maps.cgrp_readings);
+    cgrpValues.assign(keyNum * cpuNums, bpf_perf_event_value{});
+    std::vector<__u32> keys(keyNum);
+    int cnt = LookupBatch(mapFd, keys.data(), sizeof(__u32), cgrpValues.data(),
+                          sizeof(bpf_perf_event_value) * cpuNums, keyNum);
+    if (cnt < 0) {
+        // Batch operation is not supported by kernel, read keys one by one.
+        for (__u32 key = 0; key < keyNum; ++key) {
+            int err = bpf_map_lookup_elem(mapFd, &key, &cgrpValues[key * cpuNums]);
+            if (err) {
+                New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to lookup cgroup map cgrp_readings. Error: " + string(strerror(errno)));
+                return LIBPERF_ERR_BPF_ACT_FAILED;
+            }
+        }
+    } else if (static_cast<__u32>(cnt) < keyNum) {
+        New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to lookup cgroup map cgrp_readings. Error: " + string(strerror(errno)));
+        return LIBPERF_ERR_BPF_ACT_FAILED;
+    } else {
+        // Array is iterated from key 0, so values are indexed by key.
+        for (__u32 i = 0; i < keyNum; ++i) {
+            if (keys[i] != i) {
+                New(LIBPERF_ERR_BPF_ACT_FAILED, "unexpected key of cgroup map cgrp_readings");
+                return LIBPERF_ERR_BPF_ACT_FAILED;
+            }
+        }
     }
 
+    // Clear all values for next read.
+    std::vector<bpf_perf_event_value> zeros(keyNum * cpuNums, bpf_perf_event_value{});
+    __u32 updateCnt = keyNum;
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts, .elem_flags = BPF_ANY);
+    for (__u32 i = 0; i < keyNum; ++i) {
+        keys[i] = i;
+    }
+    if (bpf_map_update_batch(mapFd, keys.data(), zeros.data(), &updateCnt, &opts) != 0) {
+        for (__u32 key = updateCnt; key < keyNum; ++key) {
+            int err = bpf_map_update_elem(mapFd, &key, zeros.data(), BPF_ANY);
+            if (err) {
+                New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to update cgroup map cgrp_readings. Error: " + string(strerror(errno)));
+                return LIBPERF_ERR_BPF_ACT_FAILED;
+            }
+        }
+    }
+    if (includeChildCgroup) {
+        ++childCgroupReads;
+        PruneChildCgroupNames();
+        ReadChildCgroupValues();
+        CheckSwitchStat();
+    }
+    cgrpValuesValid = true;
     return SUCCESS;
 }
 
-int KUNPENG_PMU::PerfCounterBpf::ReadBpfCgroup(std::vector<PmuData> &data)
+int KUNPENG_PMU::PerfCounterBpf::ReadBpfCgroup(EventData &eventData)
 {
+    auto &data = eventData.data;
     auto cgrpName = this->evt->cgroupName;
     if (readCgroups.find(cgrpName) != readCgroups.end()) {
         return SUCCESS;
     }
     readCgroups.insert(cgrpName);
 
-    for (int i = 0; i < MAX_CPU_NUM; ++i) {
-        int triggerErr = TriggeredRead(cgrpProgFd, i);
-        if (triggerErr) {
-            DBG_PRINT("trigger error: %s\n", strerror(-triggerErr));
+    // Trigger and read once for all cgroups and events.
+    if (!cgrpValuesValid) {
+        int err = ReadAllCgroupValues();
+        if (err != SUCCESS) {
+            return err;
         }
     }
 
     const unsigned cpuNums = MAX_CPU_NUM;
-    struct bpf_perf_event_value values[cpuNums];
-    int readKey = cgroupIdxMap[cgrpName] * evtDataMap.size() + evtDataMap[this->evt->name].eventId;
-    int err = bpf_map__lookup_elem(cgrpCounter->maps.cgrp_readings, &readKey, sizeof(__u32), values, sizeof(values), BPF_ANY);
-    if (err) {
-        string msg =
-            "failed to lookup cgroup map cgrp_readings. Error: " + string(strerror(-err)) + " pid " + to_string(this->pid);
-        New(LIBPERF_ERR_BPF_ACT_FAILED, msg);
+    auto findCgrp = cgroupIdxMap.find(cgrpName);
+    if (findCgrp == cgroupIdxMap.end()) {
         return SUCCESS;
     }
-
+    size_t readKey = findCgrp->second * evtDataMap.size() + evtDataMap[this->evt->name].eventId;
+    if ((readKey + 1) * cpuNums > cgrpValues.size()) {
+        return SUCCESS;
+    }
+    const bpf_perf_event_value *values = &cgrpValues[readKey * cpuNums];
     for (int cpu = 0; cpu < cpuNums; ++cpu) {
         data.emplace_back(PmuData{
             .tid          = this->pid,
@@ -168,17 +530,50 @@ int KUNPENG_PMU::PerfCounterBpf::ReadBpfCgroup(std::vector<PmuData> &data)
             .cgroupName   = this->evt->cgroupName.c_str(),
         });
     }
-
-    memset(values, 0, cpuNums * sizeof(bpf_perf_event_value));
-    err = bpf_map__update_elem(cgrpCounter->maps.cgrp_readings, &readKey, sizeof(__u32), values, sizeof(bpf_perf_event_value) * MAX_CPU_NUM, BPF_ANY);
-    if (err) {
-        New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to update cgroup map cgrp_readings. Error: "
-                + string(strerror(-err)) + " pid " + to_string(this->pid));
-        return LIBPERF_ERR_BPF_ACT_FAILED;
+    if (this->evt->includeChildCgroup) {
+        ReadBpfChildCgroup(eventData);
     }
     return SUCCESS;
 }
 
+void KUNPENG_PMU::PerfCounterBpf::ReadBpfChildCgroup(EventData &eventData)
+{
+    const unsigned cpuNums = MAX_CPU_NUM;
+    __u32 eventId = evtDataMap[this->evt->name].eventId;
+    for (auto &child : childCgrpValues) {
+        if (child.evtIdx != eventId) {
+            continue;
+        }
+        const string *childName = FindChildCgroupName(child.cgrpId);
+        if (childName == nullptr) {
+            // the cgroup has been removed before it is scanned.
+            continue;
+        }
+        const string *owner = FindOwnerCgroup(*childName);
+        if (owner == nullptr || *owner != this->evt->cgroupName) {
+            continue;
+        }
+        // Names of cgroups may be pruned before data is freed, so data points to its own copy.
+        const char *cgroupName = nullptr;
+        for (int cpu = 0; cpu < cpuNums; ++cpu) {
+            const bpf_perf_event_value &value = child.values[cpu];
+            if (value.counter == 0) {
+                continue;
+            }
+            if (cgroupName == nullptr) {
+                cgroupName = KeepString(eventData, *childName);
+            }
+            eventData.data.emplace_back(PmuData{
+                .tid          = this->pid,
+                .cpu          = cpu,
+                .count        = value.counter,
+                .countPercent = value.enabled ? (double)value.running / value.enabled : 0.0,
+                .cgroupName   = cgroupName,
+            });
+        }
+    }
+}
+
 int KUNPENG_PMU::PerfCounterBpf::Read(EventData &eventData)
 {
     return SUCCESS;
@@ -235,6 +630,12 @@ int KUNPENG_PMU::PerfCounterBpf::InitPidForEvent(const std::vector<int>& pids)
         }
     }
 
+    // preallocate buffers for batch reading, which can hold all entries of accum_readings.
+    __u32 capacity = bpf_map__max_entries(obj->maps.accum_readings);
+    batchKeys.resize(capacity);
+    batchValues.resize(static_cast<size_t>(capacity) * cpu_num);
+    pidSet.insert(pids.begin(), pids.end());
+
     // initialize the filter, build the map relationship of pid and accum_key
     for (auto pid : keys) {
         int err = bpf_map__update_elem(obj->maps.filter,&pid, sizeof(__u32), &pid, sizeof(__u32), BPF_NOEXIST);
@@ -317,24 +718,6 @@ int KUNPENG_PMU::PerfCounterBpf::InitBpfObj()
     return SUCCESS;
 }
 
-static uint64_t ReadCgroupId(const string &cgroupName)
-{
-    char path[PATH_MAX + 1];
-    char mnt[PATH_MAX + 1];
-    struct {
-        struct file_handle fh;
-        uint64_t cgroup_id;
-    } handle;
-    int mount_id;
-    std::string fullCgroupPath = GetCgroupPath(cgroupName);
-    handle.fh.handle_bytes = sizeof(handle.cgroup_id);
-    if (name_to_handle_at(AT_FDCWD, fullCgroupPath.c_str(), &handle.fh, &mount_id, 0) < 0) {
-        return -1;
-    }
-
-    return handle.cgroup_id;
-}
-
 int KUNPENG_PMU::PerfCounterBpf::InitBpfCgroupObj()
 {
     int err;
@@ -348,6 +731,7 @@ int KUNPENG_PMU::PerfCounterBpf::InitBpfCgroupObj()
 
         obj->rodata->num_cpus = MAX_CPU_NUM;
         obj->rodata->num_events = this->evt->numEvent;
+        obj->rodata->include_child = this->evt->includeChildCgroup;
 
         err = bpf_map__set_max_entries(obj->maps.events, MAX_ENTITES);
         if (err) {
@@ -387,6 +771,7 @@ int KUNPENG_PMU::PerfCounterBpf::InitBpfCgroupObj()
 
         cgrpProgFd = bpf_program__fd(obj->progs.trigger_read);
         cgrpCounter = obj;
+        includeChildCgroup = this->evt->includeChildCgroup;
         DBG_PRINT("create bpf obj for cgroup evt %s \n", evt->name.c_str());
     }
 
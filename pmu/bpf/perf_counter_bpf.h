@@ -19,6 +19,8 @@
 #include <stdexcept>
 #include <linux/types.h>
 #include <unordered_set>
+#include <vector>
+#include <linux/bpf.h>
 #include "evt.h"
 #include "pmu_event.h"
 #include "perf_counter.h"
@@ -50,12 +52,19 @@ namespace KUNPENG_PMU {
         int EndRead();
         int InitPidForEvent(const std::vector<int>& pids);
         int ReadBpfProcess(const std::vector<int>& pids, std::vector<PmuData> &data);
-        int ReadBpfCgroup(std::vector<PmuData> &data);
+        int ReadBpfCgroup(EventData &eventData);
 
     private:
         int InitBpfObj();
         int InitBpfCgroupObj();
-        std::unordered_map<std::string, int> cgroupIdxMap; // key: cgroup name, value: sequential number
+        void AppendProcessData(int tid, const bpf_perf_event_value *values, std::vector<PmuData>& data);
+        void ReadBpfChildCgroup(EventData &eventData);
+
+        // buffers for batch reading of accum_readings, allocated once in InitPidForEvent.
+        std::vector<__u32> batchKeys;
+        std::vector<bpf_perf_event_value> batchValues;
+        std::vector<bpf_perf_event_value> batchZeros;
+        std::unordered_set<int> pidSet;
     };
 }  // namespace KUNPENG_PMU
 #endif
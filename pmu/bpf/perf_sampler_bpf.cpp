@@ -0,0 +1,277 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: implementations for sampling with call stacks aggregated in kernel
+ * of PerfSamplerBpf in the KUNPENG_PMU namespace.
+ ******************************************************************************/
+#include <unistd.h>
+#include <cstring>
+#include <unordered_set>
+#include <linux/perf_event.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+#include "pmu.h"
+#include "pmu_event.h"
+#include "process_map.h"
+#include "pcerr.h"
+#include "log.h"
+#include "sample_stack.h"
+#include "sample_stack.skel.h"
+#include "perf_sampler_bpf.h"
+
+using namespace std;
+using namespace pcerr;
+
+struct SampleBpfObj {
+    struct sample_stack_bpf *obj = nullptr;
+    int refs = 0;
+};
+
+// key: pmu event of one task, value: bpf obj shared by sampling events on all cpus.
+static unordered_map<const PmuEvt*, SampleBpfObj> sampleObjMap;
+
+int KUNPENG_PMU::PerfSamplerBpf::InitBpfObj()
+{
+    auto& sampleObj = sampleObjMap[this->evt];
+    if (sampleObj.obj == nullptr) {
+        struct sample_stack_bpf *obj = sample_stack_bpf__open();
+        if (!obj) {
+            sampleObjMap.erase(this->evt);
+            New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to open sample bpf obj");
+            return LIBPERF_ERR_BPF_ACT_FAILED;
+        }
+        // threads to be collected are put into procMap by EvtListBpf, and it is empty for system-wide sampling.
+        obj->rodata->filter_pid = !this->procMap.empty();
+        obj->rodata->call_stack = this->evt->callStack;
+        obj->rodata->kernel_stack = !this->evt->excludeKernel;
+        obj->rodata->user_stack = !this->evt->excludeUser;
+
+        int err = sample_stack_bpf__load(obj);
+        if (err) {
+            sample_stack_bpf__destroy(obj);
+            sampleObjMap.erase(this->evt);
+            New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to load sample bpf obj");
+            return LIBPERF_ERR_BPF_ACT_FAILED;
+        }
+        // Sample prog is attached to each perf event below, only the new task prog is attached here.
+        if (obj->rodata->filter_pid) {
+            obj->links.on_newtask = bpf_program__attach(obj->progs.on_newtask);
+            if (!obj->links.on_newtask) {
+                sample_stack_bpf__destroy(obj);
+                sampleObjMap.erase(this->evt);
+                New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to attach new task prog of sample bpf obj");
+                return LIBPERF_ERR_BPF_ACT_FAILED;
+            }
+        }
+        sampleObj.obj = obj;
+        DBG_PRINT("create sample bpf obj for evt %s\n", evt->name.c_str());
+    }
+
+    this->link = bpf_program__attach_perf_event(sampleObj.obj->progs.on_sample, this->fd);
+    if (!this->link) {
+        New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to attach sample prog to perf event. Error: "
+                + string(strerror(errno)) + " cpu " + to_string(cpu) + " fd " + to_string(fd));
+        return LIBPERF_ERR_BPF_ACT_FAILED;
+    }
+    sampleObj.refs++;
+    return SUCCESS;
+}
+
+int KUNPENG_PMU::PerfSamplerBpf::InitPidForEvent(const std::vector<int>& pids)
+{
+    auto findObj = sampleObjMap.find(this->evt);
+    if (findObj == sampleObjMap.end() || !findObj->second.obj->rodata->filter_pid) {
+        return SUCCESS;
+    }
+    int mapFd = bpf_map__fd(findObj->second.obj->maps.filter);
+    __u8 one = 1;
+    for (int pid : pids) {
+        __u32 key = static_cast<__u32>(pid);
+        int err = bpf_map_update_elem(mapFd, &key, &one, BPF_NOEXIST);
+        if (err && errno != EEXIST) {
+            New(LIBPERF_ERR_BPF_ACT_FAILED, "failed to update sample map filter. Error: " + std::to_string(err));
+            return LIBPERF_ERR_BPF_ACT_FAILED;
+        }
+    }
+    return SUCCESS;
+}
+
+// Append ips of stack <stackId> from root to leaf, which is the order of PerfSampleIps.
+static void AppendStack(int stacksFd, __s32 stackId, vector<unsigned long>& ips)
+{
+    if (stackId < 0) {
+        return;
+    }
+    __u64 stack[SAMPLE_STACK_MAX_DEPTH] = {0};
+    if (bpf_map_lookup_elem(stacksFd, &stackId, stack) != 0) {
+        return;
+    }
+    int depth = 0;
+    while (depth < SAMPLE_STACK_MAX_DEPTH && stack[depth] != 0) {
+        ++depth;
+    }
+    for (int i = depth - 1; i >= 0; --i) {
+        ips.emplace_back(stack[i]);
+    }
+}
+
+const char* KUNPENG_PMU::PerfSamplerBpf::GetComm(pid_t pid, const char* bpfComm, EventData &eventData,
+                                                unordered_map<string, const char*> &readComms)
+{
+    // Threads to be collected are in procMap. Other processes, e.g. of system-wide sampling, use comm recorded by
+    // bpf at sampling time, which is right even if the pid is reused later, and nothing is cached across reads.
+    auto findProc = procMap.find(pid);
+    if (findProc != procMap.end()) {
+        return findProc->second->comm;
+    }
+    string comm(bpfComm, strnlen(bpfComm, SAMPLE_COMM_LEN));
+    auto findComm = readComms.find(comm);
+    if (findComm == readComms.end()) {
+        // The string lives as long as the data read.
+        findComm = readComms.emplace(comm, KeepString(eventData, comm)).first;
+    }
+    return findComm->second;
+}
+
+int KUNPENG_PMU::PerfSamplerBpf::ReadBpfSample(EventData &eventData)
+{
+    auto findObj = sampleObjMap.find(this->evt);
+    if (findObj == sampleObjMap.end()) {
+        return SUCCESS;
+    }
+    auto obj = findObj->second.obj;
+    int countsFd = bpf_map__fd(obj->maps.counts);
+    int stacksFd = bpf_map__fd(obj->maps.stacks);
+
+    // Collect keys before deleting, because deleting while iterating restarts the iteration.
+    vector<SampleStackKey> keys;
+    SampleStackKey key;
+    SampleStackKey nextKey;
+    void* prevKey = nullptr;
+    while (bpf_map_get_next_key(countsFd, prevKey, &nextKey) == 0) {
+        keys.emplace_back(nextKey);
+        key = nextKey;
+        prevKey = &key;
+    }
+
+    unordered_set<__s32> stackIds;
+    unordered_map<string, const char*> readComms;
+    for (auto& k : keys) {
+        SampleStackValue val;
+        // Samples of the next interval are counted from zero.
+        if (bpf_map_lookup_and_delete_elem(countsFd, &k, &val) != 0) {
+            // Lookup and delete of hash map is not supported before linux 5.14.
+            if (bpf_map_lookup_elem(countsFd, &k, &val) != 0) {
+                continue;
+            }
+            bpf_map_delete_elem(countsFd, &k);
+        }
+
+        eventData.data.emplace_back(PmuData{0});
+        auto& current = eventData.data.back();
+        eventData.sampleIps.emplace_back(PerfSampleIps());
+        auto& ips = eventData.sampleIps.back().ips;
+        if (k.ip != 0) {
+            ips.emplace_back(k.ip);
+        } else {
+            AppendStack(stacksFd, k.userStackId, ips);
+            AppendStack(stacksFd, k.kernStackId, ips);
+            stackIds.insert(k.userStackId);
+            stackIds.insert(k.kernStackId);
+        }
+        current.pid = static_cast<pid_t>(k.pid);
+        current.tid = static_cast<int>(k.pid);
+        // Samples on all cpus are aggregated.
+        current.cpu = -1;
+        current.count = val.count;
+        current.period = val.period;
+        current.comm = GetComm(current.pid, val.comm, eventData, readComms);
+    }
+
+    // Bpf prog may have counted new samples with the same stack ids since keys are collected, and these stacks are
+    // kept for the next read. Only samples counted between this scan and the deletion may lose their stacks.
+    prevKey = nullptr;
+    while (bpf_map_get_next_key(countsFd, prevKey, &nextKey) == 0) {
+        stackIds.erase(nextKey.userStackId);
+        stackIds.erase(nextKey.kernStackId);
+        key = nextKey;
+        prevKey = &key;
+    }
+    for (auto stackId : stackIds) {
+        if (stackId >= 0) {
+            bpf_map_delete_elem(stacksFd, &stackId);
+        }
+    }
+    DBG_PRINT("read %zu aggregated samples of evt %s\n", keys.size(), evt->name.c_str());
+    return SUCCESS;
+}
+
+int KUNPENG_PMU::PerfSamplerBpf::Read(EventData &eventData)
+{
+    return SUCCESS;
+}
+
+int KUNPENG_PMU::PerfSamplerBpf::Init(const bool groupEnable, const int groupFd, const int resetOutputFd)
+{
+    int err = this->MapPerfAttr(groupEnable, groupFd);
+    if (err != SUCCESS) {
+        return err;
+    }
+    err = InitBpfObj();
+    if (err != SUCCESS) {
+        close(this->fd);
+        this->fd = -1;
+    }
+    return err;
+}
+
+int KUNPENG_PMU::PerfSamplerBpf::MapPerfAttr(const bool groupEnable, const int groupFd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(struct perf_event_attr);
+    attr.type = this->evt->type;
+    attr.config = this->evt->config;
+    attr.config1 = this->evt->config1;
+    attr.config2 = this->evt->config2;
+    attr.freq = this->evt->useFreq;
+    attr.sample_period = this->evt->period;
+    // Samples are consumed by bpf prog, no ring buffer is mapped.
+    attr.exclude_kernel = this->evt->excludeKernel;
+    attr.exclude_user = this->evt->excludeUser;
+    attr.exclude_guest = this->evt->excludeGuest;
+    attr.exclude_host = this->evt->excludeHost;
+    attr.disabled = 1;
+
+    this->fd = PerfEventOpen(&attr, -1, this->cpu, groupFd, 0);
+    DBG_PRINT("type: %d cpu: %d config: %llx myfd: %d\n", attr.type, cpu, attr.config, this->fd);
+    if (__glibc_unlikely(this->fd < 0)) {
+        return MapErrno(errno);
+    }
+    return SUCCESS;
+}
+
+int KUNPENG_PMU::PerfSamplerBpf::Close()
+{
+    if (this->link != nullptr) {
+        bpf_link__destroy(this->link);
+        this->link = nullptr;
+        auto findObj = sampleObjMap.find(this->evt);
+        if (findObj != sampleObjMap.end() && --findObj->second.refs == 0) {
+            sample_stack_bpf__destroy(findObj->second.obj);
+            sampleObjMap.erase(findObj);
+        }
+    }
+    if (this->fd > 0) {
+        close(this->fd);
+        this->fd = -1;
+    }
+    return SUCCESS;
+}
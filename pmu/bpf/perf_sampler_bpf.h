@@ -0,0 +1,49 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: declaration of class PerfSamplerBpf, which aggregates samples and call stacks in kernel by bpf.
+ ******************************************************************************/
+#ifndef PMU_SAMPLER_BPF_H
+#define PMU_SAMPLER_BPF_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <linux/types.h>
+#include "evt.h"
+#include "pmu_event.h"
+
+struct bpf_link;
+
+namespace KUNPENG_PMU {
+    class PerfSamplerBpf : public PerfEvt {
+    public:
+        using PerfEvt::PerfEvt;
+        ~PerfSamplerBpf()
+        {}
+        int Init(const bool groupEnable, const int groupFd, const int resetOutputFd) override;
+        int Read(EventData &eventData) override;
+        int MapPerfAttr(const bool groupEnable, const int groupFd) override;
+        int Close() override;
+
+        int InitPidForEvent(const std::vector<int>& pids);
+        // Move aggregated samples from bpf map to <eventData>, one PmuData for each (pid, call stack).
+        int ReadBpfSample(EventData &eventData);
+
+    private:
+        int InitBpfObj();
+        const char* GetComm(pid_t pid, const char* bpfComm, EventData &eventData,
+                            std::unordered_map<std::string, const char*> &readComms);
+
+        struct bpf_link* link = nullptr;
+    };
+}  // namespace KUNPENG_PMU
+#endif
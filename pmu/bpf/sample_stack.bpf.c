@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: (GPL-2.0-only OR BSD-2-Clause)
+
+#include <bpf/vmlinux.h>
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_helpers.h>
+#include "sample_stack.h"
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
+
+#define MAX_ENTRIES 102400
+
+// call stacks of samples. key: stack id, value: ips from leaf to root
+struct {
+    __uint(type, BPF_MAP_TYPE_STACK_TRACE);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, SAMPLE_STACK_MAX_DEPTH * sizeof(__u64));
+    __uint(max_entries, MAX_ENTRIES);
+} stacks SEC(".maps");
+
+// aggregated samples. key: (pid, kernel stack id, user stack id), value: sample count and period
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(key_size, sizeof(struct SampleStackKey));
+    __uint(value_size, sizeof(struct SampleStackValue));
+    __uint(max_entries, MAX_ENTRIES);
+} counts SEC(".maps");
+
+// check whether to record samples of a thread. key: tid, value: unused
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u8));
+    __uint(max_entries, MAX_ENTRIES);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} filter SEC(".maps");
+
+const volatile bool filter_pid = false;
+const volatile bool call_stack = true;
+const volatile bool kernel_stack = true;
+const volatile bool user_stack = true;
+
+SEC("perf_event")
+int on_sample(struct bpf_perf_event_data *ctx)
+{
+    __u64 id = bpf_get_current_pid_tgid();
+    __u32 tid = id & 0xffffffff;
+    struct SampleStackKey key = {};
+    struct SampleStackValue *val;
+
+    if (filter_pid && !bpf_map_lookup_elem(&filter, &tid)) {
+        return 0;
+    }
+
+    key.pid = id >> 32;
+    key.kernStackId = -1;
+    key.userStackId = -1;
+    if (call_stack) {
+        if (kernel_stack) {
+            key.kernStackId = bpf_get_stackid(ctx, &stacks, 0);
+        }
+        if (user_stack) {
+            key.userStackId = bpf_get_stackid(ctx, &stacks, BPF_F_USER_STACK);
+        }
+    } else {
+        // top frame only. Kernel stack is empty if the sample is taken in user mode.
+        if (!kernel_stack || bpf_get_stack(ctx, &key.ip, sizeof(key.ip), 0) <= 0) {
+            if (user_stack) {
+                bpf_get_stack(ctx, &key.ip, sizeof(key.ip), BPF_F_USER_STACK);
+            }
+        }
+    }
+
+    val = bpf_map_lookup_elem(&counts, &key);
+    if (!val) {
+        struct SampleStackValue init = {};
+        bpf_get_current_comm(&init.comm, sizeof(init.comm));
+        // another cpu may insert the same key at the same time, so lookup again whatever the result is.
+        bpf_map_update_elem(&counts, &key, &init, BPF_NOEXIST);
+        val = bpf_map_lookup_elem(&counts, &key);
+        if (!val) {
+            // map is full, the sample is dropped.
+            return 0;
+        }
+    }
+    __sync_fetch_and_add(&val->count, 1);
+    __sync_fetch_and_add(&val->period, ctx->sample_period);
+    return 0;
+}
+
+SEC("tp_btf/task_newtask")
+int BPF_PROG(on_newtask, struct task_struct *task, __u64 clone_flags)
+{
+    __u32 new_pid;
+    __u32 parent_pid;
+    __u8 one = 1;
+
+    if (!filter_pid) {
+        return 0;
+    }
+
+    parent_pid = bpf_get_current_pid_tgid() & 0xffffffff;
+    if (!bpf_map_lookup_elem(&filter, &parent_pid)) {
+        return 0;
+    }
+
+    new_pid = task->pid;
+    bpf_map_update_elem(&filter, &new_pid, &one, BPF_NOEXIST);
+    return 0;
+}
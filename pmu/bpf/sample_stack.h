@@ -0,0 +1,36 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: map layouts shared by sample_stack.bpf.c and PerfSamplerBpf.
+ ******************************************************************************/
+#ifndef PMU_SAMPLE_STACK_H
+#define PMU_SAMPLE_STACK_H
+
+#define SAMPLE_STACK_MAX_DEPTH 127
+#define SAMPLE_COMM_LEN 16
+
+// key of aggregated samples.
+// If the whole call stack is collected, ip is 0 and stack ids refer to map <stacks>,
+// otherwise stack ids are -1 and ip is the sampled instruction.
+struct SampleStackKey {
+    __u32 pid;
+    __s32 kernStackId;
+    __s32 userStackId;
+    __u32 reserved;
+    __u64 ip;
+};
+
+struct SampleStackValue {
+    __u64 count;       // number of samples
+    __u64 period;      // sum of sample period
+    char comm[SAMPLE_COMM_LEN];
+};
+
+#endif
@@ -49,8 +49,39 @@ struct {
     __uint(value_size, sizeof(struct bpf_perf_event_value));
 } cgrp_readings SEC(".maps");
 
+// key of cgrp_id_readings
+struct cgrp_evt_key {
+    __u64 cgrp_id;
+    __u32 evt_idx;
+    __u32 reserved;
+};
+
+// aggregated event values for descendants of registered cgroups (per-cpu), only used with include_child.
+// cgroups are discovered here when their tasks are scheduled, without registration from user-space.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(key_size, sizeof(struct cgrp_evt_key));
+    __uint(value_size, sizeof(struct bpf_perf_event_value));
+    __uint(max_entries, MAX_ENTRIES);
+} cgrp_id_readings SEC(".maps");
+
+// cost of trigger_read on each cpu, to measure the overhead of sched_switch.
+struct switch_stat {
+    __u64 count;     // times of trigger_read
+    __u64 ns;        // total time of trigger_read
+    __u64 dropped;   // deltas dropped because cgrp_id_readings is full
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(struct switch_stat));
+    __uint(max_entries, 1);
+} switch_stats SEC(".maps");
+
 const volatile __u32 num_events = 1;
 const volatile __u32 num_cpus = 1;
+const volatile bool include_child = false;
 
 // new kernel cgroup definition
 struct cgroup___new {
@@ -76,14 +107,20 @@ static inline __u64 get_cgroup_ancestor_id(struct cgroup *cgrp, int level)
 		return BPF_CORE_READ(cgrp_old, ancestor_ids[level]);
 	}
 }
-static inline int get_cgroup_idx(__u32 *cgrps, int size)
+// Get index of registered ancestors of current cgroup into <cgrps>.
+// If include_child is set, ids of cgroups below the highest registered ancestor are put into <child_ids>.
+// At most MAX_LEVELS levels are checked to bound the cost of each switch.
+static inline int get_cgroup_idx(__u32 *cgrps, int size, __u64 *child_ids, int *child_cnt)
 {
     struct task_struct *p = (void *)bpf_get_current_task();
     struct cgroup *cgrp;
     __u32 *elem;
     int level;
     int cnt = 0;
+    int child = 0;
+    bool under_root = false;
 
+    *child_cnt = 0;
     cgrp = BPF_CORE_READ(p, cgroups, subsys[perf_event_cgrp_id], cgroup);
     if (!cgrp) {
         return 0;
@@ -96,30 +133,45 @@ static inline int get_cgroup_idx(__u32 *cgrps, int size)
 
         elem = bpf_map_lookup_elem(&cgrp_idx, &cgrp_id);
         if (!elem) {
+            if (include_child && under_root && child < MAX_LEVELS) {
+                child_ids[child] = cgrp_id;
+                child++;
+            }
             continue;
         }
+        under_root = true;
 
-        cgrps[cnt++] = *elem;
-        if (cnt == size) {
-            break;
+        if (cnt < size) {
+            cgrps[cnt++] = *elem;
         }
     }
 
+    *child_cnt = child;
     return cnt;
 }
 
-static int bperf_cgroup_count(void)
+static inline void add_value(struct bpf_perf_event_value *dst, struct bpf_perf_event_value *delta)
+{
+    dst->counter += delta->counter;
+    dst->enabled += delta->enabled;
+    dst->running += delta->running;
+}
+
+static int bperf_cgroup_count(struct switch_stat *stat)
 {
     register __u32 idx = 0;  // to have it in a register to pass BPF verifier
     register int c = 0;
     struct bpf_perf_event_value val, delta, *prev_val, *cgrp_val;
     __u32 cpu = bpf_get_smp_processor_id();
     __u32 cgrp_idx[MAX_LEVELS];
+    __u64 child_ids[MAX_LEVELS];
+    struct cgrp_evt_key child_key = {};
     int cgrp_cnt;
+    int child_cnt;
     __u32 key, cgrp;
     long err;
 
-    cgrp_cnt = get_cgroup_idx(cgrp_idx, MAX_LEVELS);
+    cgrp_cnt = get_cgroup_idx(cgrp_idx, MAX_LEVELS, child_ids, &child_cnt);
 
     for (; idx < MAX_EVENTS; idx++) {
         if (idx == num_events)
@@ -143,14 +195,12 @@ static int bperf_cgroup_count(void)
         key = idx * num_cpus + cpu;
         err = bpf_perf_event_read_value(&events, key, &val, sizeof(val));
         if (err) {
-            bpf_printk("bpf_perf_event_read_value failed, continue");
             continue;
         }
 
         delta.counter = val.counter - prev_val->counter;
         delta.enabled = val.enabled - prev_val->enabled;
         delta.running = val.running - prev_val->running;
-        bpf_printk("prev_val : %ld val : %ld delta : %ld \n", prev_val->counter, val.counter, delta.counter);
 
         for (c = 0; c < MAX_LEVELS; c++) {
             if (c == cgrp_cnt)
@@ -161,15 +211,32 @@ static int bperf_cgroup_count(void)
             key = cgrp * num_events + idx;
             cgrp_val = bpf_map_lookup_elem(&cgrp_readings, &key);
             if (cgrp_val) {
-                cgrp_val->counter += delta.counter;
-                cgrp_val->enabled += delta.enabled;
-                cgrp_val->running += delta.running;
-                bpf_printk("cgrp_val : %ld\n", cgrp_val->counter);
+                add_value(cgrp_val, &delta);
             } else {
                 bpf_map_update_elem(&cgrp_readings, &key, &delta, BPF_ANY);
             }
         }
 
+        // roll up to every descendant level of the registered cgroup, so each cgroup has the sum of its subtree.
+        child_key.evt_idx = idx;
+        for (c = 0; c < MAX_LEVELS; c++) {
+            if (c == child_cnt)
+                break;
+            child_key.cgrp_id = child_ids[c];
+            cgrp_val = bpf_map_lookup_elem(&cgrp_id_readings, &child_key);
+            if (cgrp_val) {
+                add_value(cgrp_val, &delta);
+            } else if (bpf_map_update_elem(&cgrp_id_readings, &child_key, &delta, BPF_NOEXIST)) {
+                // the entry may be created by another cpu just now, otherwise the map is full.
+                cgrp_val = bpf_map_lookup_elem(&cgrp_id_readings, &child_key);
+                if (cgrp_val) {
+                    add_value(cgrp_val, &delta);
+                } else if (stat) {
+                    stat->dropped++;
+                }
+            }
+        }
+
         *prev_val = val;
     }
     return 0;
@@ -178,5 +245,14 @@ static int bperf_cgroup_count(void)
 SEC("raw_tp/sched_switch")
 int BPF_PROG(trigger_read)
 {
-    return bperf_cgroup_count();
+    __u32 zero = 0;
+    struct switch_stat *stat = bpf_map_lookup_elem(&switch_stats, &zero);
+    __u64 start = bpf_ktime_get_ns();
+
+    bperf_cgroup_count(stat);
+    if (stat) {
+        stat->count++;
+        stat->ns += bpf_ktime_get_ns() - start;
+    }
+    return 0;
 }
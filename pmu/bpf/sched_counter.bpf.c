@@ -35,6 +35,15 @@ struct {
     __uint(max_entries, 1024);
 } accum_readings SEC(".maps");
 
+// whether a task to be recorded is running on this cpu. value: 1 if yes, otherwise 0.
+// Reader only needs to trigger on_switch on these cpus to flush the pmu count of running tasks.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u64));
+    __uint(max_entries, 1);
+} oncpu SEC(".maps");
+
 // check whether to record pmu value. key: pid, value: accum_key
 struct {
     __uint(type, BPF_MAP_TYPE_HASH);
@@ -44,31 +53,49 @@ struct {
     __uint(map_flags, BPF_F_NO_PREALLOC);
 } filter SEC(".maps");
 
+static inline void update_oncpu(struct task_struct *next)
+{
+    __u32 zero = 0;
+    __u32 next_pid;
+    __u64 *running;
+
+    // next is null if on_switch is triggered by reader.
+    if (!next) {
+        return;
+    }
+    running = bpf_map_lookup_elem(&oncpu, &zero);
+    if (!running) {
+        return;
+    }
+    next_pid = BPF_CORE_READ(next, pid);
+    *running = bpf_map_lookup_elem(&filter, &next_pid) ? 1 : 0;
+}
+
 SEC("raw_tp/sched_switch")
-int BPF_PROG(on_switch)
+int BPF_PROG(on_switch, bool preempt, struct task_struct *prev, struct task_struct *next)
 {
     __u32 pid;
     __u32 zero=0;
     __u32 *accum_key;
-    __u32 cpu = bpf_get_smp_processor_id();
     long err;
     struct bpf_perf_event_value cur_val, *prev_val, *accum_val;
 
+    update_oncpu(next);
     prev_val = bpf_map_lookup_elem(&prev_readings, &zero);
     if (!prev_val) {
-        bpf_printk("failed to bpf_map_lookup_elem prev_readings.\n");
         return 0;
     }
 
     // get pmu value by API of bpf
     err = bpf_perf_event_read_value(&events, BPF_F_CURRENT_CPU, &cur_val, sizeof(struct bpf_perf_event_value));
     if (err) {
-         bpf_printk("failed to bpf_event_read_value: %d cpu %d\n", err, cpu);
         return 0;
     }
     pid = bpf_get_current_pid_tgid() & 0xffffffff;
     accum_key = bpf_map_lookup_elem(&filter, &pid);
     if (!accum_key) {
+        // count of untracked task must not be accumulated to the next tracked task.
+        *prev_val = cur_val;
         return 0;
     }
 
@@ -81,8 +108,6 @@ int BPF_PROG(on_switch)
     accum_val->counter += cur_val.counter - prev_val->counter;
     accum_val->enabled += cur_val.enabled - prev_val->enabled;
     accum_val->running += cur_val.running - prev_val->running;
-    bpf_printk("cur_val counting: %ld prev_val counting: %ld accum_val counting: %ld\n", 
-                cur_val.counter, prev_val->counter, accum_val->counter);
 
     *prev_val = cur_val;
     return 0;
@@ -106,6 +131,5 @@ int BPF_PROG(on_newtask, struct task_struct *task, __u64 clone_flags)
     }
 
     bpf_map_update_elem(&filter, &new_pid, accum_key, BPF_NOEXIST);
-    bpf_printk("new pid: %d parent: %d accum_key: %ld\n", new_pid, parent_pid, *accum_key);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,331 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: aggregate branch records into branches and fall-through ranges of binaries for AutoFDO and BOLT.
+ ******************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "symbol.h"
+#include "symbol_resolve.h"
+#include "pcerr.h"
+#include "handle_registry.h"
+#include "branch_profile.h"
+
+using namespace std;
+using namespace pcerr;
+using namespace KUNPENG_PMU;
+
+static constexpr unsigned DEFAULT_MAX_ENTRIES = 1 << 18;
+// Entries are pruned to this ratio of max entries, so that pruning is not triggered by every sample.
+static constexpr double PRUNE_RATIO = 0.75;
+// A fall-through range longer than it is regarded as broken records, such as records across an interrupt.
+static constexpr unsigned long MAX_RANGE_BYTES = 1 << 20;
+static constexpr size_t MAX_MODULE_CACHE = 4096;
+static const char *UNKNOWN_SYMBOL = "[unknown]";
+
+static HandleRegistry<BranchProfile> profiles;
+
+BranchProfile::BranchProfile(const PmuBranchProfileAttr &attr)
+{
+    maxEntries = attr.maxEntries == 0 ? DEFAULT_MAX_ENTRIES : attr.maxEntries;
+}
+
+unsigned BranchProfile::GetModuleId(const string &key, const string &name, const string &path)
+{
+    const string &idKey = key.empty() ? path : key;
+    auto findId = moduleIds.find(idKey);
+    if (findId != moduleIds.end()) {
+        return findId->second;
+    }
+    unsigned id = modules.size();
+    modules.push_back({name, path});
+    moduleIds[idKey] = id;
+    return id;
+}
+
+bool BranchProfile::FindModule(const string &module, unsigned &id) const
+{
+    // Binaries in containers are matched by path including mount point, or by name if it is not ambiguous.
+    // If a binary at the same path is rebuilt during profiling, the newest build is taken.
+    bool found = false;
+    for (unsigned i = 0; i < modules.size(); ++i) {
+        if (modules[i].path == module) {
+            id = i;
+            found = true;
+        }
+    }
+    if (found) {
+        return true;
+    }
+    for (unsigned i = 0; i < modules.size(); ++i) {
+        if (modules[i].name != module) {
+            continue;
+        }
+        if (found && modules[id].path != modules[i].path) {
+            return false;
+        }
+        id = i;
+        found = true;
+    }
+    return found;
+}
+
+bool BranchProfile::MapAddr(int pid, unsigned long addr, unsigned &moduleId, unsigned long &elfAddr)
+{
+    auto module = KUNPENG_SYM::SymbolResolve::GetInstance()->MapModuleAddr(pid, addr, elfAddr);
+    if (!module) {
+        return false;
+    }
+    auto findModule = moduleCache.find(module);
+    if (findModule != moduleCache.end()) {
+        moduleId = findModule->second;
+        return true;
+    }
+    // Maps of exited processes are held by the cache, so it is rebuilt once it is too large.
+    if (moduleCache.size() >= MAX_MODULE_CACHE) {
+        moduleCache.clear();
+    }
+    string mntPoint = KUNPENG_SYM::SymbolResolve::GetInstance()->ModuleMntPoint(*module);
+    string path = mntPoint.empty() ? module->moduleName : mntPoint + "/" + module->moduleName;
+    moduleId = GetModuleId(module->moduleKey, module->moduleName, path);
+    moduleCache[module] = moduleId;
+    return true;
+}
+
+string BranchProfile::MapSymbol(const string &modulePath, unsigned long elfAddr, unsigned long &offset)
+{
+    Symbol *symbol = SymResolverMapCodeAddr(modulePath.c_str(), elfAddr);
+    if (symbol == nullptr) {
+        return "";
+    }
+    string name;
+    // BOLT matches functions by linkage name.
+    const char *symName = symbol->mangleName != nullptr ? symbol->mangleName : symbol->symbolName;
+    if (symName != nullptr && strcmp(symName, "UNKNOWN") != 0) {
+        name = symName;
+        offset = symbol->offset;
+    }
+    FreeSymbolPtr(symbol);
+    return name;
+}
+
+void BranchProfile::AddRecords(int pid, const BranchSampleRecord *records, unsigned long nr)
+{
+    bool hasNewer = false;
+    unsigned newerModule = 0;
+    unsigned long newerFrom = 0;
+    for (unsigned long i = 0; i < nr; ++i) {
+        unsigned fromModule = 0;
+        unsigned toModule = 0;
+        unsigned long from = 0;
+        unsigned long to = 0;
+        bool fromValid = MapAddr(pid, records[i].fromAddr, fromModule, from);
+        bool toValid = MapAddr(pid, records[i].toAddr, toModule, to);
+        if (fromValid && toValid && fromModule == toModule) {
+            auto &branch = branches[{fromModule, from, to}];
+            branch.count++;
+            branch.mispreds += records[i].misPred;
+        }
+        // Instructions from the target of this branch to the source of the newer branch are executed in sequence.
+        if (hasNewer && toValid && toModule == newerModule && to <= newerFrom && newerFrom - to < MAX_RANGE_BYTES) {
+            ranges[{toModule, to, newerFrom}]++;
+        }
+        hasNewer = fromValid;
+        newerModule = fromModule;
+        newerFrom = from;
+    }
+}
+
+void BranchProfile::Prune()
+{
+    size_t target = static_cast<size_t>(maxEntries * PRUNE_RATIO);
+    while (branches.size() + ranges.size() > target) {
+        for (auto iter = branches.begin(); iter != branches.end();) {
+            iter->second.count >>= 1;
+            iter->second.mispreds >>= 1;
+            iter = iter->second.count == 0 ? branches.erase(iter) : next(iter);
+        }
+        for (auto iter = ranges.begin(); iter != ranges.end();) {
+            iter->second >>= 1;
+            iter = iter->second == 0 ? ranges.erase(iter) : next(iter);
+        }
+    }
+}
+
+void BranchProfile::Add(const PmuData *data, unsigned len)
+{
+    lock_guard<mutex> lg(mtx);
+    for (unsigned i = 0; i < len; ++i) {
+        if (data[i].ext == nullptr || data[i].ext->branchRecords == nullptr) {
+            continue;
+        }
+        AddRecords(data[i].pid, data[i].ext->branchRecords, data[i].ext->nr);
+        if (branches.size() + ranges.size() > maxEntries) {
+            Prune();
+        }
+    }
+}
+
+void BranchProfile::WriteAutoFdo(unsigned module, ostream &out)
+{
+    // Entries are sorted by address, so profiles of the same binary are easy to compare.
+    vector<pair<EdgeKey, uint64_t>> moduleRanges;
+    for (auto &range : ranges) {
+        if (range.first.module == module) {
+            moduleRanges.emplace_back(range.first, range.second);
+        }
+    }
+    vector<pair<EdgeKey, uint64_t>> moduleBranches;
+    for (auto &branch : branches) {
+        if (branch.first.module == module) {
+            moduleBranches.emplace_back(branch.first, branch.second.count);
+        }
+    }
+    auto byAddr = [](const pair<EdgeKey, uint64_t> &a, const pair<EdgeKey, uint64_t> &b) {
+        return a.first.from != b.first.from ? a.first.from < b.first.from : a.first.to < b.first.to;
+    };
+    std::sort(moduleRanges.begin(), moduleRanges.end(), byAddr);
+    std::sort(moduleBranches.begin(), moduleBranches.end(), byAddr);
+
+    // Sections of ranges, addresses and branches. Addresses are not sampled, so that section is empty.
+    out << moduleRanges.size() << '\n';
+    for (auto &range : moduleRanges) {
+        out << hex << range.first.from << '-' << range.first.to << ':' << dec << range.second << '\n';
+    }
+    out << 0 << '\n';
+    out << moduleBranches.size() << '\n';
+    for (auto &branch : moduleBranches) {
+        out << hex << branch.first.from << "->" << branch.first.to << ':' << dec << branch.second << '\n';
+    }
+}
+
+void BranchProfile::WriteBolt(unsigned module, ostream &out)
+{
+    struct Location {
+        string name;
+        unsigned long offset;
+    };
+    unordered_map<unsigned long, Location> locations;
+    auto getLocation = [&](unsigned long elfAddr) -> const Location & {
+        auto findLoc = locations.find(elfAddr);
+        if (findLoc != locations.end()) {
+            return findLoc->second;
+        }
+        Location loc;
+        loc.offset = 0;
+        loc.name = MapSymbol(modules[module].path, elfAddr, loc.offset);
+        if (loc.name.empty()) {
+            loc.offset = elfAddr;
+        }
+        return locations.emplace(elfAddr, move(loc)).first->second;
+    };
+    auto writeLocation = [&out](const Location &loc) {
+        if (loc.name.empty()) {
+            out << 0 << ' ' << UNKNOWN_SYMBOL << ' ';
+        } else {
+            out << 1 << ' ' << loc.name << ' ';
+        }
+        out << hex << loc.offset << dec << ' ';
+    };
+
+    vector<pair<EdgeKey, BranchCount>> moduleBranches;
+    for (auto &branch : branches) {
+        if (branch.first.module == module) {
+            moduleBranches.emplace_back(branch.first, branch.second);
+        }
+    }
+    std::sort(moduleBranches.begin(), moduleBranches.end(),
+         [](const pair<EdgeKey, BranchCount> &a, const pair<EdgeKey, BranchCount> &b) {
+             return a.second.count != b.second.count ? a.second.count > b.second.count :
+                    (a.first.from != b.first.from ? a.first.from < b.first.from : a.first.to < b.first.to);
+         });
+    // <is symbol> <function> <offset> <is symbol> <function> <offset> <mispredicts> <count>
+    for (auto &branch : moduleBranches) {
+        writeLocation(getLocation(branch.first.from));
+        writeLocation(getLocation(branch.first.to));
+        out << branch.second.mispreds << ' ' << branch.second.count << '\n';
+    }
+}
+
+bool BranchProfile::HasModule(const string &module)
+{
+    lock_guard<mutex> lg(mtx);
+    unsigned id = 0;
+    return FindModule(module, id);
+}
+
+bool BranchProfile::Write(const string &module, PmuBranchProfileFormat format, ostream &out)
+{
+    lock_guard<mutex> lg(mtx);
+    unsigned id = 0;
+    if (!FindModule(module, id)) {
+        return false;
+    }
+    if (format == PMU_PROFILE_BOLT) {
+        WriteBolt(id, out);
+    } else {
+        WriteAutoFdo(id, out);
+    }
+    return true;
+}
+
+PmuBranchProfile PmuBranchProfileOpen(struct PmuBranchProfileAttr *attr)
+{
+    if (attr == nullptr) {
+        New(LIBPERF_ERR_NULL_POINTER, "PmuBranchProfileAttr cannot be null");
+        return NULL;
+    }
+    return profiles.Open(*attr);
+}
+
+int PmuBranchProfileAdd(PmuBranchProfile profile, struct PmuData *data, unsigned len)
+{
+    return profiles.Call(profile, LIBPERF_ERR_INVALID_BRANCH_PROFILE, [&](BranchProfile &branchProfile) {
+        if (data == nullptr && len > 0) {
+            New(LIBPERF_ERR_NULL_POINTER, "PmuData cannot be null");
+            return LIBPERF_ERR_NULL_POINTER;
+        }
+        branchProfile.Add(data, len);
+        return SUCCESS;
+    });
+}
+
+int PmuBranchProfileWrite(PmuBranchProfile profile, const char *module,
+                          enum PmuBranchProfileFormat format, const char *path)
+{
+    return profiles.Call(profile, LIBPERF_ERR_INVALID_BRANCH_PROFILE, [&](BranchProfile &branchProfile) {
+        if (module == nullptr || path == nullptr) {
+            New(LIBPERF_ERR_NULL_POINTER, "module and path cannot be null");
+            return LIBPERF_ERR_NULL_POINTER;
+        }
+        if (format != PMU_PROFILE_AUTOFDO && format != PMU_PROFILE_BOLT) {
+            New(LIBPERF_ERR_INVALID_FIELD_ARGS, "invalid branch profile format");
+            return LIBPERF_ERR_INVALID_FIELD_ARGS;
+        }
+        if (!branchProfile.HasModule(module)) {
+            New(LIBPERF_ERR_BRANCH_PROFILE_NO_MODULE, "no branch of " + string(module) +
+                " is in profile, or binaries at several paths are named so, which are written by path");
+            return LIBPERF_ERR_BRANCH_PROFILE_NO_MODULE;
+        }
+        ofstream out(path);
+        if (!out.is_open()) {
+            New(LIBPERF_ERR_OPEN_INVALID_FILE, "failed to open " + string(path));
+            return LIBPERF_ERR_OPEN_INVALID_FILE;
+        }
+        branchProfile.Write(module, format, out);
+        return SUCCESS;
+    });
+}
+
+void PmuBranchProfileClose(PmuBranchProfile profile)
+{
+    profiles.Close(profile);
+}
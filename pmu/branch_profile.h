@@ -0,0 +1,114 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: aggregate branch records into branches and fall-through ranges of binaries for AutoFDO and BOLT.
+ ******************************************************************************/
+#ifndef BRANCH_PROFILE_H
+#define BRANCH_PROFILE_H
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "pmu.h"
+
+namespace KUNPENG_SYM {
+    struct ModuleMap;
+}
+
+namespace KUNPENG_PMU {
+    /**
+     * Branch records of a sample are ordered from the newest to the oldest, so instructions between target of
+     * a record and source of the newer record are executed in sequence, which is a fall-through range.
+     * Addresses are keyed by binary and address in elf file, so profiles of processes running the same binary
+     * are merged. To keep memory bounded, once entries exceed the limit, all counts are halved and entries
+     * whose count becomes zero are dropped, which keeps hot branches and ages the cold ones.
+     */
+    class BranchProfile {
+    public:
+        explicit BranchProfile(const PmuBranchProfileAttr &attr);
+        virtual ~BranchProfile() = default;
+
+        void Add(const PmuData *data, unsigned len);
+
+        bool HasModule(const std::string &module);
+
+        /**
+         * @brief Write profile of a binary. Return false if there is no branch of the binary.
+         */
+        bool Write(const std::string &module, PmuBranchProfileFormat format, std::ostream &out);
+
+    protected:
+        /**
+         * @brief Map address of a process to id of binary and address in elf file.
+         */
+        virtual bool MapAddr(int pid, unsigned long addr, unsigned &moduleId, unsigned long &elfAddr);
+
+        /**
+         * @brief Get function of an elf address and offset from the start of function, empty if it is unknown.
+         */
+        virtual std::string MapSymbol(const std::string &modulePath, unsigned long elfAddr, unsigned long &offset);
+
+        /**
+         * @brief Get id of a binary by its identity <key>, such as build-id, so different builds of a binary
+         * are not merged. <key> falls back to <path> if it is empty.
+         */
+        unsigned GetModuleId(const std::string &key, const std::string &name, const std::string &path);
+
+    private:
+        struct EdgeKey {
+            unsigned module;
+            unsigned long from;
+            unsigned long to;
+
+            bool operator==(const EdgeKey &other) const
+            {
+                return module == other.module && from == other.from && to == other.to;
+            }
+        };
+
+        struct EdgeKeyHash {
+            size_t operator()(const EdgeKey &key) const
+            {
+                return std::hash<unsigned long>()(key.from) ^ (std::hash<unsigned long>()(key.to) << 1) ^
+                       (static_cast<size_t>(key.module) << 48);
+            }
+        };
+
+        struct BranchCount {
+            uint64_t count = 0;
+            uint64_t mispreds = 0;
+        };
+
+        struct Module {
+            std::string name;
+            // Path to open elf file, which is different from name for binaries in containers.
+            std::string path;
+        };
+
+        bool FindModule(const std::string &module, unsigned &id) const;
+        void AddRecords(int pid, const BranchSampleRecord *records, unsigned long nr);
+        void Prune();
+        void WriteAutoFdo(unsigned module, std::ostream &out);
+        void WriteBolt(unsigned module, std::ostream &out);
+
+        size_t maxEntries = 0;
+        std::mutex mtx;
+        std::vector<Module> modules;
+        // key: identity of binary
+        std::unordered_map<std::string, unsigned> moduleIds;
+        std::unordered_map<std::shared_ptr<KUNPENG_SYM::ModuleMap>, unsigned> moduleCache;
+        std::unordered_map<EdgeKey, BranchCount, EdgeKeyHash> branches;
+        // Key of range is the begin and end address, both are included.
+        std::unordered_map<EdgeKey, uint64_t, EdgeKeyHash> ranges;
+    };
+}   // namespace KUNPENG_PMU
+#endif
@@ -0,0 +1,521 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: detect false sharing and true sharing of cache lines from load and store samples.
+ ******************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <sys/uio.h>
+#include "symbol.h"
+#include "pcerr.h"
+#include "handle_registry.h"
+#include "task_runner.h"
+#include "contention.h"
+
+using namespace std;
+using namespace pcerr;
+using namespace KUNPENG_PMU;
+
+static constexpr unsigned DEFAULT_WINDOW_MS = 5;
+static constexpr unsigned DEFAULT_CACHE_LINE_SIZE = 64;
+static constexpr unsigned MAX_CACHE_LINE_SIZE = 64;
+static constexpr unsigned DEFAULT_MIN_CONFLICT_WINDOWS = 2;
+static constexpr unsigned DEFAULT_SHARDS = 8;
+static constexpr unsigned MAX_SHARDS = 256;
+static constexpr uint64_t NS_PER_MS = 1000 * 1000;
+// A worker thread is worth spawning only for enough samples.
+static constexpr size_t MIN_SAMPLES_PER_WORKER = 4096;
+
+static HandleRegistry<ContentionDetector> detectors;
+
+static inline bool IsPowerOf2(unsigned long value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static inline bool IsHitm(unsigned short source)
+{
+    return source == HIP_PEER_CPU_HITM || source == HIP_L3_HITM || source == HIP_L2_HITM ||
+           source == HIP_PEER_CLUSTER_HITM || source == HIP_REMOTE_SOCKET_HITM;
+}
+
+// Bit i is set if byte i of cache line is accessed.
+static inline uint64_t MakeByteMask(unsigned long va, unsigned long lineSize, int accessBytes)
+{
+    unsigned long begin = va & (lineSize - 1);
+    unsigned long width = min(static_cast<unsigned long>(max(accessBytes, 1)), lineSize - begin);
+    return width >= 64 ? ~0ULL : ((1ULL << width) - 1) << begin;
+}
+
+// Get access width of an aarch64 load or store instruction, 0 if unknown.
+static int DecodeAccessBytes(uint32_t insn)
+{
+    bool simd = ((insn >> 26) & 0x1) != 0;
+    uint32_t opc = (insn >> 30) & 0x3;
+    // Load or store pair.
+    if ((insn & 0x3A000000) == 0x28000000) {
+        if (!simd) {
+            return (4 << ((opc >> 1) & 0x1)) * 2;
+        }
+        return opc == 3 ? 0 : (4 << opc) * 2;
+    }
+    if (simd) {
+        return 16;
+    }
+    return 1 << opc;
+}
+
+static int ReadAccessBytes(int pid, unsigned long pc)
+{
+    uint32_t insn = 0;
+    iovec local{&insn, sizeof(insn)};
+    iovec remote{reinterpret_cast<void *>(pc), sizeof(insn)};
+    if (pid <= 0 || pc == 0 || process_vm_readv(pid, &local, 1, &remote, 1, 0) != sizeof(insn)) {
+        return 0;
+    }
+    return DecodeAccessBytes(insn);
+}
+
+static char *CopyString(const string &str)
+{
+    if (str.empty()) {
+        return nullptr;
+    }
+    char *copy = new char[str.size() + 1];
+    memcpy(copy, str.c_str(), str.size() + 1);
+    return copy;
+}
+
+// Keep up to 2 distinct values, which is enough to tell whether accesses come from different threads or cpus.
+struct Distinct2 {
+    int v1 = numeric_limits<int>::min();
+    int v2 = numeric_limits<int>::min();
+
+    void Add(int v)
+    {
+        if (v1 == numeric_limits<int>::min()) {
+            v1 = v;
+        } else if (v != v1 && v2 == numeric_limits<int>::min()) {
+            v2 = v;
+        }
+    }
+
+    bool HasAtLeast2() const
+    {
+        return v2 != numeric_limits<int>::min();
+    }
+};
+
+ContentionDetector::ContentionDetector(const PmuContentionAttr &attr)
+{
+    windowNs = (attr.windowMs == 0 ? DEFAULT_WINDOW_MS : attr.windowMs) * NS_PER_MS;
+    lineMask = ~(static_cast<unsigned long>(attr.cacheLineSize == 0 ? DEFAULT_CACHE_LINE_SIZE : attr.cacheLineSize) - 1);
+    minConflictWindows = attr.minConflictWindows == 0 ? DEFAULT_MIN_CONFLICT_WINDOWS : attr.minConflictWindows;
+    topN = attr.topN;
+    topParticipants = attr.topParticipants;
+    decodeAccessWidth = attr.decodeAccessWidth;
+    shards.resize(attr.shards == 0 ? DEFAULT_SHARDS : attr.shards);
+}
+
+const ContentionDetector::PcInfo &ContentionDetector::GetPcInfo(const PmuData &data, unsigned long pc, bool atomic)
+{
+    auto findPc = pcInfos.find({data.pid, pc});
+    if (findPc != pcInfos.end()) {
+        return findPc->second;
+    }
+    PcInfo pcInfo;
+    Symbol *symbol = data.stack->symbol;
+    if (symbol->symbolName != nullptr) {
+        pcInfo.symbolName = symbol->symbolName;
+    }
+    if (symbol->module != nullptr) {
+        pcInfo.module = symbol->module;
+    }
+    pcInfo.offset = symbol->offset;
+    pcInfo.accessBytes = decodeAccessWidth ? ReadAccessBytes(data.pid, pc) : 0;
+    if (pcInfo.accessBytes == 0) {
+        pcInfo.accessBytes = atomic ? sizeof(uint64_t) : sizeof(uint32_t);
+    }
+    return pcInfos.emplace(AddrKey{data.pid, pc}, move(pcInfo)).first->second;
+}
+
+void ContentionDetector::Add(const PmuData *data, unsigned len)
+{
+    lock_guard<mutex> lg(mtx);
+    unsigned long lineSize = ~lineMask + 1;
+    uint64_t newestWindow = 0;
+    size_t added = 0;
+    for (unsigned i = 0; i < len; ++i) {
+        const PmuDataExt *ext = data[i].ext;
+        if (ext == nullptr || ext->va == 0 || data[i].stack == nullptr || data[i].stack->symbol == nullptr) {
+            continue;
+        }
+        bool atomic = (ext->op & SPE_OP_ATOMIC) != 0;
+        bool load = (ext->op & SPE_OP_LD) != 0 || atomic;
+        bool store = (ext->op & SPE_OP_ST) != 0 || atomic;
+        if (!load && !store) {
+            continue;
+        }
+        unsigned long pc = data[i].stack->symbol->addr;
+        const PcInfo &pcInfo = GetPcInfo(data[i], pc, atomic);
+
+        Sample sample;
+        sample.line = {data[i].pid, ext->va & lineMask};
+        sample.window = data[i].ts > 0 ? static_cast<uint64_t>(data[i].ts) / windowNs : 0;
+        sample.access = {data[i].cpu, data[i].tid, pc, MakeByteMask(ext->va, lineSize, pcInfo.accessBytes)};
+        sample.va = ext->va;
+        sample.load = load;
+        sample.store = store;
+        sample.hitm = IsHitm(ext->source);
+        sample.hazard = (ext->event & (SPE_FORWARD_HAZARD | SPE_STRUCTURE_HAZARD)) != 0;
+        // Adjacent lines are spread over shards, so that a hot array is aggregated by all workers.
+        auto &shard = shards[((sample.line.addr / lineSize) ^ static_cast<unsigned long>(sample.line.pid)) %
+                             shards.size()];
+        shard.samples.push_back(sample);
+        added++;
+        newestWindow = max(newestWindow, sample.window);
+
+        if (samples == 0 || data[i].ts < beginTs) {
+            beginTs = data[i].ts;
+        }
+        endTs = max(endTs, data[i].ts);
+        samples++;
+    }
+
+    // Samples of cpus are read at the same time, so the newest window may be still filling.
+    // Windows before it are complete and scored now, which bounds memory for continuous detection.
+    size_t maxWorkers = min(shards.size(), added / MIN_SAMPLES_PER_WORKER + 1);
+    RunParallelTasks(shards.size(), maxWorkers, 1, [this, newestWindow](size_t i) {
+        AddToShard(shards[i]);
+        CloseWindows(shards[i], newestWindow);
+    });
+}
+
+void ContentionDetector::AddToShard(Shard &shard)
+{
+    for (auto &sample : shard.samples) {
+        auto &lineState = shard.lines[sample.line];
+        auto findWindow = lineState.windows.find(sample.window);
+        if (findWindow == lineState.windows.end()) {
+            findWindow = lineState.windows.emplace(sample.window, WindowBuckets()).first;
+            shard.openWindows[sample.window].push_back(sample.line);
+        }
+        auto &bucket = findWindow->second[sample.access];
+        if (bucket.va == 0) {
+            bucket.va = sample.va;
+        }
+        if (sample.load) {
+            bucket.loads++;
+            bucket.hitmLoads += sample.hitm ? 1 : 0;
+            bucket.hazardLoads += sample.hazard ? 1 : 0;
+        }
+        bucket.stores += sample.store ? 1 : 0;
+
+        if (lineState.firstCpu == -1) {
+            lineState.firstCpu = sample.access.cpu;
+        } else if (lineState.firstCpu != sample.access.cpu) {
+            lineState.crossCpu = true;
+        }
+    }
+    shard.samples.clear();
+}
+
+void ContentionDetector::CloseWindows(Shard &shard, uint64_t endWindow)
+{
+    auto windowEnd = shard.openWindows.lower_bound(endWindow);
+    for (auto window = shard.openWindows.begin(); window != windowEnd; ++window) {
+        for (auto &line : window->second) {
+            auto findLine = shard.lines.find(line);
+            if (findLine == shard.lines.end()) {
+                continue;
+            }
+            auto &lineState = findLine->second;
+            auto findWindow = lineState.windows.find(window->first);
+            if (findWindow == lineState.windows.end()) {
+                continue;
+            }
+            ScoreWindow(lineState, findWindow->second);
+            lineState.windows.erase(findWindow);
+            // Lines without contention are dropped as soon as they are idle.
+            if (lineState.windows.empty() && lineState.issues[PMU_FALSE_SHARING].conflictWindows == 0 &&
+                lineState.issues[PMU_TRUE_SHARING].conflictWindows == 0) {
+                shard.lines.erase(findLine);
+            }
+        }
+    }
+    shard.openWindows.erase(shard.openWindows.begin(), windowEnd);
+}
+
+void ContentionDetector::ScoreWindow(LineState &lineState, const WindowBuckets &buckets)
+{
+    using Access = WindowBuckets::value_type;
+    vector<const Access *> stores;
+    vector<const Access *> loads;
+    Distinct2 tids;
+    Distinct2 cpus;
+    for (auto &access : buckets) {
+        tids.Add(access.first.tid);
+        cpus.Add(access.first.cpu);
+        if (access.second.stores > 0) {
+            stores.push_back(&access);
+        }
+        if (access.second.loads > 0) {
+            loads.push_back(&access);
+        }
+    }
+    if (stores.empty() || !tids.HasAtLeast2()) {
+        return;
+    }
+
+    vector<const Access *> conflicts;
+    for (int kind = PMU_FALSE_SHARING; kind <= PMU_TRUE_SHARING; ++kind) {
+        bool falseSharing = kind == PMU_FALSE_SHARING;
+        // False sharing needs the line to bounce between caches of different cpus.
+        if (falseSharing && !cpus.HasAtLeast2() && !lineState.crossCpu) {
+            continue;
+        }
+        auto conflicting = [&](const Access *a, const Access *b) {
+            if (a->first.tid == b->first.tid) {
+                return false;
+            }
+            if (falseSharing && a->first.cpu == b->first.cpu && !lineState.crossCpu) {
+                return false;
+            }
+            bool overlap = (a->first.mask & b->first.mask) != 0;
+            return falseSharing ? !overlap : overlap;
+        };
+
+        uint64_t bestScore = 0;
+        uint64_t bestEvidence = 0;
+        conflicts.clear();
+        for (size_t i = 0; i < stores.size(); ++i) {
+            for (size_t j = i + 1; j < stores.size(); ++j) {
+                if (!conflicting(stores[i], stores[j])) {
+                    continue;
+                }
+                uint64_t score = min(stores[i]->second.stores, stores[j]->second.stores);
+                bestScore = max(bestScore, score);
+                conflicts.push_back(stores[i]);
+                conflicts.push_back(stores[j]);
+            }
+            for (auto load : loads) {
+                if (!conflicting(stores[i], load)) {
+                    continue;
+                }
+                uint64_t score = min(stores[i]->second.stores, load->second.loads);
+                // Loads hitting modified lines or hazards confirm that the line is contended.
+                uint64_t evidence = min<uint64_t>(score, load->second.hazardLoads) +
+                                    min<uint64_t>(score, load->second.hitmLoads);
+                if (score > bestScore || (score == bestScore && evidence > bestEvidence)) {
+                    bestScore = score;
+                    bestEvidence = evidence;
+                }
+                conflicts.push_back(stores[i]);
+                conflicts.push_back(load);
+            }
+        }
+        if (bestScore == 0) {
+            continue;
+        }
+
+        auto &issue = lineState.issues[kind];
+        issue.score += bestScore;
+        issue.evidence += bestEvidence;
+        issue.conflictWindows++;
+        sort(conflicts.begin(), conflicts.end());
+        conflicts.erase(unique(conflicts.begin(), conflicts.end()), conflicts.end());
+        for (auto access : conflicts) {
+            auto findParticipant = issue.participants.find({access->first.tid, access->first.pc});
+            if (findParticipant == issue.participants.end()) {
+                PmuContentionParticipant participant = {0};
+                participant.tid = access->first.tid;
+                participant.pc = access->first.pc;
+                participant.va = access->second.va;
+                findParticipant = issue.participants.emplace(
+                    ParticipantKey{access->first.tid, access->first.pc}, participant).first;
+            }
+            auto &participant = findParticipant->second;
+            participant.byteMask |= access->first.mask;
+            participant.reads += access->second.loads;
+            participant.writes += access->second.stores;
+            participant.hitmReads += access->second.hitmLoads;
+        }
+    }
+}
+
+void ContentionDetector::OutputLine(const ContendedLine &contended, PmuContendedLine &out)
+{
+    const LineIssue &issue = *contended.issue;
+    out.pid = contended.line.pid;
+    out.va = contended.line.addr;
+    out.kind = contended.kind;
+    out.score = issue.score;
+    out.evidence = issue.evidence;
+    out.conflictWindows = issue.conflictWindows;
+
+    vector<const PmuContentionParticipant *> sorted;
+    sorted.reserve(issue.participants.size());
+    for (auto &participant : issue.participants) {
+        sorted.push_back(&participant.second);
+    }
+    size_t outNum = (topParticipants == 0 || topParticipants > sorted.size()) ? sorted.size() : topParticipants;
+    partial_sort(sorted.begin(), sorted.begin() + outNum, sorted.end(),
+        [](const PmuContentionParticipant *a, const PmuContentionParticipant *b) {
+            uint64_t accessA = a->reads + a->writes;
+            uint64_t accessB = b->reads + b->writes;
+            if (accessA != accessB) {
+                return accessA > accessB;
+            }
+            return a->tid != b->tid ? a->tid < b->tid : a->pc < b->pc;
+        });
+    out.participants = outNum == 0 ? nullptr : new PmuContentionParticipant[outNum];
+    out.numParticipants = outNum;
+    for (size_t i = 0; i < outNum; ++i) {
+        out.participants[i] = *sorted[i];
+        auto findPc = pcInfos.find({out.pid, sorted[i]->pc});
+        if (findPc != pcInfos.end()) {
+            out.participants[i].symbolName = CopyString(findPc->second.symbolName);
+            out.participants[i].module = CopyString(findPc->second.module);
+            out.participants[i].offset = findPc->second.offset;
+        }
+    }
+}
+
+PmuContentionData *ContentionDetector::Read()
+{
+    lock_guard<mutex> lg(mtx);
+    RunParallelTasks(shards.size(), shards.size(), 1, [this](size_t i) {
+        CloseWindows(shards[i], numeric_limits<uint64_t>::max());
+    });
+
+    vector<ContendedLine> contended;
+    for (auto &shard : shards) {
+        for (auto &line : shard.lines) {
+            for (int kind = PMU_FALSE_SHARING; kind <= PMU_TRUE_SHARING; ++kind) {
+                const LineIssue &issue = line.second.issues[kind];
+                if (issue.conflictWindows >= minConflictWindows) {
+                    contended.push_back({line.first, static_cast<PmuContentionKind>(kind), &issue});
+                }
+            }
+        }
+    }
+    size_t outNum = (topN == 0 || topN > contended.size()) ? contended.size() : topN;
+    partial_sort(contended.begin(), contended.begin() + outNum, contended.end(),
+        [](const ContendedLine &a, const ContendedLine &b) {
+            if (a.issue->score != b.issue->score) {
+                return a.issue->score > b.issue->score;
+            }
+            if (a.issue->evidence != b.issue->evidence) {
+                return a.issue->evidence > b.issue->evidence;
+            }
+            if (a.issue->conflictWindows != b.issue->conflictWindows) {
+                return a.issue->conflictWindows > b.issue->conflictWindows;
+            }
+            return a.line.pid != b.line.pid ? a.line.pid < b.line.pid : a.line.addr < b.line.addr;
+        });
+
+    unique_ptr<PmuContentionData> contentionData(new PmuContentionData());
+    contentionData->samples = samples;
+    contentionData->beginTs = beginTs;
+    contentionData->endTs = endTs;
+    contentionData->lines = outNum == 0 ? nullptr : new PmuContendedLine[outNum]();
+    contentionData->numLines = outNum;
+    for (size_t i = 0; i < outNum; ++i) {
+        OutputLine(contended[i], contentionData->lines[i]);
+    }
+
+    // Start a new period.
+    samples = 0;
+    beginTs = 0;
+    endTs = 0;
+    for (auto &shard : shards) {
+        shard.lines.clear();
+    }
+    pcInfos.clear();
+    return contentionData.release();
+}
+
+void ContentionDetector::Free(PmuContentionData *contentionData)
+{
+    for (unsigned i = 0; i < contentionData->numLines; ++i) {
+        auto &line = contentionData->lines[i];
+        for (unsigned j = 0; j < line.numParticipants; ++j) {
+            delete[] line.participants[j].symbolName;
+            delete[] line.participants[j].module;
+        }
+        delete[] line.participants;
+    }
+    delete[] contentionData->lines;
+    delete contentionData;
+}
+
+static int CheckContentionAttr(const PmuContentionAttr *attr)
+{
+    if (attr == nullptr) {
+        New(LIBPERF_ERR_NULL_POINTER, "PmuContentionAttr cannot be null");
+        return LIBPERF_ERR_NULL_POINTER;
+    }
+    if (attr->cacheLineSize != 0 && (!IsPowerOf2(attr->cacheLineSize) || attr->cacheLineSize > MAX_CACHE_LINE_SIZE)) {
+        New(LIBPERF_ERR_INVALID_CONTENTION_ATTR, "cacheLineSize should be power of 2 and not larger than 64");
+        return LIBPERF_ERR_INVALID_CONTENTION_ATTR;
+    }
+    if (attr->shards > MAX_SHARDS) {
+        New(LIBPERF_ERR_INVALID_CONTENTION_ATTR, "shards should not be larger than " + to_string(MAX_SHARDS));
+        return LIBPERF_ERR_INVALID_CONTENTION_ATTR;
+    }
+    return SUCCESS;
+}
+
+PmuContention PmuContentionOpen(struct PmuContentionAttr *attr)
+{
+    if (CheckContentionAttr(attr) != SUCCESS) {
+        return NULL;
+    }
+    return detectors.Open(*attr);
+}
+
+int PmuContentionAdd(PmuContention contention, struct PmuData *data, unsigned len)
+{
+    return detectors.Call(contention, LIBPERF_ERR_INVALID_CONTENTION, [&](ContentionDetector &detector) {
+        if (data == nullptr && len > 0) {
+            New(LIBPERF_ERR_NULL_POINTER, "PmuData cannot be null");
+            return LIBPERF_ERR_NULL_POINTER;
+        }
+        detector.Add(data, len);
+        return SUCCESS;
+    });
+}
+
+int PmuContentionRead(PmuContention contention, struct PmuContentionData **contentionData)
+{
+    return detectors.Call(contention, LIBPERF_ERR_INVALID_CONTENTION, [&](ContentionDetector &detector) {
+        if (contentionData == nullptr) {
+            New(LIBPERF_ERR_NULL_POINTER, "contentionData cannot be null");
+            return LIBPERF_ERR_NULL_POINTER;
+        }
+        *contentionData = detector.Read();
+        return SUCCESS;
+    });
+}
+
+void PmuContentionDataFree(struct PmuContentionData *contentionData)
+{
+    if (contentionData == nullptr) {
+        return;
+    }
+    ContentionDetector::Free(contentionData);
+}
+
+void PmuContentionClose(PmuContention contention)
+{
+    detectors.Close(contention);
+}
@@ -0,0 +1,176 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: detect false sharing and true sharing of cache lines from load and store samples.
+ ******************************************************************************/
+#ifndef CONTENTION_H
+#define CONTENTION_H
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "pmu.h"
+
+namespace KUNPENG_PMU {
+    /**
+     * Samples are aggregated by cache line and time window. Once a window is closed, accesses of different threads
+     * in the window are paired: a store with another store or load on disjoint bytes is false sharing,
+     * and on overlapped bytes is true sharing. Scores of windows are accumulated per line until Read.
+     * Cache lines are hashed into shards, and shards are aggregated and scored by parallel threads.
+     */
+    class ContentionDetector {
+    public:
+        explicit ContentionDetector(const PmuContentionAttr &attr);
+
+        void Add(const PmuData *data, unsigned len);
+
+        /**
+         * @brief Close all windows, output contended lines since last read, and start a new period.
+         */
+        PmuContentionData *Read();
+
+        static void Free(PmuContentionData *contentionData);
+
+    private:
+        static constexpr int KIND_NUM = 2;
+
+        struct AddrKey {
+            int pid;
+            unsigned long addr;
+
+            bool operator==(const AddrKey &other) const
+            {
+                return pid == other.pid && addr == other.addr;
+            }
+        };
+
+        struct AddrKeyHash {
+            size_t operator()(const AddrKey &key) const
+            {
+                return std::hash<unsigned long>()(key.addr) ^ (static_cast<size_t>(key.pid) << 1);
+            }
+        };
+
+        // Accesses of an instruction from a thread on the same bytes.
+        struct AccessKey {
+            int cpu;
+            int tid;
+            unsigned long pc;
+            uint64_t mask;
+
+            bool operator==(const AccessKey &other) const
+            {
+                return cpu == other.cpu && tid == other.tid && pc == other.pc && mask == other.mask;
+            }
+        };
+
+        struct AccessKeyHash {
+            size_t operator()(const AccessKey &key) const
+            {
+                return std::hash<unsigned long>()(key.pc) ^ std::hash<uint64_t>()(key.mask) ^
+                       (static_cast<size_t>(key.tid) << 16) ^ static_cast<size_t>(key.cpu);
+            }
+        };
+
+        struct AccessBucket {
+            uint32_t loads = 0;
+            uint32_t hitmLoads = 0;
+            uint32_t hazardLoads = 0;
+            uint32_t stores = 0;
+            unsigned long va = 0;
+        };
+
+        using WindowBuckets = std::unordered_map<AccessKey, AccessBucket, AccessKeyHash>;
+
+        struct ParticipantKey {
+            int tid;
+            unsigned long pc;
+
+            bool operator==(const ParticipantKey &other) const
+            {
+                return tid == other.tid && pc == other.pc;
+            }
+        };
+
+        struct ParticipantKeyHash {
+            size_t operator()(const ParticipantKey &key) const
+            {
+                return std::hash<unsigned long>()(key.pc) ^ (static_cast<size_t>(key.tid) << 1);
+            }
+        };
+
+        struct LineIssue {
+            uint64_t score = 0;
+            uint64_t evidence = 0;
+            unsigned conflictWindows = 0;
+            std::unordered_map<ParticipantKey, PmuContentionParticipant, ParticipantKeyHash> participants;
+        };
+
+        struct LineState {
+            std::map<uint64_t, WindowBuckets> windows;
+            int firstCpu = -1;
+            bool crossCpu = false;
+            LineIssue issues[KIND_NUM];
+        };
+
+        struct Sample {
+            AddrKey line;
+            uint64_t window;
+            AccessKey access;
+            unsigned long va;
+            bool load;
+            bool store;
+            bool hitm;
+            bool hazard;
+        };
+
+        struct Shard {
+            std::unordered_map<AddrKey, LineState, AddrKeyHash> lines;
+            // Lines which have accesses in a window, ordered by window id.
+            std::map<uint64_t, std::vector<AddrKey>> openWindows;
+            std::vector<Sample> samples;
+        };
+
+        struct PcInfo {
+            std::string symbolName;
+            std::string module;
+            unsigned long offset = 0;
+            int accessBytes = 0;
+        };
+
+        struct ContendedLine {
+            AddrKey line;
+            PmuContentionKind kind;
+            const LineIssue *issue;
+        };
+
+        const PcInfo &GetPcInfo(const PmuData &data, unsigned long pc, bool atomic);
+        void AddToShard(Shard &shard);
+        void CloseWindows(Shard &shard, uint64_t endWindow);
+        void ScoreWindow(LineState &lineState, const WindowBuckets &buckets);
+        void OutputLine(const ContendedLine &contended, PmuContendedLine &out);
+
+        uint64_t windowNs = 0;
+        unsigned long lineMask = 0;
+        unsigned minConflictWindows = 0;
+        unsigned topN = 0;
+        unsigned topParticipants = 0;
+        bool decodeAccessWidth = false;
+
+        std::mutex mtx;
+        uint64_t samples = 0;
+        int64_t beginTs = 0;
+        int64_t endTs = 0;
+        std::vector<Shard> shards;
+        std::unordered_map<AddrKey, PcInfo, AddrKeyHash> pcInfos;
+    };
+}   // namespace KUNPENG_PMU
+#endif
@@ -18,132 +18,151 @@
 #include "spe.h"
 #include "arm_spe_decoder.h"
 
-static void SetPktPayload(struct SpePacket *pkt, uint8_t *buf)
+// Read the payload of <size> bytes right after the header.
+static inline uint64_t LoadPayload(const uint8_t *buf, uint8_t size)
 {
-    switch (pkt->payloadSize) {
+    switch (size) {
         case 1:
-            pkt->payload = *buf;
-            break;
-        case 2:
-            pkt->payload = *(uint16_t *)(buf);
-            break;
-        case 4:
-            pkt->payload = *(uint32_t *)(buf);
-            break;
-        case 8:
-            pkt->payload = *(uint64_t *)(buf);
-            break;
-        default:
-            break;
+            return *buf;
+        case 2: {
+            uint16_t v;
+            memcpy(&v, buf, sizeof(v));
+            return v;
+        }
+        case 4: {
+            uint32_t v;
+            memcpy(&v, buf, sizeof(v));
+            return v;
+        }
+        default: {
+            uint64_t v;
+            memcpy(&v, buf, sizeof(v));
+            return v;
+        }
     }
 }
 
-static inline void* SpePacketPad(struct SpePacket *pkt, uint8_t *buf)
+// What to do with a packet, resolved from its header byte.
+// Address and counter packets are resolved to the record field directly, so no second dispatch by index is needed.
+enum SpePktAction : uint8_t {
+    SPE_ACT_BAD,
+    SPE_ACT_PAD,
+    SPE_ACT_END,
+    SPE_ACT_TIMESTAMP,
+    SPE_ACT_EVENTS,
+    SPE_ACT_DATA_SOURCE,
+    SPE_ACT_CONTEXT,
+    SPE_ACT_OP_TYPE,
+    SPE_ACT_EXTENDED,
+    // Address and counter packets, keep them together.
+    SPE_ACT_PC,
+    SPE_ACT_VA,
+    SPE_ACT_PA,
+    SPE_ACT_LAT,
+    SPE_ACT_IGNORE,
+};
+
+struct SpePktDesc {
+    uint8_t action;
+    uint8_t payloadSize;
+};
+
+static inline uint8_t PayloadSizeOfHeader(uint8_t header)
 {
-    pkt->type = SpePacketType::SPE_PACKET_PAD;
-    buf += sizeof(uint8_t);
-    return buf;
+    return 1 << ((header & 0b110000) >> 4);
 }
 
-static inline void* SpePacketEnd(struct SpePacket *pkt, uint8_t *buf)
+static uint8_t AddressAction(uint8_t header)
 {
-    pkt->type = SpePacketType::SPE_PACKET_END;
-    buf += sizeof(uint8_t);
-    return buf;
+    switch (header & 0b111) {
+        case 0:  // PC
+            return SPE_ACT_PC;
+        case 2:  // Data access virtual address
+            return SPE_ACT_VA;
+        case 3:  // Data access physical address
+            return SPE_ACT_PA;
+        default: // Branch target address, previous branch target address and others
+            return SPE_ACT_IGNORE;
+    }
 }
 
-static inline void* SpePacketTs(uint16_t header, struct SpePacket *pkt, uint8_t *buf)
+static uint8_t ActionOfHeader(uint8_t header)
 {
-    pkt->type = SpePacketType::SPE_PACKET_TIMESTAMP;
-    buf += sizeof(uint8_t);
-    pkt->payloadSize = 1 << ((header & 0b110000) >> 4);
-    SetPktPayload(pkt, buf);
-    buf += pkt->payloadSize;
-    return buf;
+    if (header == 0) {
+        return SPE_ACT_PAD;
+    }
+    if (header == 1) {
+        return SPE_ACT_END;
+    }
+    if (header == 0b01110001) {
+        return SPE_ACT_TIMESTAMP;
+    }
+    if ((header >> 6) == 0b01) {
+        if ((header & 0b1111) == 0b0010) {
+            return SPE_ACT_EVENTS;
+        }
+        if ((header & 0b1111) == 0b0011) {
+            return SPE_ACT_DATA_SOURCE;
+        }
+        if ((header >> 2) == 0b011001) {
+            return SPE_ACT_CONTEXT;
+        }
+        if ((header >> 2) == 0b010010) {
+            return SPE_ACT_OP_TYPE;
+        }
+        return SPE_ACT_BAD;
+    }
+    if ((header >> 3) == 0b10110) {
+        return AddressAction(header);
+    }
+    if ((header >> 3) == 0b10011) {
+        // Only total latency (index 0) is recorded.
+        return (header & 0b111) == 0 ? SPE_ACT_LAT : SPE_ACT_IGNORE;
+    }
+    if ((header >> 2) == 0b001000) {
+        return SPE_ACT_EXTENDED;
+    }
+    return SPE_ACT_BAD;
 }
 
-static uint8_t* Get0B01Pkt(uint16_t header, struct SpePacket *pkt, uint8_t *buf)
-{
-    if ((header & 0b1111) == 0b0010) {
-        pkt->type = SpePacketType::SPE_PACKET_EVENTS;
-        buf += sizeof(uint8_t);
-        pkt->payloadSize = 1 << ((header & 0b110000) >> 4);
-        SetPktPayload(pkt, buf);
-        buf += pkt->payloadSize;
-    } else if ((header & 0b1111) == 0b0011) {
-        pkt->type = SpePacketType::SPE_PACKET_DATA_SOURCE;
-        buf += sizeof(uint8_t);
-        pkt->payloadSize = 1 << ((header & 0b110000) >> 4);
-        SetPktPayload(pkt, buf);
-        buf += pkt->payloadSize;
-    } else if ((header >> 2) == 0b011001) {
-        pkt->type = SpePacketType::SPE_PACKET_CONTEXT;
-        buf += sizeof(uint8_t);
-        pkt->payloadSize = 1 << ((header & 0b110000) >> 4);
-        SetPktPayload(pkt, buf);
-        buf += pkt->payloadSize;
-    } else if ((header >> 2) == 0b010010) {
-        pkt->type = SpePacketType::SPE_PACKET_OP_TYPE;
-        buf += sizeof(uint8_t);
-        pkt->payloadSize = 1 << ((header & 0b110000) >> 4);
-        SetPktPayload(pkt, buf);
-        buf += pkt->payloadSize;
-    } else {
-        pkt->type = SpePacketType::SPE_PACKET_BAD;
-        buf += sizeof(uint8_t);
+// Decoding of all 256 header bytes, so each packet is decoded by one lookup and one switch
+// instead of a chain of header checks.
+struct SpePktTable {
+    SpePktDesc desc[256];
+
+    SpePktTable()
+    {
+        for (int i = 0; i < 256; ++i) {
+            uint8_t header = static_cast<uint8_t>(i);
+            uint8_t action = ActionOfHeader(header);
+            bool hasPayload = action != SPE_ACT_BAD && action != SPE_ACT_PAD &&
+                              action != SPE_ACT_END && action != SPE_ACT_EXTENDED;
+            desc[i] = {action, hasPayload ? PayloadSizeOfHeader(header) : static_cast<uint8_t>(0)};
+        }
     }
+};
 
-    return buf;
-}
+static const SpePktTable PKT_TABLE;
 
-static uint8_t *GetPkt(struct SpePacket *pkt, uint8_t *buf)
+static inline bool IsAddrOrCounter(uint8_t action)
 {
-    uint16_t header = *static_cast<uint8_t *>(buf);
+    return action >= SPE_ACT_PC;
+}
 
-    switch (header) {
-        case (0):
-            return static_cast<uint8_t*>(SpePacketPad(pkt, buf));
-        case (1):
-            return static_cast<uint8_t*>(SpePacketEnd(pkt, buf));
-        case (0b01110001):
-            return static_cast<uint8_t*>(SpePacketTs(header, pkt, buf));
-        default:
+// Skip a run of padding bytes, 8 bytes at a time. Aux buffer is padded with zero at the end of each handover.
+static inline uint8_t *SkipPadding(uint8_t *buf, uint8_t *end)
+{
+    uint64_t word;
+    while (buf + sizeof(word) <= end) {
+        memcpy(&word, buf, sizeof(word));
+        if (word != 0) {
             break;
-    }
-
-    if (!((header >> 6) ^ 0b01)) {
-        buf = Get0B01Pkt(header, pkt, buf);
-    } else if ((header >> 3) == 0b10110) {
-        pkt->type = SpePacketType::SPE_PACKET_ADDRESS;
-        buf += sizeof(uint8_t);
-        pkt->payloadSize = 1 << ((header & 0b110000) >> 4);
-        SetPktPayload(pkt, buf);
-        buf += pkt->payloadSize;
-    } else if ((header >> 3) == 0b10011) {
-        pkt->type = SpePacketType::SPE_PACKET_COUNTER;
-        buf += sizeof(uint8_t);
-        pkt->payloadSize = 1 << ((header & 0b110000) >> 4);
-        SetPktPayload(pkt, buf);
-        buf += pkt->payloadSize;
-    } else if ((header >> 10) == 0b001000) {
-        header = *(uint16_t *)(buf);
-        if ((header & 0b11111000) == 0b10110000) {
-            pkt->type = SpePacketType::SPE_PACKET_ADDRESS;
-        } else if ((header & 0b11111000) == 0b10011000) {
-            pkt->type = SpePacketType::SPE_PACKET_COUNTER;
-        } else {
-            pkt->type = SpePacketType::SPE_PACKET_BAD;
         }
-        buf += sizeof(uint16_t);
-        pkt->payloadSize = 1 << ((header & 0b110000) >> 4);
-        SetPktPayload(pkt, buf);
-        buf += pkt->payloadSize;
-    } else {
-        pkt->type = SpePacketType::SPE_PACKET_BAD;
-        buf += sizeof(uint8_t);
+        buf += sizeof(word);
+    }
+    while (buf < end && *buf == 0) {
+        buf++;
     }
-
-    pkt->header = header;
     return buf;
 }
 
@@ -171,59 +190,6 @@ static uint64_t FixupTopByte(uint64_t va)
     return va;
 }
 
-static void DecodeAddressPkt(struct SpePacket *pkt, struct SpeRecord *record)
-{
-    uint16_t index = (pkt->header & 0b111) | (((pkt->header >> 8) & 0b11) << 3);
-
-    switch (index) {
-        case 0:  // PC
-            record->pc = pkt->payload & 0xffffffffffffff;
-            record->pc = FixupTopByte(record->pc);
-            break;
-        case 1:  // Branch target address
-            break;
-        case 2:  // Data access virtual address
-            record->va = pkt->payload & 0xffffffffffffff;
-            record->va = FixupTopByte(record->va);
-            break;
-        case 3:  // Data access physical address
-            record->pa = pkt->payload & 0xffffffffffffff;
-            break;
-        case 4:  // Previous branch target address
-            break;
-        default:
-            break;
-    }
-}
-
-static void DecodeCounterPkt(struct SpePacket *pkt, struct SpeRecord *record)
-{
-    uint16_t index = (pkt->header & 0b111) | (((pkt->header >> 8) & 0b11) << 3);
-    if (index == 0) {
-        record->lat = pkt->payload;
-    }
-}       
-
-static void DecodeEventPkt(struct SpePacket *pkt, struct SpeRecord *record)
-{
-    record->event = pkt->payload;
-}
-
-static void DecodeContextPkt(struct SpePacket *pkt, struct SpeRecord *record)
-{
-    record->tid = pkt->payload;
-}
-
-static void DecodeTimestampPkt(struct SpePacket *pkt, struct SpeRecord *record)
-{
-    record->timestamp = pkt->payload;
-}
-
-static void DecodeDataSrcPkt(struct SpePacket *pkt, struct SpeRecord *record)
-{
-    record->source = pkt->payload;
-}
-
 static inline bool IsLdStExtended(uint16_t payload)
 {
     uint8_t p = (uint8_t)(payload & 0xff);
@@ -262,68 +228,117 @@ static inline uint32_t DecodeOpTypeToMask(uint16_t header, uint64_t payload)
     return op;
 }
 
-static void DecodeOpTypePkt(struct SpePacket *pkt, struct SpeRecord *record)
+static inline void ResetRecord(struct SpeRecord *rec)
 {
-    record->opType = DecodeOpTypeToMask(pkt->header, pkt->payload);
+    rec->pid = -1;
+    rec->tid = -1;
+    rec->source = -1;
+    rec->opType = -1;
 }
 
-static void DecodePkt(struct SpePacket *pkt, struct SpeRecord *record)
+// Longest packet: extended header (2 bytes) with 8 bytes payload.
+#define SPE_MAX_PKT_SIZE 10
+
+// Whether the packet at <pos> is complete in the buffer. Only checked near the end of buffer.
+static bool HasWholePacket(const uint8_t *pos, const uint8_t *end)
 {
-    switch (pkt->type) {
-        case SpePacketType::SPE_PACKET_ADDRESS:
-            DecodeAddressPkt(pkt, record);
-            break;
-        case SpePacketType::SPE_PACKET_CONTEXT:
-            DecodeContextPkt(pkt, record);
-            break;
-        case SpePacketType::SPE_PACKET_COUNTER:
-            DecodeCounterPkt(pkt, record);
-            break;
-        case SpePacketType::SPE_PACKET_DATA_SOURCE:
-            DecodeDataSrcPkt(pkt, record);
-            break;
-        case SpePacketType::SPE_PACKET_END:
-            break;
-        case SpePacketType::SPE_PACKET_EVENTS:
-            DecodeEventPkt(pkt, record);
-            break;
-        case SpePacketType::SPE_PACKET_OP_TYPE:
-            DecodeOpTypePkt(pkt, record);
-            break;
-        case SpePacketType::SPE_PACKET_PAD:
-            break;
-        case SpePacketType::SPE_PACKET_TIMESTAMP:
-            DecodeTimestampPkt(pkt, record);
-            break;
-        default:
-            break;
+    SpePktDesc desc = PKT_TABLE.desc[*pos];
+    if (desc.action == SPE_ACT_EXTENDED) {
+        // The second header byte of an extended header is cut off as well.
+        if (pos + 1 >= end) {
+            return false;
+        }
+        if (IsAddrOrCounter(PKT_TABLE.desc[pos[1]].action)) {
+            return pos + 2 + PayloadSizeOfHeader(pos[1]) <= end;
+        }
     }
+    return pos + 1 + desc.payloadSize <= end;
 }
 
-SpeRecord *SpeGetRecord(uint8_t *buf, uint8_t *end, struct SpeRecord *rec, int *remainSize)
+SpeRecord *SpeGetRecord(uint8_t **buf, uint8_t *end, struct SpeRecord *rec, int *remainSize)
 {
-    struct SpePacket pkt;
-
-    rec->pid = -1;
-    rec->tid = -1;
-    rec->source = -1;
-    rec->opType = -1;
-    while (buf < end) {
-        if (*remainSize < 1) {
+    // Keep cursor and counter in locals, stores into <rec> may alias them through pointers.
+    uint8_t *pos = *buf;
+    int remain = *remainSize;
+
+    ResetRecord(rec);
+    while (pos < end && remain > 0) {
+        if (__glibc_unlikely(end - pos < SPE_MAX_PKT_SIZE) && !HasWholePacket(pos, end)) {
+            // Packet is cut off at the end of buffer.
+            pos = end;
             break;
         }
-
-        buf = GetPkt(&pkt, buf);
-        DecodePkt(&pkt, rec);
-        if (pkt.type == SpePacketType::SPE_PACKET_END || pkt.type == SpePacketType::SPE_PACKET_TIMESTAMP) {
-            rec++;
-            *remainSize -= 1;
-            rec->pid = -1;
-            rec->tid = -1;
-            rec->source = -1;
-            rec->opType = -1;
+        uint8_t header = *pos;
+        const uint8_t *payload = pos + sizeof(uint8_t);
+        // Each kind of packet except events and data source has a fixed payload size,
+        // so the cursor is advanced by a constant, rather than by a size loaded from the table.
+        switch (PKT_TABLE.desc[header].action) {
+            case SPE_ACT_PC:
+                rec->pc = FixupTopByte(LoadPayload(payload, 8) & 0xffffffffffffff);
+                pos += 1 + 8;
+                break;
+            case SPE_ACT_VA:
+                rec->va = FixupTopByte(LoadPayload(payload, 8) & 0xffffffffffffff);
+                pos += 1 + 8;
+                break;
+            case SPE_ACT_PA:
+                rec->pa = LoadPayload(payload, 8) & 0xffffffffffffff;
+                pos += 1 + 8;
+                break;
+            case SPE_ACT_LAT:
+                rec->lat = LoadPayload(payload, 2);
+                pos += 1 + 2;
+                break;
+            case SPE_ACT_CONTEXT:
+                rec->tid = LoadPayload(payload, 4);
+                pos += 1 + 4;
+                break;
+            case SPE_ACT_OP_TYPE:
+                rec->opType = DecodeOpTypeToMask(header, LoadPayload(payload, 1));
+                pos += 1 + 1;
+                break;
+            case SPE_ACT_EVENTS:
+                rec->event = LoadPayload(payload, PayloadSizeOfHeader(header));
+                pos += 1 + PayloadSizeOfHeader(header);
+                break;
+            case SPE_ACT_DATA_SOURCE:
+                rec->source = LoadPayload(payload, PayloadSizeOfHeader(header));
+                pos += 1 + PayloadSizeOfHeader(header);
+                break;
+            case SPE_ACT_IGNORE:
+                pos += 1 + PayloadSizeOfHeader(header);
+                break;
+            case SPE_ACT_PAD:
+                pos = SkipPadding(pos, end);
+                break;
+            case SPE_ACT_EXTENDED:
+                // Extended header only extends index of address and counter packets beyond 7,
+                // none of which is recorded, so just skip the packet.
+                pos += 1;
+                if (pos < end && IsAddrOrCounter(PKT_TABLE.desc[*pos].action)) {
+                    pos += 1 + PayloadSizeOfHeader(*pos);
+                }
+                break;
+            case SPE_ACT_TIMESTAMP:
+                rec->timestamp = LoadPayload(payload, 8);
+                pos += 1 + 8;
+                rec++;
+                remain--;
+                ResetRecord(rec);
+                break;
+            case SPE_ACT_END:
+                pos += 1;
+                rec++;
+                remain--;
+                ResetRecord(rec);
+                break;
+            default:
+                pos += 1;
+                break;
         }
     }
 
+    *buf = pos;
+    *remainSize = remain;
     return rec;
 }
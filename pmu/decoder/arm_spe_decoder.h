@@ -21,19 +21,6 @@
 #include <fcntl.h>
 #include <linux/perf_event.h>
 
-enum class SpePacketType {
-    SPE_PACKET_BAD,
-    SPE_PACKET_ADDRESS,
-    SPE_PACKET_CONTEXT,
-    SPE_PACKET_COUNTER,
-    SPE_PACKET_DATA_SOURCE,
-    SPE_PACKET_END,
-    SPE_PACKET_EVENTS,
-    SPE_PACKET_OP_TYPE,
-    SPE_PACKET_PAD,
-    SPE_PACKET_TIMESTAMP,
-};
-
 #define SPE_OP_CLASS_LD_ST_ATOMIC  0x1
 #define SPE_OP_PACKET_ST    (1ULL << 0)
 #define SPE_OP_PACKET_AT    (1ULL << 2)
@@ -46,15 +33,10 @@ enum SpeOpType {
     SPE_OP_BRANCH_ERET  = 1 << 2,
 };
 
-struct SpePacket {
-    enum SpePacketType type;
-    uint64_t payload;
-    uint16_t header;
-    uint16_t payloadSize;
-};
-
 struct SpeRecord;
 
-SpeRecord *SpeGetRecord(uint8_t *buf, uint8_t *end, struct SpeRecord *rec, int *remainSize);
+// Decode records from <*buf> until <end> or <*remainSize> records are decoded, <*buf> is moved to the next undecoded packet.
+// <rec> should have room for <*remainSize> + 1 records.
+SpeRecord *SpeGetRecord(uint8_t **buf, uint8_t *end, struct SpeRecord *rec, int *remainSize);
 
 #endif
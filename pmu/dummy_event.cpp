@@ -130,12 +130,14 @@ namespace KUNPENG_PMU {
                 auto sample = (KUNPENG_PMU::PerfRecordFork*) header;
                 std::lock_guard<std::mutex> lg(dummyMutex);
                 if((uint8_t*)page + MAP_LEN > ringBuf + off + sizeof(KUNPENG_PMU::PerfRecordFork)) {
+                    UpdateProcTopoOnFork(sample->pid, sample->tid, sample->ptid);
                     forkPidQueue.push(sample->tid);
                     hasDataCond.notify_all();
                 }
             }
             if (header->type == PERF_RECORD_EXIT) {
                 auto sample = (KUNPENG_PMU::PerfRecordFork*) header;
+                UpdateProcTopoOnExit(sample->tid);
                 if (sample->pid == sample->tid && sample->pid == pid) {
                     exitPids.push_back(pid);
                 }
@@ -0,0 +1,903 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: unwind user call stacks from sampled registers and stack with dwarf call frame information.
+ ******************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <functional>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include "symbol_resolve.h"
+#include "pmu_event.h"
+#include "task_runner.h"
+#include "log.h"
+#include "dwarf_unwind.h"
+
+using namespace std;
+
+namespace KUNPENG_PMU {
+
+#ifdef IS_X86
+static constexpr uint32_t DWARF_SP = 7;
+static constexpr uint32_t DWARF_FP = 6;
+#elif defined(IS_RISCV64)
+static constexpr uint32_t DWARF_SP = 2;
+static constexpr uint32_t DWARF_FP = 8;
+#else
+static constexpr uint32_t DWARF_SP = 31;
+static constexpr uint32_t DWARF_FP = 29;
+// Return addresses signed by pointer authentication carry a code in the bits above virtual address.
+static constexpr uint64_t USER_VA_MASK = (1ULL << 48) - 1;
+#endif
+
+static constexpr int MAX_UNWIND_FRAMES = 128;
+static constexpr size_t MAX_UNWIND_WORKERS = 8;
+static constexpr size_t MAX_MODULE_CACHE = 4096;
+static constexpr size_t MAX_CFI_TABLES = 1024;
+static constexpr size_t MIN_STACKS_PER_WORKER = 256;
+
+// Call frame instructions, refer to DWARF 5 section 6.4.2.
+enum CfaOp : uint8_t {
+    DW_CFA_NOP = 0x00,
+    DW_CFA_SET_LOC = 0x01,
+    DW_CFA_ADVANCE_LOC1 = 0x02,
+    DW_CFA_ADVANCE_LOC2 = 0x03,
+    DW_CFA_ADVANCE_LOC4 = 0x04,
+    DW_CFA_OFFSET_EXTENDED = 0x05,
+    DW_CFA_RESTORE_EXTENDED = 0x06,
+    DW_CFA_UNDEFINED = 0x07,
+    DW_CFA_SAME_VALUE = 0x08,
+    DW_CFA_REGISTER = 0x09,
+    DW_CFA_REMEMBER_STATE = 0x0a,
+    DW_CFA_RESTORE_STATE = 0x0b,
+    DW_CFA_DEF_CFA = 0x0c,
+    DW_CFA_DEF_CFA_REGISTER = 0x0d,
+    DW_CFA_DEF_CFA_OFFSET = 0x0e,
+    DW_CFA_DEF_CFA_EXPRESSION = 0x0f,
+    DW_CFA_EXPRESSION = 0x10,
+    DW_CFA_OFFSET_EXTENDED_SF = 0x11,
+    DW_CFA_DEF_CFA_SF = 0x12,
+    DW_CFA_DEF_CFA_OFFSET_SF = 0x13,
+    DW_CFA_VAL_OFFSET = 0x14,
+    DW_CFA_VAL_OFFSET_SF = 0x15,
+    DW_CFA_VAL_EXPRESSION = 0x16,
+    DW_CFA_AARCH64_NEGATE_RA_STATE = 0x2d,
+    DW_CFA_GNU_ARGS_SIZE = 0x2e,
+    DW_CFA_GNU_NEGATIVE_OFFSET_EXTENDED = 0x2f,
+    DW_CFA_ADVANCE_LOC = 0x40,
+    DW_CFA_OFFSET = 0x80,
+    DW_CFA_RESTORE = 0xc0,
+};
+
+// Pointer encodings of .eh_frame.
+enum EhPointerEncoding : uint8_t {
+    DW_EH_PE_ABSPTR = 0x00,
+    DW_EH_PE_ULEB128 = 0x01,
+    DW_EH_PE_UDATA2 = 0x02,
+    DW_EH_PE_UDATA4 = 0x03,
+    DW_EH_PE_UDATA8 = 0x04,
+    DW_EH_PE_SLEB128 = 0x09,
+    DW_EH_PE_SDATA2 = 0x0a,
+    DW_EH_PE_SDATA4 = 0x0b,
+    DW_EH_PE_SDATA8 = 0x0c,
+    DW_EH_PE_PCREL = 0x10,
+    DW_EH_PE_INDIRECT = 0x80,
+    DW_EH_PE_OMIT = 0xff,
+};
+
+class CfiReader {
+public:
+    CfiReader(const uint8_t *data, size_t size, uint64_t addr) : data(data), size(size), addr(addr)
+    {}
+
+    template <typename T>
+    T Read()
+    {
+        T value = 0;
+        if (pos + sizeof(T) > size) {
+            ok = false;
+            pos = size;
+            return value;
+        }
+        memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    uint64_t ReadUleb()
+    {
+        uint64_t value = 0;
+        unsigned shift = 0;
+        while (pos < size) {
+            uint8_t byte = data[pos++];
+            if (shift < 64) {
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            }
+            shift += 7;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        ok = false;
+        return value;
+    }
+
+    int64_t ReadSleb()
+    {
+        int64_t value = 0;
+        unsigned shift = 0;
+        while (pos < size) {
+            uint8_t byte = data[pos++];
+            if (shift < 64) {
+                value |= static_cast<int64_t>(byte & 0x7f) << shift;
+            }
+            shift += 7;
+            if ((byte & 0x80) == 0) {
+                if (shift < 64 && (byte & 0x40)) {
+                    value |= -(static_cast<int64_t>(1) << shift);
+                }
+                return value;
+            }
+        }
+        ok = false;
+        return value;
+    }
+
+    const char *ReadString()
+    {
+        const char *str = reinterpret_cast<const char *>(data + pos);
+        const void *end = memchr(data + pos, 0, size - pos);
+        if (end == nullptr) {
+            ok = false;
+            pos = size;
+            return "";
+        }
+        pos = static_cast<const uint8_t *>(end) - data + 1;
+        return str;
+    }
+
+    uint64_t ReadEncoded(uint8_t encoding)
+    {
+        if (encoding == DW_EH_PE_OMIT) {
+            return 0;
+        }
+        uint64_t fieldAddr = addr + pos;
+        uint64_t value = 0;
+        switch (encoding & 0x0f) {
+            case DW_EH_PE_ABSPTR:
+            case DW_EH_PE_UDATA8:
+            case DW_EH_PE_SDATA8:
+                value = Read<uint64_t>();
+                break;
+            case DW_EH_PE_ULEB128:
+                value = ReadUleb();
+                break;
+            case DW_EH_PE_UDATA2:
+                value = Read<uint16_t>();
+                break;
+            case DW_EH_PE_UDATA4:
+                value = Read<uint32_t>();
+                break;
+            case DW_EH_PE_SLEB128:
+                value = ReadSleb();
+                break;
+            case DW_EH_PE_SDATA2:
+                value = static_cast<int64_t>(Read<int16_t>());
+                break;
+            case DW_EH_PE_SDATA4:
+                value = static_cast<int64_t>(Read<int32_t>());
+                break;
+            default:
+                ok = false;
+                return 0;
+        }
+        switch (encoding & 0x70) {
+            case DW_EH_PE_ABSPTR:
+                break;
+            case DW_EH_PE_PCREL:
+                value += fieldAddr;
+                break;
+            default:
+                // Addresses relative to text, data or function are not used by code ranges of FDE.
+                ok = false;
+                break;
+        }
+        return value;
+    }
+
+    void Seek(size_t newPos)
+    {
+        pos = min(newPos, size);
+    }
+
+    size_t Pos() const
+    {
+        return pos;
+    }
+
+    bool Ok() const
+    {
+        return ok;
+    }
+
+private:
+    const uint8_t *data;
+    size_t size;
+    // Virtual address of data, for pc relative pointers.
+    uint64_t addr;
+    size_t pos = 0;
+    bool ok = true;
+};
+
+class CfiParser {
+public:
+    explicit CfiParser(CfiTable &table) : table(table)
+    {}
+
+    void Parse(const uint8_t *data, size_t size, uint64_t addr, bool isEhFrame);
+    void Finish();
+
+private:
+    struct Cie {
+        uint64_t codeAlign = 1;
+        int64_t dataAlign = 1;
+        uint32_t raReg = 0;
+        uint8_t fdeEncoding = DW_EH_PE_ABSPTR;
+        bool hasAugData = false;
+        size_t insnBegin = 0;
+        size_t insnEnd = 0;
+    };
+
+    enum RuleType : uint8_t {
+        RULE_SAME,
+        RULE_OFFSET,
+        RULE_UNDEFINED,
+    };
+
+    struct Rule {
+        RuleType type;
+        int64_t offset;
+
+        Rule(RuleType ruleType = RULE_SAME, int64_t ruleOffset = 0)
+        {
+            // offset is a macro of pmu_event.h, which can't be called in the initializer list.
+            type = ruleType;
+            offset = ruleOffset;
+        }
+    };
+
+    struct State {
+        uint32_t cfaReg = DWARF_SP;
+        int64_t cfaOffset = 0;
+        bool cfaValid = true;
+        Rule fp;
+        Rule ra;
+    };
+
+    struct RawRow {
+        uint64_t pc;
+        bool end;
+        CfiRow row;
+    };
+
+    bool ParseCie(CfiReader &reader, size_t entryEnd, Cie &cie);
+    const Cie *GetCie(const uint8_t *data, size_t size, uint64_t addr, size_t offset, bool isEhFrame);
+    bool Execute(CfiReader &reader, size_t end, const Cie &cie, const State &init, State &state,
+                 uint64_t &loc, uint64_t pcEnd);
+    void SetRule(uint32_t reg, const Rule &rule, const Cie &cie, State &state);
+    void RestoreRule(uint32_t reg, const Cie &cie, const State &init, State &state);
+    void EmitRow(uint64_t pc, const State &state);
+
+    CfiTable &table;
+    unordered_map<size_t, Cie> cies;
+    // Functions covered by .eh_frame, which are skipped in .debug_frame.
+    unordered_set<uint64_t> ehFunctions;
+    vector<RawRow> rawRows;
+    bool lastRowValid = false;
+    CfiRow lastRow = {0};
+};
+
+static inline bool SameRule(const CfiRow &a, const CfiRow &b)
+{
+    return a.cfaOffset == b.cfaOffset && a.fpOffset == b.fpOffset && a.raOffset == b.raOffset &&
+           a.cfaReg == b.cfaReg;
+}
+
+void CfiParser::EmitRow(uint64_t pc, const State &state)
+{
+    CfiRow row = {0};
+    row.cfaReg = CfiRow::CFA_INVALID;
+    bool fit = state.cfaOffset >= numeric_limits<int32_t>::min() && state.cfaOffset <= numeric_limits<int32_t>::max() &&
+               state.fp.offset >= numeric_limits<int16_t>::min() && state.fp.offset <= numeric_limits<int16_t>::max() &&
+               state.ra.offset > numeric_limits<int16_t>::min() && state.ra.offset <= numeric_limits<int16_t>::max();
+    if (state.cfaValid && fit && (state.cfaReg == DWARF_SP || state.cfaReg == DWARF_FP)) {
+        row.cfaReg = state.cfaReg == DWARF_SP ? CfiRow::CFA_SP : CfiRow::CFA_FP;
+        row.cfaOffset = static_cast<int32_t>(state.cfaOffset);
+        row.fpOffset = state.fp.type == RULE_OFFSET ? static_cast<int16_t>(state.fp.offset) : 0;
+        if (state.ra.type == RULE_UNDEFINED) {
+            row.raOffset = CfiRow::RA_UNDEFINED;
+        } else {
+            row.raOffset = state.ra.type == RULE_OFFSET ? static_cast<int16_t>(state.ra.offset) : 0;
+        }
+    }
+    if (lastRowValid && SameRule(lastRow, row)) {
+        return;
+    }
+    rawRows.push_back({pc, false, row});
+    lastRow = row;
+    lastRowValid = true;
+}
+
+bool CfiParser::ParseCie(CfiReader &reader, size_t entryEnd, Cie &cie)
+{
+    uint8_t version = reader.Read<uint8_t>();
+    string augmentation = reader.ReadString();
+    if (augmentation.find("eh") != string::npos) {
+        reader.Read<uint64_t>();
+    }
+    if (version >= 4) {
+        uint8_t addrSize = reader.Read<uint8_t>();
+        reader.Read<uint8_t>();
+        if (addrSize != sizeof(uint64_t)) {
+            return false;
+        }
+    }
+    cie.codeAlign = reader.ReadUleb();
+    cie.dataAlign = reader.ReadSleb();
+    cie.raReg = version == 1 ? reader.Read<uint8_t>() : static_cast<uint32_t>(reader.ReadUleb());
+    if (!augmentation.empty() && augmentation[0] == 'z') {
+        cie.hasAugData = true;
+        uint64_t augLen = reader.ReadUleb();
+        size_t augEnd = reader.Pos() + augLen;
+        for (size_t i = 1; i < augmentation.size(); ++i) {
+            char c = augmentation[i];
+            if (c == 'R') {
+                cie.fdeEncoding = reader.Read<uint8_t>();
+            } else if (c == 'P') {
+                uint8_t encoding = reader.Read<uint8_t>();
+                reader.ReadEncoded(encoding & ~DW_EH_PE_INDIRECT);
+            } else if (c == 'L') {
+                reader.Read<uint8_t>();
+            } else if (c != 'S' && c != 'B' && c != 'G') {
+                break;
+            }
+        }
+        reader.Seek(augEnd);
+    }
+    cie.insnBegin = reader.Pos();
+    cie.insnEnd = entryEnd;
+    return reader.Ok();
+}
+
+const CfiParser::Cie *CfiParser::GetCie(const uint8_t *data, size_t size, uint64_t addr, size_t offset,
+                                        bool isEhFrame)
+{
+    auto findCie = cies.find(offset);
+    if (findCie != cies.end()) {
+        return &findCie->second;
+    }
+    CfiReader reader(data, size, addr);
+    reader.Seek(offset);
+    uint64_t length = reader.Read<uint32_t>();
+    bool is64 = length == 0xffffffff;
+    if (is64) {
+        length = reader.Read<uint64_t>();
+    }
+    size_t entryEnd = reader.Pos() + length;
+    uint64_t id = is64 ? reader.Read<uint64_t>() : reader.Read<uint32_t>();
+    uint64_t cieId = isEhFrame ? 0 : (is64 ? numeric_limits<uint64_t>::max() : 0xffffffff);
+    Cie cie;
+    if (!reader.Ok() || entryEnd > size || id != cieId || !ParseCie(reader, entryEnd, cie)) {
+        return nullptr;
+    }
+    return &(cies[offset] = cie);
+}
+
+void CfiParser::SetRule(uint32_t reg, const Rule &rule, const Cie &cie, State &state)
+{
+    if (reg == DWARF_FP) {
+        // Fp which can't be recovered is taken as unchanged.
+        state.fp = rule.type == RULE_UNDEFINED ? Rule() : rule;
+    } else if (reg == cie.raReg) {
+        state.ra = rule;
+    }
+}
+
+void CfiParser::RestoreRule(uint32_t reg, const Cie &cie, const State &init, State &state)
+{
+    if (reg == DWARF_FP) {
+        state.fp = init.fp;
+    } else if (reg == cie.raReg) {
+        state.ra = init.ra;
+    }
+}
+
+bool CfiParser::Execute(CfiReader &reader, size_t end, const Cie &cie, const State &init, State &state,
+                        uint64_t &loc, uint64_t pcEnd)
+{
+    vector<State> stateStack;
+    Rule unsupported = {RULE_UNDEFINED, 0};
+    while (reader.Ok() && reader.Pos() < end) {
+        uint8_t op = reader.Read<uint8_t>();
+        uint8_t operand = op & 0x3f;
+        uint64_t delta = 0;
+        switch (op & 0xc0) {
+            case DW_CFA_ADVANCE_LOC:
+                delta = operand;
+                break;
+            case DW_CFA_OFFSET:
+                SetRule(operand, {RULE_OFFSET, static_cast<int64_t>(reader.ReadUleb()) * cie.dataAlign}, cie, state);
+                continue;
+            case DW_CFA_RESTORE:
+                RestoreRule(operand, cie, init, state);
+                continue;
+            default:
+                break;
+        }
+        if ((op & 0xc0) == 0) {
+            switch (op) {
+                case DW_CFA_NOP:
+                    continue;
+                case DW_CFA_SET_LOC:
+                    EmitRow(loc, state);
+                    loc = reader.ReadEncoded(cie.fdeEncoding);
+                    continue;
+                case DW_CFA_ADVANCE_LOC1:
+                    delta = reader.Read<uint8_t>();
+                    break;
+                case DW_CFA_ADVANCE_LOC2:
+                    delta = reader.Read<uint16_t>();
+                    break;
+                case DW_CFA_ADVANCE_LOC4:
+                    delta = reader.Read<uint32_t>();
+                    break;
+                case DW_CFA_OFFSET_EXTENDED: {
+                    uint32_t reg = reader.ReadUleb();
+                    SetRule(reg, {RULE_OFFSET, static_cast<int64_t>(reader.ReadUleb()) * cie.dataAlign}, cie, state);
+                    continue;
+                }
+                case DW_CFA_OFFSET_EXTENDED_SF: {
+                    uint32_t reg = reader.ReadUleb();
+                    SetRule(reg, {RULE_OFFSET, reader.ReadSleb() * cie.dataAlign}, cie, state);
+                    continue;
+                }
+                case DW_CFA_GNU_NEGATIVE_OFFSET_EXTENDED: {
+                    uint32_t reg = reader.ReadUleb();
+                    SetRule(reg, {RULE_OFFSET, -static_cast<int64_t>(reader.ReadUleb()) * cie.dataAlign}, cie, state);
+                    continue;
+                }
+                case DW_CFA_RESTORE_EXTENDED:
+                    RestoreRule(reader.ReadUleb(), cie, init, state);
+                    continue;
+                case DW_CFA_UNDEFINED:
+                    SetRule(reader.ReadUleb(), {RULE_UNDEFINED, 0}, cie, state);
+                    continue;
+                case DW_CFA_SAME_VALUE:
+                    SetRule(reader.ReadUleb(), {RULE_SAME, 0}, cie, state);
+                    continue;
+                case DW_CFA_REGISTER: {
+                    // Registers saved in other registers are not sampled, so they can't be recovered.
+                    uint32_t reg = reader.ReadUleb();
+                    reader.ReadUleb();
+                    SetRule(reg, unsupported, cie, state);
+                    continue;
+                }
+                case DW_CFA_VAL_OFFSET:
+                case DW_CFA_VAL_OFFSET_SF: {
+                    uint32_t reg = reader.ReadUleb();
+                    op == DW_CFA_VAL_OFFSET ? reader.ReadUleb() : reader.ReadSleb();
+                    SetRule(reg, unsupported, cie, state);
+                    continue;
+                }
+                case DW_CFA_EXPRESSION:
+                case DW_CFA_VAL_EXPRESSION: {
+                    uint32_t reg = reader.ReadUleb();
+                    reader.Seek(reader.Pos() + reader.ReadUleb());
+                    SetRule(reg, unsupported, cie, state);
+                    continue;
+                }
+                case DW_CFA_REMEMBER_STATE:
+                    stateStack.push_back(state);
+                    continue;
+                case DW_CFA_RESTORE_STATE:
+                    if (!stateStack.empty()) {
+                        state = stateStack.back();
+                        stateStack.pop_back();
+                    }
+                    continue;
+                case DW_CFA_DEF_CFA:
+                    state.cfaReg = reader.ReadUleb();
+                    state.cfaOffset = reader.ReadUleb();
+                    state.cfaValid = true;
+                    continue;
+                case DW_CFA_DEF_CFA_SF:
+                    state.cfaReg = reader.ReadUleb();
+                    state.cfaOffset = reader.ReadSleb() * cie.dataAlign;
+                    state.cfaValid = true;
+                    continue;
+                case DW_CFA_DEF_CFA_REGISTER:
+                    state.cfaReg = reader.ReadUleb();
+                    continue;
+                case DW_CFA_DEF_CFA_OFFSET:
+                    state.cfaOffset = reader.ReadUleb();
+                    continue;
+                case DW_CFA_DEF_CFA_OFFSET_SF:
+                    state.cfaOffset = reader.ReadSleb() * cie.dataAlign;
+                    continue;
+                case DW_CFA_DEF_CFA_EXPRESSION:
+                    reader.Seek(reader.Pos() + reader.ReadUleb());
+                    state.cfaValid = false;
+                    continue;
+                case DW_CFA_GNU_ARGS_SIZE:
+                    reader.ReadUleb();
+                    continue;
+                case DW_CFA_AARCH64_NEGATE_RA_STATE:
+                    // Signed return address is stripped when it is read.
+                    continue;
+                default:
+                    DBG_PRINT("Unknown cfa instruction: %x\n", op);
+                    return false;
+            }
+        }
+        EmitRow(loc, state);
+        loc += delta * cie.codeAlign;
+        if (loc >= pcEnd) {
+            break;
+        }
+    }
+    return reader.Ok();
+}
+
+void CfiParser::Parse(const uint8_t *data, size_t size, uint64_t addr, bool isEhFrame)
+{
+    CfiReader reader(data, size, addr);
+    while (reader.Pos() + sizeof(uint32_t) <= size) {
+        uint64_t length = reader.Read<uint32_t>();
+        if (length == 0) {
+            if (isEhFrame) {
+                break;
+            }
+            continue;
+        }
+        bool is64 = length == 0xffffffff;
+        if (is64) {
+            length = reader.Read<uint64_t>();
+        }
+        size_t idPos = reader.Pos();
+        size_t entryEnd = idPos + length;
+        if (!reader.Ok() || entryEnd > size || entryEnd < idPos) {
+            break;
+        }
+        uint64_t id = is64 ? reader.Read<uint64_t>() : reader.Read<uint32_t>();
+        uint64_t cieId = isEhFrame ? 0 : (is64 ? numeric_limits<uint64_t>::max() : 0xffffffff);
+        if (id == cieId) {
+            reader.Seek(entryEnd);
+            continue;
+        }
+        // Pointer to CIE is relative to the field in .eh_frame, and is an offset of section in .debug_frame.
+        size_t cieOffset = isEhFrame ? idPos - id : id;
+        const Cie *cie = GetCie(data, size, addr, cieOffset, isEhFrame);
+        if (cie == nullptr) {
+            reader.Seek(entryEnd);
+            continue;
+        }
+        uint64_t pcBegin = reader.ReadEncoded(cie->fdeEncoding);
+        uint64_t pcRange = reader.ReadEncoded(cie->fdeEncoding & 0x0f);
+        if (cie->hasAugData) {
+            reader.Seek(reader.Pos() + reader.ReadUleb());
+        }
+        bool duplicated = isEhFrame ? !ehFunctions.insert(pcBegin).second : ehFunctions.count(pcBegin) > 0;
+        if (!reader.Ok() || pcRange == 0 || duplicated) {
+            reader.Seek(entryEnd);
+            continue;
+        }
+        uint64_t pcEnd = pcBegin + pcRange;
+
+        State init;
+        uint64_t loc = pcBegin;
+        CfiReader cieReader(data, cie->insnEnd, addr);
+        cieReader.Seek(cie->insnBegin);
+        lastRowValid = false;
+        size_t rowBegin = rawRows.size();
+        Execute(cieReader, cie->insnEnd, *cie, init, init, loc, pcEnd);
+        State state = init;
+        loc = pcBegin;
+        if (!Execute(reader, entryEnd, *cie, init, state, loc, pcEnd)) {
+            // Rows after the unknown instruction are not reliable.
+            state.cfaValid = false;
+        }
+        if (loc < pcEnd) {
+            EmitRow(loc, state);
+        }
+        // Rows beyond the function are from broken instructions.
+        while (rawRows.size() > rowBegin && rawRows.back().pc >= pcEnd) {
+            rawRows.pop_back();
+        }
+        CfiRow endRow = {0};
+        endRow.cfaReg = CfiRow::CFA_INVALID;
+        rawRows.push_back({pcEnd, true, endRow});
+        reader.Seek(entryEnd);
+    }
+}
+
+void CfiParser::Finish()
+{
+    // End of a function is overridden by the row of the next function starting at the same address.
+    stable_sort(rawRows.begin(), rawRows.end(), [](const RawRow &a, const RawRow &b) {
+        return a.pc != b.pc ? a.pc < b.pc : a.end && !b.end;
+    });
+    if (rawRows.empty()) {
+        return;
+    }
+    table.base = rawRows.front().pc;
+    table.rows.reserve(rawRows.size());
+    for (size_t i = 0; i < rawRows.size(); ++i) {
+        if (i + 1 < rawRows.size() && rawRows[i + 1].pc == rawRows[i].pc) {
+            continue;
+        }
+        uint64_t pc = rawRows[i].pc - table.base;
+        if (pc > numeric_limits<uint32_t>::max()) {
+            break;
+        }
+        CfiRow row = rawRows[i].row;
+        row.pc = static_cast<uint32_t>(pc);
+        if (!table.rows.empty() && SameRule(table.rows.back(), row)) {
+            continue;
+        }
+        table.rows.push_back(row);
+    }
+    table.rows.shrink_to_fit();
+    vector<RawRow>().swap(rawRows);
+}
+
+shared_ptr<CfiTable> CfiTable::Load(const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Elf64_Ehdr)) {
+        close(fd);
+        return nullptr;
+    }
+    size_t fileSize = st.st_size;
+    void *map = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return nullptr;
+    }
+    unique_ptr<void, function<void(void *)>> mapGuard(map, [fileSize](void *p) { munmap(p, fileSize); });
+    auto *base = static_cast<const uint8_t *>(map);
+    auto *ehdr = reinterpret_cast<const Elf64_Ehdr *>(base);
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr->e_ident[EI_DATA] != ELFDATA2LSB) {
+        return nullptr;
+    }
+    if (ehdr->e_phoff + static_cast<uint64_t>(ehdr->e_phnum) * sizeof(Elf64_Phdr) > fileSize ||
+        ehdr->e_shoff + static_cast<uint64_t>(ehdr->e_shnum) * sizeof(Elf64_Shdr) > fileSize ||
+        ehdr->e_shstrndx >= ehdr->e_shnum) {
+        return nullptr;
+    }
+
+    shared_ptr<CfiTable> table = make_shared<CfiTable>();
+    table->isExec = ehdr->e_type == ET_EXEC;
+    auto *phdrs = reinterpret_cast<const Elf64_Phdr *>(base + ehdr->e_phoff);
+    for (unsigned i = 0; i < ehdr->e_phnum; ++i) {
+        if (phdrs[i].p_type == PT_LOAD) {
+            table->segments.push_back({phdrs[i].p_offset, phdrs[i].p_vaddr, phdrs[i].p_filesz});
+        }
+    }
+
+    auto *shdrs = reinterpret_cast<const Elf64_Shdr *>(base + ehdr->e_shoff);
+    const Elf64_Shdr &strTab = shdrs[ehdr->e_shstrndx];
+    if (strTab.sh_offset + strTab.sh_size > fileSize) {
+        return nullptr;
+    }
+    auto findSection = [&](const char *name) -> const Elf64_Shdr * {
+        for (unsigned i = 0; i < ehdr->e_shnum; ++i) {
+            if (shdrs[i].sh_type == SHT_NOBITS || shdrs[i].sh_name >= strTab.sh_size ||
+                shdrs[i].sh_offset + shdrs[i].sh_size > fileSize) {
+                continue;
+            }
+            const char *secName = reinterpret_cast<const char *>(base + strTab.sh_offset + shdrs[i].sh_name);
+            if (strncmp(secName, name, strTab.sh_size - shdrs[i].sh_name) == 0) {
+                return &shdrs[i];
+            }
+        }
+        return nullptr;
+    };
+
+    CfiParser parser(*table);
+    auto ehFrame = findSection(".eh_frame");
+    if (ehFrame != nullptr) {
+        parser.Parse(base + ehFrame->sh_offset, ehFrame->sh_size, ehFrame->sh_addr, true);
+    }
+    auto debugFrame = findSection(".debug_frame");
+    if (debugFrame != nullptr) {
+        parser.Parse(base + debugFrame->sh_offset, debugFrame->sh_size, 0, false);
+    }
+    parser.Finish();
+    if (table->rows.empty()) {
+        return nullptr;
+    }
+    DBG_PRINT("Load cfi of %s: %lu rows\n", path.c_str(), table->rows.size());
+    return table;
+}
+
+const CfiRow *CfiTable::Find(unsigned long elfAddr) const
+{
+    uint64_t vaddr = elfAddr;
+    if (!isExec) {
+        // Convert file offset to virtual address by the segment containing it.
+        bool found = false;
+        for (auto &segment : segments) {
+            if (elfAddr >= segment.offset && elfAddr < segment.offset + segment.size) {
+                vaddr = elfAddr - segment.offset + segment.vaddr;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return nullptr;
+        }
+    }
+    if (vaddr < base || vaddr - base > numeric_limits<uint32_t>::max()) {
+        return nullptr;
+    }
+    uint32_t pc = static_cast<uint32_t>(vaddr - base);
+    auto iter = upper_bound(rows.begin(), rows.end(), pc, [](uint32_t pc, const CfiRow &row) {
+        return pc < row.pc;
+    });
+    if (iter == rows.begin()) {
+        return nullptr;
+    }
+    --iter;
+    return iter->cfaReg == CfiRow::CFA_INVALID ? nullptr : &*iter;
+}
+
+UnwindRegs ParseUnwindRegs(const uint64_t *regs)
+{
+    UnwindRegs unwindRegs;
+#ifdef IS_X86
+    unwindRegs.fp = regs[0];
+    unwindRegs.sp = regs[1];
+    unwindRegs.pc = regs[2];
+#elif defined(IS_RISCV64)
+    unwindRegs.pc = regs[0];
+    unwindRegs.lr = regs[1];
+    unwindRegs.sp = regs[2];
+    unwindRegs.fp = regs[3];
+#else
+    unwindRegs.fp = regs[0];
+    unwindRegs.lr = regs[1];
+    unwindRegs.sp = regs[2];
+    unwindRegs.pc = regs[3];
+#endif
+    return unwindRegs;
+}
+
+DwarfUnwinder &DwarfUnwinder::GetInstance()
+{
+    static DwarfUnwinder unwinder;
+    return unwinder;
+}
+
+shared_ptr<const CfiTable> DwarfUnwinder::FindTable(int pid, unsigned long addr, unsigned long &elfAddr)
+{
+    auto module = KUNPENG_SYM::SymbolResolve::GetInstance()->MapModuleAddr(pid, addr, elfAddr);
+    if (!module) {
+        return nullptr;
+    }
+    lock_guard<mutex> lg(mtx);
+    auto findModule = moduleTables.find(module);
+    if (findModule != moduleTables.end()) {
+        return findModule->second;
+    }
+    // Maps of exited processes are held by the cache, so it is rebuilt once it is too large.
+    if (moduleTables.size() >= MAX_MODULE_CACHE) {
+        moduleTables.clear();
+    }
+    // A file rebuilt at the same path has another build-id or mtime, so its cfi is parsed again.
+    string key = module->moduleKey.empty() ? module->FilePath() : module->moduleKey;
+    auto findTable = tables.find(key);
+    if (findTable == tables.end()) {
+        if (tables.size() >= MAX_CFI_TABLES) {
+            // Tables of unmapped and rebuilt files are no longer referred to by modules or workers.
+            for (auto iter = tables.begin(); iter != tables.end();) {
+                iter = iter->second.use_count() <= 1 ? tables.erase(iter) : next(iter);
+            }
+        }
+        // Each file is parsed once, and it is done under lock so that other workers wait for it.
+        findTable = tables.emplace(key, CfiTable::Load(module->FilePath())).first;
+    }
+    moduleTables[module] = findTable->second;
+    return findTable->second;
+}
+
+void DwarfUnwinder::Unwind(int pid, const UnwindRegs &regs, const char *stack, size_t size,
+                           vector<unsigned long> &frames)
+{
+    uint64_t pc = regs.pc;
+    uint64_t sp = regs.sp;
+    uint64_t fp = regs.fp;
+    auto readStack = [&regs, stack, size](uint64_t addr, uint64_t &value) {
+        if (addr < regs.sp || addr - regs.sp + sizeof(uint64_t) > size) {
+            return false;
+        }
+        memcpy(&value, stack + (addr - regs.sp), sizeof(uint64_t));
+        return true;
+    };
+
+    frames.push_back(pc);
+    for (int depth = 0; depth < MAX_UNWIND_FRAMES; ++depth) {
+        // Return address is the instruction after call, which may be out of the calling function.
+        unsigned long lookupPc = depth == 0 ? pc : pc - 1;
+        unsigned long elfAddr = 0;
+        auto table = FindTable(pid, lookupPc, elfAddr);
+        const CfiRow *row = table == nullptr ? nullptr : table->Find(elfAddr);
+        if (row == nullptr || row->raOffset == CfiRow::RA_UNDEFINED) {
+            break;
+        }
+        uint64_t cfa = (row->cfaReg == CfiRow::CFA_SP ? sp : fp) + row->cfaOffset;
+        uint64_t ra = 0;
+        if (row->raOffset != 0) {
+            if (!readStack(cfa + row->raOffset, ra)) {
+                break;
+            }
+        } else if (depth == 0 && regs.lr != 0) {
+            // Return address of leaf function or function prologue is still in link register.
+            ra = regs.lr;
+        } else {
+            break;
+        }
+        if (row->fpOffset != 0 && !readStack(cfa + row->fpOffset, fp)) {
+            break;
+        }
+#ifdef IS_ARM
+        ra &= USER_VA_MASK;
+#endif
+        // Stack grows down, so a caller frame is never below the callee.
+        if (ra == 0 || cfa < sp || (cfa == sp && ra == pc)) {
+            break;
+        }
+        sp = cfa;
+        pc = ra;
+        frames.push_back(pc);
+    }
+}
+
+void UnwindUserStacks(EventData &eventData)
+{
+    auto &userStacks = eventData.userStacks;
+    size_t maxWorkers = min(MAX_UNWIND_WORKERS, static_cast<size_t>(thread::hardware_concurrency()));
+    RunParallelTasks(userStacks.size(), maxWorkers, MIN_STACKS_PER_WORKER, [&eventData, &userStacks](size_t i) {
+        auto &userStack = userStacks[i];
+        auto &pmuData = eventData.data[userStack.idx];
+        vector<unsigned long> frames;
+        DwarfUnwinder::GetInstance().Unwind(pmuData.pid, userStack.regs,
+                                            eventData.userStackData.data() + userStack.offset, userStack.size,
+                                            frames);
+        // Ips are ordered from the outermost frame, and user frames are outer than kernel frames.
+        auto &ips = eventData.sampleIps[userStack.idx].ips;
+        ips.insert(ips.begin(), frames.rbegin(), frames.rend());
+    });
+    vector<UserStackSample>().swap(userStacks);
+    vector<char>().swap(eventData.userStackData);
+}
+
+}   // namespace KUNPENG_PMU
@@ -0,0 +1,147 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: unwind user call stacks from sampled registers and stack with dwarf call frame information.
+ ******************************************************************************/
+#ifndef DWARF_UNWIND_H
+#define DWARF_UNWIND_H
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+
+namespace KUNPENG_SYM {
+    struct ModuleMap;
+}
+
+namespace KUNPENG_PMU {
+    struct EventData;
+
+    // Registers sampled by PERF_SAMPLE_REGS_USER, which are stored in the order of bits.
+#ifdef IS_X86
+    static constexpr uint64_t UNWIND_SAMPLE_REGS = (1ULL << 6) | (1ULL << 7) | (1ULL << 8);  // bp, sp, ip
+    static constexpr int UNWIND_SAMPLE_REG_NUM = 3;
+#elif defined(IS_RISCV64)
+    static constexpr uint64_t UNWIND_SAMPLE_REGS = (1ULL << 0) | (1ULL << 1) | (1ULL << 2) | (1ULL << 8);  // pc, ra, sp, s0
+    static constexpr int UNWIND_SAMPLE_REG_NUM = 4;
+#else
+    static constexpr uint64_t UNWIND_SAMPLE_REGS = (1ULL << 29) | (1ULL << 30) | (1ULL << 31) | (1ULL << 32);  // fp, lr, sp, pc
+    static constexpr int UNWIND_SAMPLE_REG_NUM = 4;
+#endif
+
+    struct UnwindRegs {
+        uint64_t pc = 0;
+        uint64_t sp = 0;
+        uint64_t fp = 0;
+        // Link register, which holds return address of a leaf function. 0 if the architecture has no link register.
+        uint64_t lr = 0;
+    };
+
+    UnwindRegs ParseUnwindRegs(const uint64_t *regs);
+
+    // Registers and user stack of a sample, the stack data is stored in EventData.userStackData.
+    struct UserStackSample {
+        size_t idx;
+        UnwindRegs regs;
+        size_t offset;
+        size_t size;
+    };
+
+    /**
+     * Rules to recover the caller frame at an address, which are flattened from cfi instructions.
+     * Only registers needed by unwinding are kept, so that a row is 16 bytes.
+     */
+    struct CfiRow {
+        static constexpr uint8_t CFA_SP = 0;
+        static constexpr uint8_t CFA_FP = 1;
+        static constexpr uint8_t CFA_INVALID = 2;
+        static constexpr int16_t RA_UNDEFINED = INT16_MIN;
+
+        uint32_t pc;          // start of row, relative to base of table.
+        int32_t cfaOffset;    // cfa is sp or fp of this frame plus cfaOffset.
+        int16_t fpOffset;     // fp of caller is saved at cfa + fpOffset, 0 if fp is not changed.
+        int16_t raOffset;     // return address is saved at cfa + raOffset, 0 if it is in link register.
+        uint8_t cfaReg;
+    };
+
+    /**
+     * Rows of all FDEs in .eh_frame and .debug_frame of an elf file, sorted by address.
+     * A row is valid until the next row, and gaps between functions are filled with invalid rows.
+     */
+    class CfiTable {
+    public:
+        /**
+         * @brief Parse cfi of an elf file. Return nullptr if the file is not a 64-bit elf or has no cfi.
+         */
+        static std::shared_ptr<CfiTable> Load(const std::string &path);
+
+        /**
+         * @brief Find row of an address, which is a file offset for shared objects and virtual address for
+         * executables, the same as the address to search symbols. Return nullptr if no cfi covers it.
+         */
+        const CfiRow *Find(unsigned long elfAddr) const;
+
+        size_t Size() const
+        {
+            return rows.size();
+        }
+
+    private:
+        struct Segment {
+            uint64_t offset;
+            uint64_t vaddr;
+            uint64_t size;
+        };
+
+        bool isExec = false;
+        std::vector<Segment> segments;
+        uint64_t base = 0;
+        std::vector<CfiRow> rows;
+
+        friend class CfiParser;
+    };
+
+    class DwarfUnwinder {
+    public:
+        static DwarfUnwinder &GetInstance();
+
+        virtual ~DwarfUnwinder() = default;
+
+        /**
+         * @brief Unwind from registers and a copy of user stack beginning at sp, which is thread safe.
+         * Addresses of frames are appended from the innermost one, which is pc.
+         */
+        void Unwind(int pid, const UnwindRegs &regs, const char *stack, size_t size,
+                    std::vector<unsigned long> &frames);
+
+    protected:
+        /**
+         * @brief Find cfi of module which an address belongs to, and convert the address to elf address.
+         */
+        virtual std::shared_ptr<const CfiTable> FindTable(int pid, unsigned long addr, unsigned long &elfAddr);
+
+    private:
+        std::mutex mtx;
+        // Tables are shared by processes mapping the same file, which are keyed by module key, i.e. build-id or
+        // device, inode and mtime. nullptr is cached for files without cfi. Both caches are bounded.
+        std::unordered_map<std::string, std::shared_ptr<const CfiTable>> tables;
+        std::unordered_map<std::shared_ptr<KUNPENG_SYM::ModuleMap>, std::shared_ptr<const CfiTable>> moduleTables;
+    };
+
+    /**
+     * @brief Unwind user stacks of samples in parallel, and prepend frames to ips of samples.
+     * Modules of processes should be recorded before that, and stack data is released after unwinding.
+     */
+    void UnwindUserStacks(EventData &eventData);
+}   // namespace KUNPENG_PMU
+#endif
@@ -52,6 +52,15 @@ int KUNPENG_PMU::PerfEvt::Disable()
     return LIBPERF_ERR_FAILED_PMU_DISABLE;
 }
 
+int KUNPENG_PMU::PerfEvt::SetPeriod(__u64 value)
+{
+    // For events with freq set, <value> is the new sample frequency.
+    if (ioctl(this->fd, PERF_EVENT_IOC_PERIOD, &value) == 0) {
+        return SUCCESS;
+    }
+    return LIBPERF_ERR_FAILED_PMU_SET_PERIOD;
+}
+
 int KUNPENG_PMU::PerfEvt::Close()
 {
     close(this->fd);
@@ -39,6 +39,7 @@ public:
     virtual int Enable();
     virtual int Reset();
     virtual int Close();
+    virtual int SetPeriod(__u64 value);
     virtual int BeginRead();
     virtual int EndRead();
 
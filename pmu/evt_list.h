@@ -118,6 +118,12 @@ public:
     virtual void ClearExitFd(std::set<int> noProcList) = 0;
     virtual void RemoveInitErr() = 0;
 
+    // Multiply sample period of all events by <scale>, based on the period or freq in PmuAttr.
+    virtual int ScalePeriod(const double scale)
+    {
+        return SUCCESS;
+    }
+
 protected:
     using PerfEvtPtr = std::shared_ptr<KUNPENG_PMU::PerfEvt>;
     std::vector<CpuPtr> cpuList;
@@ -13,6 +13,11 @@
  * Description: implementations for managing and interacting with performance events in the KUNPENG_PMU namespace
  ******************************************************************************/
 #include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
 #include <unordered_set>
 #include <fstream>
 #include "cpu_map.h"
@@ -21,10 +26,16 @@
 #include "pcerr.h"
 #include "log.h"
 #include "common.h"
+#include "task_runner.h"
 #include "evt_list_default.h"
 
 using namespace std;
 
+// Upper bound of threads used to open events in EvtListDefault::Init.
+static constexpr size_t MAX_INIT_WORKERS = 32;
+// Each worker should have enough perf_event_open calls to pay for its creation.
+static constexpr size_t MIN_CELLS_PER_WORKER = 16;
+
 int KUNPENG_PMU::EvtListDefault::CollectorXYArrayDoTask(std::vector<std::vector<PerfEvtPtr>>& xyArray, int task)
 {
     std::unique_lock<std::mutex> lock(mutex);
@@ -91,57 +102,182 @@ void KUNPENG_PMU::EvtListDefault::AdaptErrInfo(int err, PerfEvtPtr perfEvt)
     }
 }
 
+static unsigned RunInitTasks(size_t taskNum, const std::function<void(size_t)> &task)
+{
+    return RunParallelTasks(taskNum, MAX_INIT_WORKERS, MIN_CELLS_PER_WORKER, task);
+}
+
+static int64_t ElapsedUs(const std::chrono::steady_clock::time_point &begin)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void KUNPENG_PMU::EvtListDefault::InitCellEvt(InitCell &cell, const bool groupEnable, const int resetOutputFd)
+{
+    // Runs on init workers: only touch <cell>, pcerr and procMap are left to MergeInitCells.
+    auto begin = std::chrono::steady_clock::now();
+    auto &perfEvt = cell.perfEvt;
+    int err = perfEvt->Init(groupEnable, cell.groupFd, resetOutputFd);
+    if (err == LIBPERF_ERR_NO_PERMISSION && !this->pmuEvt->excludeKernel && !this->pmuEvt->excludeUser && GetParanoidVal() > 1) {
+        perfEvt->SetNeedTryExcludeKernel(true);
+        err = perfEvt->Init(groupEnable, cell.groupFd, resetOutputFd);
+    }
+    cell.err = err;
+    cell.savedErrno = errno;
+    cell.done = true;
+    cell.costUs = ElapsedUs(begin);
+}
+
+int KUNPENG_PMU::EvtListDefault::MergeInitCells(std::vector<std::vector<InitCell>> &cells)
+{
+    int firstErr = SUCCESS;
+    for (auto &rowCells : cells) {
+        std::vector<PerfEvtPtr> evtVec{};
+        for (auto &cell : rowCells) {
+            if (!cell.done) {
+                // Skipped because a main pid has already failed.
+                continue;
+            }
+            if (cell.err == SUCCESS) {
+                fdList.insert(cell.perfEvt->GetFd());
+                evtVec.emplace_back(cell.perfEvt);
+                continue;
+            }
+            if (!cell.isMain) {
+                // child pid init err
+                cell.perfEvt->SetInitErr(true);
+                evtVec.emplace_back(cell.perfEvt);
+                continue;
+            }
+            if (firstErr == SUCCESS) {
+                firstErr = cell.err;
+                errno = cell.savedErrno;
+                this->AdaptErrInfo(cell.err, cell.perfEvt);
+            }
+        }
+        // Opened fds are kept in xyCounterArray even on failure, so that Close releases them.
+        this->xyCounterArray.emplace_back(evtVec);
+    }
+    return firstErr;
+}
+
 int KUNPENG_PMU::EvtListDefault::Init(const bool groupEnable, const std::shared_ptr<EvtList> evtLeader)
 {
     // Init process map.
     for (auto& proc: pidList) {
         procMap[proc->tid] = proc; 
     }
+    auto evtleaderDefault = std::dynamic_pointer_cast<EvtListDefault>(evtLeader);
+    std::vector<std::vector<InitCell>> cells(numCpu);
+    size_t cellNum = 0;
+    // In perCpuSample mode, one cpu-wide event per cpu replaces the events of all threads,
+    // samples of other processes are dropped by the sampler.
+    unsigned int colNum = this->pmuEvt->perCpuSample ? 1 : numPid;
     for (unsigned int row = 0; row < numCpu; row++) {
-        int resetOutPutFd = -1;
-        std::vector<PerfEvtPtr> evtVec{};
-        for (unsigned int col = 0; col < numPid; col++) {
-            PerfEvtPtr perfEvt =
-                    this->MapPmuAttr(this->cpuList[row]->coreId, this->pidList[col]->tid, this->pmuEvt.get());
+        for (unsigned int col = 0; col < colNum; col++) {
+            int pid = this->pmuEvt->perCpuSample ? -1 : this->pidList[col]->tid;
+            PerfEvtPtr perfEvt = this->MapPmuAttr(this->cpuList[row]->coreId, pid, this->pmuEvt.get());
             if (perfEvt == nullptr) {
                 continue;
             }
-            if (col > 0 && !evtVec.empty() && !perfEvt->GetPerThread()) {
-                resetOutPutFd = evtVec[0]->GetFd();
-            }
             perfEvt->SetSymbolMode(symMode);
             perfEvt->SetBranchSampleFilter(branchSampleFilter);
-            auto evtleaderDefault = std::dynamic_pointer_cast<EvtListDefault>(evtLeader);
-            int groupFd = -1;
+            InitCell cell;
             if (groupEnable && evtleaderDefault) {
                 // if leader initErr should skip;
                 if (evtleaderDefault->xyCounterArray[row][col]->GetInitErr()) {
                     continue;
                 }
-                groupFd = evtleaderDefault->xyCounterArray[row][col]->GetFd();
+                cell.groupFd = evtleaderDefault->xyCounterArray[row][col]->GetFd();
             }
-            int err = perfEvt->Init(groupEnable, groupFd, resetOutPutFd);
-            if (err == LIBPERF_ERR_NO_PERMISSION && !this->pmuEvt->excludeKernel && !this->pmuEvt->excludeUser && GetParanoidVal() > 1) {
-                perfEvt->SetNeedTryExcludeKernel(true);
-                err = perfEvt->Init(groupEnable, groupFd, resetOutPutFd);
-            }
-            if (err != SUCCESS) {
-                if (!perfEvt->IsMainPid()) {
-                    // child pid init err
-                    perfEvt->SetInitErr(true);
-                    evtVec.emplace_back(perfEvt);
-                    continue;
+            cell.isMain = perfEvt->IsMainPid();
+            cell.perfEvt = perfEvt;
+            cells[row].emplace_back(cell);
+            ++cellNum;
+        }
+    }
+
+    // Spe collectors are shared per cpu in a static map, keep them on the calling thread.
+    bool parallel = this->pmuEvt->collectType != SPE_SAMPLING;
+    // Without perThread, sampling events of one cpu share the ring buffer of the first opened event,
+    // so that event has to be opened before the others of its row can be redirected with SET_OUTPUT.
+    bool redirect = this->pmuEvt->collectType == SAMPLING && !this->pmuEvt->perThread;
+    std::vector<int> outputFd(numCpu, -1);
+    std::vector<size_t> firstPending(numCpu, 0);
+    std::atomic<bool> mainFailed(false);
+    int64_t anchorUs = 0;
+    unsigned workerNum = 1;
+    auto begin = std::chrono::steady_clock::now();
+    if (redirect) {
+        // Phase 1: per row, open events in order until one owns a ring buffer.
+        auto openAnchor = [&](size_t row) {
+            auto &rowCells = cells[row];
+            for (auto &cell : rowCells) {
+                if (mainFailed) {
+                    return;
+                }
+                InitCellEvt(cell, groupEnable, -1);
+                firstPending[row]++;
+                if (cell.err == SUCCESS) {
+                    outputFd[row] = cell.perfEvt->GetFd();
+                    return;
+                }
+                if (cell.isMain) {
+                    mainFailed = true;
+                    return;
                 }
-                this->AdaptErrInfo(err, perfEvt);
-                return err;
             }
-            fdList.insert(perfEvt->GetFd());
-            evtVec.emplace_back(perfEvt);
+        };
+        if (parallel) {
+            workerNum = RunInitTasks(numCpu, openAnchor);
+        } else {
+            for (size_t row = 0; row < numCpu; ++row) {
+                openAnchor(row);
+            }
         }
-        this->xyCounterArray.emplace_back(evtVec);
+        anchorUs = ElapsedUs(begin);
     }
 
-    return SUCCESS;
+    // Phase 2: the remaining events are independent of each other.
+    std::vector<std::pair<size_t, size_t>> pending;
+    pending.reserve(cellNum);
+    for (size_t row = 0; row < numCpu; ++row) {
+        for (size_t col = firstPending[row]; col < cells[row].size(); ++col) {
+            pending.emplace_back(row, col);
+        }
+    }
+    auto fanOutBegin = std::chrono::steady_clock::now();
+    auto openPending = [&](size_t i) {
+        if (mainFailed) {
+            return;
+        }
+        auto &cell = cells[pending[i].first][pending[i].second];
+        InitCellEvt(cell, groupEnable, outputFd[pending[i].first]);
+        if (cell.err != SUCCESS && cell.isMain) {
+            mainFailed = true;
+        }
+    };
+    if (parallel && !mainFailed) {
+        workerNum = std::max(workerNum, RunInitTasks(pending.size(), openPending));
+    } else {
+        for (size_t i = 0; i < pending.size(); ++i) {
+            openPending(i);
+        }
+    }
+    int64_t fanOutUs = ElapsedUs(fanOutBegin);
+
+    int64_t anchorBusyUs = 0;
+    int64_t fanOutBusyUs = 0;
+    for (size_t row = 0; row < numCpu; ++row) {
+        for (size_t col = 0; col < cells[row].size(); ++col) {
+            (col < firstPending[row] ? anchorBusyUs : fanOutBusyUs) += cells[row][col].costUs;
+        }
+    }
+    DBG_PRINT("evt: %s init %zu events with %u workers, ring buffer owners: %lld us (busy %lld us), "
+              "others: %lld us (busy %lld us)\n", pmuEvt->name.c_str(), cellNum, workerNum, (long long)anchorUs,
+              (long long)anchorBusyUs, (long long)fanOutUs, (long long)fanOutBusyUs);
+
+    return MergeInitCells(cells);
 }
 
 int KUNPENG_PMU::EvtListDefault::Start()
@@ -175,6 +311,38 @@ int KUNPENG_PMU::EvtListDefault::Reset()
     return CollectorXYArrayDoTask(this->xyCounterArray, RESET);
 }
 
+int KUNPENG_PMU::EvtListDefault::ScalePeriod(const double scale)
+{
+    if (pmuEvt->collectType != SAMPLING) {
+        return SUCCESS;
+    }
+    if (pmuEvt->blockedSample == 1 && pmuEvt->name == "context-switches") {
+        // Every context switch is needed to calculate off-cpu time.
+        return SUCCESS;
+    }
+    __u64 value;
+    if (pmuEvt->useFreq) {
+        value = static_cast<__u64>(pmuEvt->freq / scale);
+    } else {
+        value = static_cast<__u64>(pmuEvt->period * scale);
+    }
+    value = std::max<__u64>(value, 1);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto& row: xyCounterArray) {
+        for (auto& evt: row) {
+            if (evt == nullptr || evt->GetInitErr()) {
+                continue;
+            }
+            auto err = evt->SetPeriod(value);
+            if (err != SUCCESS) {
+                return err;
+            }
+        }
+    }
+    return SUCCESS;
+}
+
 void KUNPENG_PMU::EvtListDefault::FillFields(
         size_t start, size_t end, CpuTopology* cpuTopo, ProcTopology* procTopo, vector<PmuData>& data)
 {
@@ -198,7 +366,7 @@ void KUNPENG_PMU::EvtListDefault::FillFields(
                 // If process has a fork call, it will generate a new pid and add a new comm.
                 if (data[i].pid > 0 && procMap.find(data[i].pid) != procMap.end()) {
                     data[i].comm = procMap[data[i].pid]->comm;   
-                } else {
+                } else if (procTopo != nullptr) {
                     data[i].comm = procTopo->comm;
                 }
             }
@@ -238,7 +406,9 @@ int KUNPENG_PMU::EvtListDefault::Read(EventData &eventData)
                           cpuTopo->coreId, eventData.data.size() - cnt);
             }
             // Fill event name and cpu topology.
-            FillFields(cnt, eventData.data.size(), cpuTopo, procMap[evt->GetPid()].get(), eventData.data);
+            auto findProc = procMap.find(evt->GetPid());
+            ProcTopology *procTopo = findProc == procMap.end() ? nullptr : findProc->second.get();
+            FillFields(cnt, eventData.data.size(), cpuTopo, procTopo, eventData.data);
         }
     }
 
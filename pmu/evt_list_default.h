@@ -24,6 +24,7 @@
 #include "cpu_map.h"
 #include "perf_counter_default.h"
 #include "pmu.h"
+#include "pcerrc.h"
 #include "process_map.h"
 #include "sampler.h"
 #include "spe_sampler.h"
@@ -49,10 +50,23 @@ public:
     void AddNewProcess(pid_t pid, const bool groupEnable, const std::shared_ptr<EvtList> evtLeader) override;
     void ClearExitFd(std::set<int> noProcList) override;
     void RemoveInitErr() override;
+    int ScalePeriod(const double scale) override;
 private:
+    // One (cpu, pid) cell of xyCounterArray waiting to be opened by an init worker.
+    struct InitCell {
+        PerfEvtPtr perfEvt = nullptr;
+        int groupFd = -1;
+        bool isMain = true;
+        bool done = false;
+        int err = SUCCESS;
+        int savedErrno = 0;
+        int64_t costUs = 0;
+    };
     int CollectorXYArrayDoTask(std::vector<std::vector<PerfEvtPtr>>& xyArray, int task);
     void FillFields(size_t start, size_t end, CpuTopology* cpuTopo, ProcTopology* procTopo, std::vector<PmuData>& pmuData);
     void AdaptErrInfo(int err, PerfEvtPtr perfEvt);
+    void InitCellEvt(InitCell &cell, const bool groupEnable, const int resetOutputFd);
+    int MergeInitCells(std::vector<std::vector<InitCell>> &cells);
     std::shared_ptr<PerfEvt> MapPmuAttr(int cpu, int pid, PmuEvt* pmuEvent);
     // Fixme: decouple group event with normal event, use different classes to implement Read and Init.
     std::unique_ptr<EventGroupInfo> groupInfo = nullptr;
@@ -208,7 +208,7 @@ struct CpuChunk {
 };
 
 static int TransferDriverToPmuData(PebsDriverSession& s, const CpuChunk& c, std::vector<PmuData>& outData,
-                                   std::vector<PmuDataExt*>& extPool, int totalSamples, int& idx)
+                                   KUNPENG_PMU::BranchPool& branchPool, int totalSamples, int& idx)
 {
     if (c.cpu < 0 || c.cpu >= s.cpuNum) {
         return -1;
@@ -254,8 +254,8 @@ static int TransferDriverToPmuData(PebsDriverSession& s, const CpuChunk& c, std:
 
         if (nr > 0) {
             try {
-                auto* ext = new PmuDataExt();
-                auto* br  = new BranchSampleRecord[nr]();
+                auto* ext = branchPool.Alloc((unsigned long)nr);
+                auto* br  = ext->branchRecords;
                 for (int k = 0; k < nr; k++) {
                     int i = validIdx[k];
                     uint64_t info = r->lbr_info[i];
@@ -265,10 +265,7 @@ static int TransferDriverToPmuData(PebsDriverSession& s, const CpuChunk& c, std:
                     br[k].misPred = (uint8_t)((info >> 63) & 1);
                     br[k].predicted = (uint8_t)(br[k].misPred ? 0 : 1);
                 }
-                ext->nr = (unsigned long)nr;
-                ext->branchRecords = br;
                 d.ext = ext;
-                extPool.push_back(ext);
             } catch (const std::bad_alloc&) {
                 pcerr::New(LIBPERF_ERR_LBR_DRIVER_INVALID, "Read LBR driver failed: bad_alloc occurs.");
                 return -1;
@@ -284,18 +281,6 @@ static int TransferDriverToPmuData(PebsDriverSession& s, const CpuChunk& c, std:
     return 0;
 }
 
-static inline void FreeExtPool(std::vector<PmuDataExt*>& pool)
-{
-    for (auto* ext : pool) {
-        if (!ext) {
-            continue;
-        }
-        delete[] ext->branchRecords;
-        delete ext;
-    }
-    pool.clear();
-}
-
 int PebsDriverManager::Read(int pd, PmuData** out)
 {
     if (!out) {
@@ -373,7 +358,6 @@ int PebsDriverManager::Read(int pd, PmuData** out)
     KUNPENG_PMU::EventData ed;
     ed.collectType = SAMPLING;
     ed.data.resize((size_t)totalSamples);
-    ed.extPool.clear();
     ed.sampleIps.clear();
     ed.sampleIps.reserve((size_t)totalSamples);
     int idx = 0;
@@ -381,12 +365,11 @@ int PebsDriverManager::Read(int pd, PmuData** out)
         int rc = TransferDriverToPmuData(
             s, c,
             ed.data,
-            ed.extPool,
+            KUNPENG_PMU::GetBranchPool(ed),
             totalSamples,
             idx
         );
         if (rc != 0) {
-            FreeExtPool(ed.extPool);
             return -1;
         }
         if (idx >= totalSamples) {
@@ -395,7 +378,6 @@ int PebsDriverManager::Read(int pd, PmuData** out)
     }
 
     if (idx <= 0) {
-        FreeExtPool(ed.extPool);
         return 0;
     }
     ed.data.resize((size_t)idx);
@@ -0,0 +1,271 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: fold spe samples into memory access heatmap by page, cache line, numa node and data source.
+ ******************************************************************************/
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+#include "pcerr.h"
+#include "cpu_map.h"
+#include "handle_registry.h"
+#include "mem_heatmap.h"
+
+using namespace std;
+using namespace pcerr;
+using namespace KUNPENG_PMU;
+
+static constexpr unsigned DEFAULT_CACHE_LINE_SIZE = 64;
+// Data source is not recorded for store and other operations.
+static constexpr unsigned short NO_DATA_SOURCE = 0xffff;
+
+static HandleRegistry<MemHeatmap> heatmaps;
+
+static inline bool IsPowerOf2(unsigned long value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static inline unsigned LatBucket(unsigned short lat)
+{
+    if (lat == 0) {
+        return 0;
+    }
+    unsigned bucket = 32 - __builtin_clz(lat);
+    return min(bucket, static_cast<unsigned>(PMU_MEM_LAT_BUCKETS - 1));
+}
+
+MemHeatmap::MemHeatmap(const PmuMemHeatmapAttr &attr)
+{
+    unsigned long pageSize = attr.pageSize == 0 ? sysconf(_SC_PAGESIZE) : attr.pageSize;
+    unsigned long lineSize = attr.cacheLineSize == 0 ? DEFAULT_CACHE_LINE_SIZE : attr.cacheLineSize;
+    pageMask = ~(pageSize - 1);
+    lineMask = ~(lineSize - 1);
+    topN = attr.topN;
+}
+
+void MemHeatmap::AddToSpot(SpotMap &spots, const SpotKey &key, const PmuDataExt *ext, int memNode, bool remote)
+{
+    auto findSpot = spots.find(key);
+    if (findSpot == spots.end()) {
+        PmuMemHotSpot spot = {0};
+        spot.pid = key.pid;
+        spot.va = key.va;
+        findSpot = spots.emplace(key, spot).first;
+    }
+    auto &spot = findSpot->second;
+    if (ext->pa != 0) {
+        spot.pa = ext->pa;
+        spot.nodeId = memNode;
+    } else if (spot.samples == 0) {
+        spot.nodeId = -1;
+    }
+    spot.samples++;
+    spot.stores += (ext->op & SPE_OP_ST) ? 1 : 0;
+    spot.remote += remote ? 1 : 0;
+    spot.latSum += ext->lat;
+    spot.maxLat = max(spot.maxLat, ext->lat);
+}
+
+void MemHeatmap::Add(const PmuData *data, unsigned len)
+{
+    lock_guard<mutex> lg(mtx);
+    unsigned long lastPaPage = 0;
+    int lastMemNode = -1;
+    for (unsigned i = 0; i < len; ++i) {
+        const PmuDataExt *ext = data[i].ext;
+        if (ext == nullptr || ext->va == 0) {
+            continue;
+        }
+        // Numa node of memory is looked up by physical page, and adjacent samples are mostly in the same page.
+        int memNode = -1;
+        if (ext->pa != 0) {
+            unsigned long paPage = ext->pa & pageMask;
+            if (paPage != lastPaPage) {
+                lastPaPage = paPage;
+                lastMemNode = GetNumaNodeOfPhysAddr(ext->pa);
+            }
+            memNode = lastMemNode;
+        }
+        int cpuNode = data[i].cpuTopo != nullptr ? data[i].cpuTopo->numaId : GetNumaNodeOfCpu(data[i].cpu);
+        // Without physical address, rely on the remote hint of spe event and data source.
+        bool hasLocality = cpuNode >= 0 && memNode >= 0;
+        bool remote = hasLocality ? cpuNode != memNode :
+                      (ext->event & SPE_EV_REMOTE_ACCESS) != 0 || ext->source == HIP_REMOTE_MEM;
+
+        AddToSpot(pages, {data[i].pid, ext->va & pageMask}, ext, memNode, remote);
+        AddToSpot(lines, {data[i].pid, ext->va & lineMask}, ext, memNode, remote);
+
+        auto findNode = nodes.find(cpuNode);
+        if (findNode == nodes.end()) {
+            PmuMemNodeStat nodeStat = {0};
+            nodeStat.nodeId = cpuNode;
+            findNode = nodes.emplace(cpuNode, nodeStat).first;
+        }
+        if (remote) {
+            findNode->second.remote++;
+        } else if (hasLocality) {
+            findNode->second.local++;
+        } else {
+            findNode->second.unknown++;
+        }
+
+        if (ext->source != NO_DATA_SOURCE) {
+            auto findSource = sources.find(ext->source);
+            if (findSource == sources.end()) {
+                PmuMemSourceStat sourceStat = {0};
+                sourceStat.source = ext->source;
+                findSource = sources.emplace(ext->source, sourceStat).first;
+            }
+            auto &sourceStat = findSource->second;
+            sourceStat.samples++;
+            sourceStat.latSum += ext->lat;
+            sourceStat.maxLat = max(sourceStat.maxLat, ext->lat);
+            sourceStat.latHist[LatBucket(ext->lat)]++;
+        }
+
+        if (samples == 0 || data[i].ts < beginTs) {
+            beginTs = data[i].ts;
+        }
+        endTs = max(endTs, data[i].ts);
+        samples++;
+    }
+}
+
+void MemHeatmap::OutputSpots(SpotMap &spots, PmuMemHotSpot **out, unsigned *num) const
+{
+    vector<const PmuMemHotSpot *> sorted;
+    sorted.reserve(spots.size());
+    for (auto &spot : spots) {
+        sorted.push_back(&spot.second);
+    }
+    size_t outNum = (topN == 0 || topN > sorted.size()) ? sorted.size() : topN;
+    auto hotter = [](const PmuMemHotSpot *a, const PmuMemHotSpot *b) {
+        return a->samples != b->samples ? a->samples > b->samples : a->latSum > b->latSum;
+    };
+    partial_sort(sorted.begin(), sorted.begin() + outNum, sorted.end(), hotter);
+    *out = outNum == 0 ? nullptr : new PmuMemHotSpot[outNum];
+    for (size_t i = 0; i < outNum; ++i) {
+        (*out)[i] = *sorted[i];
+    }
+    *num = outNum;
+}
+
+PmuMemHeatmapData *MemHeatmap::Read()
+{
+    lock_guard<mutex> lg(mtx);
+    unique_ptr<PmuMemHeatmapData> heatmapData(new PmuMemHeatmapData());
+    heatmapData->samples = samples;
+    heatmapData->beginTs = beginTs;
+    heatmapData->endTs = endTs;
+    OutputSpots(pages, &heatmapData->pages, &heatmapData->numPages);
+    OutputSpots(lines, &heatmapData->lines, &heatmapData->numLines);
+
+    heatmapData->numNodes = nodes.size();
+    heatmapData->nodes = nodes.empty() ? nullptr : new PmuMemNodeStat[nodes.size()];
+    size_t idx = 0;
+    for (auto &node : nodes) {
+        heatmapData->nodes[idx++] = node.second;
+    }
+    heatmapData->numSources = sources.size();
+    heatmapData->sources = sources.empty() ? nullptr : new PmuMemSourceStat[sources.size()];
+    idx = 0;
+    for (auto &source : sources) {
+        heatmapData->sources[idx++] = source.second;
+    }
+
+    // Start a new window.
+    samples = 0;
+    beginTs = 0;
+    endTs = 0;
+    pages.clear();
+    lines.clear();
+    nodes.clear();
+    sources.clear();
+    return heatmapData.release();
+}
+
+void MemHeatmap::Free(PmuMemHeatmapData *heatmapData)
+{
+    delete[] heatmapData->pages;
+    delete[] heatmapData->lines;
+    delete[] heatmapData->nodes;
+    delete[] heatmapData->sources;
+    delete heatmapData;
+}
+
+static int CheckHeatmapAttr(const PmuMemHeatmapAttr *attr)
+{
+    if (attr == nullptr) {
+        New(LIBPERF_ERR_NULL_POINTER, "PmuMemHeatmapAttr cannot be null");
+        return LIBPERF_ERR_NULL_POINTER;
+    }
+    if (attr->pageSize != 0 && !IsPowerOf2(attr->pageSize)) {
+        New(LIBPERF_ERR_INVALID_HEATMAP_ATTR, "pageSize should be power of 2");
+        return LIBPERF_ERR_INVALID_HEATMAP_ATTR;
+    }
+    if (attr->cacheLineSize != 0 && !IsPowerOf2(attr->cacheLineSize)) {
+        New(LIBPERF_ERR_INVALID_HEATMAP_ATTR, "cacheLineSize should be power of 2");
+        return LIBPERF_ERR_INVALID_HEATMAP_ATTR;
+    }
+    unsigned long pageSize = attr->pageSize == 0 ? sysconf(_SC_PAGESIZE) : attr->pageSize;
+    unsigned long lineSize = attr->cacheLineSize == 0 ? DEFAULT_CACHE_LINE_SIZE : attr->cacheLineSize;
+    if (lineSize > pageSize) {
+        New(LIBPERF_ERR_INVALID_HEATMAP_ATTR, "cacheLineSize should not be larger than pageSize");
+        return LIBPERF_ERR_INVALID_HEATMAP_ATTR;
+    }
+    return SUCCESS;
+}
+
+PmuMemHeatmap PmuMemHeatmapOpen(struct PmuMemHeatmapAttr *attr)
+{
+    if (CheckHeatmapAttr(attr) != SUCCESS) {
+        return NULL;
+    }
+    return heatmaps.Open(*attr);
+}
+
+int PmuMemHeatmapAdd(PmuMemHeatmap heatmap, struct PmuData *data, unsigned len)
+{
+    return heatmaps.Call(heatmap, LIBPERF_ERR_INVALID_HEATMAP, [&](MemHeatmap &memHeatmap) {
+        if (data == nullptr && len > 0) {
+            New(LIBPERF_ERR_NULL_POINTER, "PmuData cannot be null");
+            return LIBPERF_ERR_NULL_POINTER;
+        }
+        memHeatmap.Add(data, len);
+        return SUCCESS;
+    });
+}
+
+int PmuMemHeatmapRead(PmuMemHeatmap heatmap, struct PmuMemHeatmapData **heatmapData)
+{
+    return heatmaps.Call(heatmap, LIBPERF_ERR_INVALID_HEATMAP, [&](MemHeatmap &memHeatmap) {
+        if (heatmapData == nullptr) {
+            New(LIBPERF_ERR_NULL_POINTER, "heatmapData cannot be null");
+            return LIBPERF_ERR_NULL_POINTER;
+        }
+        *heatmapData = memHeatmap.Read();
+        return SUCCESS;
+    });
+}
+
+void PmuMemHeatmapDataFree(struct PmuMemHeatmapData *heatmapData)
+{
+    if (heatmapData == nullptr) {
+        return;
+    }
+    MemHeatmap::Free(heatmapData);
+}
+
+void PmuMemHeatmapClose(PmuMemHeatmap heatmap)
+{
+    heatmaps.Close(heatmap);
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: fold spe samples into memory access heatmap by page, cache line, numa node and data source.
+ ******************************************************************************/
+#ifndef MEM_HEATMAP_H
+#define MEM_HEATMAP_H
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "pmu.h"
+
+namespace KUNPENG_PMU {
+    class MemHeatmap {
+    public:
+        explicit MemHeatmap(const PmuMemHeatmapAttr &attr);
+
+        /**
+         * @brief Fold samples with data address into the current window.
+         */
+        void Add(const PmuData *data, unsigned len);
+
+        /**
+         * @brief Output heatmap of the current window, and start a new window.
+         */
+        PmuMemHeatmapData *Read();
+
+        static void Free(PmuMemHeatmapData *heatmapData);
+
+    private:
+        struct SpotKey {
+            int pid;
+            unsigned long va;
+
+            bool operator==(const SpotKey &other) const
+            {
+                return pid == other.pid && va == other.va;
+            }
+        };
+
+        struct SpotKeyHash {
+            size_t operator()(const SpotKey &key) const
+            {
+                return std::hash<unsigned long>()(key.va) ^ (static_cast<size_t>(key.pid) << 1);
+            }
+        };
+
+        using SpotMap = std::unordered_map<SpotKey, PmuMemHotSpot, SpotKeyHash>;
+
+        void AddToSpot(SpotMap &spots, const SpotKey &key, const PmuDataExt *ext, int memNode, bool remote);
+        void OutputSpots(SpotMap &spots, PmuMemHotSpot **out, unsigned *num) const;
+
+        unsigned long pageMask = 0;
+        unsigned long lineMask = 0;
+        unsigned topN = 0;
+
+        std::mutex mtx;
+        uint64_t samples = 0;
+        int64_t beginTs = 0;
+        int64_t endTs = 0;
+        SpotMap pages;
+        SpotMap lines;
+        std::map<int, PmuMemNodeStat> nodes;
+        std::map<unsigned short, PmuMemSourceStat> sources;
+    };
+}   // namespace KUNPENG_PMU
+#endif
@@ -0,0 +1,177 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: attribute off-cpu time of threads to context switch samples in blocked sample mode.
+ ******************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "symbol.h"
+#include "log.h"
+#include "off_cpu.h"
+
+using namespace std;
+
+namespace KUNPENG_PMU {
+
+void TrimKernelStack(PmuData &data)
+{
+    auto stack = data.stack;
+    while (stack != nullptr && stack->symbol != nullptr) {
+        if (strcmp(stack->symbol->module, "[kernel]") == 0) {
+            stack = stack->next;
+            continue;
+        }
+        data.stack = stack;
+        break;
+    }
+}
+
+bool OffCpuTracker::ToPeriod(const ThreadState &state, int64_t offTime, uint64_t &period) const
+{
+    // Only the on cpu event is cycles, so the rate of the last two samples is cycles per ns.
+    if (state.prevOnTs == 0 || state.lastOnTs <= state.prevOnTs) {
+        return false;
+    }
+    period = static_cast<uint64_t>(static_cast<double>(offTime) * state.lastOnPeriod /
+                                   (state.lastOnTs - state.prevOnTs));
+    return true;
+}
+
+void OffCpuTracker::Attribute(ThreadState &state, int64_t ts, EventData &eventData)
+{
+    int64_t offTime = ts - state.attributedTs;
+    uint64_t period = 0;
+    if (offTime <= 0 || !ToPeriod(state, offTime, period)) {
+        return;
+    }
+    state.attributedTs = ts;
+    if (state.offIdx != NO_SAMPLE) {
+        auto &offData = eventData.data[state.offIdx];
+        offData.period = period;
+        DBG_PRINT("Context switch: ts=%ld, tid=%d, offTime=%ld, period=%lu\n", offData.ts, offData.tid, offTime, period);
+    } else if (state.hasLastOff) {
+        // The sample has been read before, and the remaining off-cpu time is carried by its copy.
+        eventData.data.push_back(state.lastOff);
+        auto &carried = eventData.data.back();
+        carried.ts = ts;
+        carried.period = period;
+        carried.comm = state.lastOffComm.empty() ? nullptr : KeepString(eventData, state.lastOffComm);
+        carried.cgroupName = state.lastOffCgroup.empty() ? nullptr : KeepString(eventData, state.lastOffCgroup);
+        eventData.sampleIps.push_back(state.lastOffIps);
+        DBG_PRINT("Context switch carried: ts=%ld, tid=%d, offTime=%ld, period=%lu\n", ts, state.lastOff.tid,
+                  offTime, period);
+    }
+}
+
+void OffCpuTracker::KeepLastOff(ThreadState &state, const PmuData &offData)
+{
+    state.lastOff = offData;
+    state.lastOff.ext = nullptr;
+    state.lastOff.rawData = nullptr;
+    state.lastOffComm = offData.comm == nullptr ? "" : offData.comm;
+    state.lastOffCgroup = offData.cgroupName == nullptr ? "" : offData.cgroupName;
+    state.lastOff.comm = nullptr;
+    state.lastOff.cgroupName = nullptr;
+    state.hasLastOff = true;
+}
+
+void OffCpuTracker::Process(EventData &eventData, SymbolMode symMode)
+{
+    auto &data = eventData.data;
+    auto &switchData = eventData.switchData;
+    // Only records of the same thread need to be ordered, and data is left in the order of reading.
+    unordered_map<int, vector<Record>> threadRecords;
+    int64_t lastTs = 0;
+    size_t dataNum = data.size();
+    for (size_t i = 0; i < dataNum; ++i) {
+        bool offCpu = strcmp(data[i].evt, "context-switches") == 0;
+        if (offCpu && symMode != NO_SYMBOL_RESOLVE) {
+            TrimKernelStack(data[i]);
+        }
+        threadRecords[data[i].tid].push_back({data[i].ts, offCpu ? OFF_CPU_SAMPLE : ON_CPU_SAMPLE, i});
+        lastTs = max(lastTs, data[i].ts);
+    }
+    for (size_t i = 0; i < switchData.size(); ++i) {
+        int64_t ts = static_cast<int64_t>(switchData[i].ts);
+        RecordType type = switchData[i].exited ? EXIT : (switchData[i].swOut ? SWITCH_OUT : SWITCH_IN);
+        threadRecords[switchData[i].tid].push_back({ts, type, i});
+        lastTs = max(lastTs, ts);
+    }
+
+    for (auto &thread : threadRecords) {
+        auto &records = thread.second;
+        sort(records.begin(), records.end());
+        auto &state = threads[thread.first];
+        for (auto &record : records) {
+            switch (record.type) {
+                case ON_CPU_SAMPLE:
+                    state.prevOnTs = state.lastOnTs;
+                    state.lastOnTs = record.ts;
+                    state.lastOnPeriod = data[record.idx].period;
+                    break;
+                case OFF_CPU_SAMPLE:
+                    state.offIdx = record.idx;
+                    state.hasLastOff = false;
+                    break;
+                case SWITCH_OUT:
+                    state.outTs = record.ts;
+                    state.attributedTs = record.ts;
+                    break;
+                case SWITCH_IN:
+                    // Switch in without switch out is the first record of a thread, which is ignored.
+                    if (state.outTs != 0) {
+                        Attribute(state, record.ts, eventData);
+                    }
+                    state.outTs = 0;
+                    state.offIdx = NO_SAMPLE;
+                    state.hasLastOff = false;
+                    break;
+                case EXIT:
+                    // A thread exiting while switched out is off cpu until then.
+                    if (state.outTs != 0) {
+                        Attribute(state, record.ts, eventData);
+                    }
+                    state.outTs = 0;
+                    state.exited = true;
+                    break;
+            }
+        }
+    }
+
+    // Threads which are still off cpu are attributed until the last record of this read.
+    for (auto iter = threads.begin(); iter != threads.end();) {
+        auto &state = iter->second;
+        if (state.exited) {
+            iter = threads.erase(iter);
+            continue;
+        }
+        if (state.outTs == 0) {
+            // Thread without records is not running, and the state is rebuilt when it appears again.
+            if (threadRecords.find(iter->first) == threadRecords.end()) {
+                iter = threads.erase(iter);
+                continue;
+            }
+            state.offIdx = NO_SAMPLE;
+            ++iter;
+            continue;
+        }
+        Attribute(state, lastTs, eventData);
+        if (state.offIdx != NO_SAMPLE) {
+            KeepLastOff(state, data[state.offIdx]);
+            state.lastOffIps = eventData.sampleIps[state.offIdx];
+            state.offIdx = NO_SAMPLE;
+        }
+        ++iter;
+    }
+    vector<PmuSwitchData>().swap(switchData);
+}
+
+}   // namespace KUNPENG_PMU
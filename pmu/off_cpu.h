@@ -0,0 +1,91 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: attribute off-cpu time of threads to context switch samples in blocked sample mode.
+ ******************************************************************************/
+#ifndef PMU_OFF_CPU_H
+#define PMU_OFF_CPU_H
+#include <string>
+#include <unordered_map>
+#include "pmu.h"
+#include "pmu_event.h"
+
+namespace KUNPENG_PMU {
+
+/**
+ * Convert stack from 'schedule[kernel] -> futex_wait[kernel] -> ...[kernel] -> lock_wait -> start_thread'
+ * to 'lock_wait -> start_thread', only keeping user stack.
+ */
+void TrimKernelStack(PmuData &data);
+
+/**
+ * A state machine per thread, driven by switch records and samples of each read.
+ * Period of a context-switches sample is set to the cycles the thread could run during its off-cpu time,
+ * which is estimated by the last two on-cpu samples of the thread.
+ * If a thread is still off cpu at the end of a read, time until then is attributed to its sample,
+ * and the rest is emitted as a copy of that sample in the read that sees the thread switched in.
+ * So only the last off-cpu sample of a blocked thread is kept across reads, until it switches in or exits.
+ */
+class OffCpuTracker {
+public:
+    void Process(EventData &eventData, SymbolMode symMode);
+
+private:
+    enum RecordType {
+        ON_CPU_SAMPLE,
+        OFF_CPU_SAMPLE,
+        SWITCH_OUT,
+        SWITCH_IN,
+        EXIT,
+    };
+
+    struct Record {
+        int64_t ts;
+        RecordType type;
+        size_t idx;
+
+        bool operator<(const Record &other) const
+        {
+            return ts != other.ts ? ts < other.ts : type < other.type;
+        }
+    };
+
+    struct ThreadState {
+        int64_t prevOnTs = 0;
+        int64_t lastOnTs = 0;
+        uint64_t lastOnPeriod = 0;
+        // Switch out time of current blocking, 0 if the thread is on cpu.
+        int64_t outTs = 0;
+        // Off-cpu time before it has been attributed to samples.
+        int64_t attributedTs = 0;
+        // Context-switches sample of current blocking in this read.
+        size_t offIdx = NO_SAMPLE;
+        // Copy of off-cpu sample of a blocking which spans reads. Data of that read may have been freed,
+        // so strings are copied and pointers to ext and raw data are cleared.
+        bool hasLastOff = false;
+        PmuData lastOff = {0};
+        PerfSampleIps lastOffIps;
+        std::string lastOffComm;
+        std::string lastOffCgroup;
+        // The thread has exited, and its state is dropped at the end of the read.
+        bool exited = false;
+    };
+
+    static constexpr size_t NO_SAMPLE = static_cast<size_t>(-1);
+
+    bool ToPeriod(const ThreadState &state, int64_t offTime, uint64_t &period) const;
+    void Attribute(ThreadState &state, int64_t ts, EventData &eventData);
+    void KeepLastOff(ThreadState &state, const PmuData &offData);
+
+    std::unordered_map<int, ThreadState> threads;
+};
+
+}   // namespace KUNPENG_PMU
+#endif
@@ -0,0 +1,95 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: adjust sample period of running events to keep within a cpu overhead budget.
+ ******************************************************************************/
+#include <algorithm>
+#include <ctime>
+#include "period_controller.h"
+
+using namespace std;
+
+namespace {
+    const double BUDGET_UNIT = 10000.0;
+    const double EWMA_ALPHA = 0.5;
+    // Ring buffers filled more than this ratio are about to lose records.
+    const float HIGH_RING_FILL = 0.5;
+    const float LOW_RING_FILL = 0.25;
+    // Restore period only if overhead is far below budget, to avoid oscillation.
+    const double LOW_OVERHEAD_RATIO = 0.5;
+    const double MIN_SCALE_UP = 1.25;
+    const double MAX_SCALE_UP = 4;
+    const double MAX_SCALE = 1024;
+    const int64_t NS_PER_SEC = 1000000000;
+
+    int64_t ClockNs(clockid_t clk)
+    {
+        struct timespec ts;
+        if (clock_gettime(clk, &ts) != 0) {
+            return 0;
+        }
+        return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+    }
+}
+
+KUNPENG_PMU::PeriodController::PeriodController(unsigned budget) : budget(budget / BUDGET_UNIT)
+{}
+
+void KUNPENG_PMU::PeriodController::BeginDrain()
+{
+    drainStartCpuNs = ClockNs(CLOCK_THREAD_CPUTIME_ID);
+}
+
+bool KUNPENG_PMU::PeriodController::EndDrain(float ringFill)
+{
+    int64_t drainCpuNs = ClockNs(CLOCK_THREAD_CPUTIME_ID) - drainStartCpuNs;
+    int64_t now = ClockNs(CLOCK_MONOTONIC);
+    if (lastDrainNs == 0) {
+        // The first drain has no interval to compare with.
+        lastDrainNs = now;
+        return false;
+    }
+    int64_t wallNs = now - lastDrainNs;
+    lastDrainNs = now;
+    return Update(drainCpuNs, wallNs, ringFill);
+}
+
+bool KUNPENG_PMU::PeriodController::Update(int64_t drainCpuNs, int64_t wallNs, float ringFill)
+{
+    if (wallNs <= 0 || budget <= 0) {
+        return false;
+    }
+    double cur = static_cast<double>(max<int64_t>(drainCpuNs, 0)) / wallNs;
+    overhead = hasOverhead ? EWMA_ALPHA * cur + (1 - EWMA_ALPHA) * overhead : cur;
+    hasOverhead = true;
+
+    double ratio = overhead / budget;
+    double newScale = scale;
+    if (ratio > 1 || ringFill >= HIGH_RING_FILL) {
+        // Sample count is inversely proportional to period, so enlarge period by the overrun ratio.
+        double factor = min(max(ratio, MIN_SCALE_UP), MAX_SCALE_UP);
+        if (ringFill >= 1) {
+            factor = MAX_SCALE_UP;
+        } else if (ringFill >= HIGH_RING_FILL) {
+            factor = max(factor, 2.0);
+        }
+        newScale = min(scale * factor, MAX_SCALE);
+    } else if (ratio < LOW_OVERHEAD_RATIO && ringFill < LOW_RING_FILL) {
+        newScale = max(scale / 2, 1.0);
+    }
+
+    if (newScale == scale) {
+        return false;
+    }
+    scale = newScale;
+    // Overhead measured with the old period is meaningless now.
+    hasOverhead = false;
+    return true;
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: adjust sample period of running events to keep within a cpu overhead budget.
+ ******************************************************************************/
+#ifndef PMU_PERIOD_CONTROLLER_H
+#define PMU_PERIOD_CONTROLLER_H
+#include <cstdint>
+
+namespace KUNPENG_PMU {
+
+/**
+ * Measure cpu time spent in draining ring buffers of one pd and decide how much the sample period
+ * should be enlarged. Scale is always >= 1, which means the controller never samples faster than
+ * the period or freq given by user.
+ */
+class PeriodController {
+public:
+    // <budget> is in units of 0.01% of one cpu.
+    explicit PeriodController(unsigned budget);
+
+    // Call before and after reading all ring buffers of one pd.
+    // EndDrain returns true if scale is changed and events should be updated.
+    void BeginDrain();
+    bool EndDrain(float ringFill);
+
+    double GetScale() const
+    {
+        return scale;
+    }
+
+    double GetOverhead() const
+    {
+        return overhead;
+    }
+
+private:
+    bool Update(int64_t drainCpuNs, int64_t wallNs, float ringFill);
+
+    double budget;
+    double scale = 1;
+    double overhead = 0;
+    bool hasOverhead = false;
+    int64_t lastDrainNs = 0;
+    int64_t drainStartCpuNs = 0;
+};
+}  // namespace KUNPENG_PMU
+#endif
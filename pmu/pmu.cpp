@@ -46,6 +46,8 @@ static unordered_map<int, int> groupEvtCapacity = {{HIPA, 12}, {HIPB, 8}, {HIPC,
 #define REQUEST_USER_ACCESS 0x2
 #define HARD_WARE_METRIC 0x1
 #define SAMPLING_RECORD_PERIOD 4000
+#define MAX_OVERHEAD_BUDGET 10000
+#define MAX_USER_STACK_SIZE 65528
 
 struct PmuTaskAttr* AssignPmuTaskParam(PmuTaskType collectType, struct PmuAttr *attr);
 
@@ -370,6 +372,11 @@ static int CheckUserAccess(enum PmuTaskType collectType, struct PmuAttr *attr)
 
 static int CheckBpfMode(enum PmuTaskType collectType, struct PmuAttr *attr)
 {
+    if (attr->includeChildCgroup &&
+        (!attr->enableBpf || collectType != COUNTING || attr->cgroupNameList == nullptr || attr->numCgroup == 0)) {
+        New(LIBPERF_ERR_INVALID_BPF_PARAM, "includeChildCgroup just supports bpf counting mode with cgroupNameList");
+        return LIBPERF_ERR_INVALID_BPF_PARAM;
+    }
     if (!attr->enableBpf) {
         return SUCCESS;
     }
@@ -377,11 +384,19 @@ static int CheckBpfMode(enum PmuTaskType collectType, struct PmuAttr *attr)
         New(LIBPERF_ERR_INVALID_BPF_PARAM, "No compilation of 'bpf=true' to support bpf mode");
         return LIBPERF_ERR_INVALID_BPF_PARAM;
     #endif
-    if (collectType != COUNTING) {
-        New(LIBPERF_ERR_INVALID_BPF_PARAM, "Bpf mode only support counting");
+    if (collectType != COUNTING && collectType != SAMPLING) {
+        New(LIBPERF_ERR_INVALID_BPF_PARAM, "Bpf mode only support counting and sampling");
         return LIBPERF_ERR_INVALID_BPF_PARAM;
     }
-    if (attr->cgroupNameList == nullptr && attr->pidList == nullptr) {
+    if (collectType == SAMPLING) {
+        // Samples are aggregated in kernel, features based on each sample record are not available.
+        if (attr->cgroupNameList != nullptr || attr->blockedSample || attr->perThread || attr->perCpuSample ||
+            attr->enableOnExec || attr->overheadBudget || attr->branchSampleFilter != KPERF_NO_BRANCH_SAMPLE) {
+            New(LIBPERF_ERR_INVALID_BPF_PARAM, "Bpf sampling mode doesn't support cgroup, blockedSample, perThread, "
+                "perCpuSample, enableOnExec, overheadBudget or branchSampleFilter");
+            return LIBPERF_ERR_INVALID_BPF_PARAM;
+        }
+    } else if (attr->cgroupNameList == nullptr && attr->pidList == nullptr) {
         New(LIBPERF_ERR_INVALID_BPF_PARAM, "Bpf mode need collect pid or cgroup");
         return LIBPERF_ERR_INVALID_BPF_PARAM;
     }
@@ -455,6 +470,91 @@ static int CheckPerThread(enum PmuTaskType collectType, struct PmuAttr* attr) {
     return SUCCESS;
 }
 
+static int CheckPerCpuSample(enum PmuTaskType collectType, struct PmuAttr* attr) {
+    if (!attr->perCpuSample) {
+        return SUCCESS;
+    }
+
+    if (collectType != SAMPLING) {
+        New(LIBPERF_ERR_NOT_SUPPORT_PER_CPU_SAMPLE, "perCpuSample just supports SAMPLING mode");
+        return LIBPERF_ERR_NOT_SUPPORT_PER_CPU_SAMPLE;
+    }
+
+    if (!attr->numPid) {
+        New(LIBPERF_ERR_NOT_SUPPORT_PER_CPU_SAMPLE, "perCpuSample can't be enabled without specifying a process");
+        return LIBPERF_ERR_NOT_SUPPORT_PER_CPU_SAMPLE;
+    }
+
+    if (attr->perThread || attr->enableOnExec || attr->numCgroup) {
+        New(LIBPERF_ERR_NOT_SUPPORT_PER_CPU_SAMPLE,
+            "perCpuSample can't be used together with perThread, enableOnExec or cgroup");
+        return LIBPERF_ERR_NOT_SUPPORT_PER_CPU_SAMPLE;
+    }
+
+    return SUCCESS;
+}
+
+static int CheckAuxSize(enum PmuTaskType collectType, struct PmuAttr* attr) {
+    if (attr->auxPages == 0 && attr->auxWatermark == 0) {
+        return SUCCESS;
+    }
+
+    if (collectType != SPE_SAMPLING) {
+        New(LIBPERF_ERR_INVALID_AUX_SIZE, "auxPages and auxWatermark just support SPE_SAMPLING mode");
+        return LIBPERF_ERR_INVALID_AUX_SIZE;
+    }
+
+    if (attr->auxPages & (attr->auxPages - 1)) {
+        New(LIBPERF_ERR_INVALID_AUX_SIZE, "auxPages should be a power of 2");
+        return LIBPERF_ERR_INVALID_AUX_SIZE;
+    }
+
+    if (attr->auxPages != 0 && attr->auxWatermark >= static_cast<uint64_t>(attr->auxPages) * sysconf(_SC_PAGESIZE)) {
+        New(LIBPERF_ERR_INVALID_AUX_SIZE, "auxWatermark should be less than size of aux buffer");
+        return LIBPERF_ERR_INVALID_AUX_SIZE;
+    }
+
+    return SUCCESS;
+}
+
+static int CheckOverheadBudget(enum PmuTaskType collectType, struct PmuAttr* attr) {
+    if (attr->overheadBudget == 0) {
+        return SUCCESS;
+    }
+
+    if (collectType != SAMPLING) {
+        New(LIBPERF_ERR_INVALID_OVERHEAD_BUDGET, "overheadBudget just supports SAMPLING mode");
+        return LIBPERF_ERR_INVALID_OVERHEAD_BUDGET;
+    }
+
+    if (attr->overheadBudget > MAX_OVERHEAD_BUDGET) {
+        New(LIBPERF_ERR_INVALID_OVERHEAD_BUDGET, "overheadBudget should be in range (0, 10000]");
+        return LIBPERF_ERR_INVALID_OVERHEAD_BUDGET;
+    }
+
+    return SUCCESS;
+}
+
+static int CheckUserStackSize(enum PmuTaskType collectType, struct PmuAttr* attr) {
+    if (attr->userStackSize == 0) {
+        return SUCCESS;
+    }
+
+    if (collectType != SAMPLING || !attr->callStack || attr->symbolMode == NO_SYMBOL_RESOLVE ||
+        attr->symbolMode == RESOLVE_OFFLINE || attr->enableBpf) {
+        New(LIBPERF_ERR_INVALID_USER_STACK_SIZE,
+            "userStackSize just supports SAMPLING mode with callStack and online symbol resolving, and without bpf");
+        return LIBPERF_ERR_INVALID_USER_STACK_SIZE;
+    }
+
+    if (attr->userStackSize % sizeof(uint64_t) != 0 || attr->userStackSize > MAX_USER_STACK_SIZE) {
+        New(LIBPERF_ERR_INVALID_USER_STACK_SIZE, "userStackSize should be a multiple of 8 and no more than 65528");
+        return LIBPERF_ERR_INVALID_USER_STACK_SIZE;
+    }
+
+    return SUCCESS;
+}
+
 int CheckAttr(enum PmuTaskType collectType, struct PmuAttr *attr)
 {
     auto err = CheckUserAccess(collectType, attr);
@@ -519,6 +619,26 @@ int CheckAttr(enum PmuTaskType collectType, struct PmuAttr *attr)
         return err;
     }
 
+    err = CheckPerCpuSample(collectType, attr);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    err = CheckOverheadBudget(collectType, attr);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    err = CheckAuxSize(collectType, attr);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    err = CheckUserStackSize(collectType, attr);
+    if (err != SUCCESS) {
+        return err;
+    }
+
     return SUCCESS;
 }
 
@@ -1223,6 +1343,12 @@ static struct PmuTaskAttr* AssignTaskParam(PmuTaskType collectType, PmuAttr *att
     taskParam->pmuEvt->enableBpf = attr->enableBpf;
     taskParam->pmuEvt->enableOnExec = attr->enableOnExec;
     taskParam->pmuEvt->perThread = attr->perThread;
+    taskParam->pmuEvt->perCpuSample = attr->perCpuSample;
+    taskParam->pmuEvt->overheadBudget = attr->overheadBudget;
+    taskParam->pmuEvt->includeChildCgroup = attr->includeChildCgroup;
+    taskParam->pmuEvt->auxPages = attr->auxPages;
+    taskParam->pmuEvt->auxWatermark = attr->auxWatermark;
+    taskParam->pmuEvt->userStackSize = attr->userStackSize;
     return taskParam.release();
 }
 
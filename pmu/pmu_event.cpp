@@ -12,6 +12,8 @@
  * Create: 2024-04-03
  * Description: function for mapping system errors to custom error codes in the KUNPENG_PMU namespace
  ******************************************************************************/
+#include <algorithm>
+#include <cstring>
 #include "pcerrc.h"
 #include "pmu_event.h"
 
@@ -56,4 +58,49 @@ namespace KUNPENG_PMU {
         info.time = *arr;
         return info;
     }
+
+    // Slabs start small for short reads and grow up to the max size for busy rings.
+    static constexpr size_t MIN_EXT_SLAB = 256;
+    static constexpr size_t MAX_EXT_SLAB = 16 * 1024;
+    static constexpr size_t MIN_RECORD_SLAB = 4 * 1024;
+    static constexpr size_t MAX_RECORD_SLAB = 256 * 1024;
+
+    template <typename T, typename Slab>
+    static T *AllocFromSlabs(std::vector<Slab> &slabs, size_t num, size_t minSize, size_t maxSize)
+    {
+        if (slabs.empty() || slabs.back().size - slabs.back().used < num) {
+            size_t size = slabs.empty() ? minSize : std::min(slabs.back().size * 2, maxSize);
+            slabs.emplace_back();
+            slabs.back().size = std::max(size, num);
+            slabs.back().items.reset(new T[slabs.back().size]);
+        }
+        auto &slab = slabs.back();
+        T *items = slab.items.get() + slab.used;
+        slab.used += num;
+        return items;
+    }
+
+    PmuDataExt *BranchPool::Alloc(unsigned long nr)
+    {
+        // Every field of branch records is filled by caller, so only ext is cleared.
+        auto *ext = AllocFromSlabs<PmuDataExt>(extSlabs, 1, MIN_EXT_SLAB, MAX_EXT_SLAB);
+        memset(ext, 0, sizeof(PmuDataExt));
+        ext->nr = nr;
+        ext->branchRecords = AllocFromSlabs<BranchSampleRecord>(recordSlabs, nr, MIN_RECORD_SLAB, MAX_RECORD_SLAB);
+        return ext;
+    }
+
+    BranchPool &GetBranchPool(EventData &eventData)
+    {
+        if (eventData.branchPools.empty()) {
+            eventData.branchPools.emplace_back(std::make_shared<BranchPool>());
+        }
+        return *eventData.branchPools.back();
+    }
+
+    const char *KeepString(EventData &eventData, const std::string &str)
+    {
+        eventData.strings.emplace_back(std::make_shared<std::string>(str));
+        return eventData.strings.back()->c_str();
+    }
 }  // namespace KUNPENG_PMU
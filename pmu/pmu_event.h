@@ -22,6 +22,7 @@
 #include <climits>
 #include <linux/types.h>
 #include "pmu.h"
+#include "dwarf_unwind.h"
 
 #ifndef PMU_SAMPLE_STRUCT_H
 #define PMU_SAMPLE_STRUCT_H
@@ -55,10 +56,16 @@ struct PmuEvt {
     std::string cgroupName;
     unsigned enableUserAccess : 1; // avoid uncore (config1 & 0x2)  == 0x2
     unsigned numEvent;           // pmu event number for bpf cgroup init
-    unsigned enableBpf : 1;      // enable bpf mode in counting mode
+    unsigned enableBpf : 1;      // enable bpf mode in counting and sampling mode
     unsigned enableHwMetric : 1; // enable hw_metric=1 in sampling mode
     unsigned enableOnExec : 1; // set enable_on_exec = 1 
     unsigned perThread : 1; // --per-thread mode, which just supports sampling mode
+    unsigned perCpuSample : 1; // one cpu-wide event per cpu, samples are filtered by process tree when reading
+    unsigned overheadBudget;   // cpu overhead budget of sampling, unit: 0.01% of one cpu, 0 means disabled
+    unsigned includeChildCgroup : 1; // report descendant cgroups in bpf cgroup counting
+    unsigned auxPages;         // pages of spe aux buffer, 0 means default size
+    unsigned auxWatermark;     // bytes of spe aux watermark, 0 means half of aux buffer
+    unsigned userStackSize;    // bytes of user stack dumped per sample, 0 means frame pointer callchain
 };
 
 namespace KUNPENG_PMU {
@@ -118,6 +125,7 @@ struct PmuSwitchData {
     __u64 ts;               // time stamp. unit: ns
     __u32 cpu;              // cpu id
     unsigned swOut : 1;     // 1: switch out, 0: switch in, 0 is the default value
+    unsigned exited : 1;    // 1: the thread exits, and no more switch of it follows
 };
 
 struct PerfRawMmap {
@@ -203,16 +211,54 @@ union PerfEvent {
     struct ContextSwitchEvent context_switch;
 };
 
+/**
+ * Branch records of samples are stored in a few contiguous slabs instead of one allocation per sample.
+ * PmuDataExt of samples point into the slabs, and all of them are released with the pool.
+ */
+class BranchPool {
+public:
+    /**
+     * @brief Get an ext with room for <nr> branch records, which is valid until the pool is destroyed.
+     */
+    PmuDataExt *Alloc(unsigned long nr);
+
+private:
+    template <typename T>
+    struct Slab {
+        std::unique_ptr<T[]> items;
+        size_t used = 0;
+        size_t size = 0;
+    };
+
+    std::vector<Slab<PmuDataExt>> extSlabs;
+    std::vector<Slab<BranchSampleRecord>> recordSlabs;
+};
+
 struct EventData {
     unsigned pd;
     PmuTaskType collectType;
     std::vector<PmuData> data;
     std::vector<PerfSampleIps> sampleIps;
     std::vector<PmuDataExt *> extPool;
+    // Branch records of data, shared with data appended from other reads.
+    std::vector<std::shared_ptr<BranchPool>> branchPools;
     std::vector<PmuSwitchData> switchData;
+    // User stacks to unwind, which are released once ips are recovered.
+    std::vector<UserStackSample> userStacks;
+    std::vector<char> userStackData;
     std::vector<PerfRecordSample> metaData;
+    // Strings which data points to and nothing else owns, e.g. comm of exited processes, shared with data appended
+    // from other reads.
+    std::vector<std::shared_ptr<std::string>> strings;
+    // The highest fill ratio of ring buffers in the last read, 1 if any record is lost. Reset by ReadDataToBuffer.
+    float ringFill;
 };
 
+BranchPool &GetBranchPool(EventData &eventData);
+/**
+ * @brief Keep a copy of <str> until <eventData> and data appended with it are freed, and return the copy.
+ */
+const char *KeepString(EventData &eventData, const std::string &str);
 int MapErrno(int sysErr);
 struct PerfSampleInfo GetPerfSampleInfo(__u64 sampleType, PerfEvent* event);
 }   // namespace KUNPENG_PMU
@@ -15,8 +15,8 @@
  ******************************************************************************/
 #include <memory>
 #include <algorithm>
-#include <numeric>
 #include <string>
+#include <unordered_set>
 #include <sys/resource.h>
 #include "linked_list.h"
 #include "cpu_map.h"
@@ -44,6 +44,7 @@ namespace KUNPENG_PMU {
     std::mutex PmuList::dataListMtx;
     std::mutex PmuList::dataParentMtx;
     std::mutex PmuList::analysisStatusMtx;
+    std::mutex PmuList::periodCtrlMtx;
 
     int PmuList::CheckRlimit(const unsigned pd, const unsigned fdNum)
     {
@@ -119,7 +120,9 @@ namespace KUNPENG_PMU {
             if (err != SUCCESS) {
                 return err;
             }
-            fdNum += CalRequireFd(cpuTopoList.size(), procTopoList.size(), taskParam->pmuEvt->collectType);
+            // In perCpuSample mode, all threads on one cpu share a single cpu-wide event.
+            unsigned procSize = pmuTaskAttrHead->pmuEvt->perCpuSample ? 1 : procTopoList.size();
+            fdNum += CalRequireFd(cpuTopoList.size(), procSize, taskParam->pmuEvt->collectType);
 #ifdef BPF_ENABLED
             if (taskParam->pmuEvt->enableBpf) {
                 std::shared_ptr<EvtListBpf> evtList = std::make_shared<EvtListBpf>(
@@ -155,6 +158,10 @@ namespace KUNPENG_PMU {
         {
             return err;
         }
+
+        if (taskParam->pmuEvt->overheadBudget > 0) {
+            InsertPeriodController(pd, taskParam->pmuEvt->overheadBudget);
+        }
         
         this->OpenDummyEvent(taskParam, pd);
         return SUCCESS;
@@ -480,117 +487,6 @@ namespace KUNPENG_PMU {
         return userData;
     }
 
-    static void TrimKernelStack(PmuData &data)
-    {
-        auto stack = data.stack;
-        while (stack != nullptr && stack->symbol != nullptr) {
-            if (strcmp(stack->symbol->module, "[kernel]") == 0) {
-                stack = stack->next;
-                continue;
-            }
-            data.stack = stack;
-            break;
-        }
-    }
-
-
-    void SortTwoVector(std::vector<PmuData>& pmuData, std::vector<PerfSampleIps>& sampleIps)
-    {
-        std::vector<size_t> indices(pmuData.size());
-        std::iota(indices.begin(), indices.end(), 0);
-        std::stable_sort(indices.begin(), indices.end(), [&pmuData](size_t a, size_t b){
-            if (pmuData[a].tid == pmuData[b].tid) {
-                return pmuData[a].ts < pmuData[b].ts;
-            }
-            return pmuData[a].tid < pmuData[b].tid;
-        });
-
-        std::vector<PmuData> sortedPmuData;
-        std::vector<PerfSampleIps> sortedSampleIps;
-        size_t size = pmuData.size();
-        sortedPmuData.reserve(size);
-        sortedSampleIps.reserve(size);
-
-        for (size_t i = 0; i < size; ++i) {
-            sortedPmuData.emplace_back(std::move(pmuData[indices[i]]));
-            sortedSampleIps.emplace_back(std::move(sampleIps[indices[i]]));
-        }
-        pmuData = std::move(sortedPmuData);
-        sampleIps = std::move(sortedSampleIps);
-    }
-
-    void HandleBlockData(std::vector<PmuData>& pmuData, std::vector<PerfSampleIps>& sampleIps,
-                                 SymbolMode symMode,std::vector<PmuSwitchData>& switchData)
-    {
-        std::sort(switchData.begin(), switchData.end(), [](const PmuSwitchData& a, const PmuSwitchData& b) {
-            if (a.tid == b.tid) {
-                return a.ts < b.ts;
-            }
-            return a.tid < b.tid;
-        });
-        std::unordered_map<int, std::vector<int64_t>> tidToOffTimeStamps;
-        int64_t outTime = 0;
-        int prevTid = -1;
-        for (const auto& item : switchData) {
-            if (item.swOut) {
-                outTime = item.ts;
-                prevTid = item.tid;
-                DBG_PRINT("Switch out: tid=%d, ts=%llu\n", item.tid, item.ts);
-            } else {
-                // if the first event is sched_in, we need to ignore it.
-                if (prevTid == -1) {
-                    DBG_PRINT("Ignoring first sched_in event: tid=%d, ts=%ld\n", item.tid, item.ts);
-                    continue;
-                }
-                if (prevTid == item.tid && outTime > 0) {
-                    tidToOffTimeStamps[item.tid].emplace_back(item.ts - outTime);
-                    DBG_PRINT("Switch in: tid=%d, ts=%llu, offTime=%llu\n", item.tid, item.ts, item.ts - outTime);
-                    outTime = 0;
-                }
-            }
-        }
-        SortTwoVector(pmuData, sampleIps);
-        int csCnt = 0;
-        int64_t prevTs = 0;
-        int64_t currentTs = 0;
-        int64_t curPeriod = 0;
-        int currentTid = -1;
-        for (auto& item : pmuData) {
-            if (currentTid != item.tid) {
-                currentTid = item.tid;
-                csCnt = 0;
-                prevTs = 0;
-                currentTs = 0;
-                curPeriod = 0;
-                DBG_PRINT("New tid encountered: tid=%d\n", currentTid);
-            }
-            if (strcmp(item.evt, "context-switches") == 0) {
-                // Convert stack from 'schedule[kernel] -> futex_wait[kernel] -> ...[kernel] -> lock_wait -> start_thread'
-                // to 'lock_wait -> start_thread', only keeping user stack.
-                if (symMode != NO_SYMBOL_RESOLVE) {
-                      TrimKernelStack(item);
-                }
-                // Before the context-switches event, there is only one cycles event, which we need to ignore. 
-                if (currentTs == 0) {
-                    currentTs = item.ts;
-                    DBG_PRINT("Ignoring first cycles event for tid=%d\n", item.tid);
-                    continue;
-                }
-                // only the on cpu event is cycles, this compute is right.
-                if (csCnt < tidToOffTimeStamps[item.tid].size()) {
-                    item.period = tidToOffTimeStamps[item.tid][csCnt] * curPeriod / (currentTs - prevTs);
-                    DBG_PRINT("Context switch: ts=%llu, tid=%d, period=%llu\n", item.ts, item.tid, item.period);
-                    csCnt++;
-                }
-            } else {
-                // on cpu event data update.
-                prevTs = currentTs;
-                currentTs = item.ts;
-                curPeriod = item.period;
-            }
-        }
-    }
-    
     int PmuList::ReadDataToBuffer(const int pd)
     {
         // Read data from prev sampling,
@@ -600,6 +496,11 @@ namespace KUNPENG_PMU {
         evtData.collectType = static_cast<PmuTaskType>(GetTaskType(pd));
         auto ts = GetCurrentTime();
         auto eventList = GetEvtList(pd);
+        auto periodCtrl = GetPeriodController(pd);
+        if (periodCtrl != nullptr) {
+            periodCtrl->BeginDrain();
+        }
+        evtData.ringFill = 0;
         for (auto item: eventList) {
             item->SetTimeStamp(ts);
             auto err = item->Read(evtData);
@@ -610,6 +511,18 @@ namespace KUNPENG_PMU {
         
         this->ClearExitFd(pd);
 
+        if (periodCtrl != nullptr && periodCtrl->EndDrain(evtData.ringFill)) {
+            // Period of each sample is recorded in PmuData.period, so samples before and after are both valid.
+            DBG_PRINT("pd %d: overhead %f, ring fill %f, scale period by %f\n",
+                      pd, periodCtrl->GetOverhead(), evtData.ringFill, periodCtrl->GetScale());
+            for (auto item: eventList) {
+                auto err = item->ScalePeriod(periodCtrl->GetScale());
+                if (err != SUCCESS) {
+                    DBG_PRINT("failed to scale period of %s: %d\n", item->GetPmuEvtName(), err);
+                }
+            }
+        }
+
         return SUCCESS;
     }
 
@@ -645,6 +558,11 @@ namespace KUNPENG_PMU {
         auto& ipsVec = findToData->second.sampleIps;
         dataVec.insert(dataVec.end(), findFromData->second.data.begin(), findFromData->second.data.end());
         ipsVec.insert(ipsVec.end(), findFromData->second.sampleIps.begin(), findFromData->second.sampleIps.end());
+        // Appended data points into branch records of source list, which live until both lists are freed.
+        auto& poolVec = findToData->second.branchPools;
+        poolVec.insert(poolVec.end(), findFromData->second.branchPools.begin(), findFromData->second.branchPools.end());
+        auto& strVec = findToData->second.strings;
+        strVec.insert(strVec.end(), findFromData->second.strings.begin(), findFromData->second.strings.end());
         len = dataVec.size();
 
         if (*toData != dataVec.data()) {
@@ -683,6 +601,7 @@ namespace KUNPENG_PMU {
         EraseSpeCpu(pd);
         EraseParentEventMap(pd);
         EraseUnUseFd(pd);
+        ErasePeriodController(pd);
         SymResolverDestroy();
         PmuEventListFree();
         TraceParser::FreeRawFieldMap();
@@ -850,6 +769,7 @@ namespace KUNPENG_PMU {
     {
         lock_guard<mutex> lg(dataListMtx);
         dataList.erase(pd);
+        offCpuTrackers.erase(pd);
         for (auto iter = userDataList.begin(); iter != userDataList.end();) {
             if (iter->second.pd == pd) {
                 iter = userDataList.erase(iter);
@@ -862,29 +782,53 @@ namespace KUNPENG_PMU {
     void PmuList::FillStackInfo(EventData& eventData)
     {
         auto symMode = symModeList[eventData.pd];
+        if (!eventData.userStacks.empty()) {
+            // Modules are needed to find cfi of user frames, and ips are completed before they are resolved or delayed.
+            for (auto &userStack : eventData.userStacks) {
+                int pid = eventData.data[userStack.idx].pid;
+                if (symMode == RESOLVE_ELF_DWARF || symMode == RESOLVE_DELAY_DWARF) {
+                    SymResolverRecordModule(pid);
+                } else {
+                    SymResolverRecordModuleNoDwarf(pid);
+                }
+            }
+            UnwindUserStacks(eventData);
+        }
         // Parse dwarf and elf info of each pid and get stack trace for each pmu data.
+        std::unordered_set<int> readPids;
         for (size_t i = 0; i < eventData.data.size(); ++i) {
             if (GetAnalysisStatus(eventData.pd) == STOP_RESOLVE) {
                 break;
             }
             auto& pmuData = eventData.data[i];
             auto& ipsData = eventData.sampleIps[i];
-            if (symMode == RESOLVE_ELF) {
+            bool firstOfRead = pmuData.pid > 0 && readPids.insert(pmuData.pid).second;
+            if (symMode == RESOLVE_ELF || symMode == RESOLVE_DELAY_ELF) {
                 SymResolverRecordModuleNoDwarf(pmuData.pid);
-            } else if (symMode == RESOLVE_ELF_DWARF) {
-                SymResolverRecordModule(pmuData.pid);
-            } else if (symMode == RESOLVE_DELAY_ELF) {
-                 SymResolverRecordModuleNoDwarf(pmuData.pid);
-                 continue;
-            } else if (symMode == RESOLVE_DELAY_DWARF) {
+            } else if (symMode == RESOLVE_ELF_DWARF || symMode == RESOLVE_DELAY_DWARF) {
                 SymResolverRecordModule(pmuData.pid);
+            } else if (symMode == RESOLVE_OFFLINE) {
+                // Layout of a process is read once, and modules loaded later are recorded from mmap records.
+                if (firstOfRead) {
+                    SymResolverRecordModuleLayout(pmuData.pid);
+                }
+                if (pmuData.stack == nullptr) {
+                    pmuData.stack = RawStackToHash(pmuData.pid, ipsData.ips.data(), ipsData.ips.size());
+                }
                 continue;
             } else {
                 continue;
             }
+            if (firstOfRead) {
+                // Jit code compiled since the last read is checked once for each process.
+                SymResolverUpdateJitCode(pmuData.pid);
+            }
+            if (symMode == RESOLVE_DELAY_ELF || symMode == RESOLVE_DELAY_DWARF) {
+                continue;
+            }
 
             if (pmuData.stack == nullptr) {
-                pmuData.stack = StackToHash(pmuData.pid, ipsData.ips.data(), ipsData.ips.size());
+                pmuData.stack = StackToHashTime(pmuData.pid, ipsData.ips.data(), ipsData.ips.size(), pmuData.ts);
             }
         }
         //Exceptions generated by the symbol interface are not directly exposed and are processed as warnings.
@@ -915,7 +859,7 @@ namespace KUNPENG_PMU {
             auto& pmuData = eventData.data[i];
             auto& ipsData = eventData.sampleIps[i];
             if (pmuData.stack == nullptr) {
-                pmuData.stack = StackToHash(pmuData.pid, ipsData.ips.data(), ipsData.ips.size());
+                pmuData.stack = StackToHashTime(pmuData.pid, ipsData.ips.data(), ipsData.ips.size(), pmuData.ts);
             }
         }
         if (GetBlockedSampleState(eventData.pd) == 1) {
@@ -1017,6 +961,7 @@ namespace KUNPENG_PMU {
                     .collectType = COUNTING,
                     .data = move(newPmuData),
             };
+            newEvData.strings = move(evData.strings);
 
             auto inserted = userDataList.emplace(newEvData.data.data(), move(newEvData));
             dataList.erase(pd);
@@ -1024,8 +969,7 @@ namespace KUNPENG_PMU {
         } else {
             FillStackInfo(evData);
             if (GetBlockedSampleState(pd) == 1) {
-                auto symMode = symModeList[evData.pd];
-                HandleBlockData(evData.data, evData.sampleIps, symMode, evData.switchData);
+                offCpuTrackers[pd].Process(evData, symModeList[evData.pd]);
             }
             auto pData = evData.data.data();
             auto inserted = userDataList.emplace(pData, move(evData));
@@ -1041,14 +985,8 @@ namespace KUNPENG_PMU {
         if (findData == userDataList.end()) {
             return;
         }
-        if (findData->second.collectType == SAMPLING) {
-            for (auto &extMem : findData->second.extPool) {
-                if (extMem->branchRecords) {
-                    delete[] extMem->branchRecords;
-                }
-                delete extMem;
-            }
-        } else if (findData->second.collectType == SPE_SAMPLING) {
+        // Branch records of SAMPLING are released with branchPools of the data.
+        if (findData->second.collectType == SPE_SAMPLING) {
             // Delete ext pointer malloced in SpeSampler.
             for (auto &extMem : findData->second.extPool) {
                 delete[] extMem;
@@ -1177,6 +1115,28 @@ namespace KUNPENG_PMU {
         speCpuList[pd].insert(cpu);
     }
 
+    void PmuList::InsertPeriodController(const unsigned pd, const unsigned budget)
+    {
+        lock_guard<mutex> lg(periodCtrlMtx);
+        periodCtrlList[pd] = std::make_shared<PeriodController>(budget);
+    }
+
+    std::shared_ptr<PeriodController> PmuList::GetPeriodController(const unsigned pd)
+    {
+        lock_guard<mutex> lg(periodCtrlMtx);
+        auto findCtrl = periodCtrlList.find(pd);
+        if (findCtrl == periodCtrlList.end()) {
+            return nullptr;
+        }
+        return findCtrl->second;
+    }
+
+    void PmuList::ErasePeriodController(const unsigned pd)
+    {
+        lock_guard<mutex> lg(periodCtrlMtx);
+        periodCtrlList.erase(pd);
+    }
+
     void PmuList::EraseSpeCpu(const unsigned& pd)
     {
         lock_guard<mutex> lg(pmuListMtx);
@@ -1370,6 +1330,15 @@ namespace KUNPENG_PMU {
             }
         }
 
+        if (this->symModeList[pd] == RESOLVE_OFFLINE) {
+            for (const auto& pid: pidList) {
+                int rt = SymResolverRecordModuleLayout(pid);
+                if (rt != SUCCESS) {
+                    return rt;
+                }
+            }
+        }
+
         if (this->symModeList[pd] == RESOLVE_ELF_DWARF || this->symModeList[pd] == NO_SYMBOL_RESOLVE) {
             for (const auto& pid: pidList) {
                 int rt = SymResolverRecordModule(pid);
@@ -23,6 +23,8 @@
 #include "dummy_event.h"
 #include "evt_list.h"
 #include "pmu_event.h"
+#include "period_controller.h"
+#include "off_cpu.h"
 
 namespace KUNPENG_PMU {
 
@@ -158,6 +160,9 @@ private:
     void OpenDummyEvent(PmuTaskAttr* taskParam, const unsigned pd);
     void EraseDummyEvent(const unsigned pd);
     void EraseUnUseFd(const unsigned pd);
+    void InsertPeriodController(const unsigned pd, const unsigned budget);
+    std::shared_ptr<PeriodController> GetPeriodController(const unsigned pd);
+    void ErasePeriodController(const unsigned pd);
     int InitSymbolRecordModule(const unsigned pd, PmuTaskAttr* taskParam);
 
     static std::mutex pmuListMtx;
@@ -165,6 +170,7 @@ private:
     static std::mutex dataEvtGroupListMtx;
     static std::mutex dataParentMtx;
     static std::mutex analysisStatusMtx;
+    static std::mutex periodCtrlMtx;
     std::unordered_map<unsigned, std::vector<std::shared_ptr<EvtList>>> pmuList;
     // Key: pd
     // Value: PmuData List.
@@ -196,6 +202,9 @@ private:
     unsigned maxPd = 0;
 
     std::unordered_map<unsigned, SymbolMode> symModeList;
+    // Key: pd
+    // Value: off-cpu state of threads, which is kept across reads in blocked sample mode.
+    std::unordered_map<unsigned, OffCpuTracker> offCpuTrackers;
 
     std::unordered_map<unsigned, std::vector<pid_t>> ppidList;
 
@@ -212,6 +221,9 @@ private:
     std::unordered_map<unsigned, std::vector<ProcPtr>> pmuProcList;
 
     std::unordered_map<unsigned, unsigned> pmuNeedFdList;
+    // Key: pd
+    // Value: period controller, only for pd with overheadBudget.
+    std::unordered_map<unsigned, std::shared_ptr<PeriodController>> periodCtrlList;
 };
 }   // namespace KUNPENG_PMU
 #endif
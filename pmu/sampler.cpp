@@ -13,6 +13,7 @@
  * Description: implementations for sampling and processing performance data using ring buffers in
  * the KUNPENG_PMU namespace
  ******************************************************************************/
+#include <algorithm>
 #include <climits>
 #include <iostream>
 #include <poll.h>
@@ -56,6 +57,13 @@ int KUNPENG_PMU::PerfSampler::MapPerfAttr(const bool groupEnable, const int grou
         attr.sample_type |= PERF_SAMPLE_BRANCH_STACK;
         attr.branch_sample_type = branchSampleFilter;
     }
+    // User callchain is unwound from a snapshot of registers and stack, so kernel only walks kernel frames.
+    if (this->evt->userStackSize != 0) {
+        attr.sample_type |= PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER;
+        attr.sample_regs_user = UNWIND_SAMPLE_REGS;
+        attr.sample_stack_user = this->evt->userStackSize;
+        attr.exclude_callchain_user = 1;
+    }
     attr.freq = this->evt->useFreq;
     attr.sample_period = this->evt->period;
     attr.read_format = PERF_FORMAT_ID;
@@ -125,7 +133,9 @@ int KUNPENG_PMU::PerfSampler::Mmap()
 {
     // <samplePages> determines size of ring buffer on each core.
     // For normal sampling, size of each packet is around 0x38;For brbe sampling, size of each packet is around 0x330 which requires more buffer size.
-    int samplePages = branchSampleFilter == KPERF_NO_BRANCH_SAMPLE ? DEFAULT_SAMPLE_PAGES : BRBE_SAMPLE_PAGES;
+    // Packet with user stack carries up to <userStackSize> bytes, which requires the same buffer size as brbe.
+    int samplePages = branchSampleFilter == KPERF_NO_BRANCH_SAMPLE && this->evt->userStackSize == 0 ?
+                      DEFAULT_SAMPLE_PAGES : BRBE_SAMPLE_PAGES;
     int mmapLen = (samplePages + 1) * SAMPLE_PAGE_SIZE;
     auto mask = mmapLen - SAMPLE_PAGE_SIZE - 1;
     this->sampleMmap->prev = 0;
@@ -164,6 +174,21 @@ void KUNPENG_PMU::PerfSampler::UpdatePidInfo(const int &tid)
     }
 }
 
+bool KUNPENG_PMU::PerfSampler::IsFilteredOut(const __u32 pid, const __u32 tid)
+{
+    // Cpu-wide events of perCpuSample mode see every process, keep the target process trees only.
+    if (!this->evt->perCpuSample) {
+        return false;
+    }
+    return procMap.find(tid) == procMap.end() && procMap.find(pid) == procMap.end();
+}
+
+bool KUNPENG_PMU::PerfSampler::IsForkFilteredOut(const KUNPENG_PMU::PerfRecordFork &fork)
+{
+    // A new thread belongs to the process <pid>, and a new process is forked by <ppid>.
+    return IsFilteredOut(fork.pid, fork.tid) && IsFilteredOut(fork.ppid, fork.ptid);
+}
+
 void KUNPENG_PMU::PerfSampler::UpdateCommInfo(KUNPENG_PMU::PerfEvent *event)
 {
     auto sampleInfo = GetPerfSampleInfo(SAMPLING_SAMPLE_TYPE, event);
@@ -189,6 +214,16 @@ void KUNPENG_PMU::PerfSampler::UpdateCommInfo(KUNPENG_PMU::PerfEvent *event)
     }
 }
 
+/**
+ * Timestamp of a non-sample record, which is in the sample id appended to the record with sample_id_all.
+ */
+static __u64 RecordTime(const union KUNPENG_PMU::PerfEvent *event)
+{
+    auto *sampleId = reinterpret_cast<const KUNPENG_PMU::sampleId *>(
+        reinterpret_cast<const char *>(event) + event->header.size - sizeof(KUNPENG_PMU::sampleId));
+    return sampleId->time;
+}
+
 void KUNPENG_PMU::PerfSampler::ParseSwitch(KUNPENG_PMU::PerfEvent *event, struct PmuSwitchData *switchCurData)
 {
     if (switchCurData == nullptr) {
@@ -206,7 +241,7 @@ void KUNPENG_PMU::PerfSampler::ParseSwitch(KUNPENG_PMU::PerfEvent *event, struct
     }
 }
 
-void KUNPENG_PMU::PerfSampler::ParseBranchSampleData(struct PmuData *pmuData, PerfRawSample *sample, union PerfEvent *event, std::vector<PmuDataExt*> &extPool)
+void KUNPENG_PMU::PerfSampler::ParseBranchSampleData(struct PmuData *pmuData, PerfRawSample *sample, union PerfEvent *event, EventData &eventData)
 {
     if (branchSampleFilter == KPERF_NO_BRANCH_SAMPLE) {
         return;
@@ -226,8 +261,8 @@ void KUNPENG_PMU::PerfSampler::ParseBranchSampleData(struct PmuData *pmuData, Pe
     }
 
     try {
-        auto *branchExt = new struct PmuDataExt();
-        auto *records = new struct BranchSampleRecord[branchData->bnr];
+        auto *branchExt = GetBranchPool(eventData).Alloc(branchData->bnr);
+        auto *records = branchExt->branchRecords;
         for (int i = 0; i < branchData->bnr; i++) {
             auto branchItem = branchData->lbr[i];
             records[i].fromAddr = branchItem.from;
@@ -236,18 +271,52 @@ void KUNPENG_PMU::PerfSampler::ParseBranchSampleData(struct PmuData *pmuData, Pe
             records[i].misPred = branchItem.mispred;
             records[i].predicted = branchItem.predicted;
         }
-        branchExt->nr = branchData->bnr;
-        branchExt->branchRecords = records;
-        extPool.push_back(branchExt);
         pmuData->ext = branchExt;
     } catch (std::bad_alloc &err) {
         return;
     }
 }
 
+void KUNPENG_PMU::PerfSampler::ParseUserStack(PerfRawSample *sample, union PerfEvent *event, EventData &eventData)
+{
+    if (this->evt->userStackSize == 0) {
+        return;
+    }
+
+    // Registers and stack follow callchain, raw data and branch stack in the order of sample type bits.
+    auto *base = (char *)&event->sample.array;
+    auto offset = (unsigned long)offset(struct PerfRawSample, ips) + sample->nr * sizeof(unsigned long);
+    offset += sizeof(__u32) + ((TraceRawData *)(base + offset))->size;
+    if (branchSampleFilter != KPERF_NO_BRANCH_SAMPLE) {
+        offset += sizeof(__u64) + ((BranchSampleData *)(base + offset))->bnr * sizeof(struct perf_branch_entry);
+    }
+    auto abi = *(__u64 *)(base + offset);
+    offset += sizeof(__u64);
+    if (abi == PERF_SAMPLE_REGS_ABI_NONE) {
+        // Kernel threads have no user context.
+        return;
+    }
+    auto *regs = (uint64_t *)(base + offset);
+    offset += UNWIND_SAMPLE_REG_NUM * sizeof(__u64);
+    auto size = *(__u64 *)(base + offset);
+    offset += sizeof(__u64);
+    if (abi != PERF_SAMPLE_REGS_ABI_64 || size == 0) {
+        return;
+    }
+    auto dynSize = *(__u64 *)(base + offset + size);
+    dynSize = std::min(dynSize, size);
+
+    UserStackSample userStack;
+    userStack.idx = eventData.data.size() - 1;
+    userStack.regs = ParseUnwindRegs(regs);
+    userStack.offset = eventData.userStackData.size();
+    userStack.size = dynSize;
+    eventData.userStackData.insert(eventData.userStackData.end(), base + offset, base + offset + dynSize);
+    eventData.userStacks.push_back(userStack);
+}
 
 void KUNPENG_PMU::PerfSampler::RawSampleProcess(
-        struct PmuData *current, PerfSampleIps *ips, union KUNPENG_PMU::PerfEvent *event, std::vector<PmuDataExt*> &extPool)
+        struct PmuData *current, PerfSampleIps *ips, union KUNPENG_PMU::PerfEvent *event, EventData &eventData)
 {
     if (current == nullptr) {
         return;
@@ -279,7 +348,8 @@ void KUNPENG_PMU::PerfSampler::RawSampleProcess(
     if (this->evt->pmuType == TRACE_TYPE) {
         TraceParser::ParserRawFormatData(current, sample, event, this->evt->name);
     }
-    ParseBranchSampleData(current, sample, event, extPool);
+    ParseBranchSampleData(current, sample, event, eventData);
+    ParseUserStack(sample, event, eventData);
     if (this->evt->cgroupName.size() != 0) {
         current->cgroupName = this->evt->cgroupName.c_str();
     }
@@ -296,43 +366,98 @@ void KUNPENG_PMU::PerfSampler::ReadRingBuffer(EventData &eventData)
         __u32 sampleType = event->header.type;
         switch (sampleType) {
             case PERF_RECORD_SAMPLE: {
+                auto *rawSample = (KUNPENG_PMU::PerfRawSample *)event->sample.array;
+                if (IsFilteredOut(rawSample->pid, rawSample->tid)) {
+                    break;
+                }
                 eventData.data.emplace_back(PmuData{0});
                 auto& current = eventData.data.back();
                 eventData.sampleIps.emplace_back(PerfSampleIps());
                 auto& ips = eventData.sampleIps.back();
-                this->RawSampleProcess(&current, &ips, event, eventData.extPool);
+                this->RawSampleProcess(&current, &ips, event, eventData);
                 break;
             }
             case PERF_RECORD_MMAP: {
+                if (IsFilteredOut(event->mmap.pid, event->mmap.tid)) {
+                    break;
+                }
                 eventData.metaData.push_back(event->sample);
                 if (symMode == RESOLVE_ELF_DWARF || symMode == RESOLVE_DELAY_DWARF) {
-                    SymResolverUpdateModule(event->mmap.tid, event->mmap.filename, event->mmap.addr);
+                    SymResolverUpdateModuleMmapTime(event->mmap.pid, event->mmap.filename, event->mmap.addr,
+                                                    event->mmap.len, event->mmap.pgoff, RecordTime(event));
                 } else if (symMode == RESOLVE_ELF || symMode == RESOLVE_DELAY_ELF) {
-                    SymResolverUpdateModuleNoDwarf(event->mmap.tid, event->mmap.filename, event->mmap.addr);
+                    SymResolverUpdateModuleMmapTimeNoDwarf(event->mmap.pid, event->mmap.filename,
+                                                           event->mmap.addr, event->mmap.len, event->mmap.pgoff,
+                                                           RecordTime(event));
+                } else if (symMode == RESOLVE_OFFLINE) {
+                    SymResolverUpdateLayoutMmap2Time(event->mmap.pid, event->mmap.filename, event->mmap.addr,
+                                                     event->mmap.len, event->mmap.pgoff, 0, 0, 0, RecordTime(event));
                 }
                 break;
             }
             case PERF_RECORD_MMAP2: {
+                if (IsFilteredOut(event->mmap2.pid, event->mmap2.tid)) {
+                    break;
+                }
                 eventData.metaData.push_back(event->sample);
+                auto &mmap2 = event->mmap2;
                 if (symMode == RESOLVE_ELF_DWARF || symMode == RESOLVE_DELAY_DWARF) {
-                    SymResolverUpdateModule(event->mmap2.tid, event->mmap2.filename, event->mmap2.addr);
+                    SymResolverUpdateModuleMmap2Time(mmap2.pid, mmap2.filename, mmap2.addr, mmap2.len, mmap2.pgoff,
+                                                     mmap2.maj, mmap2.min, mmap2.ino, RecordTime(event));
                 } else if (symMode == RESOLVE_ELF || symMode == RESOLVE_DELAY_ELF) {
-                    SymResolverUpdateModuleNoDwarf(event->mmap2.tid, event->mmap2.filename, event->mmap2.addr);
+                    SymResolverUpdateModuleMmap2TimeNoDwarf(mmap2.pid, mmap2.filename, mmap2.addr, mmap2.len,
+                                                            mmap2.pgoff, mmap2.maj, mmap2.min, mmap2.ino,
+                                                            RecordTime(event));
+                } else if (symMode == RESOLVE_OFFLINE) {
+                    SymResolverUpdateLayoutMmap2Time(mmap2.pid, mmap2.filename, mmap2.addr, mmap2.len, mmap2.pgoff,
+                                                     mmap2.maj, mmap2.min, mmap2.ino, RecordTime(event));
                 }
                 break;
             }
             case PERF_RECORD_FORK: {
+                if (IsForkFilteredOut(event->fork)) {
+                    break;
+                }
                 DBG_PRINT("Fork ptid: %d tid: %d\n", event->fork.pid, event->fork.tid);
                 eventData.metaData.push_back(event->sample);
+                UpdateProcTopoOnFork(event->fork.pid, event->fork.tid, event->fork.ptid);
                 UpdatePidInfo(event->fork.tid);
                 break;
             }
+            case PERF_RECORD_EXIT: {
+                UpdateProcTopoOnExit(event->exit.tid);
+                if (this->evt->blockedSample == 1 && this->evt->name == "context-switches") {
+                    // A thread may exit without a switch in, e.g. killed while blocked, so its off-cpu state ends here.
+                    eventData.switchData.emplace_back(PmuSwitchData{0});
+                    auto& exitData = eventData.switchData.back();
+                    exitData.pid = event->exit.pid;
+                    exitData.tid = event->exit.tid;
+                    exitData.ts = event->exit.time;
+                    exitData.exited = 1;
+                }
+                break;
+            }
             case PERF_RECORD_COMM: {
+                if (IsFilteredOut(event->comm.pid, event->comm.tid)) {
+                    break;
+                }
                 eventData.metaData.push_back(event->sample);
+                if ((event->header.misc & PERF_RECORD_MISC_COMM_EXEC) && symMode != NO_SYMBOL_RESOLVE) {
+                    SymResolverExecModule(event->comm.pid, RecordTime(event));
+                }
+                UpdateProcTopoOnComm(event->comm.pid, event->comm.tid, event->comm.comm);
                 UpdateCommInfo(event);
                 break;
             }
+            case PERF_RECORD_LOST: {
+                // Ring buffer was full, this is taken as the heaviest load by period controller.
+                eventData.ringFill = 1;
+                break;
+            }
             case PERF_RECORD_SWITCH: {
+                if (IsFilteredOut(event->context_switch.sampleId.pid, event->context_switch.sampleId.tid)) {
+                    break;
+                }
                 eventData.switchData.emplace_back(PmuSwitchData{0});
                 auto& switchCurData = eventData.switchData.back();
                 ParseSwitch(event, &switchCurData);
@@ -374,6 +499,9 @@ int KUNPENG_PMU::PerfSampler::Read(EventData &eventData)
     if (__glibc_unlikely(err != SUCCESS)) {
         return err;
     }
+    auto& map = *this->sampleMmap.get();
+    float fill = static_cast<float>(map.end - map.start) / (static_cast<unsigned long>(map.mask) + 1);
+    eventData.ringFill = std::max(eventData.ringFill, std::min(fill, 1.0f));
     auto cnt = eventData.data.size();
     this->ReadRingBuffer(eventData);
     if (__glibc_unlikely(Perrorno() == LIBPERF_ERR_BUFFER_CORRUPTED)) {
@@ -51,13 +51,16 @@ namespace KUNPENG_PMU {
         int MmapResetOutput(const int resetOutputFd);
         int Mmap();
         union PerfEvent *SampleReadEvent();
-        void RawSampleProcess(struct PmuData *sampleHead, PerfSampleIps *ips, union KUNPENG_PMU::PerfEvent *event, std::vector<PmuDataExt*> &extPool);
+        void RawSampleProcess(struct PmuData *sampleHead, PerfSampleIps *ips, union KUNPENG_PMU::PerfEvent *event, EventData &eventData);
         void ReadRingBuffer(EventData &eventData);
         void FillComm(const size_t &start, const size_t &end, std::vector<PmuData> &data);
         void UpdatePidInfo(const int &tid);
+        bool IsFilteredOut(const __u32 pid, const __u32 tid);
+        bool IsForkFilteredOut(const KUNPENG_PMU::PerfRecordFork &fork);
         void UpdateCommInfo(KUNPENG_PMU::PerfEvent *event);
         void ParseSwitch(KUNPENG_PMU::PerfEvent *event, struct PmuSwitchData *switchCurData);
-        void ParseBranchSampleData(struct PmuData *pmuData, PerfRawSample *sample, union PerfEvent *event, std::vector<PmuDataExt*> &extPool);
+        void ParseBranchSampleData(struct PmuData *pmuData, PerfRawSample *sample, union PerfEvent *event, EventData &eventData);
+        void ParseUserStack(PerfRawSample *sample, union PerfEvent *event, EventData &eventData);
 
         std::shared_ptr<PerfMmap> sampleMmap = nullptr;
     };
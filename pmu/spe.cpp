@@ -32,7 +32,6 @@ using namespace std;
 using namespace pcerr;
 using namespace KUNPENG_PMU;
 
-constexpr unsigned SPE_RECORD_MAX = 100000;
 constexpr unsigned BUFF_SIZE = 64;
 /* Should align to 2^n size in pages */
 constexpr unsigned RING_BUF_SIZE = 64 * 1024;
@@ -43,8 +42,7 @@ struct AuxContext {
     struct ContextSwitchData *dummyData;
     int *dummyIdx;
     int cpu;
-    size_t auxOffset;
-    size_t auxSize;
+    bool *ctxIdLost;
 };
 
 static int OpenSpeEvent(PmuEvt *pmuAttr, int cpu, int pid)
@@ -65,6 +63,8 @@ static int OpenSpeEvent(PmuEvt *pmuAttr, int cpu, int pid)
     attr.read_format = PERF_FORMAT_ID;
     attr.exclude_kernel = pmuAttr->excludeKernel;
     attr.exclude_user = pmuAttr->excludeUser;
+    // Bytes of aux data to generate a PERF_RECORD_AUX, 0 means half of aux buffer.
+    attr.aux_watermark = pmuAttr->auxWatermark;
 
     if (pmuAttr->enableOnExec) {
         attr.enable_on_exec = 1;
@@ -243,7 +243,7 @@ int SpeOpen(PmuEvt *attr, int cpu, SpeContext *ctx, int pid)
 
     /* Should align to 2^n size in pages */
     ctx->speMmapSize = RING_BUF_SIZE + static_cast<unsigned>(pageSize);
-    ctx->auxMmapSize = AUX_BUF_SIZE;
+    ctx->auxMmapSize = attr->auxPages ? static_cast<__u64>(attr->auxPages) * pageSize : AUX_BUF_SIZE;
     ctx->dummyMmapSize = RING_BUF_SIZE + pageSize;
 
     ctx->coreCtxes = (struct SpeCoreContext *)malloc(sizeof(struct SpeCoreContext));
@@ -420,14 +420,16 @@ int Spe::CoreDummyData(struct SpeCoreContext *context, struct ContextSwitchData
         if (header->type == PERF_RECORD_MMAP) {
             struct PerfRecordMmap *sample = (struct PerfRecordMmap *)header;
             if (symbolMode == RESOLVE_ELF_DWARF || symbolMode == RESOLVE_DELAY_DWARF) {
-                int ret = SymResolverUpdateModule(sample->tid, sample->filename, sample->addr);
+                int ret = SymResolverUpdateModuleMmap(sample->pid, sample->filename, sample->addr, sample->len,
+                                                      sample->pgoff);
                 if (ret != SUCCESS) {
                     // if the module fails to be updated, a warning is recorded to overwrite the failure error code.
                     SetWarn(ret, Perror());
                     New(SUCCESS);
                 }
             } else if (symbolMode == RESOLVE_ELF || symbolMode == RESOLVE_DELAY_ELF) {
-                int ret = SymResolverUpdateModuleNoDwarf(sample->tid, sample->filename, sample->addr);
+                int ret = SymResolverUpdateModuleMmapNoDwarf(sample->pid, sample->filename, sample->addr, sample->len,
+                                                             sample->pgoff);
                  if (ret != SUCCESS) {
                     // if the module fails to be updated, a warning is recorded to overwrite the failure error code.
                     SetWarn(ret, Perror());
@@ -440,6 +442,7 @@ int Spe::CoreDummyData(struct SpeCoreContext *context, struct ContextSwitchData
         if (header->type == PERF_RECORD_FORK) {
             struct PerfRecordFork *sample = (struct PerfRecordFork *)header;
             DBG_PRINT("Fork pid: %d tid: %d\n", sample->pid, sample->tid);
+            UpdateProcTopoOnFork(sample->pid, sample->tid, sample->ptid);
             if (sample->pid == sample->tid) {
                 // A new process is forked and the parent pid is ppid.
                 UpdateProcMap(sample->ppid, sample->tid);
@@ -451,9 +454,17 @@ int Spe::CoreDummyData(struct SpeCoreContext *context, struct ContextSwitchData
             continue;
         }
 
+        if (header->type == PERF_RECORD_EXIT) {
+            struct PerfRecordExit *sample = (struct PerfRecordExit *)header;
+            UpdateProcTopoOnExit(sample->tid);
+            dataTail += header->size;
+            continue;
+        }
+
         if (header->type == PERF_RECORD_COMM) {
             struct PerfRecordComm *sample = (struct PerfRecordComm *)header;
             DBG_PRINT("Comm exec pid: %d tid: %d\n", sample->pid, sample->tid);
+            UpdateProcTopoOnComm(sample->pid, sample->tid, sample->comm);
             UpdateCommProcMap(sample);
         }
 
@@ -482,9 +493,12 @@ int Spe::CoreDummyData(struct SpeCoreContext *context, struct ContextSwitchData
     return SUCCESS;
 }
 
-static void SetTidByTimestamp(struct ContextSwitchData *dummyData, int *dummyIdx, struct SpeRecord *buf,
-                              struct SpeRecord *bufEnd, int cpu, struct PerfTscConversion *tc)
+static void SetTidByTimestamp(AuxContext *auxCtx, struct SpeRecord *buf, struct SpeRecord *bufEnd,
+                              struct PerfTscConversion *tc)
 {
+    struct ContextSwitchData *dummyData = auxCtx->dummyData;
+    int *dummyIdx = auxCtx->dummyIdx;
+    int cpu = auxCtx->cpu;
     for (struct SpeRecord *start = buf; start < bufEnd; start++) {
         uint64_t recordTime = TscToPerfTime(start->timestamp, tc);
 
@@ -499,7 +513,7 @@ static void SetTidByTimestamp(struct ContextSwitchData *dummyData, int *dummyIdx
         }
         // Some OS does not implement context id for spe packets,
         // and match of tid to spe events may be inaccurate.
-        SetWarn(LIBPERF_WARN_CTXID_LOST);
+        *auxCtx->ctxIdLost = true;
 
         if (*dummyIdx >= dummyData[0].num - 1) {
             // Now, all spe records locate after the last switch-in data.
@@ -523,26 +537,6 @@ static void SetTidByTimestamp(struct ContextSwitchData *dummyData, int *dummyIdx
     return;
 }
 
-static struct SpeRecord *CoreAuxData(struct SpeCoreContext *ctx, AuxContext *auxCtx,
-                                     struct SpeRecord *buf, int *remainSize)
-{
-    struct perf_event_mmap_page *mpage = (struct perf_event_mmap_page *)ctx->speMpage;
-    uint8_t *auxBuf = static_cast<uint8_t *>(ctx->auxMpage);
-    uint8_t *auxStart = auxBuf + auxCtx->auxOffset % mpage->aux_size;
-    uint8_t *auxEnd = auxStart + auxCtx->auxSize;
-    SpeRecord *bufEnd = SpeGetRecord(auxStart, auxEnd, buf, remainSize);
-
-    struct PerfTscConversion tc;
-    auto err = PerfReadTscConversion(mpage, &tc);
-    if (err != SUCCESS) {
-        pcerr::New(err);
-        return nullptr;
-    }
-    SetTidByTimestamp(auxCtx->dummyData, auxCtx->dummyIdx, buf, bufEnd, auxCtx->cpu, &tc);
-
-    return bufEnd;
-}
-
 static size_t ComputeAuxSize(size_t auxMapLen, size_t headOff, size_t oldOff)
 {
     // Compute current aux buffer size by current offset and previous offset.
@@ -557,65 +551,167 @@ static size_t ComputeAuxSize(size_t auxMapLen, size_t headOff, size_t oldOff)
     return size;
 }
 
-static struct SpeRecord *CoreSpeData(struct SpeCoreContext *ctx, struct ContextSwitchData *dummyData,
-                                     struct SpeRecord *buf, int *remainSize, int cpu)
+static int InitAuxCursor(struct SpeCoreContext *ctx, __u64 head, SpeAuxCursor *cursor)
 {
-    int dummyIdx = 1;
     struct perf_event_mmap_page *mpage = (struct perf_event_mmap_page *)ctx->speMpage;
-    RMB();
+    uint8_t *auxBuf = static_cast<uint8_t *>(ctx->auxMpage);
+    cursor->seg = 0;
+    cursor->numSeg = 0;
+    cursor->dummyIdx = 1;
     __u64 old = ctx->prev;
-    __u64 head = ReadOnce(&mpage->aux_head);
     if (old == head) {
-        return buf;
+        return SUCCESS;
+    }
+    auto err = PerfReadTscConversion(mpage, &cursor->tc);
+    if (err != SUCCESS) {
+        return err;
     }
     size_t headOff = head & ctx->mask;
     size_t oldOff = old & ctx->mask;
     size_t size = ComputeAuxSize(mpage->aux_size, headOff, oldOff);
-
-    size_t auxOffset = 0;
-    struct SpeRecord *bufEnd = nullptr;
-    AuxContext auxCtx = {.dummyData = dummyData,
-            .dummyIdx = &dummyIdx,
-            .cpu = cpu};
     if (size > headOff) {
-        // Wraparound, read two data segments.
-        // Read the tail segment.
-        auxCtx.auxSize = size - headOff;
-        auxCtx.auxOffset = mpage->aux_size - auxCtx.auxSize;
-        buf = CoreAuxData(ctx, &auxCtx, buf, remainSize);
-        // Read the head segment.
-        auxCtx.auxOffset = 0;
-        auxCtx.auxSize = headOff;
-        buf = CoreAuxData(ctx, &auxCtx, buf, remainSize);
+        // Wraparound, read the tail segment and then the head segment.
+        cursor->pos[cursor->numSeg] = auxBuf + mpage->aux_size - (size - headOff);
+        cursor->end[cursor->numSeg] = auxBuf + mpage->aux_size;
+        cursor->numSeg++;
+        cursor->pos[cursor->numSeg] = auxBuf;
+        cursor->end[cursor->numSeg] = auxBuf + headOff;
+        cursor->numSeg++;
     } else {
-        auxCtx.auxOffset = oldOff;
-        auxCtx.auxSize = size;
-        buf = CoreAuxData(ctx, &auxCtx, buf, remainSize);
+        cursor->pos[cursor->numSeg] = auxBuf + oldOff;
+        cursor->end[cursor->numSeg] = auxBuf + oldOff + size;
+        cursor->numSeg++;
     }
-    ctx->prev = head;
+    return SUCCESS;
+}
 
-    mpage->data_tail = mpage->data_head;
-    mpage->aux_tail = mpage->aux_head;
-    MB();
+// Decode at most SPE_CHUNK_RECORDS records from <cursor> into <chunk>, which has room for one more record.
+// Return end of decoded records, which equals <chunk> if all aux data is decoded.
+static SpeRecord *DecodeAuxChunk(SpeAuxCursor *cursor, AuxContext *auxCtx, SpeRecord *chunk)
+{
+    while (cursor->seg < cursor->numSeg) {
+        int remainSize = SPE_CHUNK_RECORDS;
+        SpeRecord *chunkEnd = SpeGetRecord(&cursor->pos[cursor->seg], cursor->end[cursor->seg], chunk, &remainSize);
+        if (cursor->pos[cursor->seg] >= cursor->end[cursor->seg]) {
+            cursor->seg++;
+        }
+        if (chunkEnd != chunk) {
+            SetTidByTimestamp(auxCtx, chunk, chunkEnd, &cursor->tc);
+            return chunkEnd;
+        }
+    }
+    return chunk;
+}
 
-    return buf;
+static void CopyFromRing(uint8_t *ringBuf, uint64_t dataSize, uint64_t off, void *dst, size_t size)
+{
+    // Record may wrap around the end of ring buffer.
+    size_t first = std::min(static_cast<uint64_t>(size), dataSize - off);
+    memcpy(dst, ringBuf + off, first);
+    memcpy(static_cast<uint8_t *>(dst) + first, ringBuf, size - first);
+}
+
+void Spe::CoreAuxRecords(struct SpeCoreContext *context, int pageSize)
+{
+    // Kernel reports each handover of aux data with PERF_RECORD_AUX in ring buffer of spe event,
+    // and marks it truncated if aux buffer is full and spe records are dropped.
+    struct perf_event_mmap_page *mpage = (struct perf_event_mmap_page *)context->speMpage;
+    uint8_t *ringBuf = (uint8_t *)(mpage) + pageSize;
+    uint64_t dataHead = ReadOnce(&mpage->data_head);
+    uint64_t dataTail = mpage->data_tail;
+    RMB();
+    while (dataTail < dataHead) {
+        uint64_t off = dataTail % mpage->data_size;
+        struct perf_event_header header;
+        CopyFromRing(ringBuf, mpage->data_size, off, &header, sizeof(header));
+        if (__glibc_unlikely(header.size == 0)) {
+            break;
+        }
+        if (header.type == PERF_RECORD_AUX && header.size >= sizeof(PerfEventSampleAux)) {
+            PerfEventSampleAux aux;
+            CopyFromRing(ringBuf, mpage->data_size, off, &aux, sizeof(aux));
+            if (aux.flags & (PERF_AUX_FLAG_TRUNCATED | PERF_AUX_FLAG_COLLISION)) {
+                ++truncated;
+            }
+        } else if (header.type == PERF_RECORD_LOST && header.size >= sizeof(PerfEventSampleLost)) {
+            PerfEventSampleLost lostRecord;
+            CopyFromRing(ringBuf, mpage->data_size, off, &lostRecord, sizeof(lostRecord));
+            lost += lostRecord.lost;
+        }
+        dataTail += header.size;
+    }
+    mpage->data_tail = dataHead;
+    MB();
 }
 
-/*
- * For the initial implementation, caller should allocate a big enough buffer to
- * contain all of spe records. It's not pretty frankly, will be improved later.
- */
-int Spe::SpeReadData(struct SpeContext *context, struct SpeRecord *buf, int size)
+int Spe::Drain()
 {
-    int remainSize = size;
-    int dummySize = context->dummyMmapSize;
-    int err = CoreDummyData(context->coreCtxes, dummyData, dummySize, context->pageSize);
+    // Side-band records update process map and symbols, which are shared by all cores.
+    int err = CoreDummyData(ctx->coreCtxes, dummyData, ctx->dummyMmapSize, ctx->pageSize);
     if (err != SUCCESS) {
-        New(err);
-        return -1;
+        readErr = err;
+        return err;
+    }
+    CoreAuxRecords(ctx->coreCtxes, ctx->pageSize);
+    struct perf_event_mmap_page *mpage = (struct perf_event_mmap_page *)ctx->coreCtxes->speMpage;
+    RMB();
+    auxHead = ReadOnce(&mpage->aux_head);
+    readErr = SUCCESS;
+    return SUCCESS;
+}
+
+size_t Spe::PendingAuxSize() const
+{
+    struct perf_event_mmap_page *mpage = (struct perf_event_mmap_page *)ctx->coreCtxes->speMpage;
+    if (auxHead == ctx->coreCtxes->prev) {
+        return 0;
+    }
+    return ComputeAuxSize(mpage->aux_size, auxHead & ctx->coreCtxes->mask, ctx->coreCtxes->prev & ctx->coreCtxes->mask);
+}
+
+SpeRecord *Spe::DecodeChunk(SpeRecord *chunk)
+{
+    AuxContext auxCtx = {.dummyData = dummyData,
+            .dummyIdx = &cursor.dummyIdx,
+            .cpu = cpu,
+            .ctxIdLost = &ctxIdLost};
+    return DecodeAuxChunk(&cursor, &auxCtx, chunk);
+}
+
+void Spe::FinishAux()
+{
+    // Aux data before <auxHead> is decoded and kernel can overwrite it now.
+    struct perf_event_mmap_page *mpage = (struct perf_event_mmap_page *)ctx->coreCtxes->speMpage;
+    cursor.seg = cursor.numSeg;
+    ctx->coreCtxes->prev = auxHead;
+    mpage->aux_tail = auxHead;
+    MB();
+}
+
+void Spe::Decode()
+{
+    status |= DECODED;
+    records.clear();
+    if (readErr != SUCCESS) {
+        return;
+    }
+    readErr = InitAuxCursor(ctx->coreCtxes, auxHead, &cursor);
+    if (readErr != SUCCESS) {
+        FinishAux();
+        return;
+    }
+    // The rest of aux data is decoded by Read chunk by chunk.
+    while (records.size() < SPE_DECODE_AHEAD_CHUNKS * SPE_CHUNK_RECORDS) {
+        // SpeGetRecord initializes one record after the last decoded one.
+        size_t begin = records.size();
+        records.resize(begin + SPE_CHUNK_RECORDS + 1);
+        SpeRecord *chunk = records.data() + begin;
+        SpeRecord *chunkEnd = DecodeChunk(chunk);
+        records.resize(begin + (chunkEnd - chunk));
+        if (chunkEnd == chunk) {
+            break;
+        }
     }
-    CoreSpeData(context->coreCtxes, dummyData, buf, &remainSize, cpu);
-    return size - remainSize;
 }
 
 int Spe::Open(PmuEvt *attr, int pid)
@@ -633,9 +729,6 @@ int Spe::Open(PmuEvt *attr, int pid)
         this->dummyFd = this->ctx->coreCtxes->dummyFd;
         this->fd = this->ctx->coreCtxes->speFd;
 
-        if (records == nullptr) {
-            records = new SpeRecord[SPE_RECORD_MAX];
-        }
         if (dummyData == nullptr) {
             dummyData = new ContextSwitchData[ctx->dummyMmapSize];
         }
@@ -643,12 +736,8 @@ int Spe::Open(PmuEvt *attr, int pid)
 
     return SUCCESS;
 }
-int Spe::Enable(bool clearPrevRecords)
+int Spe::Enable()
 {
-    if (clearPrevRecords) {
-        pidRecords.clear();
-    }
-
     if (!(status & OPENED)) {
         return LIBPERF_ERR_FAILED_PMU_ENABLE;
     }
@@ -661,6 +750,7 @@ int Spe::Enable(bool clearPrevRecords)
     }
     status &= ~DISABLED;
     status &= ~READ;
+    status &= ~DECODED;
     status |= ENABLED;
     return SUCCESS;
 }
@@ -686,10 +776,7 @@ bool Spe::Close()
         return true;
     }
     SpeClose(ctx);
-    if (records != nullptr) {
-        delete[] records;
-        records = nullptr;
-    }
+    vector<SpeRecord>().swap(records);
     if (dummyData != nullptr) {
         delete[] dummyData;
         dummyData = nullptr;
@@ -698,7 +785,7 @@ bool Spe::Close()
     return true;
 }
 
-int Spe::Read()
+int Spe::Read(const SpeConsumer &consumer)
 {
     if (!(status & OPENED)) {
         return UNKNOWN_ERROR;
@@ -706,14 +793,45 @@ int Spe::Read()
     if (status & READ) {
         return SUCCESS;
     }
-    int numRecord = SpeReadData(this->ctx, records, SPE_RECORD_MAX);
-    for (int i = 0; i < numRecord; i++) {
-        SpeRecord *rec = &records[i];
-        pidRecords[rec->tid].push_back(rec);
+    if (!(status & DECODED)) {
+        // Not decoded together with other cores.
+        Drain();
+        Decode();
     }
     status |= READ;
-    if (Perrorno() == LIBPERF_ERR_KERNEL_NOT_SUPPORT || Perrorno() == LIBPERF_ERR_BUFFER_CORRUPTED) {
-        return Perrorno();
+    if (readErr != SUCCESS) {
+        records.clear();
+        New(readErr);
+        return readErr;
+    }
+    for (size_t i = 0; i < records.size(); i += SPE_CHUNK_RECORDS) {
+        size_t num = min<size_t>(SPE_CHUNK_RECORDS, records.size() - i);
+        consumer(records.data() + i, static_cast<int>(num));
+    }
+    if (cursor.seg < cursor.numSeg) {
+        // Aux data beyond chunks decoded ahead, reuse the first chunk.
+        records.resize(SPE_CHUNK_RECORDS + 1);
+        for (;;) {
+            SpeRecord *chunkEnd = DecodeChunk(records.data());
+            if (chunkEnd == records.data()) {
+                break;
+            }
+            consumer(records.data(), static_cast<int>(chunkEnd - records.data()));
+        }
+    }
+    FinishAux();
+    // Keep the capacity for the next collection.
+    records.clear();
+    if (ctxIdLost) {
+        SetWarn(LIBPERF_WARN_CTXID_LOST);
+        ctxIdLost = false;
+    }
+    if (truncated > reportedTruncated || lost > reportedLost) {
+        SetWarn(LIBPERF_WARN_SPE_AUX_TRUNCATED, "spe aux buffer of cpu " + to_string(cpu) + " is truncated " +
+                to_string(truncated - reportedTruncated) + " times and " + to_string(lost - reportedLost) +
+                " aux records are lost, please enlarge auxPages or collect with a smaller interval.");
+        reportedTruncated = truncated;
+        reportedLost = lost;
     }
     return SUCCESS;
 }
@@ -722,12 +840,3 @@ bool Spe::HaveRead()
 {
     return status & READ;
 }
-
-const std::vector<SpeRecord *> Spe::GetPidRecords(const pid_t &pid) const
-{
-    auto findRecords = pidRecords.find(pid);
-    if (findRecords == pidRecords.end()) {
-        return {};
-    }
-    return findRecords->second;
-}
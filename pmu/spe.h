@@ -18,6 +18,7 @@
 
 #include <vector>
 #include <map>
+#include <functional>
 #include <unordered_map>
 #include <fcntl.h>
 #include <stdint.h>
@@ -55,7 +56,10 @@
 #define EVENT_LLC_REFILL 0x200
 #define EVENT_REMOTE_ACCESS 0x400
 
-#define SPE_SAMPLE_MAX 200000
+// Number of records decoded from aux buffer at a time.
+#define SPE_CHUNK_RECORDS 4096
+// Chunks decoded for each core before read, which holds records of the default aux buffer.
+#define SPE_DECODE_AHEAD_CHUNKS 4
 
 struct SpeCoreContext {
     int cpu;
@@ -71,7 +75,7 @@ struct SpeCoreContext {
 struct SpeContext {
     int cpuNum;
     __u64 speMmapSize;   /* size of spe event ring buffer + first page */
-    __u64 auxMmapSize;   /* size of aux buffer */
+    __u64 auxMmapSize;   /* size of aux buffer, 2^n pages */
     int dummyMmapSize; /* size of dummy event ring buffer + first page */
     int pageSize;
     struct SpeCoreContext *coreCtxes;
@@ -104,6 +108,12 @@ struct PerfEventSampleAux {
     uint32_t pid, tid;                // process and thread id of spe record
 };
 
+struct PerfEventSampleLost {
+    struct perf_event_header header;  // lost record header
+    uint64_t id;                      // id of spe event
+    uint64_t lost;                    // number of lost records
+};
+
 struct PerfEventSampleContextSwitch {
     struct perf_event_header header;  // context switch record header
     uint32_t nextPrevPid;  // The process ID of the previous (if switching in) or
@@ -120,6 +130,16 @@ struct PerfTscConversion {
     int capUserTimeZero;
 };
 
+// Aux data of the last collection not decoded yet, in two segments if aux buffer wraps around.
+struct SpeAuxCursor {
+    uint8_t *pos[2];
+    uint8_t *end[2];
+    int seg;
+    int numSeg;
+    int dummyIdx;
+    struct PerfTscConversion tc;
+};
+
 struct ContextSwitchData {
     uint32_t nextPrevPid = 0;
     uint32_t nextPrevTid = 0;
@@ -129,6 +149,9 @@ struct ContextSwitchData {
     };
 };
 
+// Consumer of decoded spe records, called once for each chunk of at most SPE_CHUNK_RECORDS records.
+using SpeConsumer = std::function<void(const SpeRecord *records, int num)>;
+
 struct SampleId {
     __u32 pid, tid;   /* if PERF_SAMPLE_TID set */
     __u64 time;       /* if PERF_SAMPLE_TIME set */
@@ -146,14 +169,6 @@ public:
             : cpu(cpu), procMap(procMap), symbolMode(symMode)
     {}
 
-    ~Spe()
-    {
-        if (records != nullptr) {
-            delete[] records;
-            records = nullptr;
-        }
-    }
-
     /**
      * @brief Open SPE ring buffer.
      * @param attr sampling attribute.
@@ -164,9 +179,8 @@ public:
 
     /**
      * @brief Start collect.
-     * @param clearPrevRecords whether clear all records from previous collection.
      */
-    int Enable(bool clearPrevRecords = true);
+    int Enable();
 
     /**
      * @brief Stop collect.
@@ -181,11 +195,30 @@ public:
     bool Close();
 
     /**
-     * @brief Read data in ring buffer in last collection, and store data in this object. Use GetPidRecords to get data.
-     * @return true
-     * @return false
+     * @brief Consume side-band records and take a snapshot of aux data in last collection.
+     * Process map and symbols are updated here, so it should be called for cores one by one.
+     * @return error code
+     */
+    int Drain();
+
+    /**
+     * @brief Size in bytes of aux data taken by Drain.
+     */
+    size_t PendingAuxSize() const;
+
+    /**
+     * @brief Decode at most SPE_DECODE_AHEAD_CHUNKS chunks of aux data taken by Drain. Only data of this core
+     * is touched, so Decode of different cores can run concurrently. Errors are reported by Read.
      */
-    int Read();
+    void Decode();
+
+    /**
+     * @brief Pass records of last collection to <consumer> chunk by chunk, and decode them first if Decode is not called.
+     * Aux data beyond chunks decoded ahead is decoded here one chunk at a time, so memory is bounded by chunks.
+     * @param consumer called for each chunk of decoded records.
+     * @return error code
+     */
+    int Read(const SpeConsumer &consumer);
 
     /**
      * @brief The last collceted data have been read.
@@ -195,24 +228,39 @@ public:
     bool HaveRead();
 
     /**
-     * @brief Get SPE data of process with <pid>.
-     * @param pid
-     * @return const std::vector<SpeRecord *>
+     * @brief The last collected data is stopped and waits for Drain and Decode.
      */
-    const std::vector<SpeRecord *> GetPidRecords(const pid_t &pid) const;
+    bool NeedDecode() const
+    {
+        return (status & OPENED) && (status & DISABLED) && !(status & (READ | DECODED));
+    }
 
     int GetSpeFd() const
     {
         return fd;
     }
 
-    const std::map<pid_t, std::vector<SpeRecord *>>& GetAllRecords() const
+    /**
+     * @brief Get times of aux buffer truncated since opened, which means spe records are lost
+     * because aux buffer is full before it is read.
+     */
+    uint64_t GetTruncated() const
+    {
+        return truncated;
+    }
+
+    /**
+     * @brief Get number of records lost in ring buffer of spe event since opened, such as PERF_RECORD_AUX.
+     */
+    uint64_t GetLost() const
     {
-        return pidRecords;
+        return lost;
     }
 
 private:
-    int SpeReadData(struct SpeContext *context, struct SpeRecord *buf, int size);
+    void CoreAuxRecords(struct SpeCoreContext *context, int pageSize);
+    SpeRecord *DecodeChunk(SpeRecord *chunk);
+    void FinishAux();
     int CoreDummyData(struct SpeCoreContext *context, struct ContextSwitchData *data, int size, int pageSize);
     void UpdateProcMap(__u32 ppid, __u32 pid);
     void UpdateCommProcMap(struct KUNPENG_PMU::PerfRecordComm* recordComm);
@@ -222,6 +270,7 @@ private:
     const unsigned short ENABLED = 1 << 1;
     const unsigned short DISABLED = 1 << 2;
     const unsigned short READ = 1 << 3;
+    const unsigned short DECODED = 1 << 4;
 
     int cpu = 0;
     SymbolMode symbolMode = NO_SYMBOL_RESOLVE;
@@ -229,9 +278,16 @@ private:
     unsigned short status = NONE;
     int dummyFd = 0;
     int fd = 0;
-    SpeRecord *records = nullptr;
     ContextSwitchData *dummyData = nullptr;
-    std::map<pid_t, std::vector<SpeRecord *>> pidRecords;
+    std::vector<SpeRecord> records;
+    SpeAuxCursor cursor = {0};
+    __u64 auxHead = 0;
+    int readErr = 0;
+    bool ctxIdLost = false;
+    uint64_t truncated = 0;
+    uint64_t lost = 0;
+    uint64_t reportedTruncated = 0;
+    uint64_t reportedLost = 0;
     std::unordered_map<pid_t, std::shared_ptr<ProcTopology>> &procMap;
 };
 
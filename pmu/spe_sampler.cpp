@@ -18,17 +18,45 @@
 #include <linux/perf_event.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <unordered_set>
 #include "linked_list.h"
 #include "spe.h"
 #include "pcerrc.h"
 #include "spe_sampler.h"
 #include "pcerr.h"
+#include "task_runner.h"
 
 using namespace std;
 
 namespace KUNPENG_PMU {
 
     static map<int, Spe> speSet;
+    // At most so many threads to decode aux data of cores.
+    static constexpr size_t MAX_DECODE_WORKERS = 16;
+    // Aux data for each decode thread, smaller data is decoded in the calling thread to save thread creation.
+    static constexpr size_t MIN_AUX_BYTES_PER_WORKER = 256 * 1024;
+
+    /**
+     * Decode the first chunks of aux data of all cores stopped for this read on a pool of workers.
+     * Side-band records are drained core by core before that, because process map and symbols are shared.
+     */
+    static void DecodeAllSpe()
+    {
+        vector<Spe *> pending;
+        size_t auxBytes = 0;
+        for (auto &spe : speSet) {
+            if (!spe.second.NeedDecode()) {
+                continue;
+            }
+            spe.second.Drain();
+            auxBytes += spe.second.PendingAuxSize();
+            pending.push_back(&spe.second);
+        }
+        size_t maxWorkers = min(MAX_DECODE_WORKERS, auxBytes / MIN_AUX_BYTES_PER_WORKER + 1);
+        RunParallelTasks(pending.size(), maxWorkers, 1, [&pending](size_t i) {
+            pending[i]->Decode();
+        });
+    }
 
     bool PerfSpe::Mmap()
     {
@@ -69,54 +97,59 @@ namespace KUNPENG_PMU {
             // Do not repeat reading data from the same core.
             return SUCCESS;
         }
-        if (findSpe->second.Read() != SUCCESS) {
-            return Perrorno();
+        if (findSpe->second.NeedDecode()) {
+            // The first core in this read, decode all cores at once.
+            DecodeAllSpe();
         }
-
-        // Fill pmu data from SPE collector.
-        auto cnt = eventData.data.size();
-        if (pid == -1) {
-            // Loop over all tids in records and resolve module symbol for all pids.
-            UpdatePidList(findSpe->second);
-            for (auto records : findSpe->second.GetAllRecords()) {
-                if (records.first == -1 || records.first == 0) {
-                    continue;
-                }
-                // Insert each spe record for each tid.
-                InsertSpeRecords(records.first, records.second, eventData.data, eventData.sampleIps, eventData.extPool);
-            }
-        } else {
-            // Loop over all tids.
-            for (auto &proc : procMap) {
-                // Get all spe records for tid.
-                const auto &records = findSpe->second.GetPidRecords(proc.first);
-                InsertSpeRecords(proc.second->tid, records, eventData.data, eventData.sampleIps, eventData.extPool);
+        // Records are handed over chunk by chunk, and filled into pmu data directly.
+        std::unordered_set<int> unknownTids;
+        auto consumer = [&](const SpeRecord *records, int num) {
+            if (pid == -1) {
+                // Resolve module symbol for all pids in records.
+                UpdatePidList(records, num, unknownTids);
             }
+            InsertSpeRecords(records, num, eventData.data, eventData.sampleIps, eventData.extPool);
+        };
+        if (findSpe->second.Read(consumer) != SUCCESS) {
+            return Perrorno();
         }
 
         return SUCCESS;
     }
 
-    void PerfSpe::InsertSpeRecords(
-            const int &tid, const std::vector<SpeRecord *> &speRecords, vector<PmuData> &data, vector<PerfSampleIps> &sampleIps, std::vector<PmuDataExt*> &extPool)
+    void PerfSpe::InsertSpeRecords(const SpeRecord *speRecords, int num, vector<PmuData> &data,
+                                   vector<PerfSampleIps> &sampleIps, std::vector<PmuDataExt*> &extPool)
     {
-        ProcTopology *procTopo = nullptr;
-        auto findProc = procMap.find(tid);
-        if (findProc == procMap.end()) {
-            return;
-        }
-        procTopo = findProc->second.get();
         // Use large memory malloc instead of small mallocs to improve performance.
-        PmuDataExt *extPtrs = new PmuDataExt[speRecords.size()];
-        extPool.push_back(extPtrs);
-        for (size_t i = 0; i < speRecords.size(); ++i) {
-            auto rec = speRecords[i];
+        PmuDataExt *extPtrs = nullptr;
+        size_t extIdx = 0;
+        ProcTopology *procTopo = nullptr;
+        int lastTid = -1;
+        for (int i = 0; i < num; ++i) {
+            const SpeRecord *rec = &speRecords[i];
+            int tid = static_cast<int>(rec->tid);
+            if (tid == -1 || tid == 0) {
+                continue;
+            }
+            if (tid != lastTid) {
+                // Records of the same thread are mostly adjacent.
+                auto findProc = procMap.find(tid);
+                procTopo = findProc == procMap.end() ? nullptr : findProc->second.get();
+                lastTid = tid;
+            }
+            if (procTopo == nullptr) {
+                continue;
+            }
+            if (extPtrs == nullptr) {
+                extPtrs = new PmuDataExt[num];
+                extPool.push_back(extPtrs);
+            }
             data.emplace_back(PmuData{0});
             auto &current = data.back();
             current.pid = static_cast<pid_t>(procTopo->pid);
-            current.tid = static_cast<int>(rec->tid);
+            current.tid = tid;
             current.cpu = this->cpu;
-            current.ext = &extPtrs[i];
+            current.ext = &extPtrs[extIdx++];
             current.ext->event = rec->event;
             current.ext->va = rec->va;
             current.ext->pa = rec->pa;
@@ -124,7 +157,7 @@ namespace KUNPENG_PMU {
             current.ext->source = rec->source;
             current.ext->op = rec->opType;
             current.ts = static_cast<int64_t>(rec->timestamp);
-            current.comm = procTopo ? procTopo->comm : nullptr;
+            current.comm = procTopo->comm;
             // Assign pc, which will be parsed to Symbol in PmuRead.
             sampleIps.emplace_back(PerfSampleIps());
             auto &ips = sampleIps.back();
@@ -132,15 +165,19 @@ namespace KUNPENG_PMU {
         }
     }
 
-    void PerfSpe::UpdatePidList(const Spe &spe)
+    void PerfSpe::UpdatePidList(const SpeRecord *speRecords, int num, std::unordered_set<int> &unknownTids)
     {
-        for (auto records : spe.GetAllRecords()) {
-            auto tid = records.first;
-            if (procMap.find(tid) == procMap.end()) {
-                auto procTopo = GetProcTopology(tid);
-                if (procTopo != nullptr) {
-                    procMap[tid] = shared_ptr<ProcTopology>(procTopo, FreeProcTopo);
-                }
+        for (int i = 0; i < num; ++i) {
+            int tid = static_cast<int>(speRecords[i].tid);
+            if (tid == -1 || tid == 0 || procMap.find(tid) != procMap.end() || unknownTids.count(tid)) {
+                continue;
+            }
+            auto procTopo = GetProcTopology(tid);
+            if (procTopo != nullptr) {
+                procMap[tid] = shared_ptr<ProcTopology>(procTopo, FreeProcTopo);
+            } else {
+                // Don't look up an exited thread again in this read.
+                unknownTids.insert(tid);
             }
         }
     }
@@ -20,6 +20,7 @@
 #include <stdexcept>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <climits>
 #include <unistd.h>
 #include "process_map.h"
@@ -49,9 +50,9 @@ namespace KUNPENG_PMU {
         int EndRead() override;
         
     private:
-        void InsertSpeRecords(const int &tid, const std::vector<SpeRecord *> &speRecords, std::vector<PmuData> &data,
+        void InsertSpeRecords(const SpeRecord *speRecords, int num, std::vector<PmuData> &data,
                               std::vector<PerfSampleIps> &sampleIps, std::vector<PmuDataExt*> &extPool);
-        void UpdatePidList(const Spe &spe);
+        void UpdatePidList(const SpeRecord *speRecords, int num, std::unordered_set<int> &unknownTids);
     };
 }  // namespace KUNPENG_PMU
 #endif
@@ -164,6 +164,12 @@ class CtypesPmuAttr(ctypes.Structure):
         ('enableHwMetric', ctypes.c_uint, 1),
         ('enableOnExec', ctypes.c_uint, 1),
         ('perThread', ctypes.c_uint, 1),
+        ('perCpuSample', ctypes.c_uint, 1),
+        ('overheadBudget', ctypes.c_uint),
+        ('includeChildCgroup', ctypes.c_uint, 1),
+        ('auxPages', ctypes.c_uint),
+        ('auxWatermark', ctypes.c_uint),
+        ('userStackSize', ctypes.c_uint),
     ]
 
     def __init__(self,
@@ -192,6 +198,12 @@ class CtypesPmuAttr(ctypes.Structure):
                  enableHwMetric=False,
                  enableOnExec=False,
                  perThread=False,
+                 perCpuSample=False,
+                 overheadBudget=0,
+                 includeChildCgroup=False,
+                 auxPages=0,
+                 auxWatermark=0,
+                 userStackSize=0,
                  *args, **kw):
         super(CtypesPmuAttr, self).__init__(*args, **kw)
 
@@ -260,6 +272,12 @@ class CtypesPmuAttr(ctypes.Structure):
         self.enableHwMetric = enableHwMetric
         self.enableOnExec = enableOnExec
         self.perThread = perThread
+        self.perCpuSample = perCpuSample
+        self.overheadBudget = ctypes.c_uint(overheadBudget)
+        self.includeChildCgroup = includeChildCgroup
+        self.auxPages = ctypes.c_uint(auxPages)
+        self.auxWatermark = ctypes.c_uint(auxWatermark)
+        self.userStackSize = ctypes.c_uint(userStackSize)
 
 class PmuAttr(object):
     __slots__ = ['__c_pmu_attr']
@@ -288,7 +306,13 @@ class PmuAttr(object):
                  enableBpf=False,
                  enableHwMetric=False,
                  enableOnExec=False,
-                 perThread=False):
+                 perThread=False,
+                 perCpuSample=False,
+                 overheadBudget=0,
+                 includeChildCgroup=False,
+                 auxPages=0,
+                 auxWatermark=0,
+                 userStackSize=0):
 
         self.__c_pmu_attr = CtypesPmuAttr(
             evtList=evtList,
@@ -315,6 +339,12 @@ class PmuAttr(object):
             enableHwMetric=enableHwMetric,
             enableOnExec=enableOnExec,
             perThread=perThread,
+            perCpuSample=perCpuSample,
+            overheadBudget=overheadBudget,
+            includeChildCgroup=includeChildCgroup,
+            auxPages=auxPages,
+            auxWatermark=auxWatermark,
+            userStackSize=userStackSize,
         )
 
     @property
@@ -569,6 +599,54 @@ class PmuAttr(object):
     def perThread(self, perThread):
         self.c_pmu_attr.perThread = int(perThread)
 
+    @property
+    def perCpuSample(self):
+        return bool(self.c_pmu_attr.perCpuSample)
+
+    @perCpuSample.setter
+    def perCpuSample(self, perCpuSample):
+        self.c_pmu_attr.perCpuSample = int(perCpuSample)
+
+    @property
+    def overheadBudget(self):
+        return self.c_pmu_attr.overheadBudget
+
+    @overheadBudget.setter
+    def overheadBudget(self, overheadBudget):
+        self.c_pmu_attr.overheadBudget = ctypes.c_uint(overheadBudget)
+
+    @property
+    def includeChildCgroup(self):
+        return bool(self.c_pmu_attr.includeChildCgroup)
+
+    @includeChildCgroup.setter
+    def includeChildCgroup(self, includeChildCgroup):
+        self.c_pmu_attr.includeChildCgroup = int(includeChildCgroup)
+
+    @property
+    def auxPages(self):
+        return self.c_pmu_attr.auxPages
+
+    @auxPages.setter
+    def auxPages(self, auxPages):
+        self.c_pmu_attr.auxPages = ctypes.c_uint(auxPages)
+
+    @property
+    def auxWatermark(self):
+        return self.c_pmu_attr.auxWatermark
+
+    @auxWatermark.setter
+    def auxWatermark(self, auxWatermark):
+        self.c_pmu_attr.auxWatermark = ctypes.c_uint(auxWatermark)
+
+    @property
+    def userStackSize(self):
+        return self.c_pmu_attr.userStackSize
+
+    @userStackSize.setter
+    def userStackSize(self, userStackSize):
+        self.c_pmu_attr.userStackSize = ctypes.c_uint(userStackSize)
+
     @classmethod
     def from_c_pmu_data(cls, c_pmu_attr):
         pmu_attr = cls()
@@ -304,6 +304,7 @@ class CtypesAsmCode(ctypes.Structure):
         char* code;            // code of asm
         char* fileName;        // this source file name of this asm code
         unsigned int lineNum;  // the real line of this addr
+        unsigned long count;   // number of samples of this addr, only set by PmuAnnotate
     };
     """
 
@@ -311,7 +312,8 @@ class CtypesAsmCode(ctypes.Structure):
         ('addr',     ctypes.c_ulong),
         ('code',     ctypes.c_char_p),
         ('fileName', ctypes.c_char_p),
-        ('lineNum',  ctypes.c_uint)
+        ('lineNum',  ctypes.c_uint),
+        ('count',    ctypes.c_ulong)
     ]
 
     def __init__(self,
@@ -319,12 +321,14 @@ class CtypesAsmCode(ctypes.Structure):
                  code= '',
                  fileName= '',
                  lineNum= 0,
+                 count= 0,
                  *args, **kw):
         super(CtypesAsmCode, self).__init__(*args, **kw)
         self.addr =  ctypes.c_ulong(addr)
         self.code = ctypes.c_char_p(code.encode(UTF_8))
         self.fileName = ctypes.c_char_p(fileName.encode(UTF_8))
         self.lineNum =  ctypes.c_uint(lineNum)
+        self.count = ctypes.c_ulong(count)
 
 
 class AsmCode:
@@ -335,12 +339,14 @@ class AsmCode:
                  addr= 0,
                  code= '',
                  fileName= '',
-                 lineNum= 0):
+                 lineNum= 0,
+                 count= 0):
         self.__c_asm_code = CtypesAsmCode(
             addr=addr,
             code=code,
             fileName=fileName,
-            lineNum=lineNum
+            lineNum=lineNum,
+            count=count
         )
 
     @property
@@ -379,6 +385,14 @@ class AsmCode:
     def lineNum(self, lineNum):
         self.c_asm_code.lineNum = ctypes.c_uint(lineNum)
 
+    @property
+    def count(self):
+        return self.c_asm_code.count
+
+    @count.setter
+    def count(self, count):
+        self.c_asm_code.count = ctypes.c_ulong(count)
+
     @classmethod
     def from_c_asm_code(cls, c_asm_code):
         asm_code = cls()
@@ -525,6 +539,46 @@ def SymResolverRecordModuleNoDwarf(pid):
     c_SymResolverRecordModuleNoDwarf(c_pid)
 
 
+def SymResolverSetCacheDir(cacheDir):
+    """
+    int SymResolverSetCacheDir(const char* dir);
+    """
+    c_SymResolverSetCacheDir = sym_so.SymResolverSetCacheDir
+    c_SymResolverSetCacheDir.argtypes = [ctypes.c_char_p]
+    c_SymResolverSetCacheDir.restype = ctypes.c_int
+
+    c_dir = ctypes.c_char_p(cacheDir.encode(UTF_8)) if cacheDir else None
+
+    return c_SymResolverSetCacheDir(c_dir)
+
+
+def SymResolverSaveLayout(path):
+    """
+    int SymResolverSaveLayout(const char* path);
+    """
+    c_SymResolverSaveLayout = sym_so.SymResolverSaveLayout
+    c_SymResolverSaveLayout.argtypes = [ctypes.c_char_p]
+    c_SymResolverSaveLayout.restype = ctypes.c_int
+
+    c_path = ctypes.c_char_p(path.encode(UTF_8))
+
+    return c_SymResolverSaveLayout(c_path)
+
+
+def SymResolverLoadLayout(path, rootDir):
+    """
+    int SymResolverLoadLayout(const char* path, const char* rootDir);
+    """
+    c_SymResolverLoadLayout = sym_so.SymResolverLoadLayout
+    c_SymResolverLoadLayout.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+    c_SymResolverLoadLayout.restype = ctypes.c_int
+
+    c_path = ctypes.c_char_p(path.encode(UTF_8))
+    c_rootDir = ctypes.c_char_p(rootDir.encode(UTF_8)) if rootDir else None
+
+    return c_SymResolverLoadLayout(c_path, c_rootDir)
+
+
 def StackToHash(pid, stackList):
     """
     struct Stack* StackToHash(int pid, unsigned long* stack, int nr);
@@ -597,6 +651,9 @@ __all__ = [
     'SymResolverRecordKernel',
     'SymResolverRecordModule',
     'SymResolverRecordModuleNoDwarf',
+    'SymResolverSetCacheDir',
+    'SymResolverSaveLayout',
+    'SymResolverLoadLayout',
     'StackToHash',
     'SymResolverMapAddr',
     'FreeModuleData',
@@ -121,6 +121,7 @@ class SymbolMode:
     RESOLVE_ELF_DWARF = 2   # Resolve elf and dwarf. All fields in Symbol will be valid.
     RESOLVE_DELAY_ELF = 3   # Load elf. The ResolvePmuDataSymbol can be called to obtain elf information.
     RESOLVE_DELAY_DWARF = 4 # Load elf and dwarf. The ResolvePmuDataSymbol can be called to obtain elf information and dwarf information.
+    RESOLVE_OFFLINE = 5     # Only addr of Symbol is valid. Module layouts are recorded to be saved by ksym.save_layout.
 
 class PmuDeviceMetric:
     # Perchannel metric.
@@ -328,7 +329,13 @@ class PmuAttr(_libkperf.PmuAttr):
         branchSampleFilter: if the filter mode is set, branch_sample_stack data is collected in sampling mode
         cgroupNameList: cgroup name list, can not assigned with pidList.
         enableUserAccess: In count mode, enable read the register directly to collect data
-        enableBpf: In count mode, enable bpf to collect data.
+        enableBpf: In count mode, enable bpf to collect data. In sampling mode, aggregate samples by call stack in kernel.
+        perCpuSample: In sampling mode, open one event per cpu for <pidList> and their children instead of one per thread.
+        overheadBudget: In sampling mode, cpu overhead budget in units of 0.01% of one cpu, sample period is enlarged when it is exceeded.
+        includeChildCgroup: In bpf count mode with cgroupNameList, also report each descendant cgroup, which counts its own subtree.
+        auxPages: In spe mode, pages of aux buffer for each cpu, must be a power of 2. 0 means 1MB.
+        auxWatermark: In spe mode, bytes of aux data to hand over to user space. 0 means half of aux buffer.
+        userStackSize: In sampling mode with callStack, bytes of user stack dumped per sample to unwind with dwarf cfi, a multiple of 8 and no more than 65528. 0 means frame pointer callchain.
     """
     def __init__(self,
                  evtList = None, 
@@ -353,7 +360,13 @@ class PmuAttr(_libkperf.PmuAttr):
                  enableUserAccess = False,
                  enableBpf = False,
                  enableOnExec = False,
-                 perThread = False):
+                 perThread = False,
+                 perCpuSample = False,
+                 overheadBudget = 0,
+                 includeChildCgroup = False,
+                 auxPages = 0,
+                 auxWatermark = 0,
+                 userStackSize = 0):
         super(PmuAttr, self).__init__(
             evtList=evtList,
             pidList=pidList,
@@ -378,6 +391,12 @@ class PmuAttr(_libkperf.PmuAttr):
             enableBpf=enableBpf,
             enableOnExec=enableOnExec,
             perThread=perThread,
+            perCpuSample=perCpuSample,
+            overheadBudget=overheadBudget,
+            includeChildCgroup=includeChildCgroup,
+            auxPages=auxPages,
+            auxWatermark=auxWatermark,
+            userStackSize=userStackSize,
         )
 
 class CpuTopology(_libkperf.CpuTopology):
@@ -68,6 +68,27 @@ def record_module(pid, dwarf = True):
         _libkperf.SymResolverRecordModuleNoDwarf(pid)
 
 
+def set_cache_dir(cache_dir):
+    """
+    Set directory to cache symbol indexes of elf files by build-id, which should be called before recording modules.
+    """
+    return _libkperf.SymResolverSetCacheDir(cache_dir)
+
+
+def save_layout(path):
+    """
+    Save module layouts recorded in RESOLVE_OFFLINE mode and kernel symbols, to resolve addresses later
+    """
+    return _libkperf.SymResolverSaveLayout(path)
+
+
+def load_layout(path, root_dir = None):
+    """
+    Load saved module layouts and kernel symbols, after which get_stack and get_symbol resolve saved addresses
+    """
+    return _libkperf.SymResolverLoadLayout(path, root_dir)
+
+
 def get_stack(pid, stacks):
     """
     Convert a callstack to an unsigned long long hashid
@@ -98,6 +119,9 @@ __all__ = [
     'Stack',
     'record_kernel',
     'record_module',
+    'set_cache_dir',
+    'save_layout',
+    'load_layout',
     'get_stack',
     'get_symbol',
     'free_module',
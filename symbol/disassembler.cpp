@@ -0,0 +1,263 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: disassemble code of elf files in process with llvm MC.
+ ******************************************************************************/
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include "llvm/MC/MCInst.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "disassembler.h"
+
+using namespace llvm;
+using namespace llvm::object;
+
+namespace KUNPENG_SYM {
+
+static constexpr int WORD_LEN = 4;
+static constexpr int SHORT_LEN = 2;
+static constexpr int HEX_STR_LEN = 32;
+
+static void InitTargets()
+{
+    static std::once_flag initFlag;
+    std::call_once(initFlag, []() {
+        InitializeAllTargetInfos();
+        InitializeAllTargetMCs();
+        InitializeAllDisassemblers();
+    });
+}
+
+static bool IsMappingSymbol(StringRef name, bool& isData)
+{
+    // Mapping symbols are $d, $x, $a, $t, optionally followed by a suffix such as $d.1.
+    if (name.size() < 2 || name[0] != '$' || (name.size() > 2 && name[2] != '.')) {
+        return false;
+    }
+    isData = name[1] == 'd';
+    return isData || name[1] == 'x' || name[1] == 'a' || name[1] == 't';
+}
+
+std::shared_ptr<AsmDisassembler> AsmDisassembler::Create(const std::string& path)
+{
+    std::shared_ptr<AsmDisassembler> disassembler(new AsmDisassembler());
+    if (!disassembler->Init(path)) {
+        return nullptr;
+    }
+    return disassembler;
+}
+
+bool AsmDisassembler::Init(const std::string& path)
+{
+    InitTargets();
+    auto binaryOrErr = ObjectFile::createObjectFile(path);
+    if (!binaryOrErr) {
+        consumeError(binaryOrErr.takeError());
+        return false;
+    }
+    binary = std::move(*binaryOrErr);
+    const ObjectFile* obj = binary.getBinary();
+    if (!obj->isELF()) {
+        return false;
+    }
+    Triple triple = obj->makeTriple();
+    std::string tripleName = triple.getTriple();
+    std::string error;
+    const Target* target = TargetRegistry::lookupTarget("", triple, error);
+    if (target == nullptr) {
+        return false;
+    }
+    mri.reset(target->createMCRegInfo(tripleName));
+    if (!mri) {
+        return false;
+    }
+    asmInfo.reset(target->createMCAsmInfo(*mri, tripleName));
+    sti.reset(target->createMCSubtargetInfo(tripleName, "", obj->getFeatures().getString()));
+    mii.reset(target->createMCInstrInfo());
+    if (!asmInfo || !sti || !mii) {
+        return false;
+    }
+    mofi.reset(new MCObjectFileInfo());
+    ctx.reset(new MCContext(asmInfo.get(), mri.get(), mofi.get()));
+    mofi->InitMCObjectFileInfo(triple, false, *ctx);
+    disAsm.reset(target->createMCDisassembler(*sti, *ctx));
+    printer.reset(target->createMCInstPrinter(triple, asmInfo->getAssemblerDialect(), *asmInfo, *mii, *mri));
+    if (!disAsm || !printer) {
+        return false;
+    }
+    mia.reset(target->createMCInstrAnalysis(mii.get()));
+
+    for (const SectionRef& section : obj->sections()) {
+        if (!section.isText() || section.isVirtual() || section.getSize() == 0) {
+            continue;
+        }
+        StringRef contents;
+        if (section.getContents(contents)) {
+            continue;
+        }
+        ArrayRef<uint8_t> bytes(reinterpret_cast<const uint8_t*>(contents.data()), contents.size());
+        sections.push_back({section.getAddress(), section.getSize(), ELFSectionRef(section).getOffset(), bytes});
+    }
+    LoadFuncs();
+    return !sections.empty();
+}
+
+void AsmDisassembler::LoadFuncs()
+{
+    const ObjectFile* obj = binary.getBinary();
+    bool isArm = obj->getArch() == Triple::aarch64 || obj->getArch() == Triple::arm;
+    auto addSymbols = [this, isArm](const ELFObjectFileBase::elf_symbol_iterator_range& symbols) {
+        for (const ELFSymbolRef& sym : symbols) {
+            auto nameOrErr = sym.getName();
+            auto addrOrErr = sym.getAddress();
+            if (!nameOrErr || !addrOrErr) {
+                consumeError(nameOrErr.takeError());
+                consumeError(addrOrErr.takeError());
+                continue;
+            }
+            bool isData = false;
+            if (isArm && IsMappingSymbol(*nameOrErr, isData)) {
+                dataMarks.emplace_back(*addrOrErr, isData);
+                continue;
+            }
+            if (sym.getELFType() != ELF::STT_FUNC || nameOrErr->empty()) {
+                continue;
+            }
+            funcs.push_back({*addrOrErr, *addrOrErr + sym.getSize(), nameOrErr->str()});
+        }
+    };
+    auto elfObj = cast<ELFObjectFileBase>(obj);
+    addSymbols(elfObj->symbols());
+    // Stripped files only have dynamic symbols.
+    if (funcs.empty()) {
+        addSymbols(elfObj->getDynamicSymbolIterators());
+    }
+    std::sort(funcs.begin(), funcs.end(), [](const AsmFunc& a, const AsmFunc& b) { return a.start < b.start; });
+    funcs.erase(std::unique(funcs.begin(), funcs.end(),
+                            [](const AsmFunc& a, const AsmFunc& b) { return a.start == b.start; }),
+                funcs.end());
+    // Functions without size end at the next function.
+    for (size_t i = 0; i < funcs.size(); ++i) {
+        if (funcs[i].end == funcs[i].start && i + 1 < funcs.size()) {
+            funcs[i].end = funcs[i + 1].start;
+        }
+    }
+    std::sort(dataMarks.begin(), dataMarks.end());
+}
+
+const AsmFunc* AsmDisassembler::FindFunc(unsigned long addr) const
+{
+    auto iter = std::upper_bound(funcs.begin(), funcs.end(), addr,
+                                 [](unsigned long addr, const AsmFunc& func) { return addr < func.start; });
+    if (iter == funcs.begin()) {
+        return nullptr;
+    }
+    --iter;
+    if (addr >= iter->end) {
+        return nullptr;
+    }
+    return &*iter;
+}
+
+unsigned long AsmDisassembler::FileOffset(unsigned long addr) const
+{
+    for (const auto& section : sections) {
+        if (addr >= section.addr && addr < section.addr + section.size) {
+            return addr - section.addr + section.offset;
+        }
+    }
+    return addr;
+}
+
+bool AsmDisassembler::IsData(unsigned long addr, unsigned long& dataEnd) const
+{
+    auto iter = std::upper_bound(dataMarks.begin(), dataMarks.end(), std::make_pair(addr, true));
+    if (iter == dataMarks.begin() || !std::prev(iter)->second) {
+        return false;
+    }
+    dataEnd = iter == dataMarks.end() ? ULONG_MAX : iter->first;
+    return true;
+}
+
+std::string AsmDisassembler::PrintBranchTarget(const MCInst& inst, unsigned long addr, uint64_t size) const
+{
+    if (!mia || !(mia->isCall(inst) || mia->isBranch(inst))) {
+        return "";
+    }
+    uint64_t target = 0;
+    if (!mia->evaluateBranch(inst, addr, size, target)) {
+        return "";
+    }
+    const AsmFunc* func = FindFunc(target);
+    if (func == nullptr) {
+        return "";
+    }
+    if (target == func->start) {
+        return " <" + func->name + ">";
+    }
+    char offset[HEX_STR_LEN];
+    snprintf(offset, sizeof(offset), "+0x%lx", target - func->start);
+    return " <" + func->name + offset + ">";
+}
+
+void AsmDisassembler::Disassemble(unsigned long startAddr, unsigned long endAddr, std::vector<AsmInst>& insts)
+{
+    std::lock_guard<std::mutex> lock(printMutex);
+    bool littleEndian = binary.getBinary()->isLittleEndian();
+    for (const auto& section : sections) {
+        unsigned long addr = std::max(startAddr, section.addr);
+        unsigned long end = std::min(endAddr, section.addr + section.size);
+        while (addr < end) {
+            ArrayRef<uint8_t> bytes = section.bytes.slice(addr - section.addr);
+            unsigned long dataEnd = 0;
+            if (IsData(addr, dataEnd)) {
+                // Literal pools in arm code are printed as data instead of being decoded.
+                unsigned long len = std::min(end, dataEnd) - addr;
+                len = len >= WORD_LEN ? WORD_LEN : (len >= SHORT_LEN ? SHORT_LEN : 1);
+                uint32_t value = 0;
+                for (unsigned long i = 0; i < len; ++i) {
+                    uint32_t byte = bytes[littleEndian ? len - 1 - i : i];
+                    value = (value << 8) | byte;
+                }
+                char code[HEX_STR_LEN];
+                const char* directive = len == WORD_LEN ? ".word" : (len == SHORT_LEN ? ".short" : ".byte");
+                snprintf(code, sizeof(code), "%s\t0x%0*x", directive, static_cast<int>(len * 2), value);
+                insts.push_back({addr, code});
+                addr += len;
+                continue;
+            }
+            MCInst inst;
+            uint64_t size = 0;
+            bool decoded = disAsm->getInstruction(inst, size, bytes, addr, nulls(), nulls()) ==
+                           MCDisassembler::Success;
+            if (size == 0) {
+                size = 1;
+            }
+            std::string code;
+            if (decoded) {
+                raw_string_ostream os(code);
+                printer->printInst(&inst, os, "", *sti);
+                os.flush();
+                code.erase(0, code.find_first_not_of(" \t"));
+                code += PrintBranchTarget(inst, addr, size);
+            } else {
+                code = "<unknown>";
+            }
+            insts.push_back({addr, code});
+            addr += size;
+        }
+    }
+}
+
+}  // namespace KUNPENG_SYM
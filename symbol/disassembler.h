@@ -0,0 +1,102 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: disassemble code of elf files in process with llvm MC.
+ ******************************************************************************/
+#ifndef SYMBOL_DISASSEMBLER_H
+#define SYMBOL_DISASSEMBLER_H
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInstPrinter.h"
+#include "llvm/MC/MCInstrAnalysis.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Object/ObjectFile.h"
+
+namespace KUNPENG_SYM {
+    struct AsmInst {
+        unsigned long addr;
+        std::string code;
+    };
+
+    struct AsmFunc {
+        unsigned long start;
+        unsigned long end;
+        std::string name;
+    };
+
+    /**
+     * Disassembler of an elf file, which is created once and reused by later requests of the file.
+     * Addresses are the ones in elf file, the same as the addresses to search symbols.
+     */
+    class AsmDisassembler {
+    public:
+        /**
+         * @brief Open an elf file and create disassembler for its architecture. Return nullptr if it fails.
+         */
+        static std::shared_ptr<AsmDisassembler> Create(const std::string& path);
+
+        /**
+         * @brief Disassemble instructions in [startAddr, endAddr) of text sections. Targets of branches are
+         * printed with function names, and data in code of arm is printed as .word.
+         */
+        void Disassemble(unsigned long startAddr, unsigned long endAddr, std::vector<AsmInst>& insts);
+
+        /**
+         * @brief Find function symbol which an address belongs to. Return nullptr if no function covers it.
+         */
+        const AsmFunc* FindFunc(unsigned long addr) const;
+
+        /**
+         * @brief Convert an address to offset in elf file. Return the address if it is not in a section.
+         */
+        unsigned long FileOffset(unsigned long addr) const;
+
+    private:
+        struct TextSection {
+            unsigned long addr;
+            unsigned long size;
+            unsigned long offset;
+            llvm::ArrayRef<uint8_t> bytes;
+        };
+
+        AsmDisassembler() = default;
+        bool Init(const std::string& path);
+        void LoadFuncs();
+        bool IsData(unsigned long addr, unsigned long& dataEnd) const;
+        std::string PrintBranchTarget(const llvm::MCInst& inst, unsigned long addr, uint64_t size) const;
+
+        llvm::object::OwningBinary<llvm::object::ObjectFile> binary;
+        std::unique_ptr<const llvm::MCRegisterInfo> mri;
+        std::unique_ptr<const llvm::MCAsmInfo> asmInfo;
+        std::unique_ptr<const llvm::MCSubtargetInfo> sti;
+        std::unique_ptr<const llvm::MCInstrInfo> mii;
+        std::unique_ptr<llvm::MCObjectFileInfo> mofi;
+        std::unique_ptr<llvm::MCContext> ctx;
+        std::unique_ptr<const llvm::MCDisassembler> disAsm;
+        std::unique_ptr<const llvm::MCInstrAnalysis> mia;
+        std::unique_ptr<llvm::MCInstPrinter> printer;
+        std::vector<TextSection> sections;
+        // Functions sorted by start address.
+        std::vector<AsmFunc> funcs;
+        // Mapping symbols of arm, which mark start of data ($d) and code ($x, $a, $t) in text sections.
+        std::vector<std::pair<unsigned long, bool>> dataMarks;
+        // Printer keeps state when printing, so instructions are printed one by one.
+        std::mutex printMutex;
+    };
+}  // namespace KUNPENG_SYM
+#endif
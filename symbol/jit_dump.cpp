@@ -0,0 +1,256 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: read jit code of a process from binary jitdump file jit-<pid>.dump, which is written by jit agents.
+ ******************************************************************************/
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "symbol_resolve.h"
+#include "jit_dump.h"
+
+namespace KUNPENG_SYM {
+
+// "JiTD", which is read as "DTiJ" if the dump is written with another byte order.
+static constexpr uint32_t JITDUMP_MAGIC = 0x4A695444;
+// File name of a debug entry, which means the same file as the previous entry.
+static constexpr unsigned char JITDUMP_SAME_FILE = 0xff;
+static const std::string JIT_UNKNOWN_FILE = "UNKNOWN";
+
+JitDump::~JitDump()
+{
+    if (base != nullptr) {
+        munmap(base, size);
+    }
+}
+
+bool JitDump::Remap(size_t newSize)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    void* newBase = mmap(nullptr, newSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (newBase == MAP_FAILED) {
+        return false;
+    }
+    if (base != nullptr) {
+        munmap(base, size);
+    }
+    base = newBase;
+    size = newSize;
+    return true;
+}
+
+uint32_t JitDump::AddFile(const char* file)
+{
+    auto iter = fileIds.find(file);
+    if (iter != fileIds.end()) {
+        return iter->second;
+    }
+    uint32_t id = files.size();
+    files.emplace_back(file);
+    fileIds.emplace(file, id);
+    return id;
+}
+
+void JitDump::AddCode(JitCode&& code, const std::function<void(unsigned long, unsigned long)>& replaced)
+{
+    auto iter = codes.upper_bound(code.start);
+    if (iter != codes.begin() && std::prev(iter)->second.end > code.start) {
+        iter = std::prev(iter);
+    }
+    while (iter != codes.end() && iter->first < code.end) {
+        replaced(iter->second.start, iter->second.end);
+        iter = codes.erase(iter);
+    }
+    unsigned long start = code.start;
+    codes[start] = std::move(code);
+}
+
+void JitDump::ParseCodeLoad(const char* rec, size_t recSize, const std::function<void(unsigned long, unsigned long)>& replaced)
+{
+    JitCodeLoad load;
+    if (recSize < sizeof(load)) {
+        return;
+    }
+    memcpy(&load, rec, sizeof(load));
+    JitCode code;
+    code.start = load.codeAddr;
+    code.end = load.codeAddr + load.codeSize;
+    code.name.assign(rec + sizeof(load), strnlen(rec + sizeof(load), recSize - sizeof(load)));
+    auto iter = pendingLines.find(code.start);
+    if (iter != pendingLines.end()) {
+        code.lines = std::move(iter->second);
+        pendingLines.erase(iter);
+    }
+    AddCode(std::move(code), replaced);
+}
+
+void JitDump::ParseCodeMove(const char* rec, size_t recSize, const std::function<void(unsigned long, unsigned long)>& replaced)
+{
+    JitCodeMove move;
+    if (recSize < sizeof(move)) {
+        return;
+    }
+    memcpy(&move, rec, sizeof(move));
+    auto iter = codes.find(move.oldCodeAddr);
+    if (iter == codes.end()) {
+        return;
+    }
+    JitCode code = std::move(iter->second);
+    codes.erase(iter);
+    replaced(code.start, code.end);
+    for (auto& line : code.lines) {
+        line.addr = line.addr - move.oldCodeAddr + move.newCodeAddr;
+    }
+    code.start = move.newCodeAddr;
+    code.end = move.newCodeAddr + move.codeSize;
+    AddCode(std::move(code), replaced);
+}
+
+void JitDump::ParseDebugInfo(const char* rec, size_t recSize)
+{
+    JitDebugInfo info;
+    if (recSize < sizeof(info)) {
+        return;
+    }
+    memcpy(&info, rec, sizeof(info));
+    const char* pos = rec + sizeof(info);
+    const char* end = rec + recSize;
+    std::vector<JitLine> lines;
+    for (uint64_t i = 0; i < info.nrEntry && pos + sizeof(JitDebugEntry) <= end; ++i) {
+        JitDebugEntry entry;
+        memcpy(&entry, pos, sizeof(entry));
+        pos += sizeof(entry);
+        size_t len = strnlen(pos, end - pos);
+        if (pos + len == end) {
+            break;
+        }
+        uint32_t file;
+        if (len == 1 && static_cast<unsigned char>(pos[0]) == JITDUMP_SAME_FILE && !lines.empty()) {
+            file = lines.back().file;
+        } else {
+            file = AddFile(pos);
+        }
+        pos += len + 1;
+        lines.push_back({entry.addr, static_cast<unsigned int>(entry.line), file});
+    }
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const JitLine& a, const JitLine& b) { return a.addr < b.addr; });
+    pendingLines[info.codeAddr] = std::move(lines);
+}
+
+void JitDump::LoadNewRecords(const std::function<void(unsigned long, unsigned long)>& replaced)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return;
+    }
+    size_t fileSize = st.st_size;
+    if (st.st_ino != inode || fileSize < readOffset) {
+        // The dump is rewritten, e.g. by a new process with the same pid.
+        if (!codes.empty()) {
+            replaced(0, ULONG_MAX);
+        }
+        codes.clear();
+        pendingLines.clear();
+        files.clear();
+        fileIds.clear();
+        readOffset = 0;
+        closed = false;
+        inode = st.st_ino;
+        if (base != nullptr) {
+            munmap(base, size);
+            base = nullptr;
+            size = 0;
+        }
+    }
+    if (closed || fileSize == size || !Remap(fileSize)) {
+        return;
+    }
+    const char* data = static_cast<const char*>(base);
+    if (readOffset == 0) {
+        JitHeader header;
+        if (size < sizeof(header)) {
+            return;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != JITDUMP_MAGIC || header.totalSize < sizeof(header)) {
+            // Dumps of another byte order are not supported.
+            closed = true;
+            return;
+        }
+        readOffset = header.totalSize;
+    }
+    while (!closed && readOffset + sizeof(JitRecordPrefix) <= size) {
+        JitRecordPrefix prefix;
+        memcpy(&prefix, data + readOffset, sizeof(prefix));
+        if (prefix.totalSize < sizeof(prefix)) {
+            closed = true;
+            return;
+        }
+        // The last record is being written, and it is read next time.
+        if (readOffset + prefix.totalSize > size) {
+            return;
+        }
+        const char* rec = data + readOffset;
+        switch (prefix.id) {
+            case JIT_CODE_LOAD:
+                ParseCodeLoad(rec, prefix.totalSize, replaced);
+                break;
+            case JIT_CODE_MOVE:
+                ParseCodeMove(rec, prefix.totalSize, replaced);
+                break;
+            case JIT_CODE_DEBUG_INFO:
+                ParseDebugInfo(rec, prefix.totalSize);
+                break;
+            case JIT_CODE_CLOSE:
+                closed = true;
+                break;
+            default:
+                break;
+        }
+        readOffset += prefix.totalSize;
+    }
+}
+
+int JitDump::FindElf(unsigned long addr, struct JavaEntry& entry) const
+{
+    auto iter = codes.upper_bound(addr);
+    if (iter == codes.begin()) {
+        return -1;
+    }
+    --iter;
+    const JitCode& code = iter->second;
+    if (addr >= code.end) {
+        return -1;
+    }
+    entry.start = code.start;
+    entry.end = code.end;
+    entry.symbolName = code.name;
+    entry.fileName = JIT_UNKNOWN_FILE;
+    entry.line = 0;
+    auto line = std::upper_bound(code.lines.begin(), code.lines.end(), addr,
+                                 [](unsigned long addr, const JitLine& line) { return addr < line.addr; });
+    if (line != code.lines.begin()) {
+        --line;
+        entry.fileName = files[line->file];
+        entry.line = line->line;
+    }
+    return 0;
+}
+
+}  // namespace KUNPENG_SYM
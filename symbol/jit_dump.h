@@ -0,0 +1,147 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: read jit code of a process from binary jitdump file jit-<pid>.dump, which is written by jit agents.
+ ******************************************************************************/
+#ifndef JIT_DUMP_H
+#define JIT_DUMP_H
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+namespace KUNPENG_SYM {
+    struct JavaEntry;
+
+    enum JitRecordType : uint32_t {
+        JIT_CODE_LOAD = 0,
+        JIT_CODE_MOVE = 1,
+        JIT_CODE_DEBUG_INFO = 2,
+        JIT_CODE_CLOSE = 3,
+        JIT_CODE_UNWINDING_INFO = 4,
+    };
+
+    struct JitHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t totalSize;
+        uint32_t elfMach;
+        uint32_t pad1;
+        uint32_t pid;
+        uint64_t timestamp;
+        uint64_t flags;
+    };
+
+    struct JitRecordPrefix {
+        uint32_t id;
+        uint32_t totalSize;
+        uint64_t timestamp;
+    };
+
+    // Followed by name terminated with '\0' and code.
+    struct JitCodeLoad {
+        JitRecordPrefix prefix;
+        uint32_t pid;
+        uint32_t tid;
+        uint64_t vma;
+        uint64_t codeAddr;
+        uint64_t codeSize;
+        uint64_t codeIndex;
+    };
+
+    struct JitCodeMove {
+        JitRecordPrefix prefix;
+        uint32_t pid;
+        uint32_t tid;
+        uint64_t vma;
+        uint64_t oldCodeAddr;
+        uint64_t newCodeAddr;
+        uint64_t codeSize;
+        uint64_t codeIndex;
+    };
+
+    // Followed by nrEntry entries, and each one is followed by file name terminated with '\0'.
+    struct JitDebugInfo {
+        JitRecordPrefix prefix;
+        uint64_t codeAddr;
+        uint64_t nrEntry;
+    };
+
+    struct JitDebugEntry {
+        uint64_t addr;
+        int32_t line;
+        int32_t discrim;
+    };
+
+    /**
+     * Jit code recorded in jitdump file, which is mapped and only records after readOffset are parsed when
+     * the file grows. Code loaded or moved later removes the old code it overlaps, as JavaElf does.
+     */
+    class JitDump {
+    public:
+        explicit JitDump(const std::string& path) : path(path) {};
+        ~JitDump();
+        JitDump(const JitDump&) = delete;
+        JitDump& operator=(const JitDump&) = delete;
+
+        /**
+         * @brief Find jit code of an address, with file and line of the address if the code has debug info.
+         */
+        int FindElf(unsigned long addr, struct JavaEntry& entry) const;
+        /**
+         * @brief Parse records appended since the last call, and call <replaced> with address ranges of code removed
+         * or moved by them.
+         */
+        void LoadNewRecords(const std::function<void(unsigned long, unsigned long)>& replaced);
+
+        const std::string& GetPath() const
+        {
+            return path;
+        }
+
+    private:
+        // Source line of code from addr to the next line.
+        struct JitLine {
+            unsigned long addr;
+            unsigned int line;
+            uint32_t file;
+        };
+
+        struct JitCode {
+            unsigned long start;
+            unsigned long end;
+            std::string name;
+            std::vector<JitLine> lines;
+        };
+
+        bool Remap(size_t newSize);
+        void ParseCodeLoad(const char* rec, size_t size, const std::function<void(unsigned long, unsigned long)>& replaced);
+        void ParseCodeMove(const char* rec, size_t size, const std::function<void(unsigned long, unsigned long)>& replaced);
+        void ParseDebugInfo(const char* rec, size_t size);
+        void AddCode(JitCode&& code, const std::function<void(unsigned long, unsigned long)>& replaced);
+        uint32_t AddFile(const char* file);
+
+        std::string path;
+        void* base = nullptr;
+        size_t size = 0;
+        ino_t inode = 0;
+        size_t readOffset = 0;
+        bool closed = false;
+        std::map<unsigned long, JitCode> codes;
+        // Debug info is written before the code it belongs to, and kept until the code is loaded.
+        std::unordered_map<unsigned long, std::vector<JitLine>> pendingLines;
+        std::vector<std::string> files;
+        std::unordered_map<std::string, uint32_t> fileIds;
+    };
+}  // namespace KUNPENG_SYM
+#endif
@@ -54,6 +54,46 @@ int SymResolverRecordModuleNoDwarf(int pid)
     }
 }
 
+int SymResolverSetCacheDir(const char* dir)
+{
+    try {
+        return SymbolResolve::GetInstance()->SetCacheDir(dir);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverRecordModuleLayout(int pid)
+{
+    try {
+        return SymbolResolve::GetInstance()->RecordModuleLayout(pid);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverSaveLayout(const char* path)
+{
+    try {
+        return SymbolResolve::GetInstance()->SaveLayout(path);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverLoadLayout(const char* path, const char* rootDir)
+{
+    try {
+        return SymbolResolve::GetInstance()->LoadLayout(path, rootDir);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
 void SymResolverDestroy()
 {
     SymbolResolve::GetInstance()->Clear();
@@ -69,6 +109,26 @@ struct Stack* StackToHash(int pid, unsigned long* stack, int nr)
     }
 }
 
+struct Stack* StackToHashTime(int pid, unsigned long* stack, int nr, unsigned long time)
+{
+    try {
+        return SymbolResolve::GetInstance()->StackToHash(pid, stack, nr, true, time);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return nullptr;
+    }
+}
+
+struct Stack* RawStackToHash(int pid, unsigned long* stack, int nr)
+{
+    try {
+        return SymbolResolve::GetInstance()->StackToHash(pid, stack, nr, false);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return nullptr;
+    }
+}
+
 struct Symbol* SymResolverMapAddr(int pid, unsigned long addr)
 {
     try {
@@ -119,6 +179,126 @@ int SymResolverUpdateModuleNoDwarf(int pid, const char* moduleName, unsigned lon
     }
 }
 
+int SymResolverUpdateModuleMmap(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                unsigned long pgoff)
+{
+    try {
+        return SymbolResolve::GetInstance()->UpdateModule(pid, moduleName, startAddr, len, pgoff,
+                                                          RecordModuleType::RECORD_ALL);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverUpdateModuleMmapNoDwarf(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                       unsigned long pgoff)
+{
+    try {
+        return SymbolResolve::GetInstance()->UpdateModule(pid, moduleName, startAddr, len, pgoff,
+                                                          RecordModuleType::RECORD_NO_DWARF);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverUpdateModuleMmapTime(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                    unsigned long pgoff, unsigned long time)
+{
+    try {
+        return SymbolResolve::GetInstance()->UpdateModule(pid, moduleName, startAddr, len, pgoff,
+                                                          RecordModuleType::RECORD_ALL, time);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverUpdateModuleMmapTimeNoDwarf(int pid, const char* moduleName, unsigned long startAddr,
+                                           unsigned long len, unsigned long pgoff, unsigned long time)
+{
+    try {
+        return SymbolResolve::GetInstance()->UpdateModule(pid, moduleName, startAddr, len, pgoff,
+                                                          RecordModuleType::RECORD_NO_DWARF, time);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+// Same format as device and inode in /proc/<pid>/maps.
+static std::string MmapFileId(unsigned maj, unsigned min, unsigned long ino)
+{
+    if (ino == 0) {
+        return "";
+    }
+    char dev[32];
+    snprintf(dev, sizeof(dev), "%02x:%02x:", maj, min);
+    return std::string{dev} + std::to_string(ino);
+}
+
+int SymResolverUpdateModuleMmap2Time(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                     unsigned long pgoff, unsigned maj, unsigned min, unsigned long ino,
+                                     unsigned long time)
+{
+    try {
+        return SymbolResolve::GetInstance()->UpdateModule(pid, moduleName, startAddr, len, pgoff,
+                                                          RecordModuleType::RECORD_ALL, time,
+                                                          MmapFileId(maj, min, ino));
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverUpdateModuleMmap2TimeNoDwarf(int pid, const char* moduleName, unsigned long startAddr,
+                                            unsigned long len, unsigned long pgoff, unsigned maj, unsigned min,
+                                            unsigned long ino, unsigned long time)
+{
+    try {
+        return SymbolResolve::GetInstance()->UpdateModule(pid, moduleName, startAddr, len, pgoff,
+                                                          RecordModuleType::RECORD_NO_DWARF, time,
+                                                          MmapFileId(maj, min, ino));
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverUpdateLayoutMmap2Time(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                     unsigned long pgoff, unsigned maj, unsigned min, unsigned long ino,
+                                     unsigned long time)
+{
+    try {
+        return SymbolResolve::GetInstance()->UpdateModuleLayout(pid, moduleName, startAddr, len, pgoff, time,
+                                                                MmapFileId(maj, min, ino));
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverExecModule(int pid, unsigned long time)
+{
+    try {
+        return SymbolResolve::GetInstance()->ExecModule(pid, time);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
+int SymResolverUpdateJitCode(int pid)
+{
+    try {
+        return SymbolResolve::GetInstance()->UpdateJitCode(pid);
+    } catch (std::bad_alloc& err) {
+        pcerr::New(COMMON_ERR_NOMEM);
+        return COMMON_ERR_NOMEM;
+    }
+}
+
 struct StackAsm* SymResolverAsmCode(const char* moduleName, unsigned long startAddr, unsigned long endAddr)
 {
     try {
@@ -53,6 +53,7 @@ struct AsmCode {
     char* code;            // code of asm
     char* fileName;        // this source file name of this asm code
     unsigned int lineNum;  // the real line of this addr
+    unsigned long count;   // number of samples of this addr, only set by PmuAnnotate
 };
 
 void SymResolverInit();
@@ -74,6 +75,84 @@ int SymResolverIncrUpdateModuleNoDwarf(int pid);
 int SymResolverUpdateModule(int pid, const char* moduleName, unsigned long startAddr);
 
 int SymResolverUpdateModuleNoDwarf(int pid, const char* moduleName, unsigned long startAddr);
+/**
+ * Record a mapping of pid from PERF_RECORD_MMAP or PERF_RECORD_MMAP2 without re-reading /proc/<pid>/maps, which
+ * replaces overlapped parts of modules mapped before. /proc/<pid>/maps is read only if pid has not been recorded.
+ */
+int SymResolverUpdateModuleMmap(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                unsigned long pgoff);
+
+int SymResolverUpdateModuleMmapNoDwarf(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                       unsigned long pgoff);
+/**
+ * Same as SymResolverUpdateModuleMmap, with timestamp of the mmap record. Modules replaced by the mapping are kept,
+ * so that addresses sampled before <time> are still resolved with them by StackToHashTime.
+ */
+int SymResolverUpdateModuleMmapTime(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                    unsigned long pgoff, unsigned long time);
+
+int SymResolverUpdateModuleMmapTimeNoDwarf(int pid, const char* moduleName, unsigned long startAddr,
+                                           unsigned long len, unsigned long pgoff, unsigned long time);
+/**
+ * Same as SymResolverUpdateModuleMmapTime, with device and inode of PERF_RECORD_MMAP2. A file already loaded for
+ * another process, e.g. in another container, is found by them and not loaded again.
+ */
+int SymResolverUpdateModuleMmap2Time(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                     unsigned long pgoff, unsigned maj, unsigned min, unsigned long ino,
+                                     unsigned long time);
+
+int SymResolverUpdateModuleMmap2TimeNoDwarf(int pid, const char* moduleName, unsigned long startAddr,
+                                            unsigned long len, unsigned long pgoff, unsigned maj, unsigned min,
+                                            unsigned long ino, unsigned long time);
+/**
+ * Retire modules of pid at timestamp of PERF_RECORD_COMM with PERF_RECORD_MISC_COMM_EXEC, after which modules of
+ * the new program are recorded from mmap records. The layout of pid recorded by SymResolverRecordModuleLayout is
+ * retired as well. It is ignored if pid has not been recorded.
+ */
+int SymResolverExecModule(int pid, unsigned long time);
+/**
+ * Read jit code of pid compiled since the last call from /tmp/perf-<pid>.map and jit-<pid>.dump, and drop symbols
+ * cached for code reclaimed and reused by other methods. The files are read once when pid is recorded, and
+ * libkperf calls it once per PmuRead for each sampled process.
+ */
+int SymResolverUpdateJitCode(int pid);
+/**
+ * Set directory to cache symbol indexes of elf files, which are named by build-id and mapped by later runs
+ * instead of parsing elf and dwarf again. It should be called before recording modules, and an empty or null
+ * directory disables the cache. The directory is created if it doesn't exist.
+ */
+int SymResolverSetCacheDir(const char* dir);
+
+/**
+ * Record module layout of pid, i.e. address ranges, file offsets, paths and build-ids of modules, without loading
+ * elf and dwarf. /proc/<pid>/maps is read once, and modules loaded later are recorded by
+ * SymResolverUpdateLayoutMmap2Time.
+ */
+int SymResolverRecordModuleLayout(int pid);
+
+/**
+ * Record a mapping of PERF_RECORD_MMAP2 in the layout of pid, which is the same as SymResolverUpdateModuleMmap2Time
+ * without loading elf and dwarf. Modules replaced by the mapping are saved with their timestamps, so addresses
+ * sampled before <time> are resolved with them after SymResolverLoadLayout. For PERF_RECORD_MMAP, maj, min and ino
+ * are 0.
+ */
+int SymResolverUpdateLayoutMmap2Time(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                     unsigned long pgoff, unsigned maj, unsigned min, unsigned long ino,
+                                     unsigned long time);
+
+/**
+ * Save recorded module layouts and kernel symbols of this host to a file, which is used to resolve raw addresses
+ * later by SymResolverLoadLayout, possibly on another host.
+ */
+int SymResolverSaveLayout(const char* path);
+
+/**
+ * Load module layouts and kernel symbols from a file saved by SymResolverSaveLayout, after which raw addresses of
+ * saved processes can be resolved by StackToHash and SymResolverMapAddr as RESOLVE_ELF_DWARF does.
+ * Files of modules are searched under rootDir if it is not null, and modules whose build-id is different from the
+ * saved one are not resolved.
+ */
+int SymResolverLoadLayout(const char* path, const char* rootDir);
 /**
  * Clean up resolver in the end after usage
  */
@@ -84,6 +163,16 @@ void SymResolverDestroy();
  */
 struct Stack* StackToHash(int pid, unsigned long* stack, int nr);
 
+/**
+ * Same as StackToHash, and addresses are resolved with modules mapped at <time> when the stack is sampled.
+ */
+struct Stack* StackToHashTime(int pid, unsigned long* stack, int nr, unsigned long time);
+
+/**
+ * Convert a callstack to a stack without resolving symbols, in which only addr of symbols is valid.
+ */
+struct Stack* RawStackToHash(int pid, unsigned long* stack, int nr);
+
 /**
  * Map a specific address to a symbol
  */
@@ -0,0 +1,339 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: on-disk symbol index of elf files keyed by build-id, which is built once and mapped by later runs.
+ ******************************************************************************/
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "name_resolve.h"
+#include "symbol_index.h"
+
+namespace KUNPENG_SYM {
+
+static const char INDEX_MAGIC[8] = {'K', 'P', 'S', 'Y', 'M', 'I', 'D', 'X'};
+static constexpr uint32_t INDEX_VERSION = 1;
+static constexpr uint32_t INDEX_HAS_LINES = 1;
+static const std::string INDEX_SUFFIX = ".symidx";
+
+namespace {
+    // Row address is a plain address in old llvm and a sectioned address in new llvm.
+    template <typename T>
+    auto RowAddress(const T &addr) -> decltype(addr.Address)
+    {
+        return addr.Address;
+    }
+
+    inline uint64_t RowAddress(uint64_t addr)
+    {
+        return addr;
+    }
+
+    class IndexBuilder {
+    public:
+        bool Build(const std::string &elfPath, bool withLines);
+        bool Write(const std::string &path, const std::string &buildId, uint64_t elfSize, bool withLines);
+
+    private:
+        uint32_t AddStr(const std::string &str);
+        void AddFunctions(const llvm::object::ELFObjectFileBase &obj);
+        void AddLines(const llvm::object::ObjectFile &obj);
+
+        std::vector<IndexFunc> funcs;
+        std::vector<IndexLine> lines;
+        std::string strs;
+        std::unordered_map<std::string, uint32_t> strOffsets;
+    };
+
+    uint32_t IndexBuilder::AddStr(const std::string &str)
+    {
+        auto findStr = strOffsets.find(str);
+        if (findStr != strOffsets.end()) {
+            return findStr->second;
+        }
+        uint32_t offset = strs.size();
+        strs.append(str.c_str(), str.size() + 1);
+        strOffsets.emplace(str, offset);
+        return offset;
+    }
+
+    void IndexBuilder::AddFunctions(const llvm::object::ELFObjectFileBase &obj)
+    {
+        auto addSymbols = [this](llvm::object::ELFObjectFileBase::elf_symbol_iterator_range symbols) {
+            for (const llvm::object::ELFSymbolRef &sym : symbols) {
+                auto type = sym.getType();
+                auto addr = sym.getAddress();
+                auto name = sym.getName();
+                if (!type || !addr || !name || *type != llvm::object::SymbolRef::ST_Function || *addr == 0 ||
+                    name->empty()) {
+                    llvm::consumeError(type.takeError());
+                    llvm::consumeError(addr.takeError());
+                    llvm::consumeError(name.takeError());
+                    continue;
+                }
+                std::string mangleName = name->str();
+                std::string symName = mangleName;
+                char *demangled = CppNamedDemangle(mangleName.c_str());
+                if (demangled != nullptr) {
+                    symName = demangled;
+                    free(demangled);
+                }
+                IndexFunc func;
+                func.start = *addr;
+                func.end = *addr + sym.getSize();
+                func.name = AddStr(symName);
+                func.mangleName = AddStr(mangleName);
+                funcs.push_back(func);
+            }
+        };
+        addSymbols(obj.symbols());
+        addSymbols(obj.getDynamicSymbolIterators());
+
+        // Symbols in .symtab and .dynsym are duplicated, and larger ranges are kept for aliases.
+        std::sort(funcs.begin(), funcs.end(), [](const IndexFunc &a, const IndexFunc &b) {
+            return a.start != b.start ? a.start < b.start : a.end > b.end;
+        });
+        funcs.erase(std::unique(funcs.begin(), funcs.end(), [](const IndexFunc &a, const IndexFunc &b) {
+            return a.start == b.start;
+        }), funcs.end());
+    }
+
+    void IndexBuilder::AddLines(const llvm::object::ObjectFile &obj)
+    {
+        auto context = llvm::DWARFContext::create(obj);
+        std::vector<IndexLine> rows;
+        for (const auto &unit : context->compile_units()) {
+            auto lineTable = context->getLineTableForUnit(unit.get());
+            if (lineTable == nullptr) {
+                continue;
+            }
+            const char *compDir = unit->getCompilationDir();
+            std::unordered_map<uint64_t, uint32_t> fileOffsets;
+            for (const auto &row : lineTable->Rows) {
+                IndexLine line = {RowAddress(row.Address), 0, 0};
+                if (!row.EndSequence) {
+                    auto findFile = fileOffsets.find(row.File);
+                    if (findFile == fileOffsets.end()) {
+                        std::string fileName;
+                        lineTable->getFileNameByIndex(
+                                row.File, compDir, llvm::DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath,
+                                fileName);
+                        findFile = fileOffsets.emplace(row.File, AddStr(fileName)).first;
+                    }
+                    line.file = findFile->second;
+                    line.line = row.Line;
+                }
+                rows.push_back(line);
+            }
+        }
+        // End of a sequence is overridden by the row of the next sequence starting at the same address.
+        std::stable_sort(rows.begin(), rows.end(), [](const IndexLine &a, const IndexLine &b) {
+            return a.addr != b.addr ? a.addr < b.addr : a.line == 0 && b.line != 0;
+        });
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (i + 1 < rows.size() && rows[i + 1].addr == rows[i].addr) {
+                continue;
+            }
+            if (!lines.empty() && lines.back().file == rows[i].file && lines.back().line == rows[i].line) {
+                continue;
+            }
+            lines.push_back(rows[i]);
+        }
+    }
+
+    bool IndexBuilder::Build(const std::string &elfPath, bool withLines)
+    {
+        auto binary = llvm::object::ObjectFile::createObjectFile(elfPath);
+        if (!binary) {
+            llvm::consumeError(binary.takeError());
+            return false;
+        }
+        auto obj = llvm::dyn_cast<llvm::object::ELFObjectFileBase>(binary->getBinary());
+        if (obj == nullptr) {
+            return false;
+        }
+        AddFunctions(*obj);
+        if (withLines) {
+            AddLines(*obj);
+        }
+        return true;
+    }
+
+    bool IndexBuilder::Write(const std::string &path, const std::string &buildId, uint64_t elfSize, bool withLines)
+    {
+        IndexHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+        header.version = INDEX_VERSION;
+        header.flags = withLines ? INDEX_HAS_LINES : 0;
+        header.elfSize = elfSize;
+        strncpy(header.buildId, buildId.c_str(), sizeof(header.buildId) - 1);
+        header.funcNum = funcs.size();
+        header.funcOffset = sizeof(header);
+        header.lineNum = lines.size();
+        header.lineOffset = header.funcOffset + funcs.size() * sizeof(IndexFunc);
+        header.strOffset = header.lineOffset + lines.size() * sizeof(IndexLine);
+        header.strSize = strs.size();
+
+        // Write to a temporary file and rename it, so that other processes never map a partial index.
+        std::string tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(funcs.data()), funcs.size() * sizeof(IndexFunc));
+            out.write(reinterpret_cast<const char *>(lines.data()), lines.size() * sizeof(IndexLine));
+            out.write(strs.data(), strs.size());
+            if (!out) {
+                out.close();
+                unlink(tmpPath.c_str());
+                return false;
+            }
+        }
+        if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+}  // namespace
+
+SymbolIndex::~SymbolIndex()
+{
+    if (base != nullptr) {
+        munmap(base, size);
+    }
+}
+
+std::shared_ptr<SymbolIndex> SymbolIndex::Map(const std::string &path, const std::string &buildId,
+                                              uint64_t elfSize, bool withLines)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IndexHeader)) {
+        close(fd);
+        return nullptr;
+    }
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    std::shared_ptr<SymbolIndex> index(new SymbolIndex());
+    index->base = base;
+    index->size = st.st_size;
+    auto header = static_cast<const IndexHeader *>(base);
+    uint64_t size = st.st_size;
+    bool valid = memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->version == INDEX_VERSION && header->elfSize == elfSize &&
+                 strncmp(header->buildId, buildId.c_str(), sizeof(header->buildId)) == 0 &&
+                 (!withLines || (header->flags & INDEX_HAS_LINES)) &&
+                 header->funcOffset + header->funcNum * sizeof(IndexFunc) <= size &&
+                 header->lineOffset + header->lineNum * sizeof(IndexLine) <= size &&
+                 header->strOffset + header->strSize <= size &&
+                 (header->strSize == 0 || static_cast<const char *>(base)[header->strOffset + header->strSize - 1] == 0);
+    if (!valid) {
+        return nullptr;
+    }
+    index->header = header;
+    index->funcs = reinterpret_cast<const IndexFunc *>(static_cast<const char *>(base) + header->funcOffset);
+    index->lines = reinterpret_cast<const IndexLine *>(static_cast<const char *>(base) + header->lineOffset);
+    index->strs = static_cast<const char *>(base) + header->strOffset;
+    return index;
+}
+
+std::shared_ptr<SymbolIndex> SymbolIndex::Load(const std::string &cacheDir, const std::string &buildId,
+                                               const std::string &elfPath, bool withLines)
+{
+    if (cacheDir.empty() || buildId.empty()) {
+        return nullptr;
+    }
+    struct stat st;
+    if (stat(elfPath.c_str(), &st) != 0) {
+        return nullptr;
+    }
+    std::string path = cacheDir + "/" + buildId + INDEX_SUFFIX;
+    auto index = Map(path, buildId, st.st_size, withLines);
+    if (index != nullptr) {
+        return index;
+    }
+    IndexBuilder builder;
+    if (!builder.Build(elfPath, withLines) || !builder.Write(path, buildId, st.st_size, withLines)) {
+        return nullptr;
+    }
+    return Map(path, buildId, st.st_size, withLines);
+}
+
+bool SymbolIndex::HasLines() const
+{
+    return (header->flags & INDEX_HAS_LINES) != 0;
+}
+
+const char *SymbolIndex::Str(uint32_t offset) const
+{
+    return offset < header->strSize ? strs + offset : "";
+}
+
+const IndexLine *SymbolIndex::FindLine(unsigned long addr) const
+{
+    auto end = lines + header->lineNum;
+    auto iter = std::upper_bound(lines, end, addr, [](unsigned long addr, const IndexLine &line) {
+        return addr < line.addr;
+    });
+    if (iter == lines) {
+        return nullptr;
+    }
+    --iter;
+    return iter->line == 0 ? nullptr : iter;
+}
+
+bool SymbolIndex::Find(unsigned long addr, IndexSymbol &symbol) const
+{
+    auto end = funcs + header->funcNum;
+    auto iter = std::upper_bound(funcs, end, addr, [](unsigned long addr, const IndexFunc &func) {
+        return addr < func.start;
+    });
+    if (iter == funcs) {
+        return false;
+    }
+    --iter;
+    // Symbols without size only cover their start address.
+    if (addr >= iter->end && addr != iter->start) {
+        return false;
+    }
+    symbol.name = Str(iter->name);
+    symbol.mangleName = Str(iter->mangleName);
+    symbol.start = iter->start;
+    symbol.end = iter->end;
+    if (HasLines()) {
+        auto line = FindLine(addr);
+        if (line != nullptr) {
+            symbol.fileName = Str(line->file);
+            symbol.lineNum = line->line;
+        }
+        auto firstLine = FindLine(iter->start);
+        if (firstLine != nullptr) {
+            symbol.firstLine = firstLine->line;
+        }
+    }
+    return true;
+}
+
+}  // namespace KUNPENG_SYM
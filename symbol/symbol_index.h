@@ -0,0 +1,98 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: on-disk symbol index of elf files keyed by build-id, which is built once and mapped by later runs.
+ ******************************************************************************/
+#ifndef SYMBOL_INDEX_H
+#define SYMBOL_INDEX_H
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace KUNPENG_SYM {
+    struct IndexHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        // Size of elf file, which validates the index together with build-id.
+        uint64_t elfSize;
+        char buildId[72];
+        uint64_t funcNum;
+        uint64_t funcOffset;
+        uint64_t lineNum;
+        uint64_t lineOffset;
+        uint64_t strOffset;
+        uint64_t strSize;
+    };
+
+    // Function range [start, end), names are offsets in string table.
+    struct IndexFunc {
+        uint64_t start;
+        uint64_t end;
+        uint32_t name;
+        uint32_t mangleName;
+    };
+
+    // A line row is valid until the next row, and row with line 0 ends a sequence.
+    struct IndexLine {
+        uint64_t addr;
+        uint32_t file;
+        uint32_t line;
+    };
+
+    struct IndexSymbol {
+        const char *name = nullptr;
+        const char *mangleName = nullptr;
+        unsigned long start = 0;
+        unsigned long end = 0;
+        const char *fileName = nullptr;
+        unsigned int lineNum = 0;
+        unsigned int firstLine = 0;
+    };
+
+    /**
+     * Sorted function ranges, names and optional line table of an elf file, stored as
+     * <cacheDir>/<build-id>.symidx. Addresses are the ones to search symbols of the elf file.
+     */
+    class SymbolIndex {
+    public:
+        ~SymbolIndex();
+
+        /**
+         * @brief Map index of an elf file from cache directory. If it doesn't exist, is stale, or lacks lines when
+         * <withLines> is true, build it from the elf file and write it to the directory.
+         * Return nullptr if the index can't be mapped or built.
+         */
+        static std::shared_ptr<SymbolIndex> Load(const std::string &cacheDir, const std::string &buildId,
+                                                 const std::string &elfPath, bool withLines);
+
+        /**
+         * @brief Find function of an address, and file and line if the index has lines.
+         */
+        bool Find(unsigned long addr, IndexSymbol &symbol) const;
+
+        bool HasLines() const;
+
+    private:
+        SymbolIndex() = default;
+        static std::shared_ptr<SymbolIndex> Map(const std::string &path, const std::string &buildId,
+                                                uint64_t elfSize, bool withLines);
+        const IndexLine *FindLine(unsigned long addr) const;
+        const char *Str(uint32_t offset) const;
+
+        void *base = nullptr;
+        size_t size = 0;
+        const IndexHeader *header = nullptr;
+        const IndexFunc *funcs = nullptr;
+        const IndexLine *lines = nullptr;
+        const char *strs = nullptr;
+    };
+}  // namespace KUNPENG_SYM
+#endif
@@ -28,6 +28,7 @@
 #include "name_resolve.h"
 #include "java_symbol.h"
 #include "symbol_resolve.h"
+#include "disassembler.h"
 
 using namespace KUNPENG_SYM;
 constexpr __u64 MAX_LINE_LENGTH = 1024;
@@ -50,6 +51,8 @@ constexpr int CODE_LINE_RANGE_LEN = 10;
 constexpr int HEX_LEN = 16;
 constexpr int TO_TAIL_LEN = 2;
 constexpr unsigned long USER_MAX_ADDR = 0xffffffff;
+constexpr size_t MAX_RETIRED_MODULES = 8192;
+constexpr size_t MIN_MODULE_FILE_SWEEP = 1024;
 
 const std::string HUGEPAGE = "/anon_hugepage";
 const std::string DEV_ZERO = "/dev/zero";
@@ -65,6 +68,9 @@ const std::string R_XP = "r-xp";
 const std::string SLASH = "/";
 const char DASH = '-';
 const char EXE_TYPE = 'x';
+const std::string RAW_STACK_PREFIX = "raw:";
+const std::string LAYOUT_HEADER = "# libkperf module layout v2";
+const std::string LAYOUT_NONE = "-";
 char* UNKNOWN = "UNKNOWN";
 char* KERNEL = "[kernel]";
 
@@ -80,6 +86,16 @@ namespace {
         return  mapline.find(R_XP) != std::string::npos;
     }
 
+    static inline bool IsJitDump(const std::string& moduleName)
+    {
+        // Jit agents map jit-<pid>.dump to notify profilers of the dump, as perf does.
+        std::string name = moduleName.substr(moduleName.find_last_of('/') + 1);
+        const std::string prefix = "jit-";
+        const std::string suffix = ".dump";
+        return name.size() > prefix.size() + suffix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+               name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
     static inline char* InitChar(int len)
     {
         char* str = new char[len + 1];
@@ -125,85 +141,11 @@ namespace {
             }
             data->fileOffset = strtoul(offset, nullptr, HEX_LEN);
             data->moduleName = modNameChar;
-            modVec.emplace_back(data);
-        }
-    }
-
-    static StackAsm* FirstLineMatch(const std::string& line)
-    {
-        if (line[line.size() - TO_TAIL_LEN] == ':') {
-            struct StackAsm* stackAsm = CreateNode<struct StackAsm>();
-            stackAsm->funcName = InitChar(MAX_LINE_LENGTH);
-            stackAsm->asmCode = nullptr;
-            stackAsm->next = nullptr;
-            int ret = sscanf(line.c_str(), "%llx %s %*s %*s %llx", &stackAsm->funcStartAddr, stackAsm->funcName,
-                               &stackAsm->functFileOffset);
-            if (ret == EOF) {
-                delete[] stackAsm->funcName;
-                stackAsm->funcName = nullptr;
-                delete stackAsm;
-                stackAsm = nullptr;
-                return nullptr;
+            if (strcmp(inode, "0") != 0) {
+                data->fileId = std::string{dev} + ":" + inode;
             }
-            return stackAsm;
-        }
-        return nullptr;
-    }
-
-    static bool MatchFileName(const std::string& line, std::string& fileName, unsigned int& lineNum)
-    {
-        char startStr[MAX_LINE_LENGTH + 1];
-        int ret = sscanf(line.c_str(), "%s", startStr);
-        if (ret < 0) {
-            return false;
-        }
-        std::string preLine = startStr;
-        if (preLine.find(":") + 1 >= preLine.size()) {
-            return false;
-        }
-        std::string lineStr = preLine.substr(preLine.find(":") + 1, preLine.size());
-        if (lineStr.empty()) {
-            return false;
-        }
-        if (!SymbolUtils::IsNumber(lineStr)) {
-            return false;
-        }
-        try {
-            lineNum = std::atoi(lineStr.c_str());
-        } catch (std::exception& err) {
-            return false;
-        }
-        fileName = preLine.substr(0, preLine.find(":"));
-        return true;
-    }
-
-    static AsmCode* MatchAsmCode(const std::string& line, const std::string& srcFileName, unsigned int lineNum)
-    {
-        std::string addrStr = line.substr(0, line.find(":"));
-        struct AsmCode* asmCode = new AsmCode();
-        asmCode->addr = SymbolUtils::SymStoul(addrStr);
-        if (asmCode->addr == 0) {
-            delete asmCode;
-            return nullptr;
-        }
-        size_t tailLen = line.find("\n") != std::string::npos ? line.find("\n") : strlen(line.c_str());
-        char startStr[MAX_LINE_LENGTH + 1];
-        int ret = sscanf(line.c_str(), "%*s %s", startStr);
-        if (ret == EOF) {
-            delete asmCode;
-            return nullptr;
-        }
-        std::string codeStr = line.substr(line.find(startStr) + strlen(startStr), tailLen);
-        if (!codeStr.empty()) {
-            codeStr.erase(0, codeStr.find_first_not_of(" "));
-            codeStr.erase(0, codeStr.find_first_not_of("\t"));
+            modVec.emplace_back(data);
         }
-        asmCode->code = InitChar(MAX_LINE_LENGTH);
-        strcpy(asmCode->code, codeStr.c_str());
-        asmCode->fileName = InitChar(MAX_LINUX_FILE_NAME);
-        strcpy(asmCode->fileName, srcFileName.c_str());
-        asmCode->lineNum = lineNum;
-        return asmCode;
     }
 
     static inline void FreeStackMap(STACK_MAP& stackMap)
@@ -225,20 +167,40 @@ namespace {
         return str;
     }
 
-    static inline bool CheckColonSuffix(const std::string& str)
+    // Device, inode and mtime of a file, and mtime tells a file rewritten in place.
+    static std::string GetFileStamp(const std::string& path)
     {
-        if (!strstr(str.c_str(), ":")) {
-            return false;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return "";
         }
-        size_t colonIndex = str.find(":");
-        if (colonIndex + 1 >= str.size()) {
-            return false;
+        return std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino) + ":" +
+               std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+    }
+
+    static std::string GetModuleKey(MyElf& myElf, const std::string& path, std::string& buildIdStr)
+    {
+        char* buildId = nullptr;
+        if (myElf.ElfGetBuildId(&buildId) == SUCCESS) {
+            buildIdStr = buildId;
+            delete[] buildId;
+            return buildIdStr;
         }
-        std::string suffix = str.substr(colonIndex + 1, str.size());
-        if (suffix.empty() || suffix.size() == 1) {
-            return false;
+        // Files without build-id are identified by the file.
+        return GetFileStamp(path);
+    }
+
+    static inline void CopyResolvedSymbol(const struct Symbol* from, struct Symbol* to, bool withDwarf)
+    {
+        to->symbolName = from->symbolName;
+        to->mangleName = from->mangleName;
+        if (withDwarf) {
+            to->fileName = from->fileName;
+            to->lineNum = from->lineNum;
+            to->firstLine = from->firstLine;
         }
-        return true;
+        to->offset = from->offset;
+        to->codeMapEndAddr = from->codeMapEndAddr;
     }
 
 }  // namespace
@@ -317,25 +279,79 @@ static inline void ElfInfoRecord(ParserElf& myElf, const elf::section& sec)
     }
 }
 
-ELF_SYM* ParserElf::FindSymbol(unsigned long addr)
+void ParserElf::Emplace(unsigned long addr, const ELF_SYM& elfSym)
 {
-    if (symTab.empty()) {
-        return nullptr;
+    std::string name = elfSym.get_name();
+    auto findName = this->nameOffsets.find(name);
+    uint32_t nameOffset;
+    if (findName != this->nameOffsets.end()) {
+        nameOffset = findName->second;
+    } else {
+        nameOffset = this->names.size();
+        this->names.append(name.c_str(), name.size() + 1);
+        this->nameOffsets.emplace(name, nameOffset);
     }
-    auto it = symTab.upper_bound(addr);
-    if(it == symTab.cbegin()) {
-        return nullptr;
+    this->starts.push_back(addr);
+    this->funcs.push_back({elfSym.get_data().size, nameOffset});
+}
+
+void ParserElf::Build()
+{
+    std::vector<size_t> order(this->starts.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    // The first symbol of an address is kept, e.g. the one in .symtab rather than .dynsym.
+    std::stable_sort(order.begin(), order.end(),
+                     [this](size_t a, size_t b) { return this->starts[a] < this->starts[b]; });
+    std::vector<unsigned long> sortedStarts;
+    std::vector<ElfFunc> sortedFuncs;
+    sortedStarts.reserve(order.size());
+    sortedFuncs.reserve(order.size());
+    for (size_t i : order) {
+        if (!sortedStarts.empty() && sortedStarts.back() == this->starts[i]) {
+            continue;
+        }
+        sortedStarts.push_back(this->starts[i]);
+        sortedFuncs.push_back(this->funcs[i]);
+    }
+    this->starts.swap(sortedStarts);
+    this->funcs.swap(sortedFuncs);
+    this->starts.shrink_to_fit();
+    this->funcs.shrink_to_fit();
+    this->names.shrink_to_fit();
+    this->nameOffsets = {};
+}
+
+long ParserElf::FindSymbol(unsigned long addr) const
+{
+    auto it = std::upper_bound(this->starts.begin(), this->starts.end(), addr);
+    if (it == this->starts.begin()) {
+        return -1;
     }
-    --it;
-    if(addr > it->first + it->second.get_data().size) {
-        return nullptr;
+    long index = it - this->starts.begin() - 1;
+    unsigned long size = this->funcs[index].size;
+    // A function without size only covers its start address.
+    if (addr - this->starts[index] >= size && addr != this->starts[index]) {
+        return -1;
     }
-    return &it->second;
+    return index;
 }
 
-void ParserElf::Emplace(unsigned long addr, const ELF_SYM& elfSym)
+std::string ParserElf::GetDemangledName(long index)
 {
-    this->symTab.emplace(addr, elfSym);
+    uint32_t nameOffset = this->funcs[index].name;
+    std::lock_guard<std::mutex> lock(this->demangleMutex);
+    auto findName = this->demangledNames.find(nameOffset);
+    if (findName != this->demangledNames.end()) {
+        return findName->second;
+    }
+    const char* mangleName = this->names.data() + nameOffset;
+    char* name = CppNamedDemangle(mangleName);
+    std::string demangledName = name != nullptr ? name : mangleName;
+    free(name);
+    this->demangledNames.emplace(nameOffset, demangledName);
+    return demangledName;
 }
 
 int SymbolResolve::RecordElf(const char* fileName)
@@ -367,13 +383,14 @@ int SymbolResolve::RecordElf(const char* fileName)
     try {
         std::shared_ptr<elf::loader> efLoader = elf::create_mmap_loader(fd);
         elf::elf ef(efLoader);
-        ParserElf myElf(ef);
+        auto myElf = std::make_shared<ParserElf>();
         for (const auto& sec : ef.sections()) {
             if (sec.get_hdr().type != elf::sht::symtab && sec.get_hdr().type != elf::sht::dynsym) {
                 continue;
             }
-            ElfInfoRecord(myElf, sec);
+            ElfInfoRecord(*myElf, sec);
         }
+        myElf->Build();
         this->elfMap.emplace(file, myElf);
     } catch (std::exception& error) {
         pcerr::New(LIBSYM_ERR_ELFIN_FOMAT_FAILED, "libsym record elf format error: " + std::string{error.what()});
@@ -388,23 +405,14 @@ int SymbolResolve::RecordElf(const char* fileName)
 
 void SymbolResolve::SearchElfInfo(ParserElf& myElf, unsigned long addr, struct Symbol* symbol, unsigned long* offset)
 {
-    ELF_SYM *elfSym = myElf.FindSymbol(addr);
-    if (elfSym == nullptr) {
-        return;
-    }
-    symbol->codeMapEndAddr = elfSym->get_data().value + elfSym->get_data().size;
-    *offset = addr - elfSym->get_data().value;
-    std::string symName = elfSym->get_name();
-    symbol->mangleName = GetCharFromStr(symName);
-    char *name = CppNamedDemangle(symName.c_str());
-    if (name) {
-        symbol->symbolName = GetCharFromStr(name);
-        free(name);
-        name = nullptr;
+    long index = myElf.FindSymbol(addr);
+    if (index < 0) {
         return;
     }
-    symbol->symbolName = GetCharFromStr(symName);
-    return;
+    symbol->codeMapEndAddr = myElf.GetStart(index) + myElf.GetSize(index);
+    *offset = addr - myElf.GetStart(index);
+    symbol->mangleName = GetCharFromStr(myElf.GetName(index));
+    symbol->symbolName = GetCharFromStr(myElf.GetDemangledName(index));
 }
 #endif
 
@@ -427,42 +435,158 @@ int SymbolResolve::RecordModule(int pid, RecordModuleType recordModuleType)
     }
     std::vector<std::shared_ptr<ModuleMap>> modVec;
     ReadProcPidMap(file, modVec);
-    std::string mntPoint = GetMntPoint(pid);
     bool hasJava = false;
     for (auto& item : modVec) {
-        std::string moduleName = item->moduleName;
-        if (!mntPoint.empty()) {
-            item->mntPoint = mntPoint;
-            moduleName = mntPoint + "/" + moduleName;
-        }
+        item->moduleType = recordModuleType;
+        this->LoadPidModule(pid, *item);
+        std::string moduleName = item->FilePath();
         if (strstr(moduleName.c_str(), "libjvm.so")) {
             hasJava = true;
         }
-        MyElf myElf(moduleName);
-        int ret = myElf.LoadMmap();
-        if (ret != SUCCESS) {
-            item->isFile = false;
-            continue;
+        if (IsJitDump(moduleName)) {
+            RecordJitDump(pid, moduleName);
         }
-        item->isExecFile = myElf.IsExecFile();
-#ifndef ELF_LLVM
-        this->RecordElf(moduleName.c_str());
-#endif
-        item->moduleType = recordModuleType;
     }
     if (hasJava) {
         JavaAttachInfo attachInfo;
         int ret = attach_java_process(pid, &attachInfo);
         if (ret == 0) {
             JavaElf javaElf(pid, attachInfo.perfMapPath);
+            javaElf.LoadNewEntries([](unsigned long, unsigned long) {});
             javaElfArr[pid] = javaElf;
         }
     }
-    this->moduleMap.insert({pid, modVec});
+    ModuleTree modules;
+    for (auto& item : modVec) {
+        modules.Insert(item);
+    }
+    this->moduleMap.insert({pid, std::move(modules)});
     pcerr::New(0, "success");
     return 0;
 }
 
+int SymbolResolve::LoadModule(ModuleMap& module, const std::string& path)
+{
+    MyElf myElf(path);
+    int ret = myElf.LoadMmap();
+    if (ret != SUCCESS) {
+        module.isFile = false;
+        return ret;
+    }
+    module.isExecFile = myElf.IsExecFile();
+    module.moduleKey = GetModuleKey(myElf, path, module.buildId);
+#ifndef ELF_LLVM
+    if (!this->LoadSymbolIndex(module, path)) {
+        this->RecordElf(path.c_str());
+    }
+#else
+    this->LoadSymbolIndex(module, path);
+#endif
+    return SUCCESS;
+}
+
+void SymbolResolve::LoadPidModule(int pid, ModuleMap& module)
+{
+    if (this->FindModuleFile(module)) {
+        // Mount point is only looked up when it is reported.
+        module.mntPid = pid;
+        return;
+    }
+    this->LoadModuleFile(pid, module);
+}
+
+void SymbolResolve::LoadModuleFile(int pid, ModuleMap& module)
+{
+    module.mntPoint = this->GetPidMntPoint(pid);
+    std::string path = module.mntPoint.empty() ? module.moduleName : module.mntPoint + "/" + module.moduleName;
+    if (this->LoadModule(module, path) != SUCCESS) {
+        // Mount point is not found for some container runtimes, and the file is still reachable from the
+        // root of the process while it is alive. Such a path is not shared with other processes.
+        std::string procRoot = "/proc/" + std::to_string(pid) + "/root";
+        if (procRoot != module.mntPoint) {
+            module.isFile = true;
+            if (this->LoadModule(module, procRoot + "/" + module.moduleName) == SUCCESS) {
+                module.mntPoint = procRoot;
+            }
+        }
+        return;
+    }
+    std::lock_guard<std::mutex> lg(moduleFileMutex);
+    this->AddModuleFile(module, path, this->moduleFiles);
+}
+
+bool SymbolResolve::FindModuleFile(ModuleMap& module)
+{
+    if (module.fileId.empty()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lg(moduleFileMutex);
+    return this->FindModuleFile(module, this->moduleFiles);
+}
+
+void SymbolResolve::AddModuleFile(ModuleMap& module, const std::string& path, ModuleFiles& moduleFiles)
+{
+    std::string stamp = GetFileStamp(path);
+    if (module.fileId.empty() || stamp.empty()) {
+        return;
+    }
+    module.filePath = path;
+    auto file = std::make_shared<ModuleMap>(module);
+    module.loadedFile = file;
+    auto &files = moduleFiles.files;
+    if (files.size() >= moduleFiles.sweepSize) {
+        // Files of exited processes and unmapped modules are dropped as the map grows.
+        for (auto iter = files.begin(); iter != files.end();) {
+            iter = iter->second.module.expired() ? files.erase(iter) : std::next(iter);
+        }
+        moduleFiles.sweepSize = std::max(MIN_MODULE_FILE_SWEEP, files.size() * 2);
+    }
+    files[module.fileId] = {file, stamp};
+}
+
+bool SymbolResolve::FindModuleFile(ModuleMap& module, ModuleFiles& moduleFiles)
+{
+    auto findFile = moduleFiles.files.find(module.fileId);
+    if (findFile == moduleFiles.files.end()) {
+        return false;
+    }
+    // The inode may be reused by a file deployed after the loaded one is removed.
+    auto file = findFile->second.module.lock();
+    if (file == nullptr || GetFileStamp(file->filePath) != findFile->second.stamp) {
+        moduleFiles.files.erase(findFile);
+        return false;
+    }
+    // The same file may be mapped by another path, e.g. a hard link, which is not under the mount point found.
+    if (file->moduleName != module.moduleName) {
+        return false;
+    }
+    // The file is opened by the path of the process which loads it first, and mntPoint is kept for reporting.
+    module.filePath = file->filePath;
+    module.isFile = file->isFile;
+    module.isExecFile = file->isExecFile;
+    module.moduleKey = file->moduleKey;
+    module.buildId = file->buildId;
+    module.loadedFile = file;
+    return true;
+}
+
+std::string SymbolResolve::ModuleMntPoint(const ModuleMap& module)
+{
+    return module.mntPid < 0 ? module.mntPoint : this->GetPidMntPoint(module.mntPid);
+}
+
+std::string SymbolResolve::GetPidMntPoint(int pid)
+{
+    std::lock_guard<std::mutex> lg(mntPointMutex);
+    auto findMnt = this->mntPointMap.find(pid);
+    if (findMnt != this->mntPointMap.end()) {
+        return findMnt->second;
+    }
+    std::string mntPoint = GetMntPoint(pid);
+    this->mntPointMap.emplace(pid, mntPoint);
+    return mntPoint;
+}
+
 int SymbolResolve::UpdateModule(int pid, RecordModuleType recordModuleType)
 {
     if (pid < 0) {
@@ -487,36 +611,16 @@ int SymbolResolve::UpdateModule(int pid, RecordModuleType recordModuleType)
     }
     std::vector<std::shared_ptr<ModuleMap>> newModVec;
     ReadProcPidMap(file, newModVec);
-    std::string mntPoint = GetMntPoint(pid);
-    // Find new dynamic modules.
-    auto &oldModVec = moduleMap[pid];
-    auto diffModVec = FindDiffMaps(oldModVec, newModVec);
-    // Load modules.
-    for (auto& item : diffModVec) {
-        std::string moduleName = item->moduleName;
-        if (!mntPoint.empty()) {
-            item->mntPoint = mntPoint;
-            moduleName = mntPoint + "/" + moduleName;
-        }
-        MyElf myElf(moduleName);
-        int ret = myElf.LoadMmap();
-        if (ret != SUCCESS) {
-            item->isFile = false;
+    // Load new dynamic modules.
+    auto &modules = moduleMap[pid];
+    for (auto& item : newModVec) {
+        if (modules.HasStart(item->start)) {
             continue;
         }
-        item->isExecFile = myElf.IsExecFile();
         item->moduleType = recordModuleType;
-#ifndef ELF_LLVM
-        this->RecordElf(moduleName.c_str());
-#endif
+        this->LoadPidModule(pid, *item);
+        modules.Insert(item);
     }
-    for (auto& mod : diffModVec) {
-        oldModVec.emplace_back(mod);
-    }
-    std::sort(oldModVec.begin(), oldModVec.end(),
-              [](const std::shared_ptr<ModuleMap> &left, const std::shared_ptr<ModuleMap> &right) {
-                  return left->start < right->start;
-              });
     pcerr::New(SUCCESS);
     moduleSafeHandler.releaseLock(pid);
     return SUCCESS;
@@ -533,6 +637,8 @@ void SymbolResolve::FreeModule(int pid)
         this->moduleMap.erase(it);
     }
     moduleSafeHandler.releaseLock(pid);
+    std::lock_guard<std::mutex> lg(mntPointMutex);
+    this->mntPointMap.erase(pid);
     return;
 }
 
@@ -551,6 +657,12 @@ void SymbolResolve::Clear()
     for (auto& item: symbolUnmap) {
         SymbolUtils::FreeSymbol(item);
     }
+
+    for (auto& item : this->moduleSymbolMap) {
+        for (auto& data : item.second) {
+            SymbolUtils::FreeSymbol(data.second);
+        }
+    }
     /**
      * free the memory allocated for stack table
      */
@@ -568,38 +680,245 @@ void SymbolResolve::Clear()
     this->instance = nullptr;
 }
 
-std::shared_ptr<ModuleMap> SymbolResolve::AddrToModule(
-        std::vector<std::shared_ptr<ModuleMap>>& processModule, unsigned long addr)
+void ModuleTree::Add(const std::shared_ptr<ModuleMap>& module)
 {
-    ssize_t start = 0;
-    ssize_t end = processModule.size() - 1;
-    ssize_t mid;
-    unsigned long symAddr;
+    auto findModule = this->modules.find(module->start);
+    if (findModule != this->modules.end()) {
+        Erase(findModule);
+    }
+    this->modules.emplace(module->start, module);
+    this->nameCount[module->moduleName]++;
+}
 
-    while (start < end) {
-        mid = start + (end - start + 1) / BINARY_HALF;
-        symAddr = processModule[mid]->start;
-        if (symAddr <= addr) {
-            start = mid;
-        } else {
-            end = mid - 1;
+ModuleTree::Iterator ModuleTree::Erase(Iterator iter)
+{
+    auto findName = this->nameCount.find(iter->second->moduleName);
+    if (findName != this->nameCount.end() && --findName->second == 0) {
+        this->nameCount.erase(findName);
+    }
+    return this->modules.erase(iter);
+}
+
+void ModuleTree::Retire(const std::shared_ptr<ModuleMap>& module, unsigned long time)
+{
+    if (time == 0) {
+        return;
+    }
+    this->history.push_back({module, time});
+    if (this->history.size() > MAX_RETIRED_MODULES) {
+        this->history.pop_front();
+    }
+}
+
+void ModuleTree::AddGeneration(unsigned long time, unsigned long start, unsigned long end)
+{
+    this->genTimes.insert(std::upper_bound(this->genTimes.begin(), this->genTimes.end(), time), time);
+    this->genRanges.push_back({start, end});
+    if (this->genTimes.size() > MAX_RETIRED_MODULES) {
+        this->genTimes.erase(this->genTimes.begin());
+        this->genRanges.pop_front();
+        ++this->droppedGens;
+    }
+}
+
+bool ModuleTree::ForEachReplaced(size_t gen, const std::function<void(unsigned long, unsigned long)>& func) const
+{
+    if (gen < this->droppedGens) {
+        return false;
+    }
+    for (size_t i = gen - this->droppedGens; i < this->genRanges.size(); ++i) {
+        if (this->genRanges[i].end > this->genRanges[i].start) {
+            func(this->genRanges[i].start, this->genRanges[i].end);
+        }
+    }
+    return true;
+}
+
+void ModuleTree::ForEachRetired(
+    const std::function<void(const std::shared_ptr<ModuleMap>&, unsigned long)>& func) const
+{
+    for (const auto& retired : this->history) {
+        func(retired.module, retired.unmapTime);
+    }
+}
+
+void ModuleTree::Restore(const std::shared_ptr<ModuleMap>& module, unsigned long unmapTime)
+{
+    Retire(module, unmapTime);
+    // Modules retired together, e.g. by exec, are in one generation.
+    if (unmapTime != 0 && !std::binary_search(this->genTimes.begin(), this->genTimes.end(), unmapTime)) {
+        AddGeneration(unmapTime, module->start, module->end);
+    }
+}
+
+size_t ModuleTree::GenerationAt(unsigned long time) const
+{
+    return this->droppedGens +
+           (std::upper_bound(this->genTimes.begin(), this->genTimes.end(), time) - this->genTimes.begin());
+}
+
+void ModuleTree::Insert(const std::shared_ptr<ModuleMap>& module)
+{
+    unsigned long start = module->start;
+    unsigned long end = module->end;
+    if (end <= start) {
+        Add(module);
+        return;
+    }
+    unsigned long time = module->mapTime;
+    Iterator iter = this->modules.lower_bound(start);
+    if (iter != this->modules.begin() && std::prev(iter)->second->end > start) {
+        iter = std::prev(iter);
+    }
+    // Files, and modules of other names, resolve to other symbols, while an anonymous mapping remapped as the same
+    // does not change the layout.
+    auto changes = [&module](const ModuleMap& other) {
+        return other.isFile || other.moduleName != module->moduleName;
+    };
+    if (time != 0) {
+        // A mapping read after newer ones of other cpus was replaced by them, so it only goes to history. The current
+        // layout is not changed by it.
+        bool late = false;
+        unsigned long newer = ULONG_MAX;
+        for (auto overlap = iter; overlap != this->modules.end() && overlap->first < end; ++overlap) {
+            if (overlap->second->mapTime > time) {
+                late = true;
+                if (changes(*overlap->second)) {
+                    newer = std::min(newer, overlap->second->mapTime);
+                }
+            }
+        }
+        if (newer != ULONG_MAX) {
+            Retire(module, newer);
+            AddGeneration(newer, start, start);
+        }
+        if (late) {
+            return;
+        }
+    }
+    bool replaced = false;
+    auto retire = [this, &changes, &replaced, time](const std::shared_ptr<ModuleMap>& old) {
+        if (changes(*old)) {
+            Retire(old, time);
+            replaced = true;
+        }
+    };
+    // Cut the module which begins before the new one and covers its start. Old modules are not changed in place,
+    // since they may be kept in history.
+    if (iter != this->modules.end() && iter->first < start) {
+        auto old = iter->second;
+        if (old->end > end) {
+            auto tail = std::make_shared<ModuleMap>(*old);
+            tail->start = end;
+            tail->fileOffset += end - old->start;
+            Add(tail);
+        }
+        auto head = std::make_shared<ModuleMap>(*old);
+        head->end = start;
+        Add(head);
+        retire(old);
+    }
+    // Remove modules which begin in the new one, and keep the parts after it.
+    iter = this->modules.lower_bound(start);
+    while (iter != this->modules.end() && iter->first < end) {
+        auto old = iter->second;
+        iter = Erase(iter);
+        retire(old);
+        if (old->end > end) {
+            auto tail = std::make_shared<ModuleMap>(*old);
+            tail->start = end;
+            tail->fileOffset += end - old->start;
+            Add(tail);
+            break;
         }
     }
+    Add(module);
+    if (replaced && time != 0) {
+        AddGeneration(time, start, end);
+    }
+}
+
+void ModuleTree::Exec(unsigned long time)
+{
+    for (Iterator iter = this->modules.begin(); iter != this->modules.end();) {
+        // Mappings of the new program may be read before the exec record.
+        if (iter->second->mapTime > time) {
+            ++iter;
+            continue;
+        }
+        Retire(iter->second, time);
+        iter = Erase(iter);
+    }
+    AddGeneration(time, 0, ULONG_MAX);
+}
+
+std::shared_ptr<ModuleMap> ModuleTree::Find(unsigned long addr) const
+{
+    auto iter = this->modules.upper_bound(addr);
+    if (iter == this->modules.begin()) {
+        return nullptr;
+    }
+    auto module = std::prev(iter)->second;
+    if (module->end > module->start && addr >= module->end) {
+        return nullptr;
+    }
+    return module;
+}
+
+std::shared_ptr<ModuleMap> ModuleTree::Find(unsigned long addr, unsigned long time) const
+{
+    auto module = Find(addr);
+    if (time == 0 || GenerationAt(time) == Generation() || (module != nullptr && module->mapTime <= time)) {
+        return module;
+    }
+    // The newest retired module is searched first, since a range may be mapped and replaced several times.
+    for (auto iter = this->history.rbegin(); iter != this->history.rend(); ++iter) {
+        const ModuleMap& retired = *iter->module;
+        if (retired.mapTime <= time && time < iter->unmapTime && retired.end > retired.start &&
+            addr >= retired.start && addr < retired.end) {
+            return iter->module;
+        }
+    }
+    return module;
+}
+
+bool ModuleTree::HasStart(unsigned long start) const
+{
+    return this->modules.find(start) != this->modules.end();
+}
+
+bool ModuleTree::HasModule(const std::string& moduleName) const
+{
+    return this->nameCount.find(moduleName) != this->nameCount.end();
+}
 
-    if (start == end && processModule[start]->start <= addr) {
-        return processModule[start];
+std::shared_ptr<ModuleMap> SymbolResolve::AddrToModule(const ModuleTree& processModule, unsigned long addr,
+                                                       unsigned long time)
+{
+    auto module = processModule.Find(addr, time);
+    if (module != nullptr) {
+        return module;
     }
 
     pcerr::New(LIBSYM_ERR_MAP_ADDR_MODULE_FAILED, "libsym addr can't find module");
     return nullptr;
 }
 
-struct Stack* SymbolResolve::StackToHash(int pid, unsigned long* stack, int nr)
+struct Stack* SymbolResolve::StackToHash(int pid, unsigned long* stack, int nr, bool resolve, unsigned long time)
 {
     if (this->stackMap.find(pid) == this->stackMap.end()) {
         this->stackMap[pid] = {};
     }
-    std::string stackId = HashStr(stack, nr);
+    std::string stackId = resolve ? HashStr(stack, nr) : RAW_STACK_PREFIX + HashStr(stack, nr);
+    auto findModules = this->moduleMap.find(pid);
+    if (resolve && findModules != this->moduleMap.end()) {
+        // The same ips may be different functions in another generation of layout.
+        const ModuleTree& modules = findModules->second;
+        size_t generation = time == 0 ? modules.Generation() : modules.GenerationAt(time);
+        if (generation != 0) {
+            stackId += "@" + std::to_string(generation);
+        }
+    }
     if (this->stackMap.at(pid).find(stackId) != this->stackMap.at(pid).end()) {
         return this->stackMap.at(pid).at(stackId);
     }
@@ -607,7 +926,7 @@ struct Stack* SymbolResolve::StackToHash(int pid, unsigned long* stack, int nr)
     struct Stack* head = nullptr;
     for (int i = nr - 1; i >= 0; i--) {
         struct Stack* current = CreateNode<struct Stack>();
-        auto symbol = this->MapAddr(pid, stack[i]);
+        auto symbol = resolve ? this->MapAddr(pid, stack[i], time) : nullptr;
         if (symbol != nullptr) {
             current->symbol = symbol;
         } else {
@@ -657,71 +976,154 @@ char* SymbolResolve::GetCharFromStr(const std::string& str)
     return strToCharMap[str];
 }
 
-struct Symbol* SymbolResolve::MapUserAddr(int pid, unsigned long addr)
+void SymbolResolve::UnmapSymbols(std::unordered_map<__u64, struct Symbol*>& symbols,
+                                 std::vector<std::pair<unsigned long, unsigned long>>& ranges)
+{
+    // Ranges are merged so that each symbol is checked with a binary search.
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<std::pair<unsigned long, unsigned long>> merged;
+    for (const auto& range : ranges) {
+        if (range.second <= range.first) {
+            continue;
+        }
+        if (!merged.empty() && range.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, range.second);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    if (merged.empty()) {
+        return;
+    }
+    // Stacks may still point to dropped symbols, so they are released by Clear.
+    for (auto item = symbols.begin(); item != symbols.end();) {
+        unsigned long addr = item->first;
+        auto range = std::upper_bound(merged.begin(), merged.end(), std::make_pair(addr, ULONG_MAX));
+        if (range != merged.begin() && addr < std::prev(range)->second) {
+            symbolUnmap.emplace_back(item->second);
+            item = symbols.erase(item);
+        } else {
+            ++item;
+        }
+    }
+}
+
+struct Symbol* SymbolResolve::MapUserAddr(int pid, unsigned long addr, unsigned long time)
 {
     if (this->moduleMap.find(pid) == this->moduleMap.end()) {
         pcerr::New(LIBSYM_ERR_NOT_FIND_PID, "The libsym process ID " + std::to_string(pid) + " cannot be found.");
         return nullptr;
     }
+    const ModuleTree& modules = this->moduleMap.at(pid);
+    // Symbols of addresses sampled before the layout changed are not cached for the process.
+    bool isCurrent = time == 0 || modules.GenerationAt(time) == modules.Generation();
 
     symSafeHandler.tryLock(pid);
     if (this->symbolMap.find(pid) == this->symbolMap.end()) {
         this->symbolMap[pid] = {};
     }
+    auto& symbols = this->symbolMap.at(pid);
+    size_t& symbolGen = this->symbolGenMap[pid];
+    if (symbolGen != modules.Generation()) {
+        std::vector<std::pair<unsigned long, unsigned long>> ranges;
+        auto replaced = [&ranges](unsigned long start, unsigned long end) { ranges.emplace_back(start, end); };
+        if (!modules.ForEachReplaced(symbolGen, replaced)) {
+            ranges.assign(1, {0, ULONG_MAX});
+        }
+        this->UnmapSymbols(symbols, ranges);
+        symbolGen = modules.Generation();
+    }
     symSafeHandler.releaseLock(pid);
-    auto it = this->symbolMap.at(pid).find(addr);
-    if (it != this->symbolMap.at(pid).end()) {
-        return it->second;
+    if (isCurrent) {
+        auto it = symbols.find(addr);
+        if (it != symbols.end()) {
+            return it->second;
+        }
     }
 
-    auto javaIt = javaElfArr.find(pid);
-    if (javaIt != javaElfArr.end()) {
-        JavaEntry entry;
-        int javaRet = javaIt->second.FindElf(addr, entry);
-        if (javaRet == 0) {
-            struct Symbol* symbol = InitializeSymbol(addr);
-            symbol->codeMapAddr = addr;
-            symbol->offset = addr - entry.start;
-            symbol->codeMapEndAddr = entry.end;
-            symbol->symbolName = GetCharFromStr(entry.symbolName);
-            symbol->mangleName = GetCharFromStr(entry.symbolName);
-            symbol->fileName = GetCharFromStr(entry.fileName);
-            symbol->lineNum = entry.line;
-            this->symbolMap.at(pid).insert({addr, symbol});
-            pcerr::New(0, "success");
+    struct Symbol* symbol = nullptr;
+    // Jit code is in anonymous memory, so addresses of files are not searched in jit entries.
+    std::shared_ptr<ModuleMap> module = this->AddrToModule(modules, addr, time);
+    JavaEntry entry;
+    if ((module == nullptr || !module->isFile) && FindJitEntry(pid, addr, entry)) {
+        symbol = InitializeSymbol(addr);
+        symbol->codeMapAddr = addr;
+        symbol->offset = addr - entry.start;
+        symbol->codeMapEndAddr = entry.end;
+        symbol->symbolName = GetCharFromStr(entry.symbolName);
+        symbol->mangleName = GetCharFromStr(entry.symbolName);
+        symbol->fileName = GetCharFromStr(entry.fileName);
+        symbol->lineNum = entry.line;
+        pcerr::New(0, "success");
+    } else {
+        if (!module) {
+            return nullptr;
+        }
+        symbol = this->MapModuleSymbol(*module, addr);
+        if (!module->isFile) {
+            symbolUnmap.emplace_back(symbol);
             return symbol;
         }
     }
-
-    std::shared_ptr<ModuleMap> module = this->AddrToModule(this->moduleMap.at(pid), addr);
-    if (!module) {
-        return nullptr;
+    if (isCurrent) {
+        symbols.insert({addr, symbol});
+    } else {
+        symbolUnmap.emplace_back(symbol);
     }
+    return symbol;
+}
+
+struct Symbol* SymbolResolve::MapModuleSymbol(const ModuleMap& module, unsigned long addr)
+{
     /**
      * Try to search elf data first
      */
     struct Symbol* symbol = InitializeSymbol(addr);
-    symbol->module = GetCharFromStr(module->moduleName);
-    if (!module->isFile) {
+    symbol->module = GetCharFromStr(module.moduleName);
+    if (!module.isFile) {
         pcerr::New(0, "success");
         return symbol;
     }
     unsigned long addrToSearch = addr;
-    if (!module->isExecFile) {
+    if (!module.isExecFile) {
         // /proc/<pid>/maps provides mapping address and file offset. ELF symbols are
         // relative to the image base, not the individual mapping (notably on x86_64).
-        addrToSearch = addrToSearch - module->start + module->fileOffset;
+        addrToSearch = addrToSearch - module.start + module.fileOffset;
     }
 
-    std::string moduleName = module->moduleName;
-    if (!module->mntPoint.empty()) {
-        symbol->mntPoint = GetCharFromStr(module->mntPoint);
-        moduleName = module->mntPoint + "/" + module->moduleName;
+    std::string moduleName = module.FilePath();
+    std::string mntPoint = this->ModuleMntPoint(module);
+    if (!mntPoint.empty()) {
+        symbol->mntPoint = GetCharFromStr(mntPoint);
     }
+    symbol->codeMapAddr = addrToSearch;
 
-#ifndef ELF_LLVM
-    if (this->elfMap.find(moduleName) != this->elfMap.end()) {
-        ParserElf& myElf = this->elfMap.at(moduleName);
+    // Symbols resolved with dwarf can be used without dwarf, but not vice versa.
+    bool withDwarf = module.moduleType == RecordModuleType::RECORD_ALL;
+    std::string moduleKey = module.moduleKey;
+    if (!moduleKey.empty() && !withDwarf) {
+        moduleKey += ":nodwarf";
+    }
+    if (!moduleKey.empty() && (this->FindModuleSymbol(module.moduleKey, addrToSearch, symbol, withDwarf) ||
+        (!withDwarf && this->FindModuleSymbol(moduleKey, addrToSearch, symbol, false)))) {
+        pcerr::New(0, "success");
+        return symbol;
+    }
+    if (this->FindIndexSymbol(module, addrToSearch, symbol, withDwarf)) {
+        if (!moduleKey.empty()) {
+            this->AddModuleSymbol(moduleKey, addrToSearch, symbol);
+        }
+        pcerr::New(0, "success");
+        return symbol;
+    }
+
+#ifndef ELF_LLVM
+    if (!this->cacheDir.empty() && this->elfMap.find(moduleName) == this->elfMap.end()) {
+        // Elf of a module with symbol index is recorded only if the index misses an address.
+        this->RecordElf(moduleName.c_str());
+    }
+    if (this->elfMap.find(moduleName) != this->elfMap.end()) {
+        ParserElf& myElf = *this->elfMap.at(moduleName);
         this->SearchElfInfo(myElf, addrToSearch, symbol, &symbol->offset);
         if (symbol->symbolName == UNKNOWN) {
             auto ResOrErr = Symbolizer.getPLTCode(moduleName, addrToSearch);
@@ -734,7 +1136,7 @@ struct Symbol* SymbolResolve::MapUserAddr(int pid, unsigned long addr)
         }
     }
 
-    if (module->moduleType == RecordModuleType::RECORD_ALL) {
+    if (module.moduleType == RecordModuleType::RECORD_ALL) {
         auto ResOrErr = Symbolizer.symbolizeCode(moduleName, addrToSearch);
         if (ResOrErr->FileName != "<invalid>") {
             symbol->lineNum = ResOrErr->Line;
@@ -745,7 +1147,7 @@ struct Symbol* SymbolResolve::MapUserAddr(int pid, unsigned long addr)
 #else
     auto ResOrErr = Symbolizer.symbolizeCode(moduleName, addrToSearch);
     if (ResOrErr) {
-        if (module->moduleType == RecordModuleType::RECORD_ALL) {
+        if (module.moduleType == RecordModuleType::RECORD_ALL) {
             if (ResOrErr->FileName != "<invalid>") {
                 symbol->lineNum = ResOrErr->Line;
                 symbol->fileName = GetCharFromStr(ResOrErr->FileName);
@@ -761,65 +1163,257 @@ struct Symbol* SymbolResolve::MapUserAddr(int pid, unsigned long addr)
         }
     }
 #endif
-    symbol->codeMapAddr = addrToSearch;
-    this->symbolMap.at(pid).insert({addr, symbol});
+    if (!moduleKey.empty()) {
+        this->AddModuleSymbol(moduleKey, addrToSearch, symbol);
+    }
     pcerr::New(0, "success");
     return symbol;
 }
 
-int JavaElf::FindElf(unsigned long addr, struct JavaEntry& javaEntry) {
-    if (!hasLoad) {
-        std::string path = perfMapPath.empty() ? "/tmp/perf-" + std::to_string(pid) + ".map" : perfMapPath;
-        
-        std::ifstream fileTmp(path.c_str());
-        if (!fileTmp.is_open()) {
-            return -1;
-        }
-        std::string line;
-        while(getline(fileTmp, line)) {
-            char name[MAX_LINUX_SYMBOL_LEN];
-            unsigned long addr;
-            unsigned long size;
-            if (sscanf(line.c_str(), "%llx %llx %s %*s", &addr, &size, name) == EOF) {
-                continue;
-            }
-            std::string symbolName;
-            std::string fileName = UNKNOWN;
-            int lineNum = 0;
-            std::string symName = {name};
-            size_t index = symName.find('(');
-            if (index != std::string::npos) {
-                symbolName = symName.substr(0, index);
-                size_t lastIndex = symName.find(')');
-                std::string lineStr = symName.substr(index + 1, lastIndex - index);
-                auto vec = SplitStringByDelimiter(lineStr, ':');
-                if (!vec.empty() && vec.size() == 2) {
-                    fileName = vec[0];
-                    ConvertStrToInt(vec[1], lineNum);
-                }
-            } else {
-                symbolName = symName;
-            }
-            JavaEntry entry = {.start=addr, .end=addr + size, .symbolName=symbolName, .fileName=fileName, .line=(unsigned int)lineNum};
-            symbolList[addr] = entry;
+bool SymbolResolve::FindModuleSymbol(const std::string& key, unsigned long elfAddr, struct Symbol* symbol,
+                                     bool withDwarf)
+{
+    std::lock_guard<std::mutex> lg(moduleSymbolMutex);
+    auto findModule = this->moduleSymbolMap.find(key);
+    if (findModule == this->moduleSymbolMap.end()) {
+        return false;
+    }
+    auto findSymbol = findModule->second.find(elfAddr);
+    if (findSymbol == findModule->second.end()) {
+        return false;
+    }
+    CopyResolvedSymbol(findSymbol->second, symbol, withDwarf);
+    return true;
+}
+
+void SymbolResolve::AddModuleSymbol(const std::string& key, unsigned long elfAddr, const struct Symbol* symbol)
+{
+    std::lock_guard<std::mutex> lg(moduleSymbolMutex);
+    auto& moduleSymbols = this->moduleSymbolMap[key];
+    if (moduleSymbols.find(elfAddr) != moduleSymbols.end()) {
+        return;
+    }
+    struct Symbol* resolved = InitializeSymbol(elfAddr);
+    resolved->module = symbol->module;
+    resolved->codeMapAddr = elfAddr;
+    CopyResolvedSymbol(symbol, resolved, true);
+    moduleSymbols[elfAddr] = resolved;
+}
+
+bool SymbolResolve::LoadSymbolIndex(const ModuleMap& module, const std::string& path)
+{
+    if (this->cacheDir.empty() || module.buildId.empty()) {
+        return false;
+    }
+    bool withLines = module.moduleType == RecordModuleType::RECORD_ALL;
+    std::lock_guard<std::mutex> lg(symbolIndexMutex);
+    auto findIndex = this->symbolIndexMap.find(module.buildId);
+    if (findIndex != this->symbolIndexMap.end() && (!withLines || findIndex->second->HasLines())) {
+        return true;
+    }
+    auto index = SymbolIndex::Load(this->cacheDir, module.buildId, path, withLines);
+    if (index == nullptr) {
+        return false;
+    }
+    this->symbolIndexMap[module.buildId] = index;
+    return true;
+}
+
+bool SymbolResolve::FindIndexSymbol(const ModuleMap& module, unsigned long elfAddr, struct Symbol* symbol,
+                                    bool withDwarf)
+{
+    if (module.buildId.empty()) {
+        return false;
+    }
+    std::shared_ptr<SymbolIndex> index;
+    {
+        std::lock_guard<std::mutex> lg(symbolIndexMutex);
+        auto findIndex = this->symbolIndexMap.find(module.buildId);
+        if (findIndex == this->symbolIndexMap.end()) {
+            return false;
+        }
+        index = findIndex->second;
+    }
+    IndexSymbol indexSymbol;
+    if ((withDwarf && !index->HasLines()) || !index->Find(elfAddr, indexSymbol)) {
+        return false;
+    }
+    symbol->symbolName = GetCharFromStr(indexSymbol.name);
+    symbol->mangleName = GetCharFromStr(indexSymbol.mangleName);
+    symbol->offset = elfAddr - indexSymbol.start;
+    symbol->codeMapEndAddr = indexSymbol.end;
+    if (withDwarf && indexSymbol.fileName != nullptr) {
+        symbol->fileName = GetCharFromStr(indexSymbol.fileName);
+        symbol->lineNum = indexSymbol.lineNum;
+        symbol->firstLine = indexSymbol.firstLine;
+    }
+    return true;
+}
+
+int SymbolResolve::SetCacheDir(const char* dir)
+{
+    if (dir == nullptr || dir[0] == '\0') {
+        this->cacheDir.clear();
+        pcerr::New(SUCCESS);
+        return SUCCESS;
+    }
+    struct stat st;
+    if (stat(dir, &st) != 0 && mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        pcerr::New(LIBSYM_ERR_CACHE_DIR_INVALID,
+                   "libsym can't create cache directory " + std::string{dir} + " because of " +
+                   std::string{strerror(errno)});
+        return LIBSYM_ERR_CACHE_DIR_INVALID;
+    }
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode) || access(dir, R_OK | W_OK | X_OK) != 0) {
+        pcerr::New(LIBSYM_ERR_CACHE_DIR_INVALID, "libsym cache directory " + std::string{dir} + " is not writable");
+        return LIBSYM_ERR_CACHE_DIR_INVALID;
+    }
+    this->cacheDir = dir;
+    pcerr::New(SUCCESS);
+    return SUCCESS;
+}
+
+static bool ParseJavaEntry(const std::string& line, JavaEntry& entry)
+{
+    char name[MAX_LINUX_SYMBOL_LEN];
+    unsigned long addr;
+    unsigned long size;
+    if (sscanf(line.c_str(), "%lx %lx %s %*s", &addr, &size, name) != 3) {
+        return false;
+    }
+    std::string symbolName;
+    std::string fileName = UNKNOWN;
+    int lineNum = 0;
+    std::string symName = {name};
+    size_t index = symName.find('(');
+    if (index != std::string::npos) {
+        symbolName = symName.substr(0, index);
+        size_t lastIndex = symName.find(')');
+        std::string lineStr = symName.substr(index + 1, lastIndex - index);
+        auto vec = SplitStringByDelimiter(lineStr, ':');
+        if (!vec.empty() && vec.size() == 2) {
+            fileName = vec[0];
+            ConvertStrToInt(vec[1], lineNum);
         }
+    } else {
+        symbolName = symName;
+    }
+    entry = {.start=addr, .end=addr + size, .symbolName=symbolName, .fileName=fileName, .line=(unsigned int)lineNum};
+    return true;
+}
+
+void JavaElf::AddEntry(const JavaEntry& entry, const std::function<void(unsigned long, unsigned long)>& replaced)
+{
+    auto iter = symbolList.upper_bound(entry.start);
+    if (iter != symbolList.begin() && std::prev(iter)->second.end > entry.start) {
+        iter = std::prev(iter);
+    }
+    while (iter != symbolList.end() && iter->first < entry.end) {
+        replaced(iter->second.start, iter->second.end);
+        iter = symbolList.erase(iter);
+    }
+    symbolList[entry.start] = entry;
+}
+
+void JavaElf::LoadNewEntries(const std::function<void(unsigned long, unsigned long)>& replaced)
+{
+    std::string path = perfMapPath.empty() ? "/tmp/perf-" + std::to_string(pid) + ".map" : perfMapPath;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return;
+    }
+    if (st.st_ino != inode || st.st_size < readOffset) {
+        // The map is rewritten, e.g. by a new jvm with the same pid.
         if (!symbolList.empty()) {
-            hasLoad = true;
+            replaced(0, ULONG_MAX);
+        }
+        symbolList.clear();
+        readOffset = 0;
+        inode = st.st_ino;
+    }
+    if (st.st_size == readOffset) {
+        return;
+    }
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        return;
+    }
+    file.seekg(readOffset);
+    std::string line;
+    while (std::getline(file, line)) {
+        // The last line without newline is being written, and it is read next time.
+        if (file.eof()) {
+            break;
+        }
+        readOffset = file.tellg();
+        JavaEntry entry;
+        if (ParseJavaEntry(line, entry)) {
+            AddEntry(entry, replaced);
         }
     }
+}
+
+int JavaElf::FindElf(unsigned long addr, struct JavaEntry& javaEntry) const
+{
     auto it = symbolList.upper_bound(addr);
     if (it == symbolList.cbegin()) {
         return -1;
     }
     --it;
-    if (addr > it->second.end) {
+    if (addr >= it->second.end) {
         return -1;
     }
     javaEntry = it->second;
     return 0;
 }
 
-struct Symbol* SymbolResolve::MapAddr(int pid, unsigned long addr)
+void SymbolResolve::RecordJitDump(int pid, const std::string& path)
+{
+    auto iter = jitDumpArr.find(pid);
+    if (iter != jitDumpArr.end() && iter->second->GetPath() == path) {
+        return;
+    }
+    auto jitDump = std::make_shared<JitDump>(path);
+    jitDump->LoadNewRecords([](unsigned long, unsigned long) {});
+    jitDumpArr[pid] = jitDump;
+}
+
+bool SymbolResolve::FindJitEntry(int pid, unsigned long addr, JavaEntry& entry)
+{
+    auto jitIt = jitDumpArr.find(pid);
+    if (jitIt != jitDumpArr.end() && jitIt->second->FindElf(addr, entry) == 0) {
+        return true;
+    }
+    auto javaIt = javaElfArr.find(pid);
+    return javaIt != javaElfArr.end() && javaIt->second.FindElf(addr, entry) == 0;
+}
+
+int SymbolResolve::UpdateJitCode(int pid)
+{
+    std::vector<std::pair<unsigned long, unsigned long>> ranges;
+    auto replaced = [&ranges](unsigned long start, unsigned long end) { ranges.emplace_back(start, end); };
+    auto jitIt = jitDumpArr.find(pid);
+    if (jitIt != jitDumpArr.end()) {
+        jitIt->second->LoadNewRecords(replaced);
+    }
+    auto javaIt = javaElfArr.find(pid);
+    if (javaIt != javaElfArr.end()) {
+        javaIt->second.LoadNewEntries(replaced);
+    }
+    if (!ranges.empty()) {
+        // Symbols of code reclaimed and reused by other methods are resolved again.
+        symSafeHandler.tryLock(pid);
+        auto findSymbols = this->symbolMap.find(pid);
+        if (findSymbols != this->symbolMap.end()) {
+            this->UnmapSymbols(findSymbols->second, ranges);
+        }
+        symSafeHandler.releaseLock(pid);
+    }
+    pcerr::New(SUCCESS);
+    return SUCCESS;
+}
+
+struct Symbol* SymbolResolve::MapAddr(int pid, unsigned long addr, unsigned long time)
 {
     struct Symbol* data = nullptr;
     if (addr > KERNEL_START_ADDR) {
@@ -833,11 +1427,30 @@ struct Symbol* SymbolResolve::MapAddr(int pid, unsigned long addr)
         }
         data->offset = addr - data->addr;
     } else {
-        data = this->MapUserAddr(pid, addr);
+        data = this->MapUserAddr(pid, addr, time);
     }
     return data;
 }
 
+std::shared_ptr<ModuleMap> SymbolResolve::MapModuleAddr(int pid, unsigned long addr, unsigned long &elfAddr,
+                                                        unsigned long time)
+{
+    if (addr > KERNEL_START_ADDR) {
+        return nullptr;
+    }
+    auto findModules = this->moduleMap.find(pid);
+    if (findModules == this->moduleMap.end() || findModules->second.Empty()) {
+        pcerr::New(LIBSYM_ERR_NOT_FIND_PID, "The libsym process ID " + std::to_string(pid) + " cannot be found.");
+        return nullptr;
+    }
+    std::shared_ptr<ModuleMap> module = this->AddrToModule(findModules->second, addr, time);
+    if (!module || addr >= module->end || !module->isFile) {
+        return nullptr;
+    }
+    elfAddr = module->isExecFile ? addr : addr - module->start + module->fileOffset;
+    return module;
+}
+
 int SymbolResolve::RecordKernel()
 {
     if (!this->ksymArray.empty()) {
@@ -878,20 +1491,256 @@ int SymbolResolve::RecordKernel()
     return 0;
 }
 
-int SymbolResolve::UpdateModule(int pid, const char* moduleName, unsigned long startAddr, RecordModuleType recordModuleType)
+int SymbolResolve::RecordModuleLayout(int pid)
 {
     if (pid < 0) {
         pcerr::New(LIBSYM_ERR_PARAM_PID_INVALID, "libsym param process ID must be greater than 0");
         return LIBSYM_ERR_PARAM_PID_INVALID;
     }
-    if (this->moduleMap.find(pid) != this->moduleMap.end()) {
-        int ret = UpdateModule(pid, recordModuleType);
-        if (ret != SUCCESS) {
-            return ret;
+    std::lock_guard<std::mutex> lg(layoutMutex);
+    // Modules mapped after the process is recorded come from mmap records.
+    if (this->layoutMap.find(pid) != this->layoutMap.end()) {
+        pcerr::New(SUCCESS);
+        return SUCCESS;
+    }
+    return this->ReadModuleLayout(pid);
+}
+
+int SymbolResolve::ReadModuleLayout(int pid)
+{
+    std::string mapFile = "/proc/" + std::to_string(pid) + "/maps";
+    std::ifstream file(mapFile);
+    if (!file.is_open()) {
+        pcerr::New(LIBSYM_ERR_OPEN_FILE_FAILED,
+                   "libsym can't open file named " + mapFile + " because of " + std::string{strerror(errno)});
+        return LIBSYM_ERR_OPEN_FILE_FAILED;
+    }
+    std::vector<std::shared_ptr<ModuleMap>> newModVec;
+    ReadProcPidMap(file, newModVec);
+    std::string mntPoint = GetPidMntPoint(pid);
+    auto &modules = this->layoutMap[pid];
+    for (auto& item : newModVec) {
+        item->mntPoint = mntPoint;
+        this->LoadLayoutModule(*item);
+        modules.Insert(item);
+    }
+    pcerr::New(SUCCESS);
+    return SUCCESS;
+}
+
+void SymbolResolve::LoadLayoutModule(ModuleMap& module)
+{
+    // The same file mapped by other processes, or mapped again, is found by device and inode.
+    if (this->FindModuleFile(module, this->layoutFiles)) {
+        return;
+    }
+    std::string path = module.FilePath();
+    // Only build-id is read, which tells whether the file used to resolve offline is the same one.
+    MyElf myElf(path);
+    if (myElf.LoadMmap() != SUCCESS) {
+        module.isFile = false;
+        return;
+    }
+    module.isExecFile = myElf.IsExecFile();
+    module.moduleKey = GetModuleKey(myElf, path, module.buildId);
+    this->AddModuleFile(module, path, this->layoutFiles);
+}
+
+int SymbolResolve::UpdateModuleLayout(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                      unsigned long pgoff, unsigned long mapTime, const std::string& fileId)
+{
+    if (pid < 0) {
+        pcerr::New(LIBSYM_ERR_PARAM_PID_INVALID, "libsym param process ID must be greater than 0");
+        return LIBSYM_ERR_PARAM_PID_INVALID;
+    }
+    std::shared_ptr<ModuleMap> data = std::make_shared<ModuleMap>();
+    data->moduleName = moduleName;
+    data->start = startAddr;
+    data->end = startAddr + len;
+    data->fileOffset = pgoff;
+    data->mapTime = mapTime;
+    data->fileId = fileId;
+    std::lock_guard<std::mutex> lg(layoutMutex);
+    if (this->layoutMap.find(pid) == this->layoutMap.end() && this->ReadModuleLayout(pid) != SUCCESS) {
+        // The process may have exited, and modules are still recorded from mappings.
+        this->layoutMap[pid];
+    }
+    const std::string& name = data->moduleName;
+    if (name.empty() || name[0] != '/' || name.compare(0, ANON.size(), ANON) == 0) {
+        // Anonymous mappings are not saved, but still replace the modules mapped there before.
+        data->isFile = false;
+    } else {
+        data->mntPoint = GetPidMntPoint(pid);
+        this->LoadLayoutModule(*data);
+    }
+    this->layoutMap.at(pid).Insert(data);
+    pcerr::New(SUCCESS);
+    return SUCCESS;
+}
+
+int SymbolResolve::SaveLayout(const char* path)
+{
+    if (path == nullptr) {
+        pcerr::New(LIBSYM_ERR_FILE_INVALID, "libsym module layout path can't be nullptr");
+        return LIBSYM_ERR_FILE_INVALID;
+    }
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        pcerr::New(LIBSYM_ERR_OPEN_FILE_FAILED,
+                   "libsym can't open file named " + std::string{path} + " because of " + std::string{strerror(errno)});
+        return LIBSYM_ERR_OPEN_FILE_FAILED;
+    }
+    out << LAYOUT_HEADER << "\n";
+    {
+        std::lock_guard<std::mutex> lg(layoutMutex);
+        // Modules replaced before are saved with the timestamps they are unmapped at, and current ones with 0.
+        auto saveModule = [&out](const std::shared_ptr<ModuleMap>& item, unsigned long unmapTime) {
+            if (!item->isFile) {
+                return;
+            }
+            // Module name is the last field, which may contain spaces.
+            out << "M " << std::hex << item->start << " " << item->end << " " << item->fileOffset << std::dec
+                << " " << item->mapTime << " " << unmapTime
+                << " " << (item->buildId.empty() ? LAYOUT_NONE : item->buildId)
+                << " " << (item->mntPoint.empty() ? LAYOUT_NONE : item->mntPoint)
+                << " " << item->moduleName << "\n";
+        };
+        for (const auto& layout : this->layoutMap) {
+            out << "P " << layout.first << "\n";
+            layout.second.ForEachRetired(saveModule);
+            for (const auto& range : layout.second) {
+                saveModule(range.second, 0);
+            }
+        }
+    }
+    // Kernel and module symbols with their load addresses on this host.
+    std::ifstream kallsyms("/proc/kallsyms");
+    std::string line;
+    while (std::getline(kallsyms, line)) {
+        out << "K " << line << "\n";
+    }
+    if (!out) {
+        pcerr::New(LIBSYM_ERR_OPEN_FILE_FAILED, "libsym failed to write file named " + std::string{path});
+        return LIBSYM_ERR_OPEN_FILE_FAILED;
+    }
+    pcerr::New(SUCCESS);
+    return SUCCESS;
+}
+
+int SymbolResolve::LoadLayout(const char* path, const char* rootDir)
+{
+    if (path == nullptr) {
+        pcerr::New(LIBSYM_ERR_FILE_INVALID, "libsym module layout path can't be nullptr");
+        return LIBSYM_ERR_FILE_INVALID;
+    }
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        pcerr::New(LIBSYM_ERR_OPEN_FILE_FAILED,
+                   "libsym can't open file named " + std::string{path} + " because of " + std::string{strerror(errno)});
+        return LIBSYM_ERR_OPEN_FILE_FAILED;
+    }
+    std::string line;
+    if (!std::getline(file, line) || line != LAYOUT_HEADER) {
+        pcerr::New(LIBSYM_ERR_LAYOUT_INVALID, "libsym finds that " + std::string{path} + " is not a module layout");
+        return LIBSYM_ERR_LAYOUT_INVALID;
+    }
+    // Modules of processes in the order they are saved, with their unmap timestamps.
+    std::unordered_map<pid_t, std::vector<std::pair<std::shared_ptr<ModuleMap>, unsigned long>>> layouts;
+    std::vector<std::shared_ptr<Symbol>> ksyms;
+    int pid = -1;
+    char buildId[MAX_LINUX_MODULE_LEN];
+    char mntPoint[MAX_LINUX_MODULE_LEN];
+    char mode;
+    __u64 addr;
+    char name[KERNEL_MODULE_LNE];
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0] == 'K') {
+            if (sscanf(line.c_str(), "K %llx %c %127s", &addr, &mode, name) != 3) {
+                continue;
+            }
+            std::shared_ptr<Symbol> data = std::make_shared<Symbol>();
+            data->symbolName = GetCharFromStr(name);
+            data->mangleName = GetCharFromStr(name);
+            data->addr = addr;
+            data->fileName = KERNEL;
+            data->module = KERNEL;
+            data->lineNum = 0;
+            ksyms.emplace_back(data);
+            continue;
+        }
+        if (line[0] == 'P' && sscanf(line.c_str(), "P %d", &pid) == 1) {
+            layouts[pid] = {};
+            continue;
+        }
+        std::shared_ptr<ModuleMap> data = std::make_shared<ModuleMap>();
+        unsigned long unmapTime = 0;
+        int nameStart = 0;
+        if (line[0] != 'M' || pid < 0 ||
+            sscanf(line.c_str(), "M %lx %lx %lx %lu %lu %1023s %1023s %n", &data->start, &data->end,
+                   &data->fileOffset, &data->mapTime, &unmapTime, buildId, mntPoint, &nameStart) != 7 ||
+            nameStart == 0) {
+            pcerr::New(LIBSYM_ERR_LAYOUT_INVALID, "libsym finds invalid line in module layout: " + line);
+            return LIBSYM_ERR_LAYOUT_INVALID;
+        }
+        data->moduleName = line.substr(nameStart);
+        data->buildId = buildId == LAYOUT_NONE ? "" : buildId;
+        data->mntPoint = rootDir == nullptr ? "" : rootDir;
+        if (mntPoint != LAYOUT_NONE) {
+            data->mntPoint += mntPoint;
+        }
+        layouts[pid].emplace_back(data, unmapTime);
+    }
+
+    for (auto& layout : layouts) {
+        for (auto& saved : layout.second) {
+            auto& item = saved.first;
+            std::string moduleName = item->mntPoint.empty() ? item->moduleName : item->mntPoint + "/" + item->moduleName;
+            MyElf myElf(moduleName);
+            if (myElf.LoadMmap() != SUCCESS) {
+                item->isFile = false;
+                continue;
+            }
+            std::string buildIdStr;
+            GetModuleKey(myElf, moduleName, buildIdStr);
+            // A different file with the same path would give wrong symbols, so it is left unresolved.
+            if (buildIdStr != item->buildId) {
+                item->isFile = false;
+                continue;
+            }
+            item->moduleType = RecordModuleType::RECORD_ALL;
+            this->LoadModule(*item, moduleName);
+        }
+        ModuleTree modules;
+        for (auto& saved : layout.second) {
+            if (saved.second == 0) {
+                modules.Insert(saved.first);
+            } else {
+                modules.Restore(saved.first, saved.second);
+            }
         }
+        moduleSafeHandler.tryLock(layout.first);
+        this->moduleMap[layout.first] = std::move(modules);
+        moduleSafeHandler.releaseLock(layout.first);
+    }
+    if (!ksyms.empty()) {
+        std::lock_guard<std::mutex> guard(kernelMutex);
+        this->ksymArray.swap(ksyms);
+    }
+    pcerr::New(SUCCESS);
+    return SUCCESS;
+}
+
+int SymbolResolve::UpdateModule(int pid, const char* moduleName, unsigned long startAddr, RecordModuleType recordModuleType)
+{
+    if (pid < 0) {
+        pcerr::New(LIBSYM_ERR_PARAM_PID_INVALID, "libsym param process ID must be greater than 0");
+        return LIBSYM_ERR_PARAM_PID_INVALID;
     }
     std::shared_ptr<ModuleMap> data = std::make_shared<ModuleMap>();
-    std::string mntPoint = GetMntPoint(pid);
+    std::string mntPoint = GetPidMntPoint(pid);
     data->moduleName = moduleName;
     data->start = startAddr;
     std::string recordModule = std::string{moduleName};
@@ -905,41 +1754,100 @@ int SymbolResolve::UpdateModule(int pid, const char* moduleName, unsigned long s
         return LIBSYM_ERR_FILE_NOT_RGE;
     }
 
-    MyElf myElf(recordModule);
-    int ret = myElf.LoadMmap();
+    data->moduleType = recordModuleType;
+    int ret = this->LoadModule(*data, recordModule);
     if (ret != SUCCESS) {
         return ret;
     }
-    data->isExecFile = myElf.IsExecFile();
-    data->moduleType = recordModuleType;
-#ifndef ELF_LLVM
-    this->RecordElf(recordModule.c_str());
-#endif
     if (this->moduleMap.find(pid) == this->moduleMap.end()) {
         int ret = RecordModule(pid, recordModuleType);
         if (ret != 0) {
             return ret;
         }
     }
-    auto &modV = moduleMap[pid];
-    bool findModule = false;
-    for (const auto &item : modV) {
-        if (item->moduleName.compare(moduleName) == 0) {
-            findModule = true;
-            break;
-        }
-    }
-    if (!findModule) {
-        auto insertPos = std::lower_bound(modV.begin(), modV.end(), data->start,
-            [](const std::shared_ptr<ModuleMap> &item, unsigned long start) {
-                return item->start < start;
-            });
-        modV.insert(insertPos, data);
+    // Length of the mapping is unknown, so the module is only added if the file is not mapped yet.
+    moduleSafeHandler.tryLock(pid);
+    auto &modules = moduleMap[pid];
+    if (!modules.HasModule(data->moduleName)) {
+        modules.Insert(data);
     }
+    moduleSafeHandler.releaseLock(pid);
     pcerr::New(0, "success");
     return 0;
 }
 
+int SymbolResolve::UpdateModule(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                                unsigned long pgoff, RecordModuleType recordModuleType, unsigned long mapTime,
+                                const std::string& fileId)
+{
+    if (pid < 0) {
+        pcerr::New(LIBSYM_ERR_PARAM_PID_INVALID, "libsym param process ID must be greater than 0");
+        return LIBSYM_ERR_PARAM_PID_INVALID;
+    }
+    // /proc/<pid>/maps is only read on a cold start, and it usually holds the mapping already.
+    if (this->moduleMap.find(pid) == this->moduleMap.end() && RecordModule(pid, recordModuleType) != SUCCESS) {
+        // The process may have exited, and modules are still recorded from mappings.
+        moduleSafeHandler.tryLock(pid);
+        this->moduleMap[pid];
+        moduleSafeHandler.releaseLock(pid);
+    }
+    std::shared_ptr<ModuleMap> data = std::make_shared<ModuleMap>();
+    data->moduleName = moduleName;
+    data->start = startAddr;
+    data->end = startAddr + len;
+    data->fileOffset = pgoff;
+    data->moduleType = recordModuleType;
+    data->mapTime = mapTime;
+    data->fileId = fileId;
+    auto &modules = this->moduleMap.at(pid);
+    const std::string& name = data->moduleName;
+    if (this->FindModuleFile(*data)) {
+        // A file loaded for another process, e.g. in another container, is shared by device and inode.
+        data->mntPid = pid;
+    } else if (name.empty() || name[0] != '/' || name.compare(0, ANON.size(), ANON) == 0) {
+        // Anonymous mappings, e.g. jit code, still replace the modules mapped there before.
+        data->isFile = false;
+    } else {
+        data->mntPoint = GetPidMntPoint(pid);
+        std::string recordModule = data->FilePath();
+        if (IsJitDump(recordModule)) {
+            RecordJitDump(pid, recordModule);
+        }
+        if (SymbolUtils::IsFile(recordModule.c_str())) {
+            this->LoadModuleFile(pid, *data);
+        } else {
+            data->isFile = false;
+        }
+    }
+    moduleSafeHandler.tryLock(pid);
+    modules.Insert(data);
+    moduleSafeHandler.releaseLock(pid);
+    pcerr::New(SUCCESS);
+    return SUCCESS;
+}
+
+int SymbolResolve::ExecModule(int pid, unsigned long time)
+{
+    if (pid < 0) {
+        pcerr::New(LIBSYM_ERR_PARAM_PID_INVALID, "libsym param process ID must be greater than 0");
+        return LIBSYM_ERR_PARAM_PID_INVALID;
+    }
+    // Modules of an unrecorded process are read from /proc/<pid>/maps or mmap records after exec.
+    moduleSafeHandler.tryLock(pid);
+    auto findModules = this->moduleMap.find(pid);
+    if (findModules != this->moduleMap.end()) {
+        findModules->second.Exec(time);
+    }
+    moduleSafeHandler.releaseLock(pid);
+    std::lock_guard<std::mutex> lg(layoutMutex);
+    auto findLayout = this->layoutMap.find(pid);
+    if (findLayout != this->layoutMap.end()) {
+        findLayout->second.Exec(time);
+    }
+    pcerr::New(SUCCESS);
+    return SUCCESS;
+}
+
 struct StackAsm* SymbolResolve::MapAsmCode(const char* moduleName, unsigned long startAddr, unsigned long endAddr)
 {
     struct StackAsm* stackAsm = MapAsmCodeStack(moduleName, startAddr, endAddr);
@@ -967,7 +1875,7 @@ struct Symbol* SymbolResolve::MapCodeAddr(const char* moduleName, unsigned long
             return nullptr;
         }
         if (this->elfMap.find(moduleName) != this->elfMap.end()) {
-            this->SearchElfInfo(this->elfMap.at(moduleName), startAddr, symbol, &symbol->offset);
+            this->SearchElfInfo(*this->elfMap.at(moduleName), startAddr, symbol, &symbol->offset);
             if (symbol->symbolName == UNKNOWN) {
                 auto ResOrErr = Symbolizer.getPLTCode(moduleName, startAddr);
                 if (ResOrErr && ResOrErr->FileName == ".plt") {
@@ -1010,6 +1918,12 @@ struct Symbol* SymbolResolve::MapCodeAddr(const char* moduleName, unsigned long
     return symbol;
 }
 
+static inline size_t NoteAlign(int size)
+{
+    constexpr size_t noteAlign = 4;
+    return (static_cast<size_t>(size) + noteAlign - 1) & ~(noteAlign - 1);
+}
+
 static const void* loadElf(off_t offset, size_t size, size_t lim, void* base) {
     if (offset + size > lim) {
         return nullptr;
@@ -1124,23 +2038,26 @@ int MyElf::ElfParser(char** buildId)
             pcerr::New(LIBSYM_ERR_READ_BUILDID, "load elf data failed");
             return LIBSYM_ERR_READ_BUILDID;
         }
-        auto header = (ElfNoteHeader*)data;
-        auto ptr = (char*)header;
-        ptr += sizeof(*header);
-        char* name = ptr;
-        ptr += header->nameSize;
-        if (header->type == BUILD_ID_TYPE && 
-            header->nameSize == sizeof("GNU") &&
-            memcmp(name, "GNU", header->nameSize) == 0) {
-            char buildIdStr[2*header->descSize + 1];
-            memset(buildIdStr, 0, 2*header->descSize + 1);
-            for (size_t j = 0; j < header->descSize; j++) {
-                sprintf(buildIdStr + j*2, "%02x", ptr[j]);
+        // A note segment may hold several notes, e.g. abi tag and gnu property before build-id.
+        size_t pos = 0;
+        while (pos + sizeof(ElfNoteHeader) <= phdr[i].p_filesz) {
+            auto header = (const ElfNoteHeader*)((const char*)data + pos);
+            const char* name = (const char*)header + sizeof(*header);
+            auto desc = (const unsigned char*)name + NoteAlign(header->nameSize);
+            size_t next = pos + sizeof(*header) + NoteAlign(header->nameSize) + NoteAlign(header->descSize);
+            if (header->nameSize < 0 || header->descSize < 0 || next > phdr[i].p_filesz) {
+                break;
             }
-            buildIdStr[2 * header->descSize] = '\0';
-            *buildId = InitChar(2*header->descSize);
-            strcpy(*buildId, buildIdStr);
-            return SUCCESS;
+            if (header->type == BUILD_ID_TYPE &&
+                header->nameSize == sizeof("GNU") &&
+                memcmp(name, "GNU", header->nameSize) == 0) {
+                *buildId = InitChar(2 * header->descSize);
+                for (int j = 0; j < header->descSize; j++) {
+                    sprintf(*buildId + j * 2, "%02x", desc[j]);
+                }
+                return SUCCESS;
+            }
+            pos = next;
         }
     }
     pcerr::New(LIBSYM_ERR_READ_BUILDID, "can't find buildId");
@@ -1157,64 +2074,35 @@ int SymbolResolve::GetBuildId(const char *moduleName, char **buildId)
     return myElf.ElfGetBuildId(buildId);
 }
 
-struct StackAsm* ReadAsmCodeFromPipe(FILE* pipe)
+std::shared_ptr<AsmDisassembler> SymbolResolve::GetDisassembler(const std::string& moduleName)
 {
-    struct StackAsm* head = nullptr;
-    struct StackAsm* last = nullptr;
-    int lineLen = MAX_LINE_LENGTH;
-    char line[lineLen];
-    std::string srcFileName = "unknown";
-    unsigned int srcLineNum = 0;
-    while (!feof(pipe)) {
-        memset(line, 0, lineLen);
-        if (!fgets(line, lineLen, pipe)) {
-            break;
-        }
-        if (!line || (line && line[0] == '\0') || (line && line[0] == '\n')) {
-            continue;
-        }
-        struct StackAsm* stackAsm = nullptr;
-        if (strstr(line, "File Offset") != nullptr) {
-            stackAsm = FirstLineMatch(line);
-        }
-        if (!stackAsm && head) {
-            if (!CheckColonSuffix(line)) {
-                continue;
-            }
-            if (MatchFileName(line, srcFileName, srcLineNum)) {
-                continue;
-            }
-            AsmCode* asmCode = MatchAsmCode(line, srcFileName, srcLineNum);
-            if (!asmCode) {
-                continue;
-            }
-            struct StackAsm* current = CreateNode<struct StackAsm>();
-            current->funcName = nullptr;
-            current->asmCode = asmCode;
-            last->next = current;
-            last = current;
-            continue;
-        }
-        if (!head && stackAsm) {
-            AddTail<struct StackAsm>(&head, &stackAsm);
-            last = head;
-        }
-        if (stackAsm && head) {
-            last->next = stackAsm;
-            last = stackAsm;
-        }
+    std::lock_guard<std::mutex> lock(disassemblerMutex);
+    auto iter = this->disassemblerMap.find(moduleName);
+    if (iter != this->disassemblerMap.end()) {
+        return iter->second;
     }
-    pclose(pipe);
-    pipe = nullptr;
-    return head;
+    auto disassembler = AsmDisassembler::Create(moduleName);
+    if (disassembler) {
+        this->disassemblerMap[moduleName] = disassembler;
+    }
+    return disassembler;
+}
+
+static struct StackAsm* NewFuncNode(const std::string& name, unsigned long start, unsigned long fileOffset)
+{
+    struct StackAsm* stackAsm = CreateNode<struct StackAsm>();
+    stackAsm->funcName = InitChar(name.size());
+    strcpy(stackAsm->funcName, name.c_str());
+    stackAsm->funcStartAddr = start;
+    stackAsm->functFileOffset = fileOffset;
+    stackAsm->asmCode = nullptr;
+    stackAsm->next = nullptr;
+    return stackAsm;
 }
 
 struct StackAsm* SymbolResolve::MapAsmCodeStack(
         const std::string& moduleName, unsigned long startAddr, unsigned long endAddr)
 {
-    char startAddrStr[ADDR_LEN];
-    char endAddrStr[ADDR_LEN];
-
     if (!ExistPath(moduleName)) {
         pcerr::New(LIBSYM_ERR_FILE_INVALID, "file does not exist");
         return nullptr;
@@ -1224,46 +2112,59 @@ struct StackAsm* SymbolResolve::MapAsmCodeStack(
         pcerr::New(LIBSYM_ERR_START_SMALLER_END, "libysm the end address must be greater than the start address");
         return nullptr;
     }
-    if (snprintf(startAddrStr, ADDR_LEN, "0x%lx", startAddr) < 0) {
-        pcerr::New(LIBSYM_ERR_SNPRINF_OPERATE_FAILED, "libsym fails to execute snprintf");
-        return nullptr;
-    }
 
-    if (snprintf(endAddrStr, ADDR_LEN, "0x%lx", endAddr) < 0) {
-        pcerr::New(LIBSYM_ERR_SNPRINF_OPERATE_FAILED, "libsym fails to execute snprintf");
+    auto disassembler = GetDisassembler(moduleName);
+    if (!disassembler) {
+        pcerr::New(LIBSYM_ERR_ASM_RESOLVE_FAILED, "libsym can't disassemble " + moduleName);
         return nullptr;
     }
+    std::vector<AsmInst> insts;
+    disassembler->Disassemble(startAddr, endAddr, insts);
 
-    std::string cmd = "objdump -Fld " + moduleName + " --start-address=" + std::string{startAddrStr} +
-                      " --stop-address=" + std::string{endAddrStr};
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) {
-        pcerr::New(LIBSYM_ERR_CMD_OPERATE_FAILED,
-                   "libsym fails to obtain the assembly instruction" + std::string{strerror(errno)});
-        return nullptr;
+    struct StackAsm* head = nullptr;
+    struct StackAsm* last = nullptr;
+    const AsmFunc* lastFunc = nullptr;
+    for (const auto& inst : insts) {
+        // Instructions are listed under the function they belong to, as objdump does.
+        const AsmFunc* func = disassembler->FindFunc(inst.addr);
+        if (head == nullptr || (func != nullptr && func != lastFunc)) {
+            unsigned long funcStart = func != nullptr ? func->start : inst.addr;
+            struct StackAsm* funcNode = NewFuncNode(func != nullptr ? func->name : "", funcStart,
+                                                    disassembler->FileOffset(funcStart));
+            if (head == nullptr) {
+                head = funcNode;
+            } else {
+                last->next = funcNode;
+            }
+            last = funcNode;
+            lastFunc = func;
+        }
+        std::string fileName = "unknown";
+        unsigned int lineNum = 0;
+        auto lineOrErr = Symbolizer.symbolizeCode(moduleName, inst.addr);
+        if (lineOrErr && lineOrErr->Line != 0) {
+            fileName = lineOrErr->FileName;
+            lineNum = lineOrErr->Line;
+        } else if (!lineOrErr) {
+            consumeError(lineOrErr.takeError());
+        }
+        struct AsmCode* asmCode = new AsmCode();
+        asmCode->addr = inst.addr;
+        asmCode->code = InitChar(inst.code.size());
+        strcpy(asmCode->code, inst.code.c_str());
+        asmCode->fileName = InitChar(fileName.size());
+        strcpy(asmCode->fileName, fileName.c_str());
+        asmCode->lineNum = lineNum;
+        struct StackAsm* current = CreateNode<struct StackAsm>();
+        current->funcName = nullptr;
+        current->asmCode = asmCode;
+        last->next = current;
+        last = current;
     }
-    struct StackAsm* head = ReadAsmCodeFromPipe(pipe);
     pcerr::New(0, "success");
     return head;
 }
 
-std::vector<std::shared_ptr<ModuleMap>> SymbolResolve::FindDiffMaps(
-        const std::vector<std::shared_ptr<ModuleMap>>& oldMaps,
-        const std::vector<std::shared_ptr<ModuleMap>>& newMaps) const
-{
-    std::vector<std::shared_ptr<ModuleMap>> diffMaps;
-    std::set<unsigned long> oldStarts;
-    for (const auto& oldMod : oldMaps) {
-        oldStarts.insert(oldMod->start);
-    }
-    for (auto newMod : newMaps) {
-        if (oldStarts.find(newMod->start) ==  oldStarts.end()) {
-            diffMaps.emplace_back(newMod);
-        }
-    }
-    return diffMaps;
-}
-
 int SymbolResolve::GetAsmCodeByAddr(const char* moduleName, unsigned long startAddr, unsigned long endAddr, char** asmCode) {
     if (!ExistPath(moduleName)) {
         pcerr::New(LIBSYM_ERR_FILE_INVALID, "libsym can't find the file: " + std::string(moduleName));
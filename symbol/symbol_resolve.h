@@ -17,6 +17,8 @@
 #define USER_SYMBOL_H
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <deque>
+#include <functional>
 #include <mutex>
 #include <unordered_map>
 #include <map>
@@ -32,11 +34,14 @@
 #include <elf++.hh>
 #endif
 #include "symbol.h"
+#include "symbol_index.h"
+#include "jit_dump.h"
 
 using namespace llvm;
 using namespace symbolize;
 
 namespace KUNPENG_SYM {
+    class AsmDisassembler;
 
     enum class RecordModuleType { RECORD_ALL = 0, RECORD_NO_DWARF = 1 };
 
@@ -49,6 +54,125 @@ namespace KUNPENG_SYM {
         bool isExecFile = false;
         RecordModuleType moduleType;
         bool isFile = true;
+        // Identity of the file, which is build-id or device, inode and mtime if there is no build-id.
+        // Processes mapping the same file share symbols resolved by elf address.
+        std::string moduleKey;
+        std::string buildId;
+        // Device and inode of the mapped file from /proc/<pid>/maps or mmap2 records, which are the same in all
+        // mount namespaces.
+        std::string fileId;
+        // Path the file is opened by, which may be under the mount point of another process sharing the file.
+        // mntPoint is always the one of this process, which is reported in symbols.
+        std::string filePath;
+        // Process whose mount point is looked up when it is reported, which is set instead of mntPoint if the file
+        // is shared from another process. -1 if mntPoint is set.
+        int mntPid = -1;
+        // Module which loads the file first, shared by modules of all processes mapping the file.
+        std::shared_ptr<const ModuleMap> loadedFile;
+        // Timestamp of the mmap record. Modules read from /proc/<pid>/maps are 0, i.e. mapped since ever.
+        unsigned long mapTime = 0;
+
+        std::string FilePath() const
+        {
+            if (!filePath.empty()) {
+                return filePath;
+            }
+            return mntPoint.empty() ? moduleName : mntPoint + "/" + moduleName;
+        }
+    };
+
+    /**
+     * Modules of a process, which are non-overlapping address ranges in a balanced tree keyed by start address.
+     * As mmap does, a new mapping replaces the overlapped parts of old ones, so insert and lookup are O(log n).
+     * A module with end 0, whose length is unknown, covers addresses up to the next module.
+     *
+     * Modules replaced by a timestamped mapping, or by exec, are kept in a bounded history. Replacing a file, or
+     * a module of another name, starts a new generation of the layout, and an address sampled at some time is
+     * resolved with the generation valid at that time, so samples can be resolved later than the layout changes.
+     * An anonymous mapping remapped as the same, such as jit code made writable and executable in turn, resolves
+     * to the same symbols and does not start a generation.
+     */
+    class ModuleTree {
+    public:
+        using Iterator = std::map<unsigned long, std::shared_ptr<ModuleMap>>::const_iterator;
+
+        void Insert(const std::shared_ptr<ModuleMap>& module);
+        std::shared_ptr<ModuleMap> Find(unsigned long addr) const;
+        /**
+         * @brief Find module of an address at a timestamp. Time 0 or a time of the current generation finds
+         * the current module, and the current module is also returned if history has no module for the time.
+         */
+        std::shared_ptr<ModuleMap> Find(unsigned long addr, unsigned long time) const;
+        /**
+         * @brief Retire all modules at a timestamp, when the process calls exec and gets a new address space.
+         */
+        void Exec(unsigned long time);
+        bool HasStart(unsigned long start) const;
+        bool HasModule(const std::string& moduleName) const;
+
+        size_t Generation() const
+        {
+            return droppedGens + genTimes.size();
+        }
+
+        size_t GenerationAt(unsigned long time) const;
+
+        /**
+         * @brief Call func with address ranges replaced by generations after gen. Return false if some of them
+         * are dropped, then the whole address space should be taken as replaced.
+         */
+        bool ForEachReplaced(size_t gen, const std::function<void(unsigned long, unsigned long)>& func) const;
+        /**
+         * @brief Call func with modules in history and the timestamps they are replaced at, oldest first.
+         */
+        void ForEachRetired(const std::function<void(const std::shared_ptr<ModuleMap>&, unsigned long)>& func) const;
+        /**
+         * @brief Put a module replaced at unmapTime back to history, e.g. one loaded from a saved layout, and
+         * start a generation there if none starts at that time.
+         */
+        void Restore(const std::shared_ptr<ModuleMap>& module, unsigned long unmapTime);
+
+        bool Empty() const
+        {
+            return modules.empty();
+        }
+
+        Iterator begin() const
+        {
+            return modules.begin();
+        }
+
+        Iterator end() const
+        {
+            return modules.end();
+        }
+
+    private:
+        struct RetiredModule {
+            std::shared_ptr<ModuleMap> module;
+            unsigned long unmapTime;
+        };
+
+        struct ReplacedRange {
+            unsigned long start;
+            unsigned long end;
+        };
+
+        void Add(const std::shared_ptr<ModuleMap>& module);
+        Iterator Erase(Iterator iter);
+        void Retire(const std::shared_ptr<ModuleMap>& module, unsigned long time);
+        void AddGeneration(unsigned long time, unsigned long start, unsigned long end);
+
+        std::map<unsigned long, std::shared_ptr<ModuleMap>> modules;
+        std::unordered_map<std::string, unsigned> nameCount;
+        // Replaced modules in order of replacement, and the oldest ones are dropped if there are too many.
+        std::deque<RetiredModule> history;
+        // Sorted timestamps where generations begin. Records of cpus are read one buffer after another, so they
+        // may come out of order.
+        std::vector<unsigned long> genTimes;
+        // Address ranges of the current layout changed by generations, in order generations are added.
+        std::deque<ReplacedRange> genRanges;
+        size_t droppedGens = 0;
     };
 
 #ifndef ELF_LLVM
@@ -61,15 +185,48 @@ namespace KUNPENG_SYM {
     using ELF_SYM = elf::sym;
     using ELF = elf::elf;
 
+    /**
+     * Function symbols of an elf file, which are flattened into arrays sorted by start address after all
+     * symbols are added, so the elf file is not kept mapped.
+     */
     class ParserElf
     {
     public:
-        explicit ParserElf(const ELF &elf) : elf(elf){};
-        ELF_SYM *FindSymbol(unsigned long addr);
         void Emplace(unsigned long addr, const ELF_SYM &elfSym);
+        void Build();
+        /**
+         * @brief Find the function which an address belongs to. Return -1 if no function covers it.
+         */
+        long FindSymbol(unsigned long addr) const;
+        unsigned long GetStart(long index) const
+        {
+            return starts[index];
+        }
+        unsigned long GetSize(long index) const
+        {
+            return funcs[index].size;
+        }
+        const char *GetName(long index) const
+        {
+            return names.data() + funcs[index].name;
+        }
+        /**
+         * @brief Get demangled name of a function, which is demangled on the first hit and then cached.
+         */
+        std::string GetDemangledName(long index);
     private:
-        ELF elf;
-        std::map<unsigned long, ELF_SYM> symTab;
+        struct ElfFunc {
+            unsigned long size;
+            uint32_t name;
+        };
+        // Start addresses are apart from other fields, so that binary search touches fewer cache lines.
+        std::vector<unsigned long> starts;
+        std::vector<ElfFunc> funcs;
+        // Names terminated with '\0', and functions with the same name share one.
+        std::string names;
+        std::unordered_map<std::string, uint32_t> nameOffsets;
+        std::unordered_map<uint32_t, std::string> demangledNames;
+        std::mutex demangleMutex;
     };
 #endif
 
@@ -124,11 +281,22 @@ namespace KUNPENG_SYM {
         JavaElf() = default;
         explicit JavaElf(int pid) : pid(pid) {};
         JavaElf(int pid, const std::string& perfMapPath) : pid(pid), perfMapPath(perfMapPath) {};
-        int FindElf(unsigned long addr, struct JavaEntry& entry);
+        int FindElf(unsigned long addr, struct JavaEntry& entry) const;
+        /**
+         * Read lines appended to the perf map since the last call, and call <replaced> with address ranges of
+         * methods removed by them.
+         */
+        void LoadNewEntries(const std::function<void(unsigned long, unsigned long)>& replaced);
     private:
-        volatile bool hasLoad = false;
+        void AddEntry(const JavaEntry& entry, const std::function<void(unsigned long, unsigned long)>& replaced);
+
         int pid = -1;
         std::string perfMapPath;
+        // The perf map is appended by jvm, and only lines after readOffset are read when it grows.
+        off_t readOffset = 0;
+        ino_t inode = 0;
+        // Non-overlapping methods keyed by start address. A method compiled later at a reused address of code cache
+        // removes the old ones it overlaps.
         std::map<unsigned long, JavaEntry> symbolList;
     };
 
@@ -137,9 +305,10 @@ namespace KUNPENG_SYM {
     using SYMBOL_MAP = std::unordered_map<pid_t, std::unordered_map<__u64, struct Symbol *>>;
     using SYMBOL_UNMAP = std::vector<Symbol*>;
     using STACK_MAP = std::unordered_map<pid_t, std::unordered_map<std::string, struct Stack*>>;
-    using MODULE_MAP = std::unordered_map<pid_t, std::vector<std::shared_ptr<ModuleMap>>>;
+    using MODULE_MAP = std::unordered_map<pid_t, ModuleTree>;
+    using MODULE_SYMBOL_MAP = std::unordered_map<std::string, std::unordered_map<unsigned long, struct Symbol *>>;
 #ifndef ELF_LLVM
-    using ELF_MAP = std::unordered_map<std::string, ParserElf>;
+    using ELF_MAP = std::unordered_map<std::string, std::shared_ptr<ParserElf>>;
 #endif
 
     class SymbolUtils final {
@@ -172,14 +341,66 @@ namespace KUNPENG_SYM {
         int RecordKernel();
         int UpdateModule(int pid, RecordModuleType recordModuleType);
         int UpdateModule(int pid, const char* moduleName, unsigned long startAddr, RecordModuleType recordModuleType);
+        /**
+         * Record a mapping from a PERF_RECORD_MMAP or PERF_RECORD_MMAP2 record without reading /proc/<pid>/maps,
+         * which is only read once if the process has not been recorded. <fileId> is device and inode of mmap2,
+         * by which files shared with other processes are found.
+         */
+        int UpdateModule(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                         unsigned long pgoff, RecordModuleType recordModuleType, unsigned long mapTime = 0,
+                         const std::string& fileId = "");
+        /**
+         * Retire modules and the layout of a process at the timestamp of its exec, which is ignored if the process
+         * is not recorded.
+         */
+        int ExecModule(int pid, unsigned long time);
+        /**
+         * Read jit code of a process compiled since the last update from its perf map and jitdump, and drop symbols
+         * cached for code replaced by it.
+         */
+        int UpdateJitCode(int pid);
         void Clear();
-        std::shared_ptr<ModuleMap> AddrToModule(std::vector<std::shared_ptr<ModuleMap>>& processModule, unsigned long addr);
-        struct Stack* StackToHash(int pid, unsigned long* stack, int nr);
-        struct Symbol* MapAddr(int pid, unsigned long addr);
+        std::shared_ptr<ModuleMap> AddrToModule(const ModuleTree& processModule, unsigned long addr,
+                                                unsigned long time = 0);
+        /**
+         * Convert ips to a stack. If <resolve> is false, symbols only hold addresses, which can be resolved later.
+         * If <time> is not 0, addresses are resolved with modules mapped at that time.
+         */
+        struct Stack* StackToHash(int pid, unsigned long* stack, int nr, bool resolve = true, unsigned long time = 0);
+        struct Symbol* MapAddr(int pid, unsigned long addr, unsigned long time = 0);
+        /**
+         * Find the module of a user address, and convert the address to the one in elf file of the module,
+         * which is the same as the address to search symbols. Return nullptr for kernel and anonymous memory.
+         */
+        std::shared_ptr<ModuleMap> MapModuleAddr(int pid, unsigned long addr, unsigned long &elfAddr,
+                                                 unsigned long time = 0);
+        /**
+         * Mount point of the process mapping <module>, which is looked up on the first call if the module shares
+         * the file of another process.
+         */
+        std::string ModuleMntPoint(const ModuleMap& module);
         struct StackAsm* MapAsmCode(const char* moduleName, unsigned long startAddr, unsigned long endAddr);
         struct Symbol* MapCodeAddr(const char* moduleName, unsigned long startAddr);
         int GetBuildId(const char *moduleName, char **buildId);
         int GetAsmCodeByAddr(const char* moduleName, unsigned long startAddr, unsigned long endAddr, char** asmCode);
+        int SetCacheDir(const char* dir);
+        /**
+         * Record address ranges, file offsets, paths and build-ids of modules of a process without loading elf and
+         * dwarf. /proc/<pid>/maps is read once, and modules mapped later are recorded by UpdateModuleLayout.
+         */
+        int RecordModuleLayout(int pid);
+        /**
+         * Record a mapping of a process from a PERF_RECORD_MMAP or PERF_RECORD_MMAP2 record in its layout, which
+         * is the same as UpdateModule without loading elf and dwarf.
+         */
+        int UpdateModuleLayout(int pid, const char* moduleName, unsigned long startAddr, unsigned long len,
+                               unsigned long pgoff, unsigned long mapTime, const std::string& fileId);
+        int SaveLayout(const char* path);
+        /**
+         * Record modules of processes and kernel symbols from a saved layout, so that addresses captured on the
+         * saved host can be resolved as RESOLVE_ELF_DWARF does. Files are searched under <rootDir> if it is given.
+         */
+        int LoadLayout(const char* path, const char* rootDir);
 #ifndef ELF_LLVM
         int RecordElf(const char* fileName);
 #endif
@@ -189,16 +410,71 @@ namespace KUNPENG_SYM {
 #endif
         char* GetCharFromStr(const std::string& str);
         struct Symbol* MapKernelAddr(unsigned long addr);
-        struct Symbol* MapUserAddr(int pid, unsigned long addr);
+        struct Symbol* MapUserAddr(int pid, unsigned long addr, unsigned long time);
+        void UnmapSymbols(std::unordered_map<__u64, struct Symbol*>& symbols,
+                          std::vector<std::pair<unsigned long, unsigned long>>& ranges);
+        struct Symbol* MapModuleSymbol(const ModuleMap& module, unsigned long addr);
+        bool FindModuleSymbol(const std::string& key, unsigned long elfAddr, struct Symbol* symbol, bool withDwarf);
+        void AddModuleSymbol(const std::string& key, unsigned long elfAddr, const struct Symbol* symbol);
+        bool LoadSymbolIndex(const ModuleMap& module, const std::string& path);
+        bool FindIndexSymbol(const ModuleMap& module, unsigned long elfAddr, struct Symbol* symbol, bool withDwarf);
         struct StackAsm* MapAsmCodeStack(const std::string& moduleName, unsigned long startAddr, unsigned long endAddr);
-        std::vector<std::shared_ptr<ModuleMap>> FindDiffMaps(const std::vector<std::shared_ptr<ModuleMap>>& oldMaps,
-                                                             const std::vector<std::shared_ptr<ModuleMap>>& newMaps) const;
+        std::shared_ptr<AsmDisassembler> GetDisassembler(const std::string& moduleName);
+        int LoadModule(ModuleMap& module, const std::string& path);
+        void LoadPidModule(int pid, ModuleMap& module);
+        void LoadModuleFile(int pid, ModuleMap& module);
+        bool FindModuleFile(ModuleMap& module);
+        int ReadModuleLayout(int pid);
+        void LoadLayoutModule(ModuleMap& module);
+        std::string GetPidMntPoint(int pid);
+        void RecordJitDump(int pid, const std::string& path);
+        bool FindJitEntry(int pid, unsigned long addr, JavaEntry& entry);
         std::map<int, JavaElf> javaElfArr;
+        // Jitdump files of processes, which are found from mappings of jit-<pid>.dump made by jit agents.
+        std::map<int, std::shared_ptr<JitDump>> jitDumpArr;
         std::map<std::string, char*> strToCharMap;
         SYMBOL_MAP symbolMap{};
+        // Generations of layouts which symbols of processes in symbolMap are resolved with.
+        std::unordered_map<pid_t, size_t> symbolGenMap;
+        // Symbols resolved from files, which are keyed by module key and elf address and shared by processes.
+        MODULE_SYMBOL_MAP moduleSymbolMap{};
+        std::mutex moduleSymbolMutex;
+        // Symbol indexes mapped from cache directory, which are keyed by build-id.
+        std::string cacheDir;
+        std::unordered_map<std::string, std::shared_ptr<SymbolIndex>> symbolIndexMap;
+        std::mutex symbolIndexMutex;
+        // Disassemblers of files, which are created by the first request of a file.
+        std::unordered_map<std::string, std::shared_ptr<AsmDisassembler>> disassemblerMap;
+        std::mutex disassemblerMutex;
         SYMBOL_UNMAP symbolUnmap{};
         STACK_MAP stackMap{};
         MODULE_MAP moduleMap{};
+        struct ModuleFile {
+            std::weak_ptr<const ModuleMap> module;
+            // Device, inode and mtime of the path when the file is loaded, which tell a file replaced later.
+            std::string stamp;
+        };
+        // Files loaded for modules, which are keyed by fileId. A file is dropped once no module refers to it.
+        struct ModuleFiles {
+            std::unordered_map<std::string, ModuleFile> files;
+            size_t sweepSize = 0;
+        };
+        bool FindModuleFile(ModuleMap& module, ModuleFiles& moduleFiles);
+        void AddModuleFile(ModuleMap& module, const std::string& path, ModuleFiles& moduleFiles);
+        // Processes in containers mapping the same file reuse the path and symbols of the first process, instead of
+        // looking up their own mount points.
+        ModuleFiles moduleFiles;
+        std::mutex moduleFileMutex;
+        // Mount points of processes, which are looked up once when a module of the process is not loaded yet, or
+        // the mount point of a module sharing the file of another process is reported.
+        std::unordered_map<int, std::string> mntPointMap;
+        std::mutex mntPointMutex;
+        // Module layouts of processes to be saved for offline resolving, which are not used to resolve symbols.
+        MODULE_MAP layoutMap{};
+        // Files of layouts, whose build-ids are read once. They are not shared with moduleFiles, since their
+        // symbols are not loaded.
+        ModuleFiles layoutFiles;
+        std::mutex layoutMutex;
         std::vector<std::shared_ptr<Symbol>> ksymArray;
         SymbolResolve()
         {}
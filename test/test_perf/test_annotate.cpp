@@ -0,0 +1,63 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: Unit tests for annotating instructions with samples.
+ ******************************************************************************/
+#include "test_common.h"
+#include <sys/time.h>
+
+using namespace std;
+
+TEST(PmuAnnotate, CountSamplesOfInstructions)
+{
+    // Samples of this process in a libc function, whose first frames are resolved as collection does.
+    pid_t pid = getpid();
+    ASSERT_EQ(SymResolverRecordModuleNoDwarf(pid), SUCCESS);
+    unsigned long addr = reinterpret_cast<unsigned long>(&getitimer);
+    Symbol *func = SymResolverMapAddr(pid, addr);
+    ASSERT_NE(func, nullptr);
+    ASSERT_NE(func->module, nullptr);
+    string module = func->module;
+    unsigned long start = func->codeMapAddr - func->offset;
+    unsigned long end = func->codeMapEndAddr;
+    unsigned long runStart = addr - func->offset;
+    ASSERT_LT(start, end);
+
+    Symbol symbols[2] = {};
+    symbols[0].addr = runStart;
+    // Not in the range of annotated code.
+    symbols[1].addr = runStart + (end - start);
+    Stack stacks[2] = {};
+    stacks[0].symbol = &symbols[0];
+    stacks[1].symbol = &symbols[1];
+    PmuData data[3] = {};
+    for (int i = 0; i < 3; ++i) {
+        data[i].pid = pid;
+        data[i].tid = pid;
+        data[i].stack = &stacks[i == 2 ? 1 : 0];
+    }
+    struct StackAsm *head = PmuAnnotate(data, 3, module.c_str(), start, end);
+    ASSERT_NE(head, nullptr);
+    unsigned long total = 0;
+    bool hasStart = false;
+    for (struct StackAsm *node = head; node != nullptr; node = node->next) {
+        if (node->asmCode == nullptr) {
+            continue;
+        }
+        if (node->asmCode->addr == start) {
+            hasStart = true;
+            ASSERT_EQ(node->asmCode->count, 2);
+        }
+        total += node->asmCode->count;
+    }
+    ASSERT_TRUE(hasStart);
+    ASSERT_EQ(total, 2);
+    FreeAsmStack(head);
+}
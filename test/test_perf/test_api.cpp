@@ -12,9 +12,13 @@
  * Create: 2024-04-24
  * Description: Unit tests for api functions.
  ******************************************************************************/
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <fstream>
+#include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <linux/version.h>
 #include "util_time.h"
 #include "process_map.h"
@@ -415,6 +419,76 @@ TEST_F(TestAPI, InvalidSampleRate)
     ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_SAMPLE_RATE);
 }
 
+TEST_F(TestAPI, GetChildTidAndTopology)
+{
+    auto pid = RunTestApp("test_12threads");
+    sleep(1); // Wait for all threads to start
+    int numChildTid = 0;
+    int* childTidList = GetChildTid(pid, &numChildTid);
+    ASSERT_NE(childTidList, nullptr);
+    // Main thread and 12 threads.
+    ASSERT_EQ(numChildTid, 13);
+    for (int i = 0; i < numChildTid; ++i) {
+        // The second lookup is served by the topology cache and should be the same.
+        for (int round = 0; round < 2; ++round) {
+            ProcTopology* topo = GetProcTopology(childTidList[i]);
+            ASSERT_NE(topo, nullptr);
+            ASSERT_EQ(topo->pid, pid);
+            ASSERT_EQ(topo->tid, childTidList[i]);
+            ASSERT_STREQ(topo->comm, "test_12threads");
+            FreeProcTopo(topo);
+        }
+    }
+    delete[] childTidList;
+    KillApp(pid);
+}
+
+TEST_F(TestAPI, TopologyCacheRereadsRenamedComm)
+{
+    pid_t tid = 0;
+    bool renamed = false;
+    bool done = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread worker([&]() {
+        std::unique_lock<std::mutex> lk(mtx);
+        tid = syscall(SYS_gettid);
+        prctl(PR_SET_NAME, "topo_before");
+        cv.notify_all();
+        cv.wait(lk, [&]() { return renamed; });
+        prctl(PR_SET_NAME, "topo_after");
+        done = true;
+        cv.notify_all();
+        cv.wait(lk, [&]() { return tid == 0; });
+    });
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        cv.wait(lk, [&]() { return tid != 0; });
+    }
+    ProcTopology* topo = GetProcTopology(tid);
+    ASSERT_NE(topo, nullptr);
+    ASSERT_STREQ(topo->comm, "topo_before");
+    FreeProcTopo(topo);
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        renamed = true;
+        cv.notify_all();
+        cv.wait(lk, [&]() { return done; });
+    }
+    // No comm record is seen, and the cached comm is read again after it expires.
+    sleep(2);
+    topo = GetProcTopology(tid);
+    ASSERT_NE(topo, nullptr);
+    EXPECT_STREQ(topo->comm, "topo_after");
+    FreeProcTopo(topo);
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        tid = 0;
+        cv.notify_all();
+    }
+    worker.join();
+}
+
 TEST_F(TestAPI, TestRaiseNumFd)
 {
     // Given (setup)
@@ -785,9 +859,10 @@ TEST_F(TestAPI, InvalidBpfAttr)
     attr.enableBpf = 1;
     pd = PmuOpen(COUNTING, &attr);
     ASSERT_NE(pd, -1);
+    attr.blockedSample = 1;
     pd = PmuOpen(SAMPLING, &attr);
-    PmuClose(pd);
     ASSERT_EQ(pd, -1);
+    attr.blockedSample = 0;
     EvtAttr evtAttr[1] = {1};
     attr.evtAttr = evtAttr;
     attr.numEvtAttr = 1;
@@ -803,6 +878,27 @@ TEST_F(TestAPI, InvalidBpfAttr)
 #endif
 }
 
+TEST_F(TestAPI, InvalidIncludeChildCgroup)
+{
+    PmuAttr attr = {0};
+    char *evtList[1];
+    evtList[0] = (char *)"cycles";
+    attr.evtList = evtList;
+    attr.numEvt = 1;
+    int pidList[1] = {0};
+    attr.pidList = pidList;
+    attr.numPid = 1;
+    // Only bpf counting of cgroups can report child cgroups.
+    attr.includeChildCgroup = 1;
+    pd = PmuOpen(COUNTING, &attr);
+    ASSERT_EQ(pd, -1);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_BPF_PARAM);
+    attr.enableBpf = 1;
+    pd = PmuOpen(COUNTING, &attr);
+    ASSERT_EQ(pd, -1);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_BPF_PARAM);
+}
+
 TEST_F(TestAPI, TestEnableExeOnFailed)
 {
     PmuAttr attr = {0};
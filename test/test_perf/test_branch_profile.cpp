@@ -0,0 +1,186 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: Unit tests for branch records and branch profiles.
+ ******************************************************************************/
+#include "test_common.h"
+#include <sstream>
+#include "pmu_event.h"
+#include "branch_profile.h"
+
+using namespace std;
+
+TEST(BranchPool, RecordsStayValidAcrossSlabs)
+{
+    using namespace KUNPENG_PMU;
+    EventData eventData;
+    vector<PmuDataExt *> exts;
+    // Enough records to fill several slabs, with a branch stack larger than the first slab.
+    for (unsigned long i = 0; i < 2000; ++i) {
+        unsigned long nr = i == 1 ? 8192 : 32;
+        auto *ext = GetBranchPool(eventData).Alloc(nr);
+        ASSERT_EQ(ext->nr, nr);
+        for (unsigned long j = 0; j < nr; ++j) {
+            ext->branchRecords[j].fromAddr = i;
+            ext->branchRecords[j].toAddr = j;
+        }
+        exts.push_back(ext);
+    }
+    for (unsigned long i = 0; i < exts.size(); ++i) {
+        ASSERT_EQ(exts[i]->branchRecords[0].fromAddr, i);
+        ASSERT_EQ(exts[i]->branchRecords[exts[i]->nr - 1].fromAddr, i);
+        ASSERT_EQ(exts[i]->branchRecords[exts[i]->nr - 1].toAddr, exts[i]->nr - 1);
+    }
+}
+
+class FakeBranchProfile : public KUNPENG_PMU::BranchProfile {
+public:
+    explicit FakeBranchProfile(const PmuBranchProfileAttr &attr) : BranchProfile(attr)
+    {}
+
+    // Identity and mount point of /usr/bin/app mapped by following samples.
+    std::string buildId = "b1";
+    std::string mntPoint;
+
+protected:
+    static constexpr unsigned long LOAD_ADDR = 0x400000;
+    static constexpr unsigned long FUNC_ADDR = 0x1000;
+
+    bool MapAddr(int pid, unsigned long addr, unsigned &moduleId, unsigned long &elfAddr) override
+    {
+        if (addr < LOAD_ADDR || addr >= LOAD_ADDR * 2) {
+            return false;
+        }
+        moduleId = GetModuleId(buildId, "/usr/bin/app", mntPoint + "/usr/bin/app");
+        elfAddr = addr - LOAD_ADDR;
+        return true;
+    }
+
+    std::string MapSymbol(const std::string &modulePath, unsigned long elfAddr, unsigned long &offset) override
+    {
+        if (elfAddr < FUNC_ADDR) {
+            return "";
+        }
+        offset = elfAddr - FUNC_ADDR;
+        return "main";
+    }
+};
+
+static PmuData BranchSample(BranchSampleRecord *records, unsigned long nr, PmuDataExt &ext)
+{
+    ext.nr = nr;
+    ext.branchRecords = records;
+    PmuData data = {0};
+    data.pid = 1;
+    data.ext = &ext;
+    return data;
+}
+
+TEST(BranchProfile, AggregateBranchesAndRanges)
+{
+    PmuBranchProfileAttr attr = {0};
+    FakeBranchProfile profile(attr);
+    // The newest record is the first. The last branch is from a library, which is ignored.
+    BranchSampleRecord records[] = {
+        {0x401050, 0x401100, 0, 0, 1},
+        {0x401020, 0x401040, 0, 1, 0},
+        {0x400800, 0x401000, 0, 0, 1},
+        {0x7f0000001000, 0x400700, 0, 0, 1},
+    };
+    PmuDataExt ext;
+    PmuData data[] = {BranchSample(records, 4, ext), BranchSample(records, 4, ext)};
+    profile.Add(data, 2);
+
+    std::stringstream autoFdo;
+    ASSERT_TRUE(profile.Write("/usr/bin/app", PMU_PROFILE_AUTOFDO, autoFdo));
+    ASSERT_EQ(autoFdo.str(), "3\n700-800:2\n1000-1020:2\n1040-1050:2\n0\n3\n800->1000:2\n1020->1040:2\n1050->1100:2\n");
+
+    std::stringstream bolt;
+    ASSERT_TRUE(profile.Write("/usr/bin/app", PMU_PROFILE_BOLT, bolt));
+    ASSERT_EQ(bolt.str(), "0 [unknown] 800 1 main 0 0 2\n"
+                          "1 main 20 1 main 40 2 2\n"
+                          "1 main 50 1 main 100 0 2\n");
+    std::stringstream other;
+    ASSERT_FALSE(profile.Write("/usr/lib64/libc.so.6", PMU_PROFILE_AUTOFDO, other));
+}
+
+TEST(BranchProfile, SplitBinariesByIdentity)
+{
+    PmuBranchProfileAttr attr = {0};
+    FakeBranchProfile profile(attr);
+    auto addBranch = [&profile](const std::string &buildId, const std::string &mntPoint, unsigned long to) {
+        profile.buildId = buildId;
+        profile.mntPoint = mntPoint;
+        BranchSampleRecord record = {0x401010, to, 0, 0, 1};
+        PmuDataExt ext;
+        PmuData data = BranchSample(&record, 1, ext);
+        profile.Add(&data, 1);
+    };
+    // Two builds of the binary in two containers, and the second one is rebuilt during profiling.
+    addBranch("b1", "/proc/100/root", 0x401100);
+    addBranch("b2", "/proc/200/root", 0x401200);
+    addBranch("b3", "/proc/200/root", 0x401300);
+
+    // Name is ambiguous, and each binary is written by its path.
+    std::stringstream byName;
+    ASSERT_FALSE(profile.Write("/usr/bin/app", PMU_PROFILE_AUTOFDO, byName));
+    std::stringstream first;
+    ASSERT_TRUE(profile.Write("/proc/100/root/usr/bin/app", PMU_PROFILE_AUTOFDO, first));
+    ASSERT_EQ(first.str(), "0\n0\n1\n1010->1100:1\n");
+    std::stringstream second;
+    ASSERT_TRUE(profile.Write("/proc/200/root/usr/bin/app", PMU_PROFILE_AUTOFDO, second));
+    ASSERT_EQ(second.str(), "0\n0\n1\n1010->1300:1\n");
+}
+
+TEST(BranchProfile, KeepHotBranchesInBoundedMemory)
+{
+    PmuBranchProfileAttr attr = {0};
+    attr.maxEntries = 8;
+    FakeBranchProfile profile(attr);
+    BranchSampleRecord hot = {0x401010, 0x401100, 0, 0, 1};
+    PmuDataExt hotExt;
+    PmuData hotData = BranchSample(&hot, 1, hotExt);
+    for (unsigned long i = 0; i < 100; ++i) {
+        BranchSampleRecord cold = {0x402000 + i * 0x10, 0x403000, 0, 0, 1};
+        PmuDataExt coldExt;
+        PmuData coldData = BranchSample(&cold, 1, coldExt);
+        profile.Add(&coldData, 1);
+        profile.Add(&hotData, 1);
+        profile.Add(&hotData, 1);
+    }
+
+    std::stringstream autoFdo;
+    ASSERT_TRUE(profile.Write("/usr/bin/app", PMU_PROFILE_AUTOFDO, autoFdo));
+    std::string line;
+    std::getline(autoFdo, line);
+    ASSERT_EQ(line, "0");
+    std::getline(autoFdo, line);
+    std::getline(autoFdo, line);
+    unsigned branchNum = std::stoul(line);
+    ASSERT_LE(branchNum, attr.maxEntries);
+    bool hasHot = false;
+    while (std::getline(autoFdo, line)) {
+        hasHot = hasHot || line.find("1010->1100:") == 0;
+    }
+    ASSERT_TRUE(hasHot);
+}
+
+TEST(BranchProfile, InvalidHandle)
+{
+    ASSERT_EQ(PmuBranchProfileOpen(nullptr), nullptr);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_NULL_POINTER);
+    PmuBranchProfileAttr attr = {0};
+    auto profile = PmuBranchProfileOpen(&attr);
+    ASSERT_NE(profile, nullptr);
+    ASSERT_EQ(PmuBranchProfileWrite(profile, "/usr/bin/app", PMU_PROFILE_BOLT, "/tmp/app.fdata"),
+              LIBPERF_ERR_BRANCH_PROFILE_NO_MODULE);
+    PmuBranchProfileClose(profile);
+    ASSERT_EQ(PmuBranchProfileAdd(profile, nullptr, 0), LIBPERF_ERR_INVALID_BRANCH_PROFILE);
+}
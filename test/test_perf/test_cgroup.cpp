@@ -69,9 +69,18 @@ public:
             demoPid = 0;
         }
 
+        if (!childCgroupPath.empty()) {
+            RemoveCgroup(childCgroupPath);
+            childCgroupPath.clear();
+        }
+        RemoveCgroup(testCgroupPath);
+    }
+
+    void RemoveCgroup(const string &path)
+    {
         int removeErrno = 0;
         for (int retry = 0; retry < tryTimes; ++retry) {
-            if (rmdir(testCgroupPath.c_str()) == 0 || errno == ENOENT) {
+            if (rmdir(path.c_str()) == 0 || errno == ENOENT) {
                 removeErrno = 0;
                 break;
             }
@@ -82,7 +91,7 @@ public:
             usleep(tryUsleep);
         }
         if (removeErrno != 0) {
-            ADD_FAILURE() << "Failed to remove cgroup " << testCgroupPath << ": " << strerror(removeErrno);
+            ADD_FAILURE() << "Failed to remove cgroup " << path << ": " << strerror(removeErrno);
         }
     }
 
@@ -111,6 +120,7 @@ protected:
     static const int pdNums = 2;
     int pds[pdNums] = {0};
     PmuData *data = nullptr;
+    string childCgroupPath;
 };
 
 pid_t TestCgroup::demoPid;
@@ -202,3 +212,46 @@ TEST_F(TestCgroup, TestCgroupSPE)
     ASSERT_STREQ(data[0].cgroupName, "TestCgroupSPE");
     ASSERT_GT(data[0].period, 0);
 }
+
+#ifdef BPF_ENABLED
+TEST_F(TestCgroup, TestChildCgroupRollUp)
+{
+    ASSERT_EQ(mkdir(testCgroupPath.c_str(), 0755), 0) << strerror(errno);
+    childCgroupPath = testCgroupPath + "/child";
+    ASSERT_EQ(mkdir(childCgroupPath.c_str(), 0755), 0) << strerror(errno);
+    ofstream ofs(childCgroupPath + "/cgroup.procs");
+    ofs << demoPid;
+    ofs.close();
+
+    auto attr = GetPmuAttribute();
+    char* cgroupName[1];
+    cgroupName[0] = (char*)"TestChildCgroupRollUp";
+    attr.cgroupNameList = cgroupName;
+    attr.numCgroup = 1;
+    attr.enableBpf = 1;
+    attr.includeChildCgroup = 1;
+
+    pd = PmuOpen(COUNTING, &attr);
+    ASSERT_NE(pd, -1);
+    // Read twice, so that names of child cgroups are also checked after the first read.
+    for (int i = 0; i < 2; ++i) {
+        int ret = PmuCollect(pd, 1000, collectInterval);
+        ASSERT_EQ(ret, SUCCESS);
+        if (data != nullptr) {
+            PmuDataFree(data);
+            data = nullptr;
+        }
+        int len = PmuRead(pd, &data);
+        ASSERT_GT(len, 0);
+        uint64_t childCount = 0;
+        for (int j = 0; j < len; ++j) {
+            ASSERT_NE(data[j].cgroupName, nullptr);
+            if (strcmp(data[j].cgroupName, "TestChildCgroupRollUp/child") == 0) {
+                childCount += data[j].count;
+            }
+        }
+        // The process only runs in the child cgroup, its counts are reported by the registered parent.
+        ASSERT_GT(childCount, 0);
+    }
+}
+#endif
@@ -0,0 +1,129 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: Unit tests for unwinding user stacks with dwarf cfi.
+ ******************************************************************************/
+#include "test_common.h"
+#include <elf.h>
+#include <climits>
+#include <fstream>
+#include "dwarf_unwind.h"
+
+using namespace std;
+
+class MapsUnwinder : public KUNPENG_PMU::DwarfUnwinder {
+protected:
+    // Find module of an address by /proc/self/maps, without records of symbol resolver.
+    std::shared_ptr<const KUNPENG_PMU::CfiTable> FindTable(int pid, unsigned long addr,
+                                                           unsigned long &elfAddr) override
+    {
+        std::ifstream maps("/proc/self/maps");
+        std::string line;
+        while (std::getline(maps, line)) {
+            unsigned long start = 0;
+            unsigned long end = 0;
+            unsigned long offset = 0;
+            char path[PATH_MAX] = {0};
+            if (sscanf(line.c_str(), "%lx-%lx %*s %lx %*s %*s %s", &start, &end, &offset, path) != 4 ||
+                addr < start || addr >= end || path[0] != '/') {
+                continue;
+            }
+            auto &table = tables[path];
+            if (!table) {
+                table = KUNPENG_PMU::CfiTable::Load(path);
+            }
+            elfAddr = IsExec(path) ? addr : addr - start + offset;
+            return table;
+        }
+        return nullptr;
+    }
+
+private:
+    static bool IsExec(const char *path)
+    {
+        Elf64_Ehdr ehdr;
+        std::ifstream elf(path, std::ios::binary);
+        return elf.read(reinterpret_cast<char *>(&ehdr), sizeof(ehdr)) && ehdr.e_type == ET_EXEC;
+    }
+
+    std::unordered_map<std::string, std::shared_ptr<KUNPENG_PMU::CfiTable>> tables;
+};
+
+struct StackSnapshot {
+    KUNPENG_PMU::UnwindRegs regs;
+    std::vector<char> stack;
+    unsigned long returnAddrs[2];
+};
+
+static constexpr size_t STACK_SNAPSHOT_SIZE = 4096;
+
+static __attribute__((noinline, no_sanitize_address)) void CaptureStack(StackSnapshot &snapshot)
+{
+    uint64_t pc = 0;
+    uint64_t sp = 0;
+    uint64_t fp = 0;
+    uint64_t lr = 0;
+#if defined(__x86_64__)
+    asm volatile("lea 0(%%rip), %0\n\tmov %%rsp, %1\n\tmov %%rbp, %2" : "=r"(pc), "=r"(sp), "=r"(fp));
+#elif defined(__aarch64__)
+    asm volatile("adr %0, .\n\tmov %1, sp\n\tmov %2, x29\n\tmov %3, x30" : "=r"(pc), "=r"(sp), "=r"(fp), "=r"(lr));
+#endif
+    snapshot.regs.pc = pc;
+    snapshot.regs.sp = sp;
+    snapshot.regs.fp = fp;
+    snapshot.regs.lr = lr;
+    // Stack is copied like the kernel does, which includes frames of all callers.
+    snapshot.stack.resize(STACK_SNAPSHOT_SIZE);
+    auto *src = reinterpret_cast<const volatile char *>(sp);
+    for (size_t i = 0; i < STACK_SNAPSHOT_SIZE; ++i) {
+        snapshot.stack[i] = src[i];
+    }
+    snapshot.returnAddrs[0] = reinterpret_cast<unsigned long>(__builtin_return_address(0));
+}
+
+static __attribute__((noinline)) void CaptureInCallee(StackSnapshot &snapshot)
+{
+    CaptureStack(snapshot);
+    snapshot.returnAddrs[1] = reinterpret_cast<unsigned long>(__builtin_return_address(0));
+}
+
+static __attribute__((noinline)) void CaptureInCaller(StackSnapshot &snapshot)
+{
+    CaptureInCallee(snapshot);
+    asm volatile("" ::: "memory");
+}
+
+TEST(DwarfUnwind, LoadCfiOfExecutable)
+{
+    auto table = KUNPENG_PMU::CfiTable::Load("/proc/self/exe");
+    ASSERT_NE(table, nullptr);
+    ASSERT_GT(table->Size(), 0);
+    ASSERT_EQ(KUNPENG_PMU::CfiTable::Load("/proc/self/maps"), nullptr);
+}
+
+TEST(DwarfUnwind, UnwindFromRegsAndStack)
+{
+#if defined(__x86_64__) || defined(__aarch64__)
+    StackSnapshot snapshot;
+    CaptureInCaller(snapshot);
+    MapsUnwinder unwinder;
+    std::vector<unsigned long> frames;
+    unwinder.Unwind(getpid(), snapshot.regs, snapshot.stack.data(), snapshot.stack.size(), frames);
+    ASSERT_GE(frames.size(), 3);
+    ASSERT_EQ(frames[0], snapshot.regs.pc);
+    ASSERT_EQ(frames[1], snapshot.returnAddrs[0]);
+    ASSERT_EQ(frames[2], snapshot.returnAddrs[1]);
+
+    // Frames stop where the stack copy ends.
+    frames.clear();
+    unwinder.Unwind(getpid(), snapshot.regs, snapshot.stack.data(), 0, frames);
+    ASSERT_LE(frames.size(), 2);
+#endif
+}
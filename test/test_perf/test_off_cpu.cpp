@@ -0,0 +1,103 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: Unit tests for attributing off-cpu time of blocked threads.
+ ******************************************************************************/
+#include "test_common.h"
+#include <memory>
+#include "off_cpu.h"
+
+using namespace std;
+
+static PmuData MakeBlockedData(const char *evt, int tid, int64_t ts, uint64_t period)
+{
+    PmuData data = {0};
+    data.evt = evt;
+    data.pid = tid;
+    data.tid = tid;
+    data.ts = ts;
+    data.period = period;
+    return data;
+}
+
+TEST(OffCpuTracker, AttributeBlockingAcrossReads)
+{
+    using namespace KUNPENG_PMU;
+    OffCpuTracker tracker;
+    const char *cycles = "cycles";
+    const char *cs = "context-switches";
+    // 1000 cycles per 100 ns on cpu, then thread blocks at 300 and wakes up at 800 in the next read.
+    EventData first;
+    first.data = {MakeBlockedData(cycles, 10, 100, 1000), MakeBlockedData(cycles, 10, 200, 1000),
+                  MakeBlockedData(cs, 10, 300, 1), MakeBlockedData(cycles, 11, 500, 1000)};
+    first.sampleIps.resize(first.data.size());
+    first.switchData = {PmuSwitchData{10, 10, 300, 0, 1}};
+    // Strings and ext of the first read are freed with it.
+    unique_ptr<string> comm(new string("blocked"));
+    PmuDataExt ext = {0};
+    first.data[2].comm = comm->c_str();
+    first.data[2].ext = &ext;
+    tracker.Process(first, NO_SYMBOL_RESOLVE);
+    ASSERT_EQ(first.data.size(), 4);
+    // Off-cpu time until the last record of this read.
+    ASSERT_EQ(first.data[2].period, 2000);
+    ASSERT_TRUE(first.switchData.empty());
+    comm.reset();
+
+    EventData second;
+    second.data = {MakeBlockedData(cycles, 10, 900, 1000)};
+    second.sampleIps.resize(second.data.size());
+    second.switchData = {PmuSwitchData{10, 10, 800, 0, 0}};
+    tracker.Process(second, NO_SYMBOL_RESOLVE);
+    // The rest of off-cpu time is carried by a copy of the sample.
+    ASSERT_EQ(second.data.size(), 2);
+    ASSERT_EQ(second.sampleIps.size(), 2);
+    ASSERT_STREQ(second.data[1].evt, cs);
+    ASSERT_EQ(second.data[1].tid, 10);
+    ASSERT_EQ(second.data[1].ts, 800);
+    ASSERT_EQ(second.data[1].period, 3000);
+    ASSERT_STREQ(second.data[1].comm, "blocked");
+    ASSERT_EQ(second.data[1].ext, nullptr);
+}
+
+TEST(OffCpuTracker, DropThreadExitedWhileBlocked)
+{
+    using namespace KUNPENG_PMU;
+    OffCpuTracker tracker;
+    const char *cycles = "cycles";
+    const char *cs = "context-switches";
+    EventData first;
+    first.data = {MakeBlockedData(cycles, 10, 100, 1000), MakeBlockedData(cycles, 10, 200, 1000),
+                  MakeBlockedData(cs, 10, 300, 1), MakeBlockedData(cycles, 11, 500, 1000)};
+    first.sampleIps.resize(first.data.size());
+    first.switchData = {PmuSwitchData{10, 10, 300, 0, 1}};
+    tracker.Process(first, NO_SYMBOL_RESOLVE);
+    ASSERT_EQ(first.data[2].period, 2000);
+
+    // The thread is killed without switching in, and is off cpu until its exit.
+    EventData second;
+    second.data = {MakeBlockedData(cycles, 11, 900, 1000)};
+    second.sampleIps.resize(second.data.size());
+    second.switchData = {PmuSwitchData{10, 10, 700, 0, 0, 1}};
+    tracker.Process(second, NO_SYMBOL_RESOLVE);
+    ASSERT_EQ(second.data.size(), 2);
+    ASSERT_EQ(second.data[1].tid, 10);
+    ASSERT_EQ(second.data[1].ts, 700);
+    ASSERT_EQ(second.data[1].period, 2000);
+
+    // Later reads carry nothing of the exited thread.
+    for (int64_t ts = 1000; ts < 5000; ts += 1000) {
+        EventData next;
+        next.data = {MakeBlockedData(cycles, 11, ts, 1000)};
+        next.sampleIps.resize(next.data.size());
+        tracker.Process(next, NO_SYMBOL_RESOLVE);
+        ASSERT_EQ(next.data.size(), 1);
+    }
+}
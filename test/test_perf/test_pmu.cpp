@@ -130,6 +130,83 @@ TEST_F(TestPMU, PmuProcCollect12Threads)
     ASSERT_TRUE(FoundAllTids(data, len, appPid));
 }
 
+TEST_F(TestPMU, PmuProcCollect12ThreadsPerThread)
+{
+    // Start a 12-thread process.
+    // Threads are created on startup.
+    appPid = RunTestApp("test_12threads");
+    sleep(1);
+    pid_t pidList[1] = {appPid};
+    auto attr = GetProcAttribute(pidList, 1);
+    // Each thread owns its ring buffer, no output is redirected.
+    attr.perThread = 1;
+    int len = Collect(attr, &data);
+    ASSERT_TRUE(data != nullptr);
+    // Check all threads are sampled.
+    ASSERT_TRUE(FoundAllTids(data, len, appPid));
+}
+
+TEST_F(TestPMU, PmuProcCollect12ThreadsPerCpu)
+{
+    // Start a 12-thread process.
+    // Threads are created on startup.
+    appPid = RunTestApp("test_12threads");
+    sleep(1);
+    pid_t pidList[1] = {appPid};
+    auto attr = GetProcAttribute(pidList, 1);
+    // One cpu-wide event per cpu, samples of other processes are dropped.
+    attr.perCpuSample = 1;
+    int len = Collect(attr, &data);
+    ASSERT_TRUE(data != nullptr);
+    for (int i = 0; i < len; ++i) {
+        ASSERT_EQ(data[i].pid, appPid);
+    }
+    // Check all threads are sampled.
+    ASSERT_TRUE(FoundAllTids(data, len, appPid));
+}
+
+TEST_F(TestPMU, PmuProcCollectWithOverheadBudget)
+{
+    appPid = RunTestApp("test_12threads");
+    pid_t pidList[1] = {appPid};
+    auto attr = GetProcAttribute(pidList, 1);
+    attr.useFreq = 0;
+    attr.period = 1000;
+    // 0.01% of one cpu, which is far below the cost of draining so many samples.
+    attr.overheadBudget = 1;
+    int len = Collect(attr, &data, 2);
+    ASSERT_TRUE(data != nullptr);
+    uint64_t maxPeriod = 0;
+    for (int i = 0; i < len; ++i) {
+        ASSERT_GT(data[i].period, 0);
+        maxPeriod = max(maxPeriod, data[i].period);
+    }
+    // Period should be enlarged by the controller.
+    ASSERT_GT(maxPeriod, attr.period);
+}
+
+#ifdef BPF_ENABLED
+TEST_F(TestPMU, PmuProcCollectBpfAggregation)
+{
+    appPid = RunTestApp("test_12threads");
+    pid_t pidList[1] = {appPid};
+    auto attr = GetProcAttribute(pidList, 1);
+    attr.callStack = 1;
+    attr.enableBpf = 1;
+    int len = Collect(attr, &data);
+    ASSERT_GT(len, 0);
+    uint64_t samples = 0;
+    for (int i = 0; i < len; ++i) {
+        // Each row is an aggregated call stack of the target process.
+        ASSERT_EQ(data[i].pid, appPid);
+        ASSERT_GT(data[i].count, 0);
+        ASSERT_GE(data[i].period, data[i].count);
+        samples += data[i].count;
+    }
+    ASSERT_GT(samples, static_cast<uint64_t>(len));
+}
+#endif
+
 TEST_F(TestPMU, PmuSystemCollectSubProc)
 {
     // Start a process that will for child.
@@ -12,8 +12,14 @@
  * Create: 2024-04-24
  * Description: Common functions for spe sampling.
  ******************************************************************************/
+#include <climits>
+#include <dirent.h>
+#include <fstream>
 #include "test_common.h"
 #include "common.h"
+#include "spe.h"
+#include "arm_spe_decoder.h"
+#include "cpu_map.h"
 
 using namespace std;
 
@@ -169,6 +175,35 @@ TEST_F(TestSPE, SpeProcCollectSubProc)
     ASSERT_TRUE(FoundAllChildren(data, len, appPid));
 }
 
+TEST_F(TestSPE, SpeCollectWithSmallAuxBuffer)
+{
+    appPid = RunTestApp("test_12threads");
+    pid_t pidList[1] = {appPid};
+    auto attr = GetProcAttribute(pidList, 1);
+    attr.auxPages = 4;
+    attr.auxWatermark = sysconf(_SC_PAGESIZE);
+    // Records are decoded chunk by chunk and handed over at each collect interval.
+    int len = SpeCollect(attr, &data, 2);
+    ASSERT_GT(len, 0);
+    for (int i = 0; i < len; ++i) {
+        ASSERT_EQ(data[i].pid, appPid);
+    }
+}
+
+TEST_F(TestSPE, InvalidAuxSize)
+{
+    auto attr = GetSystemAttribute();
+    attr.auxPages = 3;
+    pd = PmuOpen(SPE_SAMPLING, &attr);
+    ASSERT_EQ(pd, -1);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_AUX_SIZE);
+    attr.auxPages = 1;
+    attr.auxWatermark = sysconf(_SC_PAGESIZE);
+    pd = PmuOpen(SPE_SAMPLING, &attr);
+    ASSERT_EQ(pd, -1);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_AUX_SIZE);
+}
+
 TEST_F(TestSPE, SpeProcCollect100000threadCase)
 {
     appPid = RunTestApp("test_100000thread");
@@ -187,3 +222,277 @@ TEST_F(TestSPE, SpeProcCollect100000threadCase)
     PmuDataFree(data);
     PmuClose(pd);
 }
+
+static void PutSpePacket(vector<uint8_t> &buf, uint8_t header, uint64_t payload, int size)
+{
+    buf.push_back(header);
+    for (int i = 0; i < size; ++i) {
+        buf.push_back(static_cast<uint8_t>(payload >> (8 * i)));
+    }
+}
+
+TEST(SpeDecoder, DecodeRecordsWithoutHardware)
+{
+    vector<uint8_t> buf;
+    // The first record, ended by timestamp.
+    PutSpePacket(buf, 0xB0, 0x00f0000000400000ULL, 8);  // pc in kernel space
+    PutSpePacket(buf, 0x98, 0x123, 2);                  // total latency
+    PutSpePacket(buf, 0x65, 1234, 4);                   // context id
+    buf.push_back(0x20);                                // extended header of previous branch target
+    PutSpePacket(buf, 0xB4, 0xdeadbeef, 8);
+    buf.insert(buf.end(), 21, 0);                       // padding
+    PutSpePacket(buf, 0x71, 5678, 8);                   // timestamp
+    // The second record, ended by END packet.
+    PutSpePacket(buf, 0x49, 0x1, 1);                    // store
+    PutSpePacket(buf, 0xB2, 0x0000ffff00001000ULL, 8);  // virtual address
+    buf.push_back(0x01);
+    // A packet cut off at the end of buffer.
+    PutSpePacket(buf, 0xB0, 0, 3);
+    buf.pop_back();
+
+    vector<SpeRecord> records(SPE_CHUNK_RECORDS + 1);
+    uint8_t *pos = buf.data();
+    uint8_t *end = buf.data() + buf.size();
+    int remain = SPE_CHUNK_RECORDS;
+    SpeRecord *recEnd = SpeGetRecord(&pos, end, records.data(), &remain);
+    ASSERT_EQ(recEnd - records.data(), 2);
+    ASSERT_EQ(remain, SPE_CHUNK_RECORDS - 2);
+    ASSERT_EQ(pos, end);
+    ASSERT_EQ(records[0].pc, 0xfff0000000400000ULL);
+    ASSERT_EQ(records[0].lat, 0x123);
+    ASSERT_EQ(records[0].tid, 1234);
+    ASSERT_EQ(records[0].timestamp, 5678);
+    ASSERT_EQ(records[1].tid, static_cast<uint64_t>(-1));
+    ASSERT_EQ(records[1].opType, SPE_OP_LDST | SPE_OP_ST);
+    ASSERT_EQ(records[1].va, 0x0000ffff00001000ULL);
+}
+
+TEST(SpeDecoder, ExtendedHeaderAtEndOfBuffer)
+{
+    vector<uint8_t> buf;
+    PutSpePacket(buf, 0x71, 5678, 8);                   // timestamp
+    buf.push_back(0x20);                                // extended header without its second byte
+
+    // Copy to a buffer of exact size, so that reading beyond the end is caught by sanitizers.
+    unique_ptr<uint8_t[]> exact(new uint8_t[buf.size()]);
+    copy(buf.begin(), buf.end(), exact.get());
+    vector<SpeRecord> records(SPE_CHUNK_RECORDS + 1);
+    uint8_t *pos = exact.get();
+    uint8_t *end = exact.get() + buf.size();
+    int remain = SPE_CHUNK_RECORDS;
+    SpeRecord *recEnd = SpeGetRecord(&pos, end, records.data(), &remain);
+    ASSERT_EQ(recEnd - records.data(), 1);
+    ASSERT_EQ(pos, end);
+    ASSERT_EQ(records[0].timestamp, 5678);
+}
+
+TEST(MemHeatmap, FoldSamplesByWindow)
+{
+    PmuMemHeatmapAttr attr = {0};
+    attr.pageSize = 4096;
+    attr.cacheLineSize = 64;
+    attr.topN = 1;
+    PmuMemHeatmap heatmap = PmuMemHeatmapOpen(&attr);
+    ASSERT_NE(heatmap, nullptr);
+
+    // Three loads in the same cache line, one remote store in another page, and one sample without address.
+    PmuDataExt exts[5] = {};
+    PmuData data[5] = {};
+    unsigned long vas[5] = {0x10000, 0x10008, 0x10010, 0x20000, 0};
+    for (int i = 0; i < 5; ++i) {
+        exts[i].va = vas[i];
+        exts[i].lat = 10 * (i + 1);
+        exts[i].source = HIP_L3;
+        exts[i].op = SPE_OP_LD;
+        data[i].pid = 100;
+        data[i].cpu = -1;
+        data[i].ts = 1000 + i;
+        data[i].ext = &exts[i];
+    }
+    exts[3].op = SPE_OP_ST;
+    exts[3].source = 0xffff;
+    exts[3].event = SPE_EV_REMOTE_ACCESS;
+    ASSERT_EQ(PmuMemHeatmapAdd(heatmap, data, 5), SUCCESS);
+
+    PmuMemHeatmapData *heat = nullptr;
+    ASSERT_EQ(PmuMemHeatmapRead(heatmap, &heat), SUCCESS);
+    ASSERT_EQ(heat->samples, 4);
+    ASSERT_EQ(heat->beginTs, 1000);
+    ASSERT_EQ(heat->endTs, 1003);
+    ASSERT_EQ(heat->numPages, 1);
+    ASSERT_EQ(heat->pages[0].va, 0x10000);
+    ASSERT_EQ(heat->pages[0].samples, 3);
+    ASSERT_EQ(heat->numLines, 1);
+    ASSERT_EQ(heat->lines[0].samples, 3);
+    ASSERT_EQ(heat->lines[0].maxLat, 30);
+    ASSERT_EQ(heat->numSources, 1);
+    ASSERT_EQ(heat->sources[0].source, HIP_L3);
+    ASSERT_EQ(heat->sources[0].samples, 3);
+    uint64_t remote = 0;
+    for (unsigned i = 0; i < heat->numNodes; ++i) {
+        remote += heat->nodes[i].remote;
+    }
+    ASSERT_EQ(remote, 1);
+    PmuMemHeatmapDataFree(heat);
+
+    // A new window starts after read.
+    ASSERT_EQ(PmuMemHeatmapRead(heatmap, &heat), SUCCESS);
+    ASSERT_EQ(heat->samples, 0);
+    ASSERT_EQ(heat->numPages, 0);
+    PmuMemHeatmapDataFree(heat);
+    PmuMemHeatmapClose(heatmap);
+    ASSERT_EQ(PmuMemHeatmapAdd(heatmap, data, 5), LIBPERF_ERR_INVALID_HEATMAP);
+}
+
+TEST(MemHeatmap, InvalidAttr)
+{
+    PmuMemHeatmapAttr attr = {0};
+    attr.cacheLineSize = 48;
+    ASSERT_EQ(PmuMemHeatmapOpen(&attr), nullptr);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_HEATMAP_ATTR);
+    attr.pageSize = 64;
+    attr.cacheLineSize = 128;
+    ASSERT_EQ(PmuMemHeatmapOpen(&attr), nullptr);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_HEATMAP_ATTR);
+}
+
+TEST(MemHeatmap, NodeOfPhysicalAddress)
+{
+    // Take a memory block of node 0, which covers physical address [block * blockSize, (block + 1) * blockSize).
+    unsigned long blockSize = 0;
+    ifstream sizeFile("/sys/devices/system/memory/block_size_bytes");
+    sizeFile >> hex >> blockSize;
+    unsigned long block = ULONG_MAX;
+    DIR *dir = opendir("/sys/devices/system/node/node0");
+    if (dir != nullptr) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr && block == ULONG_MAX) {
+            if (sscanf(entry->d_name, "memory%lu", &block) != 1) {
+                block = ULONG_MAX;
+            }
+        }
+        closedir(dir);
+    }
+    if (blockSize == 0 || block == ULONG_MAX) {
+        GTEST_SKIP() << "no memory block of numa node 0";
+    }
+    unsigned long pa = block * blockSize + blockSize / 2;
+    ASSERT_EQ(GetNumaNodeOfPhysAddr(pa), 0);
+
+    int cpu = 0;
+    int cpuNum = sysconf(_SC_NPROCESSORS_CONF);
+    while (cpu < cpuNum && GetNumaNodeOfCpu(cpu) != 0) {
+        ++cpu;
+    }
+    ASSERT_LT(cpu, cpuNum);
+    PmuMemHeatmapAttr attr = {0};
+    PmuMemHeatmap heatmap = PmuMemHeatmapOpen(&attr);
+    ASSERT_NE(heatmap, nullptr);
+    PmuDataExt ext = {};
+    ext.va = 0x10000;
+    ext.pa = pa;
+    ext.op = SPE_OP_LD;
+    ext.source = HIP_L3;
+    PmuData data = {};
+    data.pid = 100;
+    data.cpu = cpu;
+    data.ext = &ext;
+    ASSERT_EQ(PmuMemHeatmapAdd(heatmap, &data, 1), SUCCESS);
+
+    PmuMemHeatmapData *heat = nullptr;
+    ASSERT_EQ(PmuMemHeatmapRead(heatmap, &heat), SUCCESS);
+    ASSERT_EQ(heat->numPages, 1);
+    ASSERT_EQ(heat->pages[0].pa, pa);
+    ASSERT_EQ(heat->pages[0].nodeId, 0);
+    // Memory and cpu are in the same node.
+    ASSERT_EQ(heat->numNodes, 1);
+    ASSERT_EQ(heat->nodes[0].nodeId, 0);
+    ASSERT_EQ(heat->nodes[0].local, 1);
+    ASSERT_EQ(heat->nodes[0].remote, 0);
+    PmuMemHeatmapDataFree(heat);
+    PmuMemHeatmapClose(heatmap);
+}
+
+TEST(Contention, DetectFalseSharingByWindow)
+{
+    PmuContentionAttr attr = {0};
+    attr.windowMs = 5;
+    attr.shards = 4;
+    PmuContention contention = PmuContentionOpen(&attr);
+    ASSERT_NE(contention, nullptr);
+
+    // Thread 1 stores to the first field and thread 2 loads the second field of a line, in 3 windows.
+    // Both threads store to another line only in one window, which is below minConflictWindows.
+    char writer[] = "writer";
+    char reader[] = "reader";
+    char module[] = "/usr/bin/app";
+    Symbol symbols[2] = {};
+    symbols[0] = {0x400100, module, writer, writer, nullptr, 0, 0x10, 0, 0x400100, 0, nullptr};
+    symbols[1] = {0x400200, module, reader, reader, nullptr, 0, 0x20, 0, 0x400200, 0, nullptr};
+    Stack stacks[2] = {};
+    stacks[0].symbol = &symbols[0];
+    stacks[1].symbol = &symbols[1];
+    const int num = 8;
+    PmuDataExt exts[num] = {};
+    PmuData data[num] = {};
+    for (int i = 0; i < num; ++i) {
+        bool isWriter = i % 2 == 0;
+        exts[i].va = isWriter ? 0x10000 : 0x10008;
+        exts[i].op = isWriter ? SPE_OP_ST : SPE_OP_LD;
+        exts[i].source = isWriter ? 0xffff : HIP_PEER_CPU_HITM;
+        data[i].pid = 100;
+        data[i].tid = isWriter ? 101 : 102;
+        data[i].cpu = isWriter ? 0 : 1;
+        data[i].ts = (i / 2) * 5000000 + 1000;
+        data[i].stack = &stacks[isWriter ? 0 : 1];
+        data[i].ext = &exts[i];
+    }
+    exts[6].va = 0x20000;
+    exts[7].va = 0x20000;
+    exts[7].op = SPE_OP_ST;
+    ASSERT_EQ(PmuContentionAdd(contention, data, 4), SUCCESS);
+    ASSERT_EQ(PmuContentionAdd(contention, data + 4, num - 4), SUCCESS);
+
+    PmuContentionData *contentionData = nullptr;
+    ASSERT_EQ(PmuContentionRead(contention, &contentionData), SUCCESS);
+    ASSERT_EQ(contentionData->samples, num);
+    ASSERT_EQ(contentionData->numLines, 1);
+    auto &line = contentionData->lines[0];
+    ASSERT_EQ(line.pid, 100);
+    ASSERT_EQ(line.va, 0x10000);
+    ASSERT_EQ(line.kind, PMU_FALSE_SHARING);
+    ASSERT_EQ(line.conflictWindows, 3);
+    ASSERT_EQ(line.score, 3);
+    ASSERT_EQ(line.evidence, 3);
+    ASSERT_EQ(line.numParticipants, 2);
+    for (unsigned i = 0; i < line.numParticipants; ++i) {
+        auto &participant = line.participants[i];
+        bool isWriter = participant.tid == 101;
+        ASSERT_STREQ(participant.symbolName, isWriter ? "writer" : "reader");
+        ASSERT_STREQ(participant.module, "/usr/bin/app");
+        ASSERT_EQ(participant.offset, isWriter ? 0x10 : 0x20);
+        ASSERT_EQ(participant.byteMask, isWriter ? 0xfULL : 0xf00ULL);
+        ASSERT_EQ(participant.reads, isWriter ? 0 : 3);
+        ASSERT_EQ(participant.writes, isWriter ? 3 : 0);
+    }
+    PmuContentionDataFree(contentionData);
+
+    // A new period starts after read.
+    ASSERT_EQ(PmuContentionRead(contention, &contentionData), SUCCESS);
+    ASSERT_EQ(contentionData->samples, 0);
+    ASSERT_EQ(contentionData->numLines, 0);
+    PmuContentionDataFree(contentionData);
+    PmuContentionClose(contention);
+    ASSERT_EQ(PmuContentionAdd(contention, data, num), LIBPERF_ERR_INVALID_CONTENTION);
+}
+
+TEST(Contention, InvalidAttr)
+{
+    PmuContentionAttr attr = {0};
+    attr.cacheLineSize = 48;
+    ASSERT_EQ(PmuContentionOpen(&attr), nullptr);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_CONTENTION_ATTR);
+    attr.cacheLineSize = 128;
+    ASSERT_EQ(PmuContentionOpen(&attr), nullptr);
+    ASSERT_EQ(Perrorno(), LIBPERF_ERR_INVALID_CONTENTION_ATTR);
+}
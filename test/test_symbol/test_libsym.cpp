@@ -17,7 +17,13 @@
 #include <map>
 #include <iostream>
 #include <linux/types.h>
+#include <fcntl.h>
+#include <fstream>
 #include <link.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+#include <sys/time.h>
 #include <thread>
 #include <stdio.h>
 #include "pcerrc.h"
@@ -423,9 +429,15 @@ TEST_F(TestLibSym, map_asm_code)
     auto lineObj = lineMap.begin();
     Symbol *symbol = SymResolverMapCodeAddr(fileName.c_str(), lineObj->first);
 
-    struct StackAsm *stackAsm =
-        SymResolverAsmCode(fileName.c_str(), symbol->codeMapAddr - symbol->offset, symbol->codeMapEndAddr);
-    EXPECT_TRUE(stackAsm != nullptr);
+    unsigned long start = symbol->codeMapAddr - symbol->offset;
+    struct StackAsm *stackAsm = SymResolverAsmCode(fileName.c_str(), start, symbol->codeMapEndAddr);
+    ASSERT_TRUE(stackAsm != nullptr);
+    // The listing starts with the function and its first instruction.
+    ASSERT_TRUE(stackAsm->funcName != nullptr);
+    ASSERT_EQ(stackAsm->funcStartAddr, start);
+    ASSERT_TRUE(stackAsm->next != nullptr && stackAsm->next->asmCode != nullptr);
+    ASSERT_EQ(stackAsm->next->asmCode->addr, start);
+    ASSERT_GT(stackAsm->next->asmCode->lineNum, 0);
     CoutAsmCode(stackAsm);
     FreeSymbolPtr(symbol);
     FreeAsmStack(stackAsm);
@@ -489,6 +501,479 @@ TEST(symbol, get_asm_code_failed)
     EXPECT_TRUE(stackAsm == nullptr);
 }
 
+TEST(symbol, share_module_symbols_across_processes)
+{
+    pid_t child = fork();
+    if (child == 0) {
+        pause();
+        _exit(0);
+    }
+    SymResolverInit();
+    pid_t pid = getpid();
+    ASSERT_EQ(SymResolverRecordModuleNoDwarf(pid), 0);
+    ASSERT_EQ(SymResolverRecordModuleNoDwarf(child), 0);
+    // The forked process maps libc at the same address.
+    unsigned long addr = reinterpret_cast<unsigned long>(&getitimer);
+    unsigned long elfAddr = 0;
+    unsigned long childElfAddr = 0;
+    auto module = SymbolResolve::GetInstance()->MapModuleAddr(pid, addr, elfAddr);
+    auto childModule = SymbolResolve::GetInstance()->MapModuleAddr(child, addr, childElfAddr);
+    ASSERT_TRUE(module != nullptr && childModule != nullptr);
+    ASSERT_FALSE(module->moduleKey.empty());
+    ASSERT_EQ(module->moduleKey, childModule->moduleKey);
+    ASSERT_EQ(elfAddr, childElfAddr);
+    // The file of child is found by device and inode, and opened by the same path.
+    ASSERT_FALSE(module->fileId.empty());
+    ASSERT_EQ(module->fileId, childModule->fileId);
+    ASSERT_EQ(module->FilePath(), childModule->FilePath());
+    // Mount point of child is not looked up until it is reported.
+    ASSERT_EQ(childModule->mntPid, child);
+    ASSERT_EQ(childModule->loadedFile, module->loadedFile);
+    ASSERT_EQ(SymbolResolve::GetInstance()->ModuleMntPoint(*childModule),
+              SymbolResolve::GetInstance()->ModuleMntPoint(*module));
+
+    // A mapping from mmap2 record shares the file by device and inode as well.
+    struct stat st;
+    ASSERT_EQ(stat(module->FilePath().c_str(), &st), 0);
+    const unsigned long mmapStart = 0x10000000;
+    ASSERT_EQ(SymResolverUpdateModuleMmap2TimeNoDwarf(child, module->moduleName.c_str(), mmapStart,
+                                                      module->end - module->start, module->fileOffset,
+                                                      major(st.st_dev), minor(st.st_dev), st.st_ino, 1), 0);
+    unsigned long mmapElfAddr = 0;
+    auto mmapModule = SymbolResolve::GetInstance()->MapModuleAddr(child, mmapStart + addr - module->start,
+                                                                  mmapElfAddr, 2);
+    ASSERT_TRUE(mmapModule != nullptr);
+    ASSERT_EQ(mmapModule->fileId, module->fileId);
+    ASSERT_EQ(mmapModule->moduleKey, module->moduleKey);
+    ASSERT_EQ(mmapElfAddr, elfAddr);
+
+    auto symbol = SymResolverMapAddr(pid, addr);
+    auto childSymbol = SymResolverMapAddr(child, addr);
+    ASSERT_TRUE(symbol != nullptr && childSymbol != nullptr);
+    // Each process has its own symbol, and the one of child is copied from the resolved one.
+    ASSERT_NE(symbol, childSymbol);
+    ASSERT_STREQ(childSymbol->symbolName, symbol->symbolName);
+    ASSERT_EQ(childSymbol->offset, symbol->offset);
+    ASSERT_EQ(childSymbol->codeMapAddr, elfAddr);
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+}
+
+TEST(symbol, reload_module_file_changed_after_loaded)
+{
+    char path[] = "/tmp/libkperf_modfile_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    {
+        std::ifstream in("/proc/self/exe", std::ios::binary);
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << in.rdbuf();
+    }
+    struct stat st;
+    ASSERT_EQ(stat(path, &st), 0);
+    SymResolverInit();
+    pid_t pid = getpid();
+    ASSERT_EQ(SymResolverRecordModuleNoDwarf(pid), 0);
+    const unsigned long firstStart = 0x10000000;
+    const unsigned long secondStart = 0x20000000;
+    ASSERT_EQ(SymResolverUpdateModuleMmap2TimeNoDwarf(pid, path, firstStart, st.st_size, 0, major(st.st_dev),
+                                                      minor(st.st_dev), st.st_ino, 1), 0);
+    // The file is rewritten in place, so it keeps device and inode but not mtime.
+    struct timespec times[2] = {{0, UTIME_OMIT}, {st.st_mtim.tv_sec + 10, 0}};
+    ASSERT_EQ(utimensat(AT_FDCWD, path, times, 0), 0);
+    ASSERT_EQ(SymResolverUpdateModuleMmap2TimeNoDwarf(pid, path, secondStart, st.st_size, 0, major(st.st_dev),
+                                                      minor(st.st_dev), st.st_ino, 2), 0);
+    unsigned long elfAddr = 0;
+    auto first = SymbolResolve::GetInstance()->MapModuleAddr(pid, firstStart, elfAddr, 3);
+    auto second = SymbolResolve::GetInstance()->MapModuleAddr(pid, secondStart, elfAddr, 3);
+    ASSERT_TRUE(first != nullptr && second != nullptr);
+    ASSERT_EQ(first->fileId, second->fileId);
+    // The changed file is loaded again instead of sharing the one loaded before.
+    ASSERT_NE(first->loadedFile, nullptr);
+    ASSERT_NE(second->loadedFile, first->loadedFile);
+    ASSERT_EQ(second->mntPid, -1);
+    SymResolverDestroy();
+    unlink(path);
+}
+
+TEST(symbol, map_user_addr_from_symbol_index_cache)
+{
+    char cacheDir[] = "/tmp/libkperf_symidx_XXXXXX";
+    ASSERT_NE(mkdtemp(cacheDir), nullptr);
+    unsigned long addr = reinterpret_cast<unsigned long>(&getitimer);
+    pid_t pid = getpid();
+    std::string indexFile;
+    // The first run builds the index of libc, and the second one maps it.
+    for (int run = 0; run < 2; ++run) {
+        SymResolverDestroy();
+        SymResolverInit();
+        ASSERT_EQ(SymResolverSetCacheDir(cacheDir), SUCCESS);
+        ASSERT_EQ(SymResolverRecordModuleNoDwarf(pid), SUCCESS);
+        unsigned long elfAddr = 0;
+        auto module = SymbolResolve::GetInstance()->MapModuleAddr(pid, addr, elfAddr);
+        ASSERT_TRUE(module != nullptr);
+        if (module->buildId.empty()) {
+            break;
+        }
+        indexFile = std::string(cacheDir) + "/" + module->buildId + ".symidx";
+        ASSERT_EQ(access(indexFile.c_str(), R_OK), 0);
+        auto symbol = SymResolverMapAddr(pid, addr);
+        ASSERT_TRUE(symbol != nullptr);
+        ASSERT_TRUE(strstr(symbol->symbolName, SELECT_FUNC) != nullptr);
+        ASSERT_EQ(symbol->offset, 0);
+    }
+    SymResolverDestroy();
+    if (!indexFile.empty()) {
+        unlink(indexFile.c_str());
+    }
+    rmdir(cacheDir);
+}
+
+TEST(symbol, resolve_raw_stack_from_saved_layout)
+{
+    char layoutFile[] = "/tmp/libkperf_layout_XXXXXX";
+    int fd = mkstemp(layoutFile);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    pid_t pid = getpid();
+    unsigned long addr = reinterpret_cast<unsigned long>(&getitimer);
+    SymResolverDestroy();
+    SymResolverInit();
+    ASSERT_EQ(SymResolverRecordModuleLayout(pid), SUCCESS);
+    auto rawStack = RawStackToHash(pid, &addr, 1);
+    ASSERT_TRUE(rawStack != nullptr && rawStack->symbol != nullptr);
+    ASSERT_EQ(rawStack->symbol->addr, addr);
+    ASSERT_STREQ(rawStack->symbol->symbolName, "UNKNOWN");
+    ASSERT_EQ(SymResolverSaveLayout(layoutFile), SUCCESS);
+
+    // Resolve with a new resolver, which knows nothing about the process except the layout.
+    SymResolverDestroy();
+    SymResolverInit();
+    ASSERT_EQ(SymResolverLoadLayout(layoutFile, nullptr), SUCCESS);
+    auto stack = StackToHash(pid, &addr, 1);
+    ASSERT_TRUE(stack != nullptr && stack->symbol != nullptr);
+    ASSERT_TRUE(strstr(stack->symbol->symbolName, SELECT_FUNC) != nullptr);
+    ASSERT_EQ(SymResolverLoadLayout("/proc/self/maps", nullptr), LIBSYM_ERR_LAYOUT_INVALID);
+    SymResolverDestroy();
+    unlink(layoutFile);
+}
+
+TEST(symbol, resolve_replaced_module_from_saved_layout)
+{
+    char layoutFile[] = "/tmp/libkperf_layout_XXXXXX";
+    int fd = mkstemp(layoutFile);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    char* exe = realpath("/proc/self/exe", nullptr);
+    ASSERT_NE(exe, nullptr);
+    std::string path = exe;
+    free(exe);
+    struct stat st;
+    ASSERT_EQ(stat(path.c_str(), &st), 0);
+    pid_t pid = getpid();
+    const unsigned long start = 0x30000000;
+    SymResolverDestroy();
+    SymResolverInit();
+    ASSERT_EQ(SymResolverRecordModuleLayout(pid), SUCCESS);
+    // The file is mapped at time 100 and replaced by anonymous memory at time 200.
+    ASSERT_EQ(SymResolverUpdateLayoutMmap2Time(pid, path.c_str(), start, st.st_size, 0, major(st.st_dev),
+                                               minor(st.st_dev), st.st_ino, 100), SUCCESS);
+    ASSERT_EQ(SymResolverUpdateLayoutMmap2Time(pid, "//anon", start, st.st_size, 0, 0, 0, 0, 200), SUCCESS);
+    ASSERT_EQ(SymResolverSaveLayout(layoutFile), SUCCESS);
+
+    SymResolverDestroy();
+    SymResolverInit();
+    ASSERT_EQ(SymResolverLoadLayout(layoutFile, nullptr), SUCCESS);
+    unsigned long elfAddr = 0;
+    auto module = SymbolResolve::GetInstance()->MapModuleAddr(pid, start + 0x10, elfAddr, 150);
+    ASSERT_TRUE(module != nullptr);
+    ASSERT_EQ(module->moduleName, path);
+    ASSERT_EQ(module->mapTime, 100);
+    ASSERT_EQ(SymbolResolve::GetInstance()->MapModuleAddr(pid, start + 0x10, elfAddr, 250), nullptr);
+    SymResolverDestroy();
+    unlink(layoutFile);
+}
+
+static std::shared_ptr<ModuleMap> MakeMapping(const std::string& name, unsigned long start, unsigned long end,
+                                              unsigned long offset)
+{
+    auto module = std::make_shared<ModuleMap>();
+    module->moduleName = name;
+    module->start = start;
+    module->end = end;
+    module->fileOffset = offset;
+    return module;
+}
+
+TEST(symbol, module_tree_replaces_overlapped_mappings)
+{
+    ModuleTree modules;
+    modules.Insert(MakeMapping("/lib/a.so", 0x1000, 0x5000, 0));
+    modules.Insert(MakeMapping("/lib/b.so", 0x8000, 0x9000, 0));
+    ASSERT_EQ(modules.Find(0x1800)->moduleName, "/lib/a.so");
+    ASSERT_EQ(modules.Find(0x6000), nullptr);
+    ASSERT_EQ(modules.Find(0x800), nullptr);
+
+    // A mapping in the middle of a.so splits it, and the tail keeps its file offset.
+    modules.Insert(MakeMapping("//anon", 0x2000, 0x3000, 0));
+    ASSERT_EQ(modules.Find(0x1fff)->moduleName, "/lib/a.so");
+    ASSERT_EQ(modules.Find(0x2800)->moduleName, "//anon");
+    auto tail = modules.Find(0x3000);
+    ASSERT_EQ(tail->moduleName, "/lib/a.so");
+    ASSERT_EQ(tail->start, 0x3000);
+    ASSERT_EQ(tail->fileOffset, 0x2000);
+
+    // A mapping covering several modules removes them.
+    modules.Insert(MakeMapping("/lib/c.so", 0x1000, 0x8800, 0x100));
+    ASSERT_FALSE(modules.HasModule("/lib/a.so"));
+    ASSERT_FALSE(modules.HasModule("//anon"));
+    ASSERT_EQ(modules.Find(0x4000)->moduleName, "/lib/c.so");
+    ASSERT_EQ(modules.Find(0x8900)->moduleName, "/lib/b.so");
+    ASSERT_EQ(modules.Find(0x8900)->fileOffset, 0x800);
+    ASSERT_TRUE(modules.HasStart(0x8800));
+}
+
+TEST(symbol, module_tree_finds_mappings_at_sample_time)
+{
+    ModuleTree modules;
+    modules.Insert(MakeMapping("/lib/a.so", 0x1000, 0x3000, 0));
+    auto b = MakeMapping("/lib/b.so", 0x2000, 0x3000, 0);
+    b->mapTime = 100;
+    modules.Insert(b);
+    ASSERT_EQ(modules.Generation(), 1);
+    ASSERT_EQ(modules.GenerationAt(50), 0);
+    // Addresses sampled before b.so is mapped are still in a.so.
+    ASSERT_EQ(modules.Find(0x2800, 50)->moduleName, "/lib/a.so");
+    ASSERT_EQ(modules.Find(0x2800, 150)->moduleName, "/lib/b.so");
+    ASSERT_EQ(modules.Find(0x2800)->moduleName, "/lib/b.so");
+    ASSERT_EQ(modules.Find(0x1800, 50)->moduleName, "/lib/a.so");
+
+    // Exec retires the whole layout, and the new program is mapped later.
+    modules.Exec(200);
+    ASSERT_EQ(modules.Find(0x1800, 250), nullptr);
+    ASSERT_EQ(modules.Find(0x1800, 150)->moduleName, "/lib/a.so");
+    ASSERT_EQ(modules.Find(0x2800, 150)->moduleName, "/lib/b.so");
+    auto c = MakeMapping("/bin/c", 0x1000, 0x3000, 0);
+    c->mapTime = 210;
+    modules.Insert(c);
+    ASSERT_EQ(modules.Find(0x2800, 250)->moduleName, "/bin/c");
+    ASSERT_EQ(modules.Find(0x2800, 150)->moduleName, "/lib/b.so");
+
+    // A mapping read after a newer one of another cpu only goes to history.
+    auto d = MakeMapping("/lib/d.so", 0x2000, 0x3000, 0);
+    d->mapTime = 300;
+    modules.Insert(d);
+    auto e = MakeMapping("/lib/e.so", 0x2000, 0x3000, 0);
+    e->mapTime = 280;
+    modules.Insert(e);
+    ASSERT_EQ(modules.Find(0x2800)->moduleName, "/lib/d.so");
+    ASSERT_EQ(modules.Find(0x2800, 290)->moduleName, "/lib/e.so");
+    ASSERT_EQ(modules.Find(0x2800, 270)->moduleName, "/bin/c");
+}
+
+TEST(symbol, module_tree_keeps_generation_of_remapped_anon)
+{
+    ModuleTree modules;
+    modules.Insert(MakeMapping("/lib/a.so", 0x1000, 0x2000, 0));
+    auto jit = MakeMapping("//anon", 0x4000, 0x8000, 0);
+    jit->isFile = false;
+    modules.Insert(jit);
+    // Jit code made writable and executable in turn is remapped as the same anonymous memory.
+    for (unsigned long time = 100; time < 110; ++time) {
+        auto remap = MakeMapping("//anon", 0x5000, 0x6000, 0);
+        remap->isFile = false;
+        remap->mapTime = time;
+        modules.Insert(remap);
+    }
+    ASSERT_EQ(modules.Generation(), 0);
+    ASSERT_EQ(modules.Find(0x5800, 50)->moduleName, "//anon");
+
+    // A file mapped over anonymous memory, and a mapping over a file, change the layout of their ranges only.
+    auto b = MakeMapping("/lib/b.so", 0x6000, 0x7000, 0);
+    b->mapTime = 200;
+    modules.Insert(b);
+    auto anon = MakeMapping("//anon", 0x1000, 0x1800, 0);
+    anon->isFile = false;
+    anon->mapTime = 300;
+    modules.Insert(anon);
+    ASSERT_EQ(modules.Generation(), 2);
+    std::vector<std::pair<unsigned long, unsigned long>> ranges;
+    auto collect = [&ranges](unsigned long start, unsigned long end) { ranges.emplace_back(start, end); };
+    ASSERT_TRUE(modules.ForEachReplaced(1, collect));
+    ASSERT_EQ(ranges.size(), 1);
+    ASSERT_EQ(ranges[0].first, 0x1000);
+    ASSERT_EQ(ranges[0].second, 0x1800);
+    ranges.clear();
+    ASSERT_TRUE(modules.ForEachReplaced(0, collect));
+    ASSERT_EQ(ranges.size(), 2);
+    ASSERT_EQ(ranges[0].first, 0x6000);
+    ASSERT_EQ(modules.Find(0x6800, 150)->moduleName, "//anon");
+    ASSERT_EQ(modules.Find(0x1400, 250)->moduleName, "/lib/a.so");
+}
+
+TEST(symbol, java_perf_map_loaded_incrementally)
+{
+    char mapFile[] = "/tmp/perf-libkperf-XXXXXX";
+    int fd = mkstemp(mapFile);
+    ASSERT_GE(fd, 0);
+    FILE* file = fdopen(fd, "w");
+    fprintf(file, "1000 100 LFoo;::bar\n2000 100 LFoo;::baz(Foo.java:12)\n");
+    fflush(file);
+    JavaElf javaElf(getpid(), mapFile);
+    std::vector<std::pair<unsigned long, unsigned long>> replaced;
+    auto onReplaced = [&replaced](unsigned long start, unsigned long end) { replaced.emplace_back(start, end); };
+    javaElf.LoadNewEntries(onReplaced);
+    JavaEntry entry;
+    ASSERT_EQ(javaElf.FindElf(0x2050, entry), 0);
+    ASSERT_EQ(entry.symbolName, "LFoo;::baz");
+    ASSERT_EQ(entry.fileName, "Foo.java");
+    ASSERT_EQ(entry.line, 12);
+    ASSERT_EQ(javaElf.FindElf(0x3000, entry), -1);
+
+    // A line being written is not read until it is complete.
+    fprintf(file, "3000 100 LFoo;::qux");
+    fflush(file);
+    javaElf.LoadNewEntries(onReplaced);
+    ASSERT_EQ(javaElf.FindElf(0x3000, entry), -1);
+    fprintf(file, "\n");
+    fflush(file);
+    // New lines are only read when the map is loaded again.
+    ASSERT_EQ(javaElf.FindElf(0x3000, entry), -1);
+    javaElf.LoadNewEntries(onReplaced);
+    ASSERT_EQ(javaElf.FindElf(0x3000, entry), 0);
+    ASSERT_EQ(entry.symbolName, "LFoo;::qux");
+    ASSERT_TRUE(replaced.empty());
+
+    // Code cache is reused by a method compiled later.
+    fprintf(file, "1080 100 LFoo;::recompiled\n");
+    fflush(file);
+    javaElf.LoadNewEntries(onReplaced);
+    ASSERT_EQ(javaElf.FindElf(0x1010, entry), -1);
+    ASSERT_EQ(javaElf.FindElf(0x1100, entry), 0);
+    ASSERT_EQ(entry.symbolName, "LFoo;::recompiled");
+    ASSERT_EQ(replaced.size(), 1);
+    ASSERT_EQ(replaced[0].first, 0x1000);
+    ASSERT_EQ(replaced[0].second, 0x1100);
+    fclose(file);
+    unlink(mapFile);
+}
+
+static void WriteJitRecord(FILE* file, uint32_t id, const void* body, size_t bodySize, const std::string& tail)
+{
+    JitRecordPrefix prefix = {id, static_cast<uint32_t>(sizeof(prefix) + bodySize + tail.size()), 0};
+    fwrite(&prefix, sizeof(prefix), 1, file);
+    fwrite(body, bodySize, 1, file);
+    fwrite(tail.data(), tail.size(), 1, file);
+}
+
+TEST(symbol, jit_dump_loaded_incrementally)
+{
+    char dumpFile[] = "/tmp/jit-XXXXXX";
+    int fd = mkstemp(dumpFile);
+    ASSERT_GE(fd, 0);
+    FILE* file = fdopen(fd, "w");
+    JitHeader header = {0x4A695444, 1, sizeof(JitHeader), 0, 0, static_cast<uint32_t>(getpid()), 0, 0};
+    fwrite(&header, sizeof(header), 1, file);
+    // Debug info is written before the code it belongs to.
+    struct {
+        uint64_t codeAddr;
+        uint64_t nrEntry;
+    } debugInfo = {0x1000, 2};
+    JitDebugEntry first = {0x1000, 10, 0};
+    JitDebugEntry second = {0x1040, 12, 0};
+    std::string entries(reinterpret_cast<char*>(&first), sizeof(first));
+    entries += std::string("Foo.java") + '\0';
+    entries += std::string(reinterpret_cast<char*>(&second), sizeof(second));
+    entries += std::string("\xff") + '\0';
+    WriteJitRecord(file, JIT_CODE_DEBUG_INFO, &debugInfo, sizeof(debugInfo), entries);
+    uint64_t load[] = {0, 0x1000, 0x1000, 0x100, 1};
+    WriteJitRecord(file, JIT_CODE_LOAD, load, sizeof(load), std::string("Foo::bar") + '\0' + "code");
+    fflush(file);
+
+    JitDump jitDump(dumpFile);
+    std::vector<std::pair<unsigned long, unsigned long>> replaced;
+    auto onReplaced = [&replaced](unsigned long start, unsigned long end) { replaced.emplace_back(start, end); };
+    jitDump.LoadNewRecords(onReplaced);
+    JavaEntry entry;
+    ASSERT_EQ(jitDump.FindElf(0x1050, entry), 0);
+    ASSERT_EQ(entry.symbolName, "Foo::bar");
+    ASSERT_EQ(entry.fileName, "Foo.java");
+    ASSERT_EQ(entry.line, 12);
+    ASSERT_EQ(jitDump.FindElf(0x2000, entry), -1);
+
+    // A record being written is not read until it is complete.
+    uint64_t load2[] = {0, 0x2000, 0x2000, 0x100, 2};
+    JitRecordPrefix prefix = {JIT_CODE_LOAD, static_cast<uint32_t>(sizeof(prefix) + sizeof(load2) + 4), 0};
+    fwrite(&prefix, sizeof(prefix), 1, file);
+    fflush(file);
+    jitDump.LoadNewRecords(onReplaced);
+    ASSERT_EQ(jitDump.FindElf(0x2000, entry), -1);
+    fwrite(load2, sizeof(load2), 1, file);
+    fwrite("baz", 4, 1, file);
+    fflush(file);
+    jitDump.LoadNewRecords(onReplaced);
+    ASSERT_EQ(jitDump.FindElf(0x2010, entry), 0);
+    ASSERT_EQ(entry.symbolName, "baz");
+    ASSERT_EQ(entry.fileName, "UNKNOWN");
+
+    // Moved code keeps its lines, and replaces the code at new address.
+    uint64_t move[] = {0, 0x3000, 0x1000, 0x2000, 0x100, 1};
+    WriteJitRecord(file, JIT_CODE_MOVE, move, sizeof(move), "");
+    fflush(file);
+    ASSERT_TRUE(replaced.empty());
+    jitDump.LoadNewRecords(onReplaced);
+    ASSERT_EQ(jitDump.FindElf(0x1050, entry), -1);
+    ASSERT_EQ(jitDump.FindElf(0x2050, entry), 0);
+    ASSERT_EQ(entry.symbolName, "Foo::bar");
+    ASSERT_EQ(entry.line, 12);
+    // Both the old range of the moved code and the code it overlaps are replaced.
+    ASSERT_EQ(replaced.size(), 2);
+    fclose(file);
+    unlink(dumpFile);
+}
+
+TEST(symbol, jit_symbols_dropped_when_code_reused)
+{
+    char dir[] = "/tmp/libkperf_jit_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    pid_t pid = getpid();
+    std::string dumpFile = std::string(dir) + "/jit-" + std::to_string(pid) + ".dump";
+    FILE* file = fopen(dumpFile.c_str(), "w");
+    ASSERT_NE(file, nullptr);
+    JitHeader header = {0x4A695444, 1, sizeof(JitHeader), 0, 0, static_cast<uint32_t>(pid), 0, 0};
+    fwrite(&header, sizeof(header), 1, file);
+    uint64_t load[] = {0, 0x1000, 0x1000, 0x100, 1};
+    WriteJitRecord(file, JIT_CODE_LOAD, load, sizeof(load), std::string("Foo::bar") + '\0');
+    fflush(file);
+    struct stat st;
+    ASSERT_EQ(stat(dumpFile.c_str(), &st), 0);
+
+    SymResolverDestroy();
+    SymResolverInit();
+    // The jit agent maps the dump to notify profilers.
+    ASSERT_EQ(SymResolverUpdateModuleMmap2TimeNoDwarf(pid, dumpFile.c_str(), 0x40000000, st.st_size, 0,
+                                                      major(st.st_dev), minor(st.st_dev), st.st_ino, 1), SUCCESS);
+    auto symbol = SymResolverMapAddr(pid, 0x1010);
+    ASSERT_TRUE(symbol != nullptr);
+    ASSERT_STREQ(symbol->symbolName, "Foo::bar");
+
+    // The code cache is reclaimed and another method is loaded at the same address.
+    uint64_t reload[] = {0, 0x1000, 0x1000, 0x100, 2};
+    WriteJitRecord(file, JIT_CODE_LOAD, reload, sizeof(reload), std::string("Foo::baz") + '\0');
+    fflush(file);
+    symbol = SymResolverMapAddr(pid, 0x1010);
+    ASSERT_STREQ(symbol->symbolName, "Foo::bar");
+    ASSERT_EQ(SymResolverUpdateJitCode(pid), SUCCESS);
+    symbol = SymResolverMapAddr(pid, 0x1010);
+    ASSERT_TRUE(symbol != nullptr);
+    ASSERT_STREQ(symbol->symbolName, "Foo::baz");
+    SymResolverDestroy();
+    fclose(file);
+    unlink(dumpFile.c_str());
+    rmdir(dir);
+}
+
 void ClearSymbol(){
     SymResolverDestroy();
 }
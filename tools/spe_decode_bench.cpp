@@ -0,0 +1,213 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: throughput benchmark of spe aux data decoder, on recorded aux dumps or generated data.
+ ******************************************************************************/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "spe.h"
+#include "arm_spe_decoder.h"
+#include "task_runner.h"
+
+struct Options {
+    int repeat = 10;
+    int threads = 8;
+    int cores = 8;
+    size_t genBytes = 4 * 1024 * 1024;
+    std::vector<std::string> files;
+};
+
+static void PrintUsage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [-r REPEAT] [-t THREADS] [-n CORES] [-s MB] [AUX_DUMP...]\n"
+        "Options:\n"
+        "  -r REPEAT    Times to decode each buffer, default: 10\n"
+        "  -t THREADS   Max threads of parallel decode, default: 8\n"
+        "  -n CORES     Number of generated aux buffers if no dump is given, default: 8\n"
+        "  -s MB        Size of each generated aux buffer in MB, default: 4\n"
+        "  -h           Show this help\n"
+        "Each AUX_DUMP is raw aux data of one core, e.g. aux data saved from perf.data.\n"
+        "Examples:\n"
+        "  %s\n"
+        "  %s -t 16 cpu0.aux cpu1.aux cpu2.aux cpu3.aux\n",
+        program, program, program);
+}
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "r:t:n:s:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                options.repeat = atoi(optarg);
+                break;
+            case 't':
+                options.threads = atoi(optarg);
+                break;
+            case 'n':
+                options.cores = atoi(optarg);
+                break;
+            case 's':
+                options.genBytes = static_cast<size_t>(atoi(optarg)) * 1024 * 1024;
+                break;
+            default:
+                return false;
+        }
+    }
+    for (int i = optind; i < argc; ++i) {
+        options.files.emplace_back(argv[i]);
+    }
+    return options.repeat > 0 && options.threads > 0 && options.cores > 0 && options.genBytes > 0;
+}
+
+static void PutPacket(std::vector<uint8_t>& buf, uint8_t header, uint64_t payload, int size)
+{
+    buf.push_back(header);
+    for (int i = 0; i < size; ++i) {
+        buf.push_back(static_cast<uint8_t>(payload >> (8 * i)));
+    }
+}
+
+// Generate records like a load/store sampled by spe, with padding at the end of each 64KB handover.
+static std::vector<uint8_t> GenerateAux(size_t bytes, unsigned seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<uint8_t> buf;
+    buf.reserve(bytes + 64);
+    size_t handover = 64 * 1024;
+    while (buf.size() < bytes) {
+        PutPacket(buf, 0xB0, 0xffff000000400000ULL | (rng() & 0xfffff), 8);  // pc
+        PutPacket(buf, 0x99, rng() & 0xfff, 2);                              // issue latency
+        PutPacket(buf, 0x98, rng() & 0xfff, 2);                              // total latency
+        PutPacket(buf, 0x52, rng() & 0xffff, 2);                             // events
+        PutPacket(buf, 0x49, rng() & 0x1, 1);                                // load or store
+        PutPacket(buf, 0xB2, 0x0000ffff00000000ULL | (rng() & 0xffffff), 8); // virtual address
+        PutPacket(buf, 0xB3, rng() & 0xffffffffffULL, 8);                    // physical address
+        PutPacket(buf, 0x43, rng() & 0xf, 1);                                // data source
+        PutPacket(buf, 0x65, 1000 + rng() % 16, 4);                          // context id
+        PutPacket(buf, 0x71, rng(), 8);                                      // timestamp
+        if (buf.size() / handover != (buf.size() + 64) / handover) {
+            buf.resize((buf.size() / handover + 1) * handover, 0);
+        }
+    }
+    return buf;
+}
+
+static bool LoadAux(const std::string& file, std::vector<uint8_t>& buf)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Decode a buffer like Spe::Decode does, and return the number of records.
+static size_t DecodeAux(std::vector<uint8_t>& aux, std::vector<SpeRecord>& records)
+{
+    uint8_t* pos = aux.data();
+    uint8_t* end = aux.data() + aux.size();
+    records.clear();
+    while (pos < end) {
+        size_t begin = records.size();
+        records.resize(begin + SPE_CHUNK_RECORDS + 1);
+        int remain = SPE_CHUNK_RECORDS;
+        SpeRecord* chunk = records.data() + begin;
+        SpeRecord* chunkEnd = SpeGetRecord(&pos, end, chunk, &remain);
+        records.resize(begin + (chunkEnd - chunk));
+        if (chunkEnd == chunk) {
+            break;
+        }
+    }
+    return records.size();
+}
+
+static double ElapsedSec(const std::chrono::steady_clock::time_point& begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::vector<uint8_t>> auxes;
+    if (options.files.empty()) {
+        for (int i = 0; i < options.cores; ++i) {
+            auxes.emplace_back(GenerateAux(options.genBytes, i + 1));
+        }
+    } else {
+        for (auto& file : options.files) {
+            auxes.emplace_back();
+            if (!LoadAux(file, auxes.back())) {
+                fprintf(stderr, "failed to read %s\n", file.c_str());
+                return 1;
+            }
+        }
+    }
+    size_t totalBytes = 0;
+    for (auto& aux : auxes) {
+        totalBytes += aux.size();
+    }
+    std::vector<std::vector<SpeRecord>> records(auxes.size());
+    std::vector<size_t> recordNum(auxes.size());
+
+    // Warm up, so that memory of records is allocated before timing.
+    for (size_t i = 0; i < auxes.size(); ++i) {
+        recordNum[i] = DecodeAux(auxes[i], records[i]);
+    }
+
+    // Decode buffers one by one, which is the way before parallel decode.
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < options.repeat; ++r) {
+        for (size_t i = 0; i < auxes.size(); ++i) {
+            recordNum[i] = DecodeAux(auxes[i], records[i]);
+        }
+    }
+    double serial = ElapsedSec(begin);
+
+    // Decode buffers on a worker pool, as PerfSpe::Read does.
+    unsigned workers = 0;
+    begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < options.repeat; ++r) {
+        workers = RunParallelTasks(auxes.size(), options.threads, 1, [&](size_t i) {
+            recordNum[i] = DecodeAux(auxes[i], records[i]);
+        });
+    }
+    double parallel = ElapsedSec(begin);
+
+    size_t totalRecords = 0;
+    for (auto num : recordNum) {
+        totalRecords += num;
+    }
+    double mb = static_cast<double>(totalBytes) * options.repeat / (1024 * 1024);
+    double mrec = static_cast<double>(totalRecords) * options.repeat / 1e6;
+    printf("buffers: %zu, aux data: %.1f MB, records: %zu\n", auxes.size(),
+           static_cast<double>(totalBytes) / (1024 * 1024), totalRecords);
+    printf("%-10s %8s %12s %14s\n", "mode", "threads", "MB/s", "Mrecords/s");
+    printf("%-10s %8d %12.1f %14.2f\n", "serial", 1, mb / serial, mrec / serial);
+    printf("%-10s %8u %12.1f %14.2f\n", "parallel", workers, mb / parallel, mrec / parallel);
+    return 0;
+}
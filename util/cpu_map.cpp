@@ -20,6 +20,8 @@
 #include <unistd.h>
 #include <memory>
 #include <mutex>
+#include <algorithm>
+#include <vector>
 #include <dirent.h>
 #include "common.h"
 #include "pcerr.h"
@@ -31,6 +33,7 @@ static const std::string CPU_TOPOLOGY_PACKAGE_ID = "/sys/bus/cpu/devices/cpu%d/t
 static const std::string MIDR_EL1 = "/sys/devices/system/cpu/cpu0/regs/identification/midr_el1";
 static const std::string CPU_ONLINE_PATH = "/sys/devices/system/cpu/online";
 static const std::string NUMA_PATH = "/sys/devices/system/node";
+static const std::string MEMORY_BLOCK_SIZE_PATH = "/sys/devices/system/memory/block_size_bytes";
 
 static constexpr int PATH_LEN = 256;
 static constexpr int LINE_LEN = 1024;
@@ -50,6 +53,15 @@ static unordered_map<unsigned, unsigned> cpuOfNumaNodeMap;
 static mutex pmuCoreListMtx;
 static bool cpuNumaMapInit = false;
 
+// Physical memory range [start, end) of a numa node, sorted by start.
+struct NumaMemRange {
+    unsigned long start;
+    unsigned long end;
+    int nodeId;
+};
+static vector<NumaMemRange> numaMemRanges;
+static once_flag numaMemOnce;
+
 static inline bool ReadCpuPackageId(int coreId, CpuTopology* cpuTopo)
 {
     char filename[PATH_LEN];
@@ -244,4 +256,72 @@ set<int> GetOnLineCpuIds()
         tokStr = strtok(nullptr, ",");
     }
     return onLineCpuIds;
-}
\ No newline at end of file
+}
+
+static unsigned long GetMemoryBlockSize()
+{
+    ifstream in(MEMORY_BLOCK_SIZE_PATH);
+    if (!in.is_open()) {
+        return 0;
+    }
+    string size;
+    in >> size;
+    try {
+        return stoul(size, nullptr, 16);
+    } catch (...) {
+        return 0;
+    }
+}
+
+static void InitializeNumaMemRanges()
+{
+    unsigned long blockSize = GetMemoryBlockSize();
+    int maxNode = GetNumaNodeCount();
+    if (blockSize == 0 || maxNode <= 0) {
+        return;
+    }
+    // Each /sys/devices/system/node/nodeN/memoryM is a memory block of node N,
+    // which covers physical address [M * blockSize, (M + 1) * blockSize).
+    for (int nodeId = 0; nodeId < maxNode; ++nodeId) {
+        string nodePath = NUMA_PATH + "/node" + to_string(nodeId);
+        DIR *dir = opendir(nodePath.c_str());
+        if (dir == nullptr) {
+            continue;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            unsigned long block;
+            if (sscanf(entry->d_name, "memory%lu", &block) != 1) {
+                continue;
+            }
+            numaMemRanges.push_back({block * blockSize, (block + 1) * blockSize, nodeId});
+        }
+        closedir(dir);
+    }
+    sort(numaMemRanges.begin(), numaMemRanges.end(), [](const NumaMemRange &a, const NumaMemRange &b) {
+        return a.start < b.start;
+    });
+    // Merge adjacent blocks of the same node to make lookup faster.
+    vector<NumaMemRange> merged;
+    for (const auto &range : numaMemRanges) {
+        if (!merged.empty() && merged.back().end == range.start && merged.back().nodeId == range.nodeId) {
+            merged.back().end = range.end;
+        } else {
+            merged.push_back(range);
+        }
+    }
+    numaMemRanges = move(merged);
+}
+
+int GetNumaNodeOfPhysAddr(unsigned long pa)
+{
+    call_once(numaMemOnce, InitializeNumaMemRanges);
+    auto it = upper_bound(numaMemRanges.begin(), numaMemRanges.end(), pa, [](unsigned long addr, const NumaMemRange &range) {
+        return addr < range.start;
+    });
+    if (it == numaMemRanges.begin()) {
+        return -1;
+    }
+    --it;
+    return pa < it->end ? it->nodeId : -1;
+}
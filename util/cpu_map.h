@@ -36,4 +36,9 @@ CHIP_TYPE GetCpuType();
 std::set<int> GetOnLineCpuIds();
 unsigned* GetCoreList(int start);
 int GetNumaCore(unsigned nodeId, unsigned** coreList);
+int GetNumaNodeOfCpu(int coreId);
+/**
+ * Get numa node of physical memory address <pa> by memory blocks of each node, -1 if unknown.
+ */
+int GetNumaNodeOfPhysAddr(unsigned long pa);
 #endif       
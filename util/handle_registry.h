@@ -0,0 +1,99 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: registry of objects behind opaque handles of c api.
+ ******************************************************************************/
+#ifndef LIBKPROF_HANDLE_REGISTRY_H
+#define LIBKPROF_HANDLE_REGISTRY_H
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include "pcerr.h"
+
+/**
+ * Objects of type T opened by c api, such as heatmaps and contention detectors, keyed by their handles.
+ * Each call holds a reference to the object, so closing a handle does not free the object under other threads.
+ */
+template <typename T>
+class HandleRegistry {
+public:
+    /**
+     * Construct an object with <args> and return its handle, or NULL if constructor throws.
+     */
+    template <typename... Args>
+    void *Open(Args &&...args)
+    {
+        try {
+            std::shared_ptr<T> obj = std::make_shared<T>(std::forward<Args>(args)...);
+            void *handle = obj.get();
+            std::lock_guard<std::mutex> lg(mtx);
+            objs[handle] = std::move(obj);
+            pcerr::New(SUCCESS);
+            return handle;
+        } catch (std::exception &ex) {
+            pcerr::New(UNKNOWN_ERROR, ex.what());
+            return NULL;
+        }
+    }
+
+    /**
+     * Run <func> with the object of <handle> and return its error code, <invalidErr> if handle is not opened.
+     * <func> sets error message for its own failures, and exceptions are reported as UNKNOWN_ERROR.
+     */
+    int Call(void *handle, int invalidErr, const std::function<int(T &)> &func)
+    {
+        std::shared_ptr<T> obj = Find(handle);
+        if (obj == nullptr) {
+            pcerr::New(invalidErr);
+            return invalidErr;
+        }
+        try {
+            int err = func(*obj);
+            if (err == SUCCESS) {
+                pcerr::New(SUCCESS);
+            }
+            return err;
+        } catch (std::exception &ex) {
+            pcerr::New(UNKNOWN_ERROR, ex.what());
+            return UNKNOWN_ERROR;
+        }
+    }
+
+    /**
+     * Forget <handle>. The object is freed after calls in flight return.
+     */
+    void Close(void *handle)
+    {
+        std::shared_ptr<T> obj;
+        std::lock_guard<std::mutex> lg(mtx);
+        auto findObj = objs.find(handle);
+        if (findObj != objs.end()) {
+            // Released after the lock, destructor may take a while.
+            obj = std::move(findObj->second);
+            objs.erase(findObj);
+        }
+    }
+
+private:
+    std::shared_ptr<T> Find(void *handle)
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        auto findObj = objs.find(handle);
+        return findObj == objs.end() ? nullptr : findObj->second;
+    }
+
+    std::mutex mtx;
+    std::unordered_map<void *, std::shared_ptr<T>> objs;
+};
+
+#endif  // LIBKPROF_HANDLE_REGISTRY_H
@@ -66,6 +66,11 @@ namespace pcerr {
             {LIBPERF_ERR_INVALID_CGROUP_LIST, "invalid cgroup name list"},
             {LIBPERF_ERR_NOT_SUPPORT_PMU_FILE, "writing perf.data is not supported"},
             {LIBPERF_ERR_INVALID_PMU_FILE, "invalid pmu file handler"},
+            {LIBPERF_ERR_INVALID_HEATMAP, "invalid memory heatmap handler"},
+            {LIBPERF_ERR_INVALID_CONTENTION, "invalid contention detector handler"},
+            {LIBPERF_ERR_INVALID_BRANCH_PROFILE, "invalid branch profile handler"},
+            {LIBPERF_ERR_BRANCH_PROFILE_NO_MODULE, "no branch of the module is in profile"},
+            {LIBPERF_ERR_INVALID_USER_STACK_SIZE, "invalid user stack size"},
             {LIBPERF_ERR_OPEN_INVALID_FILE, "failed to open file"},
             {LIBPERF_ERR_INVALID_EVTATTR, "invalid evtAttr list"},
             {LIBPERF_ERR_COUNT_MMAP_IS_NULL, "Count mmap page is null!"},
@@ -17,14 +17,29 @@
 #include <cstdlib>
 #include <fstream>
 #include <cstring>
+#include <chrono>
 #include <dirent.h>
 #include <ctype.h>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include "common.h"
 #include "process_map.h"
 
 using namespace std;
 constexpr int PATH_LEN = 1024;
+// Name, Umask, State and Tgid are the first lines of /proc/<pid>/status.
+constexpr size_t STATUS_HEAD_LEN = 512;
+constexpr size_t DENTS_BUF_SIZE = 64 * 1024;
+constexpr size_t TOPO_CACHE_MAX = 1 << 20;
+// Comm can be changed by prctl without any record, e.g. in counting mode, so cached comm is read again after it.
+constexpr std::chrono::seconds TOPO_COMM_TTL(1);
 
 void FreeProcTopo(struct ProcTopology *procTopo)
 {
@@ -52,60 +67,186 @@ void FreeProcTopo(struct ProcTopology *procTopo)
     delete procTopo;
 }
 
+// Read at most <size>-1 bytes of a small proc file into <buf> with a single read.
+static ssize_t ReadProcFile(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
 int GetTgid(pid_t pid)
 {
     if (pid == -1) {
         // for system sampling.
         return -1;
     }
-    // Get tgid from /proc/<pid>/status.
+    // Get tgid from /proc/<pid>/status, which is one of the first lines, so the head of the file is enough.
     char path[64];
     snprintf(path, sizeof(path), "/proc/%d/status", pid);
-    FILE* f = fopen(path, "r");
-    if (!f) {
+    char buf[STATUS_HEAD_LEN];
+    if (ReadProcFile(path, buf, sizeof(buf)) <= 0) {
+        return -1;
+    }
+    char *line = strstr(buf, "\nTgid:");
+    if (line == nullptr) {
         return -1;
     }
+    line += strlen("\nTgid:");
+    char* endptr;
+    long tgid = strtol(line, &endptr, 10);
+    if (endptr == line) {
+        return -1;
+    }
+    return static_cast<int>(tgid);
+}
 
-    char line[256];
-    while (fgets(line, sizeof(line), f)) {
-        if (strncmp(line, "Tgid:", 5) == 0) {
-            char* endptr;
-            long tgid = strtol(line + 5, &endptr, 10);
-            fclose(f);
-            if (endptr == line + 5) {
-                return -1;
-            }
-            return static_cast<int>(tgid);
-        }
+static char *ReadComm(const char *path)
+{
+    char buffer[PATH_LEN];
+    if (ReadProcFile(path, buffer, sizeof(buffer)) <= 0) {
+        return nullptr;
     }
-    // The file may be successfully opened before while loop,
-    // but disappear before reading stream.
-    fclose(f);
-    return -1;
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return strdup(buffer);
 }
 
 char *GetComm(pid_t pid)
 {
-    static thread_local char buffer[PATH_MAX];
     if (pid == -1) {
         return strdup("system");
     }
 
     char path[64];
     snprintf(path, sizeof(path), "/proc/%d/comm", pid);
-    FILE* f = fopen(path, "r");
-    if (!f) {
-        return nullptr;
+    return ReadComm(path);
+}
+
+namespace {
+    // Cached topology of a live thread.
+    // <ino> is the inode of /proc/<pid>/task/<tid>, which changes when <tid> is reused by a new thread.
+    // It is 0 for entries learned from perf records, and is filled by the next lookup.
+    // <commTime> is when <comm> is read or learned, and <comm> is read again once it is older than TOPO_COMM_TTL.
+    struct TopoCacheEntry {
+        pid_t pid;
+        ino_t ino;
+        std::string comm;
+        std::chrono::steady_clock::time_point commTime;
+    };
+
+    std::mutex g_topoCacheMtx;
+    std::unordered_map<pid_t, TopoCacheEntry> g_topoCache;
+
+    bool TaskIno(pid_t pid, pid_t tid, ino_t &ino)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task/%d", pid, tid);
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            return false;
+        }
+        ino = st.st_ino;
+        return true;
     }
 
-    if (!fgets(buffer, sizeof(buffer), f)) {
-        fclose(f);
-        return nullptr;
+    void StoreTopoCache(pid_t tid, pid_t pid, ino_t ino, const char *comm)
+    {
+        std::lock_guard<std::mutex> lg(g_topoCacheMtx);
+        if (g_topoCache.size() >= TOPO_CACHE_MAX && g_topoCache.find(tid) == g_topoCache.end()) {
+            // Exit records have been missed for a long time, start over.
+            g_topoCache.clear();
+        }
+        g_topoCache[tid] = TopoCacheEntry{pid, ino, comm, std::chrono::steady_clock::now()};
     }
-    fclose(f);
 
-    buffer[strcspn(buffer, "\n")] = '\0';
-    return strdup(buffer);
+    bool LookupTopoCache(pid_t tid, pid_t &pid, std::string &comm)
+    {
+        ino_t cachedIno = 0;
+        bool commExpired = false;
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lg(g_topoCacheMtx);
+            auto findTopo = g_topoCache.find(tid);
+            if (findTopo == g_topoCache.end()) {
+                return false;
+            }
+            pid = findTopo->second.pid;
+            cachedIno = findTopo->second.ino;
+            comm = findTopo->second.comm;
+            commExpired = now - findTopo->second.commTime > TOPO_COMM_TTL;
+        }
+        // One stat instead of reading status and comm, to check that <tid> is still the cached thread.
+        ino_t ino = 0;
+        bool alive = TaskIno(pid, tid, ino);
+        char *newComm = nullptr;
+        if (alive && commExpired) {
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/%d/task/%d/comm", pid, tid);
+            newComm = ReadComm(path);
+        }
+        std::unique_ptr<char, void (*)(void *)> newCommPtr(newComm, free);
+        std::lock_guard<std::mutex> lg(g_topoCacheMtx);
+        auto findTopo = g_topoCache.find(tid);
+        if (findTopo == g_topoCache.end()) {
+            return false;
+        }
+        if (!alive || (cachedIno != 0 && cachedIno != ino) || (commExpired && newComm == nullptr)) {
+            g_topoCache.erase(findTopo);
+            return false;
+        }
+        findTopo->second.ino = ino;
+        if (newComm != nullptr) {
+            findTopo->second.comm = newComm;
+            findTopo->second.commTime = now;
+            comm = newComm;
+        }
+        return true;
+    }
+}
+
+void UpdateProcTopoOnFork(pid_t pid, pid_t tid, pid_t ptid)
+{
+    // A new task starts with the comm of the task that created it.
+    std::lock_guard<std::mutex> lg(g_topoCacheMtx);
+    auto findParent = g_topoCache.find(ptid);
+    if (findParent == g_topoCache.end()) {
+        g_topoCache.erase(tid);
+        return;
+    }
+    if (g_topoCache.size() >= TOPO_CACHE_MAX) {
+        g_topoCache.clear();
+        return;
+    }
+    std::string comm = findParent->second.comm;
+    g_topoCache[tid] = TopoCacheEntry{pid, 0, comm, std::chrono::steady_clock::now()};
+}
+
+void UpdateProcTopoOnComm(pid_t pid, pid_t tid, const char *comm)
+{
+    if (comm == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lg(g_topoCacheMtx);
+    auto findTopo = g_topoCache.find(tid);
+    if (findTopo == g_topoCache.end() || findTopo->second.pid != pid) {
+        return;
+    }
+    findTopo->second.comm = comm;
+    findTopo->second.commTime = std::chrono::steady_clock::now();
+}
+
+void UpdateProcTopoOnExit(pid_t tid)
+{
+    std::lock_guard<std::mutex> lg(g_topoCacheMtx);
+    g_topoCache.erase(tid);
 }
 
 struct ProcTopology *GetProcTopology(pid_t pid)
@@ -119,6 +260,11 @@ struct ProcTopology *GetProcTopology(pid_t pid)
         return procTopo.release();
     }
     try {
+        std::string cachedComm;
+        if (pid != -1 && LookupTopoCache(pid, procTopo->pid, cachedComm)) {
+            procTopo->comm = strdup(cachedComm.c_str());
+            return procTopo->comm == nullptr ? nullptr : procTopo.release();
+        }
         // Get tgid, i.e., process id.
         procTopo->pid = GetTgid(pid);
         if (pid != -1 && procTopo->pid == -1) {
@@ -129,6 +275,10 @@ struct ProcTopology *GetProcTopology(pid_t pid)
         if (procTopo->comm == nullptr) {
             return nullptr;
         }
+        ino_t ino = 0;
+        if (pid != -1 && TaskIno(procTopo->pid, pid, ino)) {
+            StoreTopoCache(pid, procTopo->pid, ino, procTopo->comm);
+        }
     } catch (exception&) {
         return nullptr;
     }
@@ -148,44 +298,60 @@ int IsValidInt(const char *str)
     return 1;
 }
 
-void StoreThreadId(int** childTidList, int* count, const char* entryName)
-{
-    (*count)++;
-    int* newChildTidList = new int[(*count)];
-    if (newChildTidList != nullptr) {
-        if (*childTidList != nullptr) {
-            std::copy(*childTidList, *childTidList + (*count) - 1, newChildTidList);
-            delete[] *childTidList;
-        }
-        newChildTidList[(*count) - 1] = atoi(entryName);
-        *childTidList = newChildTidList;
-    }
-}
+// Layout of the records returned by getdents64, glibc only exposes it since 2.30.
+struct LinuxDirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
 
-bool GetChildTidRecursive(const std::string& dirPath, int **childTidList, int *count)
+static bool ScanTaskDir(pid_t pid, std::vector<int> &tids)
 {
-    DIR *dir = opendir(dirPath.c_str());
-    if (!dir) {
+    std::string dirPath = "/proc/" + std::to_string(pid) + "/task";
+    int fd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
         return false;
     }
-
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_type == DT_DIR) {
+    // Large batches keep the number of getdents64 calls low for processes with thousands of threads.
+    std::vector<char> buf(DENTS_BUF_SIZE);
+    std::vector<std::pair<int, ino_t>> taskInos;
+    while (true) {
+        long nread = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+        if (nread < 0) {
+            close(fd);
+            return false;
+        }
+        if (nread == 0) {
+            break;
+        }
+        for (long bpos = 0; bpos < nread;) {
+            auto *entry = reinterpret_cast<LinuxDirent64 *>(buf.data() + bpos);
+            bpos += entry->d_reclen;
             // Skip "." and ".." directories
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            if (entry->d_type != DT_DIR || !isdigit(entry->d_name[0]) || !IsValidInt(entry->d_name)) {
                 continue;
             }
-
-            // Check if the entry name is a valid thread ID
-            if (IsValidInt(entry->d_name)) {
-                // Store the thread ID in the array
-                StoreThreadId(childTidList, count, entry->d_name);
-            }
+            int tid = atoi(entry->d_name);
+            tids.push_back(tid);
+            taskInos.emplace_back(tid, static_cast<ino_t>(entry->d_ino));
         }
     }
+    close(fd);
 
-    closedir(dir);
+    // Drop cached threads whose tid has been reused since they were cached.
+    std::lock_guard<std::mutex> lg(g_topoCacheMtx);
+    for (const auto &taskIno : taskInos) {
+        auto findTopo = g_topoCache.find(taskIno.first);
+        if (findTopo == g_topoCache.end()) {
+            continue;
+        }
+        auto &entry = findTopo->second;
+        if (entry.pid != pid || (entry.ino != 0 && entry.ino != taskIno.second)) {
+            g_topoCache.erase(findTopo);
+        }
+    }
     return true;
 }
 
@@ -198,14 +364,13 @@ int *GetChildTid(int pid, int *numChild)
         *numChild = 1;
         return childTidList;
     }
-    std::string dirPath = "/proc/" + std::to_string(pid) + "/task";
     *numChild = 0;
-    if (!GetChildTidRecursive(dirPath, &childTidList, numChild)) {
-        if (childTidList) {
-            delete[] childTidList;
-            childTidList = nullptr;
-        }
-        *numChild = 0;
+    std::vector<int> tids;
+    if (!ScanTaskDir(pid, tids) || tids.empty()) {
+        return nullptr;
     }
+    childTidList = new int[tids.size()];
+    std::copy(tids.begin(), tids.end(), childTidList);
+    *numChild = static_cast<int>(tids.size());
     return childTidList;
-}
\ No newline at end of file
+}
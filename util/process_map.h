@@ -40,6 +40,14 @@ int* GetChildTid(int pid, int* numChild);
 int GetTgid(pid_t pid);
 char *GetComm(pid_t pid);
 
+/**
+ * Thread topologies are cached between calls of GetProcTopology and GetChildTid.
+ * Feed PERF_RECORD_FORK/COMM/EXIT to these functions, so that new threads are known without reading /proc.
+ */
+void UpdateProcTopoOnFork(pid_t pid, pid_t tid, pid_t ptid);
+void UpdateProcTopoOnComm(pid_t pid, pid_t tid, const char *comm);
+void UpdateProcTopoOnExit(pid_t tid);
+
 #ifdef __cplusplus
 }
 #endif
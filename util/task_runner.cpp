@@ -0,0 +1,46 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: run independent tasks on a small pool of worker threads.
+ ******************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "task_runner.h"
+
+unsigned RunParallelTasks(size_t taskNum, size_t maxWorkers, size_t minTasksPerWorker,
+                          const std::function<void(size_t)> &task)
+{
+    size_t workerNum = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1U), maxWorkers);
+    minTasksPerWorker = std::max<size_t>(minTasksPerWorker, 1);
+    workerNum = std::min(workerNum, (taskNum + minTasksPerWorker - 1) / minTasksPerWorker);
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < taskNum; i = next++) {
+            task(i);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < workerNum; ++i) {
+        try {
+            workers.emplace_back(worker);
+        } catch (const std::system_error &) {
+            // Out of threads, the remaining workers will drain the queue.
+            break;
+        }
+    }
+    worker();
+    for (auto &t : workers) {
+        t.join();
+    }
+    return workers.size() + 1;
+}
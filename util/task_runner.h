@@ -0,0 +1,26 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ * libkperf licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Description: run independent tasks on a small pool of worker threads.
+ ******************************************************************************/
+#ifndef LIBKPROF_TASK_RUNNER_H
+#define LIBKPROF_TASK_RUNNER_H
+#include <cstddef>
+#include <functional>
+
+/**
+ * Run task(0..taskNum-1) on at most <maxWorkers> workers and return the number of workers used.
+ * Each worker takes at least <minTasksPerWorker> tasks to pay for its creation.
+ * The calling thread is one of the workers, so nothing is spawned for small task lists.
+ */
+unsigned RunParallelTasks(size_t taskNum, size_t maxWorkers, size_t minTasksPerWorker,
+                          const std::function<void(size_t)> &task);
+
+#endif  // LIBKPROF_TASK_RUNNER_H